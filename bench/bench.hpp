@@ -0,0 +1,61 @@
+// bench.hpp
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Small helpers shared by the scop_bench commands
+// Every command receives the arguments that follow its name and returns the process exit code
+
+typedef std::vector<std::string> BenchArgs;
+
+inline double benchNowMs() {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Run fn() `runs` times and keep the fastest one, in milliseconds
+template <typename F>
+double benchBestMs(int runs, F fn) {
+    double best = 1e300;
+    for (int i = 0; i < runs; i++) {
+        double start = benchNowMs();
+        fn();
+        double ms = benchNowMs() - start;
+        if (ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+size_t benchFileSize(const std::string& path);
+
+struct Mesh;
+void benchGridMesh(size_t faces, Mesh& out);
+bool benchLoadMesh(const std::string& arg, Mesh& out);
+
+int benchParse(const BenchArgs& args);
+int benchNumbers(const BenchArgs& args);
+int benchThreads(const BenchArgs& args);
+int benchGen(const BenchArgs& args);
+int benchIndex(const BenchArgs& args);
+int benchCache(const BenchArgs& args);
+int benchFaces(const BenchArgs& args);
+int benchPresize(const BenchArgs& args);
+int benchMaterials(const BenchArgs& args);
+int benchAsync(const BenchArgs& args);
+int benchNormals(const BenchArgs& args);
+int benchSmooth(const BenchArgs& args);
+int benchBounds(const BenchArgs& args);
+int benchPipeline(const BenchArgs& args);
+int benchFormats(const BenchArgs& args);
+int benchVcache(const BenchArgs& args);
+int benchLod(const BenchArgs& args);
+int benchMeshlets(const BenchArgs& args);
+int benchBvh(const BenchArgs& args);
+int benchWeld(const BenchArgs& args);
+int benchMat4(const BenchArgs& args);
+int benchTransforms(const BenchArgs& args);
+int benchChain(const BenchArgs& args);
+int benchScenegraph(const BenchArgs& args);
+int benchCull(const BenchArgs& args);
@@ -0,0 +1,56 @@
+#include <cstdio>
+#include "bench.hpp"
+#include "../include/async_loader.hpp"
+#include "../include/parallel.hpp"
+
+// When the first and the last model are ready to upload, everything loaded one after the other
+// on the main thread like ft_scop used to, versus AsyncModelLoader with 1, 2 and 4 workers
+// The cache is disabled so every run parses the files
+
+int benchAsync(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("async: expected at least one .obj file\n");
+        return 1;
+    }
+
+    ObjOptions objOptions;
+    objOptions.verbose = false;
+    MeshCacheOptions cacheOptions;
+    cacheOptions.enabled = false;
+
+    printf("%zu models\n%-12s %14s %14s\n", args.size(), "mode", "first ms", "all ms");
+
+    double start = benchNowMs(), first = 0.0;
+    for (size_t i = 0; i < args.size(); i++) {
+        std::unique_ptr<LoadedModel> model = loadModel(i, args[i], objOptions, BuildOptions(), cacheOptions);
+        if (!model->ok) {
+            printf("%s: failed to load\n", args[i].c_str());
+            return 1;
+        }
+        if (i == 0)
+            first = benchNowMs() - start;
+    }
+    printf("%-12s %14.2f %14.2f\n", "serial", first, benchNowMs() - start);
+
+    const unsigned workerCounts[] = { 1, 2, 4 };
+    for (unsigned workers : workerCounts) {
+        start = benchNowMs();
+        AsyncModelLoader loader;
+        loader.start(args, objOptions, BuildOptions(), cacheOptions, workers);
+
+        std::unique_ptr<LoadedModel> model;
+        bool gotFirst = false;
+        while (loader.wait(model)) {
+            if (!gotFirst)
+                first = benchNowMs() - start;
+            gotFirst = true;
+        }
+        unsigned used = resolveThreadCount(workers);
+        if (used > args.size())
+            used = (unsigned)args.size();
+        char name[32];
+        snprintf(name, sizeof(name), "async x%u", used);
+        printf("%-12s %14.2f %14.2f\n", name, first, benchNowMs() - start);
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include "bench.hpp"
+#include "../include/bounds.hpp"
+#include "../include/parallel.hpp"
+
+// computeBounds on synthetic point clouds, per SIMD level and thread count
+// Every run must give the same bounds as the scalar single thread one, and every point must be
+// inside the sphere (checked in double). The old computeCenterScale is kept here for comparison :
+// it started from +-1e9, so any model past 1e9 got a wrong box
+
+namespace {
+
+struct Cloud {
+    const char* name;
+    double      center[3];
+    double      size;
+    bool        ball;      // uniform in a ball, otherwise in a cube
+};
+
+const Cloud clouds[] = {
+    { "cube",  { 0.0, 0.0, 0.0 },    1.0,  false },
+    { "ball",  { 0.0, 0.0, 0.0 },    1.0,  true  },
+    { "far",   { 3e9, -2e9, 5e9 },   1e3,  true  },
+    { "huge",  { 1e38, 0.0, -1e38 }, 1e37, true  },
+};
+
+// xorshift64*, plenty for filling a cloud and much faster than <random> on 100M points
+struct Rng {
+    uint64_t state;
+    double next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return (double)((state * 0x2545F4914F6CDD1Dull) >> 11) / 9007199254740992.0 * 2.0 - 1.0;
+    }
+};
+
+void fillCloud(const Cloud& cloud, std::vector<float>& out, size_t count) {
+    out.resize(count * 3);
+    unsigned threads = resolveThreadCount(0);
+    parallelRanges(count, threads, [&](size_t begin, size_t end, size_t r) {
+        Rng rng = { 0x9E3779B97F4A7C15ull * (r + 1) };
+        for (size_t i = begin; i < end; i++) {
+            double p[3];
+            do {
+                for (int a = 0; a < 3; a++)
+                    p[a] = rng.next();
+            } while (cloud.ball && p[0] * p[0] + p[1] * p[1] + p[2] * p[2] > 1.0);
+            for (int a = 0; a < 3; a++)
+                out[i * 3 + a] = (float)(cloud.center[a] + p[a] * cloud.size);
+        }
+    });
+}
+
+// What mesh_loader did before bounds.cpp
+void legacyCenterScale(const float* pos, size_t count, float* center, float& radius) {
+    float minX=1e9,minY=1e9,minZ=1e9;
+    float maxX=-1e9,maxY=-1e9,maxZ=-1e9;
+    for(size_t i=0;i<count*3;i+=3){
+        float x=pos[i], y=pos[i+1], z=pos[i+2];
+        if(x<minX) minX=x;
+        if(x>maxX) maxX=x;
+        if(y<minY) minY=y;
+        if(y>maxY) maxY=y;
+        if(z<minZ) minZ=z;
+        if(z>maxZ) maxZ=z;
+    }
+    center[0] = (minX+maxX)*0.5f;
+    center[1] = (minY+maxY)*0.5f;
+    center[2] = (minZ+maxZ)*0.5f;
+    float dx = maxX-minX, dy = maxY-minY, dz = maxZ-minZ;
+    radius = std::sqrt(dx*dx + dy*dy + dz*dz)*0.5f;
+}
+
+// Points farther than `radius` from `center`, in double so the check itself can't overflow
+size_t countOutside(const float* pos, size_t count, const float* center, float radius) {
+    size_t outside = 0;
+    double r2 = (double)radius * radius;
+    for (size_t i = 0; i < count; i++) {
+        double d2 = 0.0;
+        for (int a = 0; a < 3; a++) {
+            double d = (double)pos[i * 3 + a] - center[a];
+            d2 += d * d;
+        }
+        outside += !(d2 <= r2);
+    }
+    return outside;
+}
+
+}
+
+int benchBounds(const BenchArgs& args) {
+    size_t count = args.empty() ? 100000000 : strtoull(args[0].c_str(), nullptr, 10);
+    if (count == 0) {
+        printf("bounds: expected a point count\n");
+        return 1;
+    }
+
+    unsigned maxThreads = resolveThreadCount(0) > 4 ? resolveThreadCount(0) : 4;
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE, SimdLevel::AVX2 };
+    int runs = count > 10000000 ? 2 : 10;
+    std::vector<float> points;
+    printf("%zu points (%.0f MB), cpu best %s\n", count, count * 12 / 1e6, simdLevelName(cpuSimdLevel()));
+
+    for (const Cloud& cloud : clouds) {
+        fillCloud(cloud, points, count);
+
+        float oldCenter[3], oldRadius;
+        double oldMs = benchBestMs(runs, [&]() { legacyCenterScale(points.data(), count, oldCenter, oldRadius); });
+        Bounds reference = computeBounds(points.data(), count, 1, SimdLevel::Scalar);
+
+        printf("%s: %s of size %g around (%g, %g, %g)\n", cloud.name, cloud.ball ? "ball" : "cube", cloud.size,
+            cloud.center[0], cloud.center[1], cloud.center[2]);
+        printf("  old computeCenterScale  %8.1f ms  center (%g, %g, %g) radius %g, %zu points outside\n",
+            oldMs, oldCenter[0], oldCenter[1], oldCenter[2], oldRadius,
+            countOutside(points.data(), count, oldCenter, oldRadius));
+        printf("  new sphere                          center (%g, %g, %g) radius %g, %zu points outside\n",
+            reference.center[0], reference.center[1], reference.center[2], reference.radius,
+            countOutside(points.data(), count, reference.center, reference.radius));
+        printf("  %-8s %8s %10s %10s %10s\n", "level", "threads", "ms", "Mpts/s", "same");
+
+        for (SimdLevel level : levels) {
+            if (clampSimdLevel(level) != level)
+                continue;
+            for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+                Bounds b;
+                double ms = benchBestMs(runs, [&]() { b = computeBounds(points.data(), count, threads, level); });
+                bool same = memcmp(&b, &reference, sizeof(Bounds)) == 0;
+                printf("  %-8s %8u %10.1f %10.1f %10s\n", simdLevelName(level), threads, ms,
+                    ms > 0.0 ? count / (ms * 1000.0) : 0.0, same ? "yes" : "MISMATCH");
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include <cmath>
+#include <cstdio>
+#include "bench.hpp"
+#include "../include/bvh.hpp"
+#include "../include/mesh.hpp"
+#include "../include/parallel.hpp"
+
+// BVH of each model : build time on 1 thread and on all of them, nodes, leaves and depth, then rays per
+// second for pick-like rays (from a sphere around the model towards a point inside it) and the slowest
+// single query, which is what a click waits for. A few hundred rays are checked against a test of every
+// triangle, which also gives the speed of picking without the hierarchy
+// Then the BVH the app makes in the background once a model is on screen (buildViewBvh), from the
+// processed view in each vertex format : its time, and the same check against every triangle
+
+namespace {
+
+struct TreeStats {
+    size_t leaves = 0, maxDepth = 0, maxLeaf = 0;
+    double depthSum = 0.0;
+};
+
+void walk(const std::vector<BvhNode>& nodes, uint32_t node, size_t depth, TreeStats& s) {
+    const BvhNode& n = nodes[node];
+    if (n.count) {
+        s.leaves++;
+        s.depthSum += depth;
+        s.maxDepth = depth > s.maxDepth ? depth : s.maxDepth;
+        s.maxLeaf = n.count > s.maxLeaf ? n.count : s.maxLeaf;
+        return;
+    }
+    walk(nodes, node + 1, depth + 1, s);
+    walk(nodes, n.first, depth + 1, s);
+}
+
+// Rays of the bench : origins on a sphere twice the model's size, aimed at a random point of its box
+struct RayGen {
+    uint64_t state = 0x2545F4914F6CDD1Dull;
+
+    float next() {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return (float)((state >> 40) & 0xffffff) / 16777216.0f;
+    }
+    void ray(const Bounds& box, float origin[3], float direction[3]) {
+        float z = next() * 2.0f - 1.0f, phi = next() * 6.2831853f, r = std::sqrt(1.0f - z * z);
+        float dir[3] = { r * std::cos(phi), r * std::sin(phi), z };
+        for (int a = 0; a < 3; a++) {
+            float target = box.min[a] + (box.max[a] - box.min[a]) * next();
+            origin[a] = box.center[a] + dir[a] * box.radius * 2.0f;
+            direction[a] = target - origin[a];
+        }
+    }
+};
+
+}
+
+int benchBvh(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("bvh: expected at least one .obj file or grid:N\n");
+        return 1;
+    }
+
+    const size_t rays = 200000, checked = 300;
+    unsigned threads = resolveThreadCount(0);
+    int status = 0;
+    for (const std::string& arg : args) {
+        Mesh mesh;
+        if (!benchLoadMesh(arg, mesh)) {
+            printf("%s: failed to load\n", arg.c_str());
+            return 1;
+        }
+        size_t triangleCount = mesh.indices.size() / 3;
+        Bounds bounds = computeBounds(mesh.vertices.data(), mesh.vertices.size() / 3);
+
+        Bvh bvh;
+        double buildMs[2];
+        unsigned counts[2] = { 1, threads };
+        for (int i = 0; i < 2; i++) {
+            std::vector<float> positions(mesh.vertices);
+            double start = benchNowMs();
+            buildBvh(positions, mesh.indices.data(), triangleCount, bvh, counts[i]);
+            buildMs[i] = benchNowMs() - start;
+        }
+        BvhView view = bvh.view();
+        TreeStats tree;
+        walk(bvh.nodes, 0, 0, tree);
+        double mb = (bvh.nodes.size() * sizeof(BvhNode) + triangleCount * 4 * sizeof(uint32_t)
+                     + bvh.positions.size() * sizeof(float)) / (1024.0 * 1024.0);
+        printf("%s: %zu triangles, build %.1f ms on 1 thread, %.1f ms on %u (%.2f Mtris/s), %zu nodes, %zu leaves "
+            "(%.1f triangles, %zu at most), depth %.1f average / %zu max, %.1f MB\n",
+            arg.c_str(), triangleCount, buildMs[0], buildMs[1], threads,
+            triangleCount / (buildMs[1] * 1000.0), bvh.nodes.size(), tree.leaves, (double)triangleCount / tree.leaves,
+            tree.maxLeaf, tree.depthSum / tree.leaves, tree.maxDepth, mb);
+
+        // Throughput, and the slowest query on its own
+        RayGen gen;
+        size_t hits = 0, visited = 0;
+        double slowest = 0.0;
+        double start = benchNowMs();
+        for (size_t r = 0; r < rays; r++) {
+            float origin[3], direction[3];
+            gen.ray(bounds, origin, direction);
+            RayHit hit;
+            size_t nodes;
+            double t0 = (r % 64 == 0) ? benchNowMs() : 0.0;
+            hits += intersectBvh(view, origin, direction, INFINITY, hit, &nodes);
+            if (r % 64 == 0) {
+                double ms = benchNowMs() - t0;
+                slowest = ms > slowest ? ms : slowest;
+            }
+            visited += nodes;
+        }
+        double ms = benchNowMs() - start;
+
+        // Same answers as testing every triangle
+        RayGen check;
+        size_t mismatches = 0;
+        start = benchNowMs();
+        for (size_t r = 0; r < checked; r++) {
+            float origin[3], direction[3];
+            check.ray(bounds, origin, direction);
+            RayHit a, b;
+            bool hitA = intersectBvh(view, origin, direction, INFINITY, a);
+            bool hitB = intersectTriangles(view, origin, direction, INFINITY, b);
+            if (hitA != hitB || (hitA && std::fabs(a.t - b.t) > 1e-5f * (1.0f + b.t)))
+                mismatches++;
+        }
+        double linearMs = (benchNowMs() - start) / checked;
+        if (mismatches)
+            status = 1;
+
+        printf("  %zu rays, %.1f%% hit: %.2f Mrays/s, %.1f nodes per ray, slowest sampled %.4f ms | every triangle: "
+            "%.3f ms per ray (%.0fx slower) | %zu/%zu same hit as the brute force test\n",
+            rays, 100.0 * hits / rays, rays / (ms * 1000.0), (double)visited / rays, slowest, linearMs,
+            linearMs / (ms / rays), checked - mismatches, checked);
+
+        const VertexFormat formats[] = { VertexFormat::Float, VertexFormat::Packed, VertexFormat::Octa };
+        for (VertexFormat format : formats) {
+            Mesh copy = mesh;
+            ModelBuffers built;
+            BuildOptions options;
+            options.format = format;
+            buildModelBuffers(copy, built, options);
+            Bvh fromView;
+            start = benchNowMs();
+            buildViewBvh(built.view, fromView, threads);
+            double viewMs = benchNowMs() - start;
+
+            BvhView v = fromView.view();
+            Bounds viewBounds = built.view.bounds;
+            RayGen viewCheck;
+            size_t viewMismatches = 0;
+            for (size_t r = 0; r < checked; r++) {
+                float origin[3], direction[3];
+                viewCheck.ray(viewBounds, origin, direction);
+                RayHit a, b;
+                bool hitA = intersectBvh(v, origin, direction, INFINITY, a);
+                bool hitB = intersectTriangles(v, origin, direction, INFINITY, b);
+                if (hitA != hitB || (hitA && std::fabs(a.t - b.t) > 1e-5f * (1.0f + b.t)))
+                    viewMismatches++;
+            }
+            if (viewMismatches || v.triangleCount != built.view.submeshes[built.view.submeshCount - 1].firstIndex / 3
+                                                     + built.view.submeshes[built.view.submeshCount - 1].indexCount / 3)
+                status = 1;
+            printf("  from the %s view: %zu triangles in %.1f ms | %zu/%zu same hit as the brute force test\n",
+                vertexFormatName(format), v.triangleCount, viewMs, checked - viewMismatches, checked);
+        }
+    }
+    return status;
+}
@@ -0,0 +1,77 @@
+#include <cstdio>
+#include <cstring>
+#include "bench.hpp"
+#include "../include/mesh_cache.hpp"
+
+// Cold start (parse + process + write the .scopbin) versus warm start (map the .scopbin)
+// The warm side also reads every byte once, like glBufferData would, so page faults are counted
+
+static bool sameView(const MeshView& a, const MeshView& b) {
+    return a.vertexCount == b.vertexCount && a.indexCount == b.indexCount && a.indexSize == b.indexSize
+        && a.layout.format == b.layout.format && a.layout.stride == b.layout.stride
+        && memcmp(a.vertices, b.vertices, a.vertexCount * a.layout.stride) == 0
+        && memcmp(a.indices, b.indices, a.indexCount * a.indexSize) == 0
+        && memcmp(a.center, b.center, sizeof(a.center)) == 0 && a.scale == b.scale
+        && memcmp(&a.bounds, &b.bounds, sizeof(Bounds)) == 0
+        && memcmp(&a.quant, &b.quant, sizeof(VertexQuantization)) == 0;
+}
+
+static uint64_t touch(const MeshView& v) {
+    uint64_t sum = 0;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(v.vertices);
+    for (size_t i = 0; i < v.vertexCount * v.layout.stride; i += 64)
+        sum += bytes[i];
+    bytes = static_cast<const unsigned char*>(v.indices);
+    for (size_t i = 0; i < v.indexCount * v.indexSize; i += 64)
+        sum += bytes[i];
+    return sum;
+}
+
+int benchCache(const BenchArgs& args) {
+    MeshCacheOptions cacheOpts;
+    cacheOpts.dir = "/tmp";
+    std::vector<std::string> files;
+    for (const std::string& a : args) {
+        if (a.rfind("--cache-dir=", 0) == 0)
+            cacheOpts.dir = a.substr(12);
+        else
+            files.push_back(a);
+    }
+    if (files.empty()) {
+        printf("cache: expected at least one .obj file [--cache-dir=DIR]\n");
+        return 1;
+    }
+
+    int status = 0;
+    volatile uint64_t sink = 0;
+    printf("%-16s %12s %12s %10s\n", "file", "cold ms", "warm ms", "speedup");
+    for (const std::string& path : files) {
+        std::string cachePath = meshCachePath(path, cacheOpts);
+        ObjOptions opts;
+        opts.verbose = false;
+
+        ModelBuffers built;
+        double cold = benchBestMs(3, [&]() {
+            Mesh mesh;
+            built = ModelBuffers();
+            loadOBJ(path, mesh, opts);
+            buildModelBuffers(mesh, built);
+            writeMeshCache(cachePath, path, built.view);
+        });
+
+        MeshCache check;
+        if (!check.open(cachePath, path) || !sameView(check.view, built.view)) {
+            printf("%s: cache content differs from a fresh load\n", path.c_str());
+            status = 1;
+            continue;
+        }
+
+        double warm = benchBestMs(3, [&]() {
+            MeshCache cache;
+            cache.open(cachePath, path);
+            sink = touch(cache.view);
+        });
+        printf("%-16s %12.2f %12.2f %9.1fx\n", path.c_str(), cold, warm, cold / warm);
+    }
+    return status;
+}
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include "bench.hpp"
+#include "../include/Mat4.hpp"
+#include "../include/transforms.hpp"
+
+// The per object matrix chain, viewProj * translate(x, 0, z) * rotateY(angle), done every way Mat4 allows :
+// calls to multiply (at the CPU's SIMD level, then the plain loops Mat4 always had) and computeTransforms
+// Time and instructions per object, the matrices have to agree with the plain multiply within float rounding
+// Instructions are counted by single-stepping a forked child through the way (ptrace, no perf counters
+// needed), the factories alone are counted too since computeTransforms gets its rotation ready made
+// Also how far the compile-time factories (series trig) are from the runtime ones (<cmath>)
+
+namespace {
+
+constexpr float camDist = 6.0f;
+constexpr Mat4 fixedViewProj = Mat4::perspective(3.14159f / 4.0f, 800.0f / 600.0f, 0.1f, 100.0f)
+                               * Mat4::lookAt(camDist, camDist * 0.6f, camDist, 0, 0, 0, 0, 1, 0);
+
+struct Objects {
+    std::vector<float> x, z, angle;
+};
+
+__attribute__((noinline)) void multiplyCalls(const Objects& o, const Mat4& vp, Mat4* out, SimdLevel level) {
+    for (size_t i = 0; i < o.x.size(); i++)
+        out[i] = Mat4::multiply(vp, Mat4::multiply(Mat4::translate(o.x[i], 0.0f, o.z[i]), Mat4::rotateY(o.angle[i]), level),
+                                level);
+}
+
+// Only what every chain starts from, the matrices are not multiplied
+__attribute__((noinline)) void factoriesOnly(const Objects& o, const Mat4&, Mat4* out, SimdLevel) {
+    for (size_t i = 0; i < o.x.size(); i++) {
+        out[i] = Mat4::translate(o.x[i], 0.0f, o.z[i]);
+        out[i].m[0] += Mat4::rotateY(o.angle[i]).m[0];
+    }
+}
+
+// Instructions `run` takes, by single-stepping it in a forked child, -1 when ptrace isn't allowed
+template <typename Run>
+long long countInstructions(Run run) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0) {
+        ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+        raise(SIGSTOP);
+        run();
+        raise(SIGUSR1);
+        _exit(0);
+    }
+    int status;
+    long long steps = 0;
+    waitpid(pid, &status, 0);
+    while (WIFSTOPPED(status) && ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr) == 0) {
+        waitpid(pid, &status, 0);
+        if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGTRAP)
+            break;
+        steps++;
+    }
+    bool finished = WIFSTOPPED(status) && WSTOPSIG(status) == SIGUSR1;
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+    return finished ? steps : -1;
+}
+
+// Largest difference over the matrices, relative to the largest element of each
+double difference(const std::vector<Mat4>& a, const std::vector<Mat4>& b) {
+    double worst = 0.0;
+    for (size_t i = 0; i < a.size(); i++) {
+        double largest = 0.0, diff = 0.0;
+        for (int k = 0; k < 16; k++) {
+            largest = std::fmax(largest, std::fabs(b[i].m[k]));
+            diff = std::fmax(diff, std::fabs(a[i].m[k] - b[i].m[k]));
+        }
+        worst = std::fmax(worst, diff / largest);
+    }
+    return worst;
+}
+
+double matrixDifference(const Mat4& a, const Mat4& b) {
+    return difference(std::vector<Mat4>(1, a), std::vector<Mat4>(1, b));
+}
+
+}
+
+int benchChain(const BenchArgs& args) {
+    size_t count = args.empty() ? 100000 : strtoull(args[0].c_str(), nullptr, 10);
+    if (count == 0) {
+        printf("chain: expected an object count\n");
+        return 1;
+    }
+
+    // Compile time against runtime factories, the runtime arguments go through a volatile
+    volatile float one = 1.0f;
+    float k = one;
+    constexpr Mat4 fixedProj = Mat4::perspective(3.14159f / 4.0f, 800.0f / 600.0f, 0.1f, 100.0f);
+    constexpr Mat4 fixedAxis = Mat4::rotateAxis(1.0f, 2.0f, 3.0f, 2.5f);
+    constexpr Mat4 fixedInverse = Mat4::inverse(fixedViewProj);
+    Mat4 viewProj = Mat4::perspective(3.14159f / 4.0f * k, 800.0f / 600.0f, 0.1f, 100.0f)
+                    * Mat4::lookAt(camDist * k, camDist * 0.6f, camDist, 0, 0, 0, 0, 1, 0);
+    printf("constexpr against runtime: perspective %.1e, rotateAxis %.1e, viewProj %.1e, inverse %.1e\n",
+        matrixDifference(fixedProj, Mat4::perspective(3.14159f / 4.0f * k, 800.0f / 600.0f, 0.1f, 100.0f)),
+        matrixDifference(fixedAxis, Mat4::rotateAxis(k, 2.0f, 3.0f, 2.5f)),
+        matrixDifference(fixedViewProj, viewProj), matrixDifference(fixedInverse, Mat4::inverse(viewProj)));
+
+    Objects objects;
+    for (size_t i = 0; i < count; i++) {
+        objects.x.push_back((float)(i % 100) * 3.0f - 150.0f);
+        objects.z.push_back((float)(i / 100 % 100) * 3.0f - 150.0f);
+        objects.angle.push_back((float)i * 0.001f);
+    }
+    ObjectTransforms transforms;
+    transforms.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        float position[3] = { objects.x[i], 0.0f, objects.z[i] }, spin[4], scale[3] = { 1.0f, 1.0f, 1.0f };
+        axisAngleQuaternion(0.0f, 1.0f, 0.0f, objects.angle[i], spin);
+        transforms.set(i, position, spin, scale);
+    }
+
+    struct Way {
+        const char* name;
+        void (*run)(const Objects&, const Mat4&, Mat4*, SimdLevel);
+        SimdLevel level;
+    };
+    const Way ways[] = {
+        { "translate + rotateY only", factoriesOnly, bestSimdLevel() },
+        { "multiply, plain loops", multiplyCalls, SimdLevel::Scalar },
+        { "multiply", multiplyCalls, bestSimdLevel() },
+        { "computeTransforms", nullptr, bestSimdLevel() },
+    };
+
+    // Single-stepping is slow, the instructions are counted on the first objects only, less a run
+    // with none at all for what the call itself costs
+    const size_t counted = std::min(count, (size_t)256);
+    Objects few = objects;
+    few.x.resize(counted);
+    few.z.resize(counted);
+    few.angle.resize(counted);
+    ObjectTransforms fewTransforms;
+    fewTransforms.resize(counted);
+    for (size_t i = 0; i < counted; i++) {
+        float position[3] = { few.x[i], 0.0f, few.z[i] }, spin[4], scale[3] = { 1.0f, 1.0f, 1.0f };
+        axisAngleQuaternion(0.0f, 1.0f, 0.0f, few.angle[i], spin);
+        fewTransforms.set(i, position, spin, scale);
+    }
+    const Objects none;
+    const ObjectTransforms noTransforms;
+
+    std::vector<Mat4> reference(count), out(count);
+    multiplyCalls(objects, viewProj, reference.data(), SimdLevel::Scalar);
+    printf("%zu objects, cpu best %s\n%-28s %10s %12s %14s\n", count, simdLevelName(cpuSimdLevel()), "way",
+        "ns/object", "instr/object", "vs plain");
+    int status = 0;
+    for (const Way& way : ways) {
+        auto runOn = [&](const Objects& o, const ObjectTransforms& t) {
+            if (way.run)
+                way.run(o, viewProj, out.data(), way.level);
+            else
+                computeTransforms(t, viewProj, nullptr, out.data(), 1);
+        };
+        long long withObjects = countInstructions([&]() { runOn(few, fewTransforms); });
+        long long empty = countInstructions([&]() { runOn(none, noTransforms); });
+        char instructions[32] = "-";
+        if (withObjects >= 0 && empty >= 0)
+            snprintf(instructions, sizeof(instructions), "%.1f", (double)(withObjects - empty) / counted);
+
+        double ms = benchBestMs(10, [&]() { runOn(objects, transforms); });
+        // The factories alone make other matrices, nothing to compare
+        char agreement[32] = "-";
+        if (way.run != factoriesOnly) {
+            double diff = difference(out, reference);
+            if (!(diff < 1e-5))
+                status = 1;
+            snprintf(agreement, sizeof(agreement), "%.1e", diff);
+        }
+        printf("%-28s %10.2f %12s %14s\n", way.name, ms * 1e6 / count, instructions, agreement);
+    }
+    return status;
+}
@@ -0,0 +1,130 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "bench.hpp"
+#include "../include/culling.hpp"
+#include "../include/transforms.hpp"
+
+// Whole object culling against the renderer's view : N objects scattered in a 200 unit cube around
+// the origin (the camera looks at it from (6, 3.6, 6)), each a random box with a random rotation and
+// scale. Time of ObjectBounds::set (world bounds from the model matrix) and of cullObjects per level
+// Checks : every level gives the scalar level's answers, and each culled object really is outside one
+// plane, by its sphere or by the 8 corners of its box, redone in double
+
+namespace {
+
+uint64_t randomState = 0x2545F4914F6CDD1Dull;
+
+float random01() {
+    randomState = randomState * 6364136223846793005ull + 1442695040888963407ull;
+    return (float)((randomState >> 40) & 0xffffff) / 16777216.0f;
+}
+
+bool outsideInDouble(const Frustum &f, const ObjectBounds &b, size_t i) {
+    for (int p = 0; p < 6; p++) {
+        const float *pl = f.planes[p];
+        double d = (double)pl[0] * b.center[0][i] + (double)pl[1] * b.center[1][i] + (double)pl[2] * b.center[2][i]
+            + pl[3];
+        if (d < -(double)b.radius[i] * (1.0 - 1e-6))
+            return true;
+        bool allOut = true;
+        for (int k = 0; k < 8 && allOut; k++) {
+            double e = pl[3];
+            for (int a = 0; a < 3; a++)
+                e += (double)pl[a] * ((k >> a) & 1 ? b.max[a][i] : b.min[a][i]);
+            allOut = e < 1e-6;
+        }
+        if (allOut)
+            return true;
+    }
+    return false;
+}
+
+}
+
+int benchCull(const BenchArgs& args) {
+    std::vector<size_t> counts;
+    for (const std::string& a : args)
+        counts.push_back(strtoull(a.c_str(), nullptr, 10));
+    if (counts.empty())
+        counts = { 1000, 100000, 1000000 };
+    for (size_t n : counts)
+        if (n == 0) {
+            printf("cull: expected object counts\n");
+            return 1;
+        }
+
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE, SimdLevel::AVX2 };
+    Mat4 viewProj = Mat4::multiply(Mat4::perspective(3.14159f / 4.0f, 800.0f / 600.0f, 0.1f, 100.0f),
+                                   Mat4::lookAt(6.0f, 3.6f, 6.0f, 0, 0, 0, 0, 1, 0));
+    Frustum frustum = frustumFromMatrix(viewProj.m);
+    int status = 0;
+    printf("cpu best %s\n", simdLevelName(cpuSimdLevel()));
+    for (size_t n : counts) {
+        std::vector<Bounds> local(n);
+        std::vector<Mat4> models(n);
+        for (size_t i = 0; i < n; i++) {
+            Bounds &b = local[i];
+            float diagonal = 0.0f;
+            for (int a = 0; a < 3; a++) {
+                float half = 0.2f + random01() * 2.0f;
+                b.min[a] = -half;
+                b.max[a] = half;
+                diagonal += half * half;
+            }
+            b.radius = std::sqrt(diagonal);
+            float position[3], rotation[4], scale[3];
+            for (int a = 0; a < 3; a++) {
+                position[a] = random01() * 200.0f - 100.0f;
+                scale[a] = 0.5f + random01();
+            }
+            axisAngleQuaternion(random01() - 0.5f, random01() - 0.5f, random01() - 0.5f, random01() * 6.2831853f,
+                                rotation);
+            models[i] = trsMatrix(position, rotation, scale);
+        }
+
+        int runs = n >= 1000000 ? 5 : n >= 100000 ? 20 : 200;
+        ObjectBounds bounds;
+        bounds.resize(n);
+        double setMs = benchBestMs(runs, [&]() {
+            for (size_t i = 0; i < n; i++)
+                bounds.set(i, local[i], models[i].m);
+        });
+        size_t sphereOnly = 0;
+        for (size_t i = 0; i < n; i++) {
+            const float center[3] = { bounds.center[0][i], bounds.center[1][i], bounds.center[2][i] };
+            sphereOnly += !sphereInFrustum(frustum, center, bounds.radius[i]);
+        }
+
+        printf("%zu objects, world bounds %.3f ms (%.1f ns per object), %zu culled by the sphere alone\n", n, setMs,
+            setMs * 1e6 / n, sphereOnly);
+        printf("  %-8s %10s %12s %10s %9s %9s %6s %9s\n", "level", "ms", "Mobjects/s", "ns/object", "culled",
+            "speedup", "same", "checked");
+        std::vector<uint8_t> visible(n), reference;
+        double scalarMs = 0.0;
+        for (SimdLevel level : levels) {
+            if (clampSimdLevel(level) != level)
+                continue;
+            ObjectCullStats stats;
+            double ms = benchBestMs(runs, [&]() {
+                stats = ObjectCullStats();
+                cullObjects(frustum, bounds, visible.data(), stats, level);
+            });
+            if (reference.empty()) {
+                reference = visible;
+                scalarMs = ms;
+            }
+            bool same = memcmp(visible.data(), reference.data(), n) == 0;
+            size_t wrong = 0;
+            for (size_t i = 0; i < n; i++)
+                wrong += !visible[i] && !outsideInDouble(frustum, bounds, i);
+            if (!same || wrong || stats.tested != n)
+                status = 1;
+            printf("  %-8s %10.4f %12.1f %10.2f %9zu %8.2fx %6s %9s\n", simdLevelName(level), ms, n / (ms * 1000.0),
+                ms * 1e6 / n, stats.culled, scalarMs / ms, same ? "yes" : "NO", wrong ? "NO" : "yes");
+        }
+    }
+    return status;
+}
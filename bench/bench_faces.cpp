@@ -0,0 +1,99 @@
+#include <cstdio>
+#include <sstream>
+#include "bench.hpp"
+#include "../include/obj_tokens.hpp"
+#include "../include/mapped_file.hpp"
+
+// Face records only : the original face code (one string per corner, up to three sscanf,
+// triangles and quads only) against readFace + fan triangulation from obj_tokens.hpp
+
+namespace {
+
+// Copy of the face branch loadOBJ had before, kept here as the reference
+void oldFaceParse(const std::string& line, std::vector<int>& corners) {
+    std::stringstream ss(line);
+    std::string type, vStr;
+    ss >> type;
+    std::vector<std::string> face;
+    while (ss >> vStr)
+        face.push_back(vStr);
+    if (face.size() < 3)
+        return;
+
+    int triCount = (face.size() == 4) ? 2 : 1;
+    int indices[6] = {0,1,2, 0,2,3};
+    for (int t = 0; t < triCount; t++) {
+        for (int i = 0; i < 3; i++) {
+            std::string vert = face[indices[t*3 + i]];
+            int vi = -1, ti = -1, ni = -1;
+            sscanf(vert.c_str(), "%d/%d/%d", &vi, &ti, &ni);
+            if (ti == -1)
+                sscanf(vert.c_str(), "%d//%d", &vi, &ni);
+            if (vi == -1)
+                sscanf(vert.c_str(), "%d", &vi);
+            corners.push_back(vi);
+            corners.push_back(ti);
+            corners.push_back(ni);
+        }
+    }
+}
+
+}
+
+int benchFaces(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("faces: expected at least one .obj file\n");
+        return 1;
+    }
+
+    printf("%-16s %9s %9s %14s %14s %9s\n", "file", "faces", "tris", "old faces/s", "new faces/s", "speedup");
+    for (const std::string& path : args) {
+        MappedFile file;
+        if (!file.open(path)) {
+            printf("%s: cannot open\n", path.c_str());
+            return 1;
+        }
+
+        // Keep only the face lines
+        std::vector<std::string> lines;
+        const char* p = file.data;
+        const char* end = file.data + file.size;
+        while (p < end) {
+            const char* eol = nextLine(p, end);
+            if (isKeyword(p, eol, "f", 1))
+                lines.push_back(std::string(p, eol - (eol[-1] == '\n' ? 1 : 0)));
+            p = eol;
+        }
+
+        std::vector<int> corners;
+        corners.reserve(lines.size() * 18);
+        size_t oldTris = 0, newTris = 0;
+
+        double tOld = benchBestMs(5, [&]() {
+            corners.clear();
+            for (const std::string& l : lines)
+                oldFaceParse(l, corners);
+            oldTris = corners.size() / 9;
+        });
+        double tNew = benchBestMs(5, [&]() {
+            corners.clear();
+            FaceCorners face;
+            for (const std::string& l : lines) {
+                readFace(l.data() + 1, l.data() + l.size(), face);
+                const int* c = face.data();
+                for (size_t i = 1; i + 1 < face.count; i++) {
+                    corners.insert(corners.end(), c, c + 3);
+                    corners.insert(corners.end(), c + i * 3, c + i * 3 + 6);
+                }
+            }
+            newTris = corners.size() / 9;
+        });
+
+        printf("%-16s %9zu %9zu %12.2f M %12.2f M %8.2fx", path.c_str(), lines.size(), newTris,
+            lines.size() / tOld / 1000.0, lines.size() / tNew / 1000.0, tOld / tNew);
+        if (oldTris != newTris)
+            printf("   (old code kept %zu triangles)", oldTris);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <cmath>
+#include <cstdio>
+#include "bench.hpp"
+#include "../include/mesh.hpp"
+
+// Vertex buffer size and precision of each VertexFormat, against the Float layout of the same model
+// Errors are measured after decoding the way the vertex shader does : positions in the fitted space
+// (the model is 3 units wide), normals in degrees, uvs in texture units
+// Frame times need a GL context : ft_scop --instances=N --vertex-format=F prints them ([FRAME] lines)
+
+namespace {
+
+struct FormatErrors {
+    double position = 0.0;
+    double normal   = 0.0;
+    double uv       = 0.0;
+};
+
+FormatErrors compareViews(const MeshView& ref, const MeshView& view) {
+    FormatErrors err;
+    const unsigned char* a = static_cast<const unsigned char*>(ref.vertices);
+    const unsigned char* b = static_cast<const unsigned char*>(view.vertices);
+    for (size_t v = 0; v < ref.vertexCount; v++) {
+        float pa[3], na[3], ua[2], pb[3], nb[3], ub[2];
+        decodeVertex(ref.layout, ref.quant, a + v * ref.layout.stride, pa, na, ua);
+        decodeVertex(view.layout, view.quant, b + v * view.layout.stride, pb, nb, ub);
+        for (int c = 0; c < 3; c++)
+            err.position = std::fmax(err.position, std::fabs((double)pa[c] - pb[c]));
+        for (int c = 0; c < 2; c++)
+            err.uv = std::fmax(err.uv, std::fabs((double)ua[c] - ub[c]));
+
+        // Degenerate triangles have no normal to compare
+        double la = std::sqrt((double)na[0] * na[0] + na[1] * na[1] + na[2] * na[2]);
+        double lb = std::sqrt((double)nb[0] * nb[0] + nb[1] * nb[1] + nb[2] * nb[2]);
+        if (la < 1e-6 || lb < 1e-6)
+            continue;
+        double dot = (na[0] * (double)nb[0] + na[1] * (double)nb[1] + na[2] * (double)nb[2]) / (la * lb);
+        err.normal = std::fmax(err.normal, std::acos(std::fmin(1.0, std::fmax(-1.0, dot))) * 180.0 / M_PI);
+    }
+    return err;
+}
+
+}
+
+int benchFormats(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("formats: expected at least one .obj file or grid:N\n");
+        return 1;
+    }
+
+    const VertexFormat formats[] = { VertexFormat::Float, VertexFormat::Packed, VertexFormat::Octa };
+    printf("%-16s %-7s %6s %10s %10s %7s %10s %12s %10s %10s\n", "file", "format", "bytes", "VBO KB",
+        "legacy KB", "ratio", "build ms", "pos error", "normal deg", "uv error");
+    for (const std::string& arg : args) {
+        Mesh source;
+        if (!benchLoadMesh(arg, source)) {
+            printf("%s: failed to load\n", arg.c_str());
+            return 1;
+        }
+        // Normals once up front, so every format encodes the same vertices
+        if (source.normals.empty())
+            generateSmoothNormals(source, NormalOptions().creaseAngle);
+        int runs = source.vertices.size() > 3000000 ? 3 : 10;
+
+        ModelBuffers reference;
+        for (VertexFormat format : formats) {
+            BuildOptions options;
+            options.format = format;
+            options.vertexCache = false;
+            ModelBuffers built;
+            double ms = benchBestMs(runs, [&]() {
+                Mesh mesh = source;
+                built = ModelBuffers();
+                buildModelBuffers(mesh, built, options);
+            });
+            const MeshView& view = built.view;
+
+            // What every vertex cost before formats existed : 8 floats, uvs or not
+            size_t legacy = view.vertexCount * 8 * sizeof(float);
+            size_t bytes = view.vertexCount * view.layout.stride;
+            FormatErrors err;
+            if (format != VertexFormat::Float)
+                err = compareViews(reference.view, view);
+            printf("%-16s %-7s %6zu %10.1f %10.1f %6.2fx %10.2f %12.3g %10.4f %10.3g\n", arg.c_str(),
+                vertexFormatName(format), view.layout.stride, bytes / 1024.0, legacy / 1024.0,
+                (double)legacy / bytes, ms, err.position, err.normal, err.uv);
+            if (format == VertexFormat::Float)
+                reference = std::move(built);
+        }
+    }
+    return 0;
+}
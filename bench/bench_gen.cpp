@@ -0,0 +1,86 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include "bench.hpp"
+#include "../include/parsing.hpp"
+
+// Write a synthetic .obj : a wavy height field of roughly `faces` triangles
+// Big enough inputs are what the multi-threaded paths are for, and we don't ship any
+
+static float gridHeight(float fx, float fy) {
+    return 0.05f * sinf(fx * 40.0f) * cosf(fy * 40.0f);
+}
+
+// Same height field built directly in memory, for inputs too big to be worth writing as text
+void benchGridMesh(size_t faces, Mesh& out) {
+    size_t side = (size_t)std::sqrt((double)faces / 2.0);
+    if (side < 1)
+        side = 1;
+
+    out = Mesh();
+    out.vertices.reserve((side + 1) * (side + 1) * 3);
+    for (size_t y = 0; y <= side; y++)
+        for (size_t x = 0; x <= side; x++) {
+            float fx = (float)x / side, fy = (float)y / side;
+            out.vertices.push_back(fx);
+            out.vertices.push_back(gridHeight(fx, fy));
+            out.vertices.push_back(fy);
+        }
+    out.indices.reserve(side * side * 6);
+    for (size_t y = 0; y < side; y++)
+        for (size_t x = 0; x < side; x++) {
+            uint32_t a = (uint32_t)(y * (side + 1) + x);
+            uint32_t b = a + 1, c = a + (uint32_t)side + 1, d = c + 1;
+            const uint32_t tris[6] = { a, c, b, b, c, d };
+            out.indices.insert(out.indices.end(), tris, tris + 6);
+        }
+    SubMesh all = SubMesh();
+    all.indexCount = (uint32_t)out.indices.size();
+    all.materialId = -1;
+    out.submeshes.push_back(all);
+}
+
+// A bench input : "grid:N" is a synthetic mesh of about N triangles, anything else an .obj file
+bool benchLoadMesh(const std::string& arg, Mesh& out) {
+    if (arg.rfind("grid:", 0) == 0) {
+        benchGridMesh(strtoull(arg.c_str() + 5, nullptr, 10), out);
+        return true;
+    }
+    ObjOptions opts;
+    opts.verbose = false;
+    return loadOBJ(arg, out, opts);
+}
+
+int benchGen(const BenchArgs& args) {
+    if (args.size() != 2) {
+        printf("gen: expected <faces> <out.obj>\n");
+        return 1;
+    }
+    size_t faces = strtoull(args[0].c_str(), nullptr, 10);
+    size_t side  = (size_t)std::sqrt((double)faces / 2.0);
+    if (side < 1)
+        side = 1;
+
+    FILE* f = fopen(args[1].c_str(), "w");
+    if (!f) {
+        printf("gen: cannot write %s\n", args[1].c_str());
+        return 1;
+    }
+
+    fprintf(f, "# synthetic grid %zux%zu\no grid\n", side, side);
+    for (size_t y = 0; y <= side; y++)
+        for (size_t x = 0; x <= side; x++) {
+            float fx = (float)x / side, fy = (float)y / side;
+            fprintf(f, "v %.6f %.6f %.6f\n", fx, gridHeight(fx, fy), fy);
+        }
+    for (size_t y = 0; y < side; y++)
+        for (size_t x = 0; x < side; x++) {
+            size_t a = y * (side + 1) + x + 1;
+            size_t b = a + 1, c = a + side + 1, d = c + 1;
+            fprintf(f, "f %zu %zu %zu\nf %zu %zu %zu\n", a, c, b, b, c, d);
+        }
+
+    fclose(f);
+    printf("wrote %s: %zu vertices, %zu triangles\n", args[1].c_str(), (side + 1) * (side + 1), side * side * 2);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include <cstdio>
+#include "bench.hpp"
+#include "../include/mesh.hpp"
+
+// GPU memory of each model as a triangle soup (what glDrawArrays needed) versus indexed
+// Models without vn get flat normals, which splits shared vertices again, so both states are shown
+
+static size_t indexedBytes(const Mesh& mesh) {
+    size_t vertexCount = mesh.vertices.size() / 3;
+    return vertexCount * vertexLayout(VertexFormat::Float, !mesh.uvs.empty()).stride
+        + mesh.indices.size() * indexSize(vertexCount);
+}
+
+int benchIndex(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("index: expected at least one .obj file\n");
+        return 1;
+    }
+
+    printf("%-16s %6s %9s %9s %11s %11s %9s %12s %9s\n", "file", "parts", "tris", "vertices",
+        "soup KB", "indexed KB", "ratio", "shaded KB", "ratio");
+    for (const std::string& path : args) {
+        ObjOptions opts;
+        opts.verbose = false;
+        Mesh mesh;
+        if (!loadOBJ(path, mesh, opts)) {
+            printf("%s: failed to load\n", path.c_str());
+            return 1;
+        }
+
+        size_t tris = mesh.indices.size() / 3;
+        size_t soup = mesh.indices.size() * vertexLayout(VertexFormat::Float, !mesh.uvs.empty()).stride;
+        size_t loaded = indexedBytes(mesh);
+        size_t vertices = mesh.vertices.size() / 3;
+        if (mesh.normals.empty())
+            generateNormals(mesh);
+        size_t shaded = indexedBytes(mesh);
+
+        printf("%-16s %6zu %9zu %9zu %11.1f %11.1f %8.2fx %12.1f %8.2fx\n", path.c_str(),
+            mesh.submeshes.size(), tris, vertices,
+            soup / 1024.0, loaded / 1024.0, (double)soup / loaded, shaded / 1024.0, (double)soup / shaded);
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include "bench.hpp"
+#include "../include/mesh.hpp"
+
+// Level of detail chain of each model : triangles, error and build time per level, and checks that
+// every level is a valid mesh whose open borders and seams did not move
+// Then a scene of dozens of copies of the model going away from the camera (the app's 45 degree lens
+// on a 600 pixel high window), each drawn at the level selectLod picks for one pixel of error :
+// triangles per frame against full detail. Frame times need a GL context (ft_scop --lod / --no-lod)
+
+namespace {
+
+// Same position = same id, like the simplifier sees them (seams are positions used by several
+// vertices that differ in normal or uv, twins equal in everything are welded and may move)
+std::vector<uint32_t> positionIds(const Mesh& mesh, std::vector<char>& seam) {
+    size_t n = mesh.vertices.size() / 3;
+    const float* v = mesh.vertices.data();
+    const float* normals = mesh.normals.size() == n * 3 ? mesh.normals.data() : nullptr;
+    const float* uvs = mesh.uvs.size() == n * 2 ? mesh.uvs.data() : nullptr;
+    auto sameAttributes = [&](uint32_t a, uint32_t b) {
+        return (!normals || memcmp(&normals[a * 3], &normals[b * 3], 3 * sizeof(float)) == 0)
+            && (!uvs || memcmp(&uvs[a * 2], &uvs[b * 2], 2 * sizeof(float)) == 0);
+    };
+    std::vector<uint32_t> order(n), id(n);
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [v](uint32_t a, uint32_t b) {
+        int c = memcmp(&v[a * 3], &v[b * 3], 3 * sizeof(float));
+        return c != 0 ? c < 0 : a < b;
+    });
+    seam.assign(n, 0);
+    for (size_t i = 0, run = 0; i < n; i++) {
+        bool twin = i > 0 && memcmp(&v[order[i] * 3], &v[order[i - 1] * 3], 3 * sizeof(float)) == 0;
+        id[order[i]] = twin ? id[order[i - 1]] : order[i];
+        if (!twin)
+            run = i;
+        else if (seam[order[run]] || !sameAttributes(order[i], order[run]))
+            for (size_t k = run; k <= i; k++)
+                seam[order[k]] = 1;
+    }
+    return id;
+}
+
+// Edges with a single triangle, in position space, sorted
+std::vector<uint64_t> borderEdges(const uint32_t* indices, size_t count, const std::vector<uint32_t>& id) {
+    std::vector<uint64_t> edges;
+    for (size_t t = 0; t < count / 3; t++) {
+        for (int k = 0; k < 3; k++) {
+            uint32_t a = id[indices[t * 3 + k]], b = id[indices[t * 3 + (k + 1) % 3]];
+            edges.push_back(a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    std::vector<uint64_t> border;
+    for (size_t i = 0; i < edges.size();) {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i])
+            j++;
+        if (j - i == 1)
+            border.push_back(edges[i]);
+        i = j;
+    }
+    return border;
+}
+
+// Triangles of a level, submesh after submesh (level 0 = the full mesh)
+std::vector<uint32_t> levelIndices(const Mesh& mesh, size_t level) {
+    std::vector<uint32_t> out;
+    size_t parts = mesh.submeshes.size();
+    for (size_t s = 0; s < parts; s++) {
+        const SubMesh& sub = level ? mesh.lodSubmeshes[(level - 1) * parts + s] : mesh.submeshes[s];
+        out.insert(out.end(), mesh.indices.begin() + sub.firstIndex,
+                   mesh.indices.begin() + sub.firstIndex + sub.indexCount);
+    }
+    return out;
+}
+
+}
+
+int benchLod(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("lod: expected at least one .obj file or grid:N\n");
+        return 1;
+    }
+
+    const std::vector<float> ratios = BuildOptions().lodRatios;
+    const size_t copies = 36;
+    // Perspective of the app : f = 1 / tan(fov / 2) with a 45 degree fov, 600 pixels high
+    const float focal = 1.0f / std::tan(3.14159f / 8.0f), height = 600.0f;
+
+    int status = 0;
+    for (const std::string& arg : args) {
+        Mesh mesh;
+        if (!benchLoadMesh(arg, mesh)) {
+            printf("%s: failed to load\n", arg.c_str());
+            return 1;
+        }
+        // The welded vertices buildModelBuffers simplifies
+        if (mesh.normals.empty())
+            generateSmoothNormals(mesh, NormalOptions().creaseAngle);
+        size_t vertexCount = mesh.vertices.size() / 3;
+
+        double start = benchNowMs();
+        buildLods(mesh, ratios);
+        double ms = benchNowMs() - start;
+
+        // Errors as the renderer sees them : the model fitted to a 1.5 radius
+        Bounds bounds = computeBounds(mesh.vertices.data(), vertexCount);
+        float center[3], scale;
+        fitBounds(bounds, center, scale);
+
+        std::vector<char> seam;
+        std::vector<uint32_t> id = positionIds(mesh, seam);
+        std::vector<uint32_t> full = levelIndices(mesh, 0);
+        std::vector<uint64_t> border = borderEdges(full.data(), full.size(), id);
+        size_t seamVertices = 0;
+        std::vector<char> usedFull(vertexCount, 0);
+        for (uint32_t i : full)
+            usedFull[i] = 1;
+        for (size_t v = 0; v < vertexCount; v++)
+            seamVertices += seam[v] && usedFull[v];
+
+        printf("%s: %zu triangles, %zu vertices, %zu border edges, %zu seam vertices, %zu levels in %.1f ms\n",
+            arg.c_str(), full.size() / 3, vertexCount, border.size(), seamVertices, mesh.lods.size(), ms);
+        printf("  %5s %7s %10s %7s %12s %7s %8s %7s %6s\n", "level", "ratio", "tris", "kept", "error", "% r",
+            "indices", "border", "seams");
+        for (size_t l = 0; l < mesh.lods.size(); l++) {
+            const MeshLod& lod = mesh.lods[l];
+            std::vector<uint32_t> tris = levelIndices(mesh, l + 1);
+            bool indicesOk = tris.size() == (size_t)lod.triangleCount * 3;
+            for (size_t t = 0; t < tris.size() / 3 && indicesOk; t++) {
+                const uint32_t* c = &tris[t * 3];
+                indicesOk = c[0] < vertexCount && c[1] < vertexCount && c[2] < vertexCount
+                    && c[0] != c[1] && c[1] != c[2] && c[0] != c[2];
+            }
+            bool borderOk = indicesOk && borderEdges(tris.data(), tris.size(), id) == border;
+            // A seam keeps its position, some of the vertices on it may go with the triangles they had alone
+            std::vector<char> used(vertexCount, 0);
+            for (uint32_t i : tris)
+                used[id[std::min<size_t>(i, vertexCount - 1)]] = 1;
+            bool seamsOk = true;
+            for (size_t v = 0; v < vertexCount && seamsOk; v++)
+                seamsOk = !(seam[v] && usedFull[v]) || used[id[v]];
+
+            float error = lod.error * scale;
+            printf("  %5zu %7.4f %10u %6.1f%% %12.3g %7.3f %8s %7s %6s\n", l + 1, lod.ratio, lod.triangleCount,
+                100.0 * lod.triangleCount / (full.size() / 3), error, 100.0 * error / 1.5,
+                indicesOk ? "ok" : "BAD", borderOk ? "kept" : "MOVED", seamsOk ? "kept" : "LOST");
+            if (!indicesOk || !borderOk || !seamsOk)
+                status = 1;
+        }
+
+        // Copies 2.7 units apart, from right in front of the camera to the far plane
+        std::vector<MeshLod> fitted(mesh.lods);
+        for (MeshLod& lod : fitted)
+            lod.error *= scale;
+        size_t fullTriangles = 0, lodTriangles = 0;
+        std::vector<size_t> perLevel(fitted.size() + 1, 0);
+        for (size_t i = 0; i < copies; i++) {
+            float distance = 5.0f + 2.7f * i;
+            float projected = 1.5f * focal / distance * height * 0.5f;
+            size_t level = selectLod(fitted.data(), fitted.size(), 1.5f, projected, 1.0f);
+            perLevel[level]++;
+            fullTriangles += full.size() / 3;
+            lodTriangles  += level ? fitted[level - 1].triangleCount : full.size() / 3;
+        }
+        printf("  scene of %zu copies from 5 to %.0f units, 1 pixel of error: %zu triangles per frame instead of %zu (%.1f%%), copies per level:",
+            copies, 5.0f + 2.7f * (copies - 1), lodTriangles, fullTriangles, 100.0 * lodTriangles / fullTriangles);
+        for (size_t count : perLevel)
+            printf(" %zu", count);
+        printf("\n");
+    }
+    return status;
+}
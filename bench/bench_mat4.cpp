@@ -0,0 +1,187 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include "bench.hpp"
+#include "../include/Mat4.hpp"
+
+// Mat4 at every SIMD level on the kind of work a frame of many instances does : products of model
+// matrices, transposes, inverses (general ones on model * view * projection, affine ones on the model
+// matrices) and points and directions run through a matrix
+// Scalar is the code Mat4 always had. Multiply, transpose and the transforms must give the same bits at
+// every level, the inverses are checked against one computed in double
+// The default of 4096 matrices (256 KB a set) stays in cache, the point is the arithmetic, not memory
+
+namespace {
+
+uint64_t randomState = 0x9E3779B97F4A7C15ull;
+
+float random01() {
+    randomState = randomState * 6364136223846793005ull + 1442695040888963407ull;
+    return (float)((randomState >> 40) & 0xffffff) / 16777216.0f;
+}
+
+// Rotation about a random axis, a scale per axis and a bit of shear, then a translation
+Mat4 randomAffine() {
+    Mat4 r = Mat4::rotateAxis(random01() - 0.5f, random01() - 0.5f, random01() - 0.5f, random01() * 6.2831853f);
+    for (int col = 0; col < 3; col++) {
+        float scale = 0.2f + random01() * 3.0f;
+        for (int row = 0; row < 3; row++)
+            r.m[col * 4 + row] *= scale;
+    }
+    r.m[4] += random01() * 0.3f;
+    Mat4 t = Mat4::translate(random01() * 20.0f - 10.0f, random01() * 20.0f - 10.0f, random01() * 20.0f - 10.0f);
+    return Mat4::multiply(t, r, SimdLevel::Scalar);
+}
+
+// Gauss-Jordan in double, what the float inverses are measured against
+void inverseDouble(const Mat4& a, double out[16]) {
+    double m[4][8];
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++) {
+            m[r][c] = a.m[c * 4 + r];
+            m[r][c + 4] = r == c;
+        }
+    for (int c = 0; c < 4; c++) {
+        int pivot = c;
+        for (int r = c + 1; r < 4; r++)
+            if (std::fabs(m[r][c]) > std::fabs(m[pivot][c]))
+                pivot = r;
+        for (int k = 0; k < 8; k++)
+            std::swap(m[c][k], m[pivot][k]);
+        for (int r = 0; r < 4; r++) {
+            double f = m[r][c] / m[c][c];
+            for (int k = 0; k < 8 && r != c; k++)
+                m[r][k] -= f * m[c][k];
+        }
+    }
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            out[c * 4 + r] = m[r][c + 4] / m[r][r];
+}
+
+// Largest difference to the double inverse, relative to the largest element of it
+float inverseError(const std::vector<Mat4>& m, const std::vector<Mat4>& inv) {
+    double worst = 0.0;
+    for (size_t i = 0; i < m.size(); i++) {
+        double exact[16], largest = 0.0, diff = 0.0;
+        inverseDouble(m[i], exact);
+        for (int k = 0; k < 16; k++) {
+            largest = std::fmax(largest, std::fabs(exact[k]));
+            diff = std::fmax(diff, std::fabs(inv[i].m[k] - exact[k]));
+        }
+        worst = std::fmax(worst, diff / largest);
+    }
+    return (float)worst;
+}
+
+}
+
+int benchMat4(const BenchArgs& args) {
+    size_t count = args.empty() ? 4096 : strtoull(args[0].c_str(), nullptr, 10);
+    size_t pointCount = args.size() < 2 ? 1000000 : strtoull(args[1].c_str(), nullptr, 10);
+    if (count == 0 || pointCount == 0) {
+        printf("mat4: expected a matrix count and a point count\n");
+        return 1;
+    }
+
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE, SimdLevel::AVX2 };
+    const int runs = 20;
+    Mat4 viewProj = Mat4::multiply(Mat4::perspective(3.14159f / 4.0f, 800.0f / 600.0f, 0.1f, 100.0f),
+                                   Mat4::lookAt(6.0f, 3.6f, 6.0f, 0, 0, 0, 0, 1, 0), SimdLevel::Scalar);
+    std::vector<Mat4> models(count), mvps(count), out(count), reference(count);
+    for (size_t i = 0; i < count; i++) {
+        models[i] = randomAffine();
+        mvps[i] = Mat4::multiply(viewProj, models[i], SimdLevel::Scalar);
+    }
+    std::vector<float> points(pointCount * 3), moved(pointCount * 3), expected(pointCount * 3);
+    for (float& p : points)
+        p = random01() * 2.0f - 1.0f;
+
+    printf("%zu matrices, %zu points, cpu best %s, Mat4 is %zu bytes aligned on %zu\n", count, pointCount,
+        simdLevelName(cpuSimdLevel()), sizeof(Mat4), alignof(Mat4));
+    printf("%-18s %-8s %10s %10s %9s %12s\n", "op", "level", "ms", "ns/op", "speedup", "check");
+
+    int status = 0;
+    auto row = [&](const char* op, SimdLevel level, double ms, size_t n, double scalarMs, const char* check, bool ok) {
+        printf("%-18s %-8s %10.2f %10.2f %8.2fx %12s\n", op, simdLevelName(level), ms, ms * 1e6 / n,
+            scalarMs / ms, check);
+        if (!ok)
+            status = 1;
+    };
+
+    // Products, transposes : same bits as scalar
+    struct Exact {
+        const char* name;
+        void (*run)(const std::vector<Mat4>&, const std::vector<Mat4>&, std::vector<Mat4>&, SimdLevel);
+    };
+    const Exact exact[] = {
+        { "multiply", [](const std::vector<Mat4>& a, const std::vector<Mat4>& b, std::vector<Mat4>& r, SimdLevel l) {
+            for (size_t i = 0; i < r.size(); i++)
+                r[i] = Mat4::multiply(a[i], b[i], l);
+        } },
+        { "transpose", [](const std::vector<Mat4>& a, const std::vector<Mat4>&, std::vector<Mat4>& r, SimdLevel l) {
+            for (size_t i = 0; i < r.size(); i++)
+                r[i] = Mat4::transpose(a[i], l);
+        } },
+    };
+    for (const Exact& op : exact) {
+        double scalarMs = 0.0;
+        for (SimdLevel level : levels) {
+            if (clampSimdLevel(level) != level)
+                continue;
+            double ms = benchBestMs(runs, [&]() { op.run(mvps, models, out, level); });
+            if (level == SimdLevel::Scalar) {
+                scalarMs = ms;
+                reference = out;
+            }
+            bool same = memcmp(out.data(), reference.data(), count * sizeof(Mat4)) == 0;
+            row(op.name, level, ms, count, scalarMs, same ? "same" : "MISMATCH", same);
+        }
+    }
+
+    // Inverses : close enough to the identity once multiplied back
+    for (int affine = 0; affine < 2; affine++) {
+        const std::vector<Mat4>& source = affine ? models : mvps;
+        double scalarMs = 0.0;
+        for (SimdLevel level : levels) {
+            if (clampSimdLevel(level) != level)
+                continue;
+            double ms = benchBestMs(runs, [&]() {
+                for (size_t i = 0; i < count; i++)
+                    out[i] = affine ? Mat4::affineInverse(source[i], level) : Mat4::inverse(source[i], level);
+            });
+            if (level == SimdLevel::Scalar)
+                scalarMs = ms;
+            float error = inverseError(source, out);
+            char check[32];
+            snprintf(check, sizeof(check), "err %.1e", error);
+            row(affine ? "affineInverse" : "inverse", level, ms, count, scalarMs, check, error < 1e-4f);
+        }
+    }
+
+    // Batch transforms : same bits as scalar
+    for (int vectors = 0; vectors < 2; vectors++) {
+        double scalarMs = 0.0;
+        for (SimdLevel level : levels) {
+            if (clampSimdLevel(level) != level)
+                continue;
+            double ms = benchBestMs(runs, [&]() {
+                if (vectors)
+                    Mat4::transformVectors(models[0], points.data(), moved.data(), pointCount, level);
+                else
+                    Mat4::transformPoints(models[0], points.data(), moved.data(), pointCount, level);
+            });
+            if (level == SimdLevel::Scalar) {
+                scalarMs = ms;
+                expected = moved;
+            }
+            bool same = memcmp(moved.data(), expected.data(), moved.size() * sizeof(float)) == 0;
+            row(vectors ? "transformVectors" : "transformPoints", level, ms, pointCount, scalarMs,
+                same ? "same" : "MISMATCH", same);
+        }
+    }
+    return status;
+}
@@ -0,0 +1,68 @@
+#include <cstdio>
+#include <map>
+#include "bench.hpp"
+#include "../include/parsing.hpp"
+#include "../include/material.hpp"
+
+// Draw list of the given models as ft_scop builds it, without a GL context :
+// textures get an id the first time their path is seen, like TextureCache does,
+// then the state changes of one frame are counted in file order and after sortDrawItems
+
+int benchMaterials(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("materials: expected at least one .obj file\n");
+        return 1;
+    }
+
+    const uint32_t program = 1, defaultTexture = 1;
+    std::map<std::string, uint32_t> textures;
+    std::vector<DrawItem> draws;
+    size_t mapReferences = 0;
+
+    for (size_t o = 0; o < args.size(); o++) {
+        ObjOptions opts;
+        opts.verbose = false;
+        Mesh mesh;
+        if (!loadOBJ(args[o], mesh, opts)) {
+            printf("%s: failed to load\n", args[o].c_str());
+            return 1;
+        }
+        std::vector<Material> materials = resolveMaterials(args[o], mesh.mtllibs, mesh.materials);
+        printf("%-16s %4zu parts %4zu materials %4zu libraries\n", args[o].c_str(),
+            mesh.submeshes.size(), materials.size(), mesh.mtllibs.size());
+
+        for (const SubMesh& sub : mesh.submeshes) {
+            const Material* mat = (sub.materialId >= 0) ? &materials[sub.materialId] : nullptr;
+            DrawItem item = DrawItem();
+            item.program    = program;
+            item.object     = (uint32_t)o;
+            item.firstIndex = sub.firstIndex;
+            item.indexCount = sub.indexCount;
+            item.texture    = defaultTexture;
+            if (mat && !mat->diffuseMap.empty()) {
+                mapReferences++;
+                std::map<std::string, uint32_t>::iterator it = textures.find(mat->diffuseMap);
+                if (it == textures.end())
+                    it = textures.insert(std::make_pair(mat->diffuseMap, (uint32_t)textures.size() + 2)).first;
+                item.texture = it->second;
+                item.hasMap  = true;
+            }
+            draws.push_back(item);
+        }
+    }
+    printf("%zu map_Kd references, %zu images decoded\n\n", mapReferences, textures.size());
+
+    DrawStats before = countDrawState(draws);
+    double sortMs = benchBestMs(5, [&]() {
+        std::vector<DrawItem> copy(draws);
+        sortDrawItems(copy);
+    });
+    sortDrawItems(draws);
+    DrawStats after = countDrawState(draws);
+
+    printf("%-12s %8s %14s %14s %15s\n", "order", "draws", "program binds", "texture binds", "object changes");
+    printf("%-12s %8zu %14zu %14zu %15zu\n", "file", before.draws, before.programBinds, before.textureBinds, before.objectChanges);
+    printf("%-12s %8zu %14zu %14zu %15zu\n", "sorted", after.draws, after.programBinds, after.textureBinds, after.objectChanges);
+    printf("sort: %.4f ms\n", sortMs);
+    return 0;
+}
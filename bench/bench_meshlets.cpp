@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "bench.hpp"
+#include "../include/Mat4.hpp"
+#include "../include/culling.hpp"
+#include "../include/mesh.hpp"
+
+// Meshlets of each model : how many, how full, build time and whether the surface is closed (cone
+// culling is only right when it is), then the culling the renderer would do over a turn of the model
+// with the app's camera, alone and in instanced grids (ft_scop --instances=N), and up close
+// Only the CPU side is measured here : frame times need a GL context (ft_scop with and without --no-cull)
+
+namespace {
+
+struct CullRun {
+    MeshletCullStats stats;
+    size_t draws = 0;
+    double ms = 0.0;
+};
+
+// The scene of render.cpp : one object at the origin turning around Y, copies on a grid scaled to fit,
+// the camera at (d, 0.6 d, d) looking at the origin
+CullRun simulate(const std::vector<Meshlet>& meshlets, bool watertight, int instances, float camDist, int turns) {
+    Mat4 proj = Mat4::perspective(3.14159f / 4.0f, 800.0f / 600.0f, 0.1f, 100.0f);
+    Mat4 view = Mat4::lookAt(camDist, camDist * 0.6f, camDist, 0, 0, 0, 0, 1, 0);
+    Mat4 vp   = Mat4::multiply(proj, view);
+    int columns = 1;
+    while (columns * columns < instances)
+        columns++;
+    MeshletCopies copies = gridCopies(columns);
+
+    CullRun run;
+    std::vector<uint32_t> firsts, counts;
+    double start = benchNowMs();
+    for (int turn = 0; turn < turns; turn++) {
+        Mat4 model = Mat4::rotateY(turn * 2.0f * 3.14159f / turns);
+        Mat4 mvp   = Mat4::multiply(vp, model);
+        Frustum frustum = frustumFromMatrix(mvp.m);
+        // Camera in model space : the rotation is orthonormal, its transpose undoes it
+        float eye[3];
+        for (int i = 0; i < 3; i++)
+            eye[i] = model.m[i * 4] * camDist + model.m[i * 4 + 1] * camDist * 0.6f + model.m[i * 4 + 2] * camDist;
+        // Like the renderer : one test against the box of every copy, the runs left are one multi-draw,
+        // a grid takes an instanced draw per run or a multi-draw per copy, whichever is fewer
+        firsts.clear();
+        counts.clear();
+        cullMeshlets(meshlets.data(), meshlets.size(), frustum, eye, watertight, copies, firsts, counts, run.stats);
+        if (!firsts.empty())
+            run.draws += instances > 0 ? std::min(firsts.size(), (size_t)instances) : 1;
+    }
+    run.ms = (benchNowMs() - start) / turns;
+    return run;
+}
+
+}
+
+int benchMeshlets(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("meshlets: expected at least one .obj file or grid:N\n");
+        return 1;
+    }
+
+    const int turns = 72;
+    int status = 0;
+    for (const std::string& arg : args) {
+        Mesh mesh;
+        if (!benchLoadMesh(arg, mesh)) {
+            printf("%s: failed to load\n", arg.c_str());
+            return 1;
+        }
+        // Like buildModelBuffers leaves it : welded by the smooth normals, in cache order
+        if (mesh.normals.empty())
+            generateSmoothNormals(mesh, NormalOptions().creaseAngle);
+        optimizeVertexCache(mesh);
+        optimizeVertexFetch(mesh);
+
+        double start = benchNowMs();
+        buildMeshlets(mesh);
+        double ms = benchNowMs() - start;
+
+        // Every triangle in exactly one meshlet, meshlets within the limits
+        size_t triangles = mesh.indices.size() / 3, covered = 0, vertexSum = 0, maxVertices = 0;
+        bool ok = mesh.meshletRanges.size() == mesh.submeshes.size() + 1;
+        std::vector<uint32_t> stamp(mesh.vertices.size() / 3, 0xffffffffu);
+        for (size_t m = 0; m < mesh.meshlets.size(); m++) {
+            const Meshlet& meshlet = mesh.meshlets[m];
+            size_t vertices = 0;
+            for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++) {
+                if (stamp[mesh.indices[i]] != m)
+                    vertices++;
+                stamp[mesh.indices[i]] = (uint32_t)m;
+            }
+            ok = ok && meshlet.firstIndex == covered * 3 && vertices <= maxMeshletVertices
+                && meshlet.indexCount / 3 <= maxMeshletTriangles && meshlet.radius >= 0.0f;
+            covered += meshlet.indexCount / 3;
+            vertexSum += vertices;
+            maxVertices = vertices > maxVertices ? vertices : maxVertices;
+        }
+        ok = ok && covered == triangles;
+        if (!ok)
+            status = 1;
+
+        size_t count = mesh.meshlets.size();
+        printf("%s: %zu triangles in %zu meshlets (%.1f triangles, %.1f vertices on average, %zu at most) in %.1f ms, %s, %s\n",
+            arg.c_str(), triangles, count, count ? (double)triangles / count : 0.0,
+            count ? (double)vertexSum / count : 0.0, maxVertices, ms,
+            mesh.watertight ? "watertight" : "open surface (no cone culling)", ok ? "ok" : "BAD");
+
+        // Bounds where the renderer uses them, fitted to the window
+        Bounds bounds = computeBounds(mesh.vertices.data(), mesh.vertices.size() / 3);
+        float center[3], scale;
+        fitBounds(bounds, center, scale);
+        for (Meshlet& m : mesh.meshlets) {
+            for (int a = 0; a < 3; a++)
+                m.center[a] = (m.center[a] - center[a]) * scale;
+            m.radius *= scale;
+        }
+
+        printf("  %-22s %10s %9s %9s %10s %11s %12s\n", "scene", "meshlets", "frustum", "facing", "tris drawn",
+            "draws/frame", "cull ms/frame");
+        struct Scene { const char* name; int instances; float camDist; };
+        const Scene scenes[] = {
+            { "alone, app camera", 0, 6.0f },
+            { "alone, up close", 0, 1.5f },
+            { "grid of 16", 16, 6.0f },
+            { "grid of 256", 256, 6.0f },
+            { "grid of 256, up close", 256, 1.5f },
+        };
+        for (const Scene& scene : scenes) {
+            CullRun run = simulate(mesh.meshlets, mesh.watertight, scene.instances, scene.camDist, turns);
+            const MeshletCullStats& s = run.stats;
+            printf("  %-22s %10zu %8.1f%% %8.1f%% %9.1f%% %11.1f %12.3f\n", scene.name, s.meshlets / turns,
+                100.0 * s.frustumCulled / s.meshlets, 100.0 * s.backFaceCulled / s.meshlets,
+                100.0 * s.drawn / s.triangles, (double)run.draws / turns, run.ms);
+        }
+    }
+    return status;
+}
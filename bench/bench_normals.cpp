@@ -0,0 +1,52 @@
+#include <cstdio>
+#include <cmath>
+#include "bench.hpp"
+#include "../include/mesh.hpp"
+#include "../include/parallel.hpp"
+
+// computeFaceNormals for every SIMD level this CPU has, on one thread and on all of them
+// The scalar single thread run is the reference, every other run must match it bit for bit
+
+int benchNormals(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("normals: expected .obj files or grid:N\n");
+        return 1;
+    }
+
+    unsigned cores = resolveThreadCount(0);
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE, SimdLevel::AVX2 };
+
+    for (const std::string& arg : args) {
+        Mesh mesh;
+        if (!benchLoadMesh(arg, mesh)) {
+            printf("%s: failed to load\n", arg.c_str());
+            return 1;
+        }
+        size_t tris = mesh.indices.size() / 3;
+        int runs = tris > 1000000 ? 3 : 20;
+        printf("%s: %zu triangles, %zu vertices, cpu best %s\n", arg.c_str(), tris, mesh.vertices.size() / 3,
+            simdLevelName(cpuSimdLevel()));
+        printf("  %-8s %8s %10s %12s %12s\n", "level", "threads", "ms", "Mtris/s", "max diff");
+
+        std::vector<float> reference(tris * 3), out(tris * 3);
+        computeFaceNormals(mesh.vertices.data(), mesh.indices.data(), tris, reference.data(), 1, SimdLevel::Scalar);
+
+        for (SimdLevel level : levels) {
+            if (clampSimdLevel(level) != level)
+                continue;
+            const unsigned threadCounts[] = { 1, cores };
+            for (unsigned t = 0; t < (cores > 1 ? 2u : 1u); t++) {
+                unsigned threads = threadCounts[t];
+                double ms = benchBestMs(runs, [&]() {
+                    computeFaceNormals(mesh.vertices.data(), mesh.indices.data(), tris, out.data(), threads, level);
+                });
+                float maxDiff = 0.0f;
+                for (size_t i = 0; i < out.size(); i++)
+                    maxDiff = std::fmax(maxDiff, std::fabs(out[i] - reference[i]));
+                printf("  %-8s %8u %10.2f %12.1f %12g\n", simdLevelName(level), threads, ms,
+                    ms > 0.0 ? tris / (ms * 1000.0) : 0.0, maxDiff);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include "bench.hpp"
+#include "../include/numparse.hpp"
+#include "../include/mapped_file.hpp"
+
+// Number conversion only : every numeric field of the OBJ files is extracted once,
+// then converted by each method (iostream, sscanf, from_chars, numparse.hpp)
+
+namespace {
+
+struct Tokens {
+    std::vector<std::string> floats;    // v / vt / vn fields
+    std::vector<std::string> ints;      // face indices, split on '/'
+};
+
+void collectTokens(const MappedFile& file, Tokens& out) {
+    const char* p = file.data;
+    const char* end = file.data + file.size;
+
+    while (p < end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+
+        std::string line(p, eol);
+        std::istringstream ss(line);
+        std::string type, tok;
+        ss >> type;
+        if (type == "v" || type == "vt" || type == "vn") {
+            while (ss >> tok)
+                out.floats.push_back(tok);
+        }
+        else if (type == "f") {
+            while (ss >> tok) {
+                size_t start = 0;
+                while (start <= tok.size()) {
+                    size_t slash = tok.find('/', start);
+                    if (slash == std::string::npos)
+                        slash = tok.size();
+                    if (slash > start)
+                        out.ints.push_back(tok.substr(start, slash - start));
+                    start = slash + 1;
+                }
+            }
+        }
+        p = eol + 1;
+    }
+}
+
+// Bitwise comparison against strtof, so -0.0f vs 0.0f counts as a mismatch too
+bool sameFloat(float a, float b) {
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+size_t verifyFloats(const std::vector<std::string>& tokens) {
+    size_t bad = 0;
+    for (const std::string& t : tokens) {
+        float fast = 0.0f;
+        const char* next = parseFloat(t.data(), t.data() + t.size(), fast);
+        float ref = strtof(t.c_str(), nullptr);
+        if (next != t.data() + t.size() || !sameFloat(fast, ref)) {
+            if (bad < 5)
+                printf("  mismatch on \"%s\": %.9g vs strtof %.9g\n", t.c_str(), fast, ref);
+            bad++;
+        }
+    }
+    return bad;
+}
+
+// Random values printed the way exporters usually do, plus the shortest round-trip form
+std::vector<std::string> randomFloatTokens(size_t count) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> coord(-1000.0f, 1000.0f);
+    std::uniform_int_distribution<int>    scale(-30, 30);
+    const char* formats[] = { "%f", "%.4f", "%.6f", "%.9g", "%g", "%e" };
+
+    std::vector<std::string> tokens;
+    char buf[64];
+    for (size_t i = 0; i < count; i++) {
+        float v = coord(rng) * powf(10.0f, (float)scale(rng));
+        snprintf(buf, sizeof(buf), formats[i % 6], v);
+        tokens.push_back(buf);
+    }
+    return tokens;
+}
+
+}
+
+int benchNumbers(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("numbers: expected at least one .obj file\n");
+        return 1;
+    }
+
+    int status = 0;
+    printf("%-16s %9s %9s %12s %12s %12s %12s %10s\n", "file", "floats", "ints",
+        "iostream", "sscanf", "from_chars", "numparse", "speedup");
+
+    for (const std::string& path : args) {
+        MappedFile file;
+        if (!file.open(path)) {
+            printf("%s: cannot open\n", path.c_str());
+            return 1;
+        }
+        Tokens tok;
+        collectTokens(file, tok);
+
+        if (verifyFloats(tok.floats) != 0)
+            status = 1;
+
+        // The stream parser reads numbers with operator>> out of one stream per line,
+        // here every field goes through the same stream so we only pay the conversion
+        std::string floatText, intText;
+        for (const std::string& t : tok.floats) { floatText += t; floatText += ' '; }
+        for (const std::string& t : tok.ints)   { intText += t;   intText += ' '; }
+
+        volatile float fsink = 0.0f;
+        volatile int   isink = 0;
+        const int runs = 5;
+
+        double tStream = benchBestMs(runs, [&]() {
+            std::istringstream fs(floatText), is(intText);
+            float f; int i;
+            while (fs >> f) fsink = f;
+            while (is >> i) isink = i;
+        });
+        double tScanf = benchBestMs(runs, [&]() {
+            float f; int i;
+            for (const std::string& t : tok.floats) { sscanf(t.c_str(), "%f", &f); fsink = f; }
+            for (const std::string& t : tok.ints)   { sscanf(t.c_str(), "%d", &i); isink = i; }
+        });
+        double tFromChars = benchBestMs(runs, [&]() {
+            float f = 0; int i = 0;
+            for (const std::string& t : tok.floats) { std::from_chars(t.data(), t.data() + t.size(), f); fsink = f; }
+            for (const std::string& t : tok.ints)   { std::from_chars(t.data(), t.data() + t.size(), i); isink = i; }
+        });
+        double tFast = benchBestMs(runs, [&]() {
+            float f = 0; int i = 0;
+            for (const std::string& t : tok.floats) { parseFloat(t.data(), t.data() + t.size(), f); fsink = f; }
+            for (const std::string& t : tok.ints)   { parseInt(t.data(), t.data() + t.size(), i); isink = i; }
+        });
+
+        // Millions of numbers per second
+        double n = (double)(tok.floats.size() + tok.ints.size());
+        printf("%-16s %9zu %9zu %10.1f M %10.1f M %10.1f M %10.1f M %9.2fx\n", path.c_str(),
+            tok.floats.size(), tok.ints.size(),
+            n / tStream / 1000.0, n / tScanf / 1000.0, n / tFromChars / 1000.0, n / tFast / 1000.0,
+            tStream / tFast);
+    }
+
+    // Exactness check on values the bundled models don't cover (exponents, long mantissas)
+    std::vector<std::string> random = randomFloatTokens(1000000);
+    size_t bad = verifyFloats(random);
+    printf("random round-trip check: %zu / %zu mismatches against strtof\n", bad, random.size());
+    return (bad || status) ? 1 : 0;
+}
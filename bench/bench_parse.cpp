@@ -0,0 +1,57 @@
+#include <cstdio>
+#include <cstring>
+#include "bench.hpp"
+#include "../include/parsing.hpp"
+
+// Compare the stream and mmap OBJ loaders on the same files
+// Both must produce the exact same Mesh, otherwise the numbers are meaningless
+
+static bool sameMesh(const Mesh& a, const Mesh& b) {
+    return a.vertices == b.vertices && a.normals == b.normals && a.uvs == b.uvs && a.indices == b.indices
+        && a.materials == b.materials && a.mtllibs == b.mtllibs && a.submeshes.size() == b.submeshes.size()
+        && memcmp(a.submeshes.data(), b.submeshes.data(), a.submeshes.size() * sizeof(SubMesh)) == 0;
+}
+
+int benchParse(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("parse: expected at least one .obj file\n");
+        return 1;
+    }
+
+    const ObjLoader loaders[] = { ObjLoader::Stream, ObjLoader::Mapped };
+    int status = 0;
+
+    printf("%-16s %10s %12s %12s %10s\n", "file", "size KB", "stream MB/s", "mmap MB/s", "speedup");
+    for (const std::string& path : args) {
+        double mb = benchFileSize(path) / (1024.0 * 1024.0);
+        double ms[2];
+        Mesh ref;
+
+        for (int l = 0; l < 2; l++) {
+            ObjOptions opts;
+            opts.loader  = loaders[l];
+            opts.verbose = false;
+
+            Mesh mesh;
+            if (!loadOBJ(path, mesh, opts)) {
+                printf("%s: failed to load\n", path.c_str());
+                return 1;
+            }
+            if (l == 0)
+                ref = mesh;
+            else if (!sameMesh(ref, mesh)) {
+                printf("%s: %s loader output differs from stream loader\n", path.c_str(), objLoaderName(loaders[l]));
+                status = 1;
+            }
+
+            ms[l] = benchBestMs(5, [&]() {
+                Mesh m;
+                loadOBJ(path, m, opts);
+            });
+        }
+
+        printf("%-16s %10.1f %12.1f %12.1f %9.2fx\n", path.c_str(), mb * 1024.0,
+            mb / (ms[0] / 1000.0), mb / (ms[1] / 1000.0), ms[0] / ms[1]);
+    }
+    return status;
+}
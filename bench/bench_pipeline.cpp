@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "bench.hpp"
+#include "../include/async_loader.hpp"
+#include "../include/memstats.hpp"
+
+// Peak resident memory of a cold load, from the .obj to the GPU buffers, with and without --fused
+// --fused runs twice : without a cache (interleaved straight into the staging) and writing a fresh
+// cache the upload then reads from the mapping of
+// The GPU side is a staging buffer of up to 16 MB (the render loop's default budget) the data goes
+// through piece by piece and gets hashed, so every mode must end with the same hash
+// Every run happens in a forked child : a fresh process, whatever malloc kept from the previous run
+// doesn't hide the next peak
+
+namespace {
+
+struct PipelineRun {
+    bool     ok = false;
+    double   ms = 0.0;
+    double   peakMB = 0.0;        // above the RSS the child started with
+    double   gpuMB = 0.0;
+    uint64_t hash = 0;
+};
+
+const size_t stagingBytes = 16 * 1024 * 1024;
+
+uint64_t hashBytes(uint64_t h, const unsigned char* p, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    return h;
+}
+
+const char* const cacheDir = "/tmp";
+
+PipelineRun runPipeline(const std::string& path, const NormalOptions& normals, bool fused, bool cache) {
+    PipelineRun run;
+    size_t startKB = currentRssKB();
+    resetPeakRss();
+    double start = benchNowMs();
+
+    ObjOptions objOptions;
+    objOptions.verbose = false;
+    MeshCacheOptions cacheOptions;
+    cacheOptions.enabled = cache;
+    cacheOptions.dir     = cacheDir;
+    BuildOptions buildOptions;
+    buildOptions.normals = normals;
+    buildOptions.fused   = fused;
+    std::unique_ptr<LoadedModel> model = loadModel(0, path, objOptions, buildOptions, cacheOptions);
+    if (!model->ok)
+        return run;
+    const MeshView& view = model->view();
+
+    // Upload in staging-sized pieces, the mapped GL buffers of SceneStreamer stand in for the staging
+    // A fused view is interleaved straight into it, like MappedWriter does
+    size_t stride = view.layout.stride;
+    size_t gpuBytes = view.vertexCount * stride + view.indexCount * view.indexSize;
+    std::vector<unsigned char> staging(std::min(stagingBytes, gpuBytes));
+    uint64_t h = 0xcbf29ce484222325ull;
+    size_t perPiece = staging.size() / stride;
+    for (size_t first = 0; first < view.vertexCount; first += perPiece) {
+        size_t n = std::min(perPiece, view.vertexCount - first);
+        copyViewVertices(view, first, n, staging.data());
+        h = hashBytes(h, staging.data(), n * stride);
+    }
+    perPiece = staging.size() / view.indexSize;
+    for (size_t first = 0; first < view.indexCount; first += perPiece) {
+        size_t n = std::min(perPiece, view.indexCount - first);
+        copyViewIndices(view, first, n, staging.data());
+        h = hashBytes(h, staging.data(), n * view.indexSize);
+    }
+    run.gpuMB = gpuBytes / (1024.0 * 1024.0);
+    model.reset();
+
+    run.ms     = benchNowMs() - start;
+    run.peakMB = (peakRssKB() - startKB) / 1024.0;
+    run.hash   = h;
+    run.ok     = true;
+    return run;
+}
+
+bool runInChild(const std::string& path, const NormalOptions& normals, bool fused, bool cache, PipelineRun& out) {
+    // Always a cold start
+    MeshCacheOptions cacheOptions;
+    cacheOptions.dir = cacheDir;
+    std::string cachePath = meshCachePath(path, cacheOptions);
+    remove(cachePath.c_str());
+
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        // The pipeline prints what it generates, keep the table readable
+        if (!freopen("/dev/null", "w", stdout))
+            _exit(1);
+        PipelineRun run = runPipeline(path, normals, fused, cache);
+        ssize_t written = write(fds[1], &run, sizeof(run));
+        _exit(written == (ssize_t)sizeof(run) ? 0 : 1);
+    }
+    close(fds[1]);
+    bool ok = pid > 0 && read(fds[0], &out, sizeof(out)) == (ssize_t)sizeof(out);
+    close(fds[0]);
+    if (pid > 0)
+        waitpid(pid, nullptr, 0);
+    remove(cachePath.c_str());
+    return ok && out.ok;
+}
+
+}
+
+int benchPipeline(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("pipeline: expected at least one .obj file\n");
+        return 1;
+    }
+
+    printf("%-16s %-8s %10s %12s %10s %12s %10s %12s %10s %8s\n", "file", "normals", "GPU MB",
+        "copies ms", "peak MB", "fused ms", "peak MB", "+cache ms", "peak MB", "same");
+    for (const std::string& path : args) {
+        for (int smooth = 1; smooth >= 0; smooth--) {
+            NormalOptions normals;
+            normals.smooth = smooth;
+            PipelineRun runs[3];
+            if (!runInChild(path, normals, false, false, runs[0]) || !runInChild(path, normals, true, false, runs[1])
+                || !runInChild(path, normals, true, true, runs[2])) {
+                printf("%s: failed to load\n", path.c_str());
+                return 1;
+            }
+            bool same = runs[0].hash == runs[1].hash && runs[0].hash == runs[2].hash;
+            printf("%-16s %-8s %10.2f %12.2f %10.1f %12.2f %10.1f %12.2f %10.1f %8s\n", path.c_str(),
+                smooth ? "smooth" : "flat", runs[0].gpuMB, runs[0].ms, runs[0].peakMB, runs[1].ms, runs[1].peakMB,
+                runs[2].ms, runs[2].peakMB, same ? "yes" : "MISMATCH");
+        }
+    }
+    return 0;
+}
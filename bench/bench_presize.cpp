@@ -0,0 +1,45 @@
+#include <cstdio>
+#include "bench.hpp"
+#include "../include/parsing.hpp"
+
+// mmap loader with and without the counting pre-pass : load time, buffer reallocations
+// and how much the resident memory grew during the load
+
+int benchPresize(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("presize: expected at least one .obj file\n");
+        return 1;
+    }
+
+    printf("%-16s %9s %10s %10s %12s %10s %10s %12s\n", "file", "MB",
+        "grow ms", "reallocs", "peak +MB", "sized ms", "reallocs", "peak +MB");
+    for (const std::string& path : args) {
+        double ms[2];
+        ObjLoadStats stats[2];
+
+        for (int presize = 0; presize < 2; presize++) {
+            ObjOptions opts;
+            opts.verbose = false;
+            opts.presize = presize;
+
+            // The peak is measured on the first load, later runs reuse memory malloc kept around
+            {
+                Mesh mesh;
+                if (!loadOBJ(path, mesh, opts, &stats[presize])) {
+                    printf("%s: failed to load\n", path.c_str());
+                    return 1;
+                }
+            }
+            ms[presize] = benchBestMs(3, [&]() {
+                Mesh mesh;
+                loadOBJ(path, mesh, opts);
+            });
+        }
+
+        printf("%-16s %9.1f %10.2f %10zu %12.1f %10.2f %10zu %12.1f\n", path.c_str(),
+            benchFileSize(path) / (1024.0 * 1024.0),
+            ms[0], stats[0].reallocations, (stats[0].peakRssKB - stats[0].startRssKB) / 1024.0,
+            ms[1], stats[1].reallocations, (stats[1].peakRssKB - stats[1].startRssKB) / 1024.0);
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "bench.hpp"
+#include "../include/scene_graph.hpp"
+#include "../include/transforms.hpp"
+
+// A hierarchy of N nodes where a few percent of them (1% by default) turn a bit every frame
+// Each node hangs under a random earlier one, which gives a bushy tree a dozen levels deep, and the
+// animated nodes are picked at random : some are leaves, some carry big subtrees
+// Per frame : nodes changed, world matrices remade, update time, against remaking every matrix like
+// a graph without dirty flags does. Checks : the world matrices have the bits of the full remake
+
+namespace {
+
+uint64_t randomState = 0x9E3779B97F4A7C15ull;
+
+float random01() {
+    randomState = randomState * 6364136223846793005ull + 1442695040888963407ull;
+    return (float)((randomState >> 40) & 0xffffff) / 16777216.0f;
+}
+
+// Every world matrix from scratch, in id order (parents have lower ids)
+void remakeAll(const SceneGraph &graph, std::vector<Mat4> &worlds) {
+    for (uint32_t id = 0; id < graph.size(); id++) {
+        const NodeTransform &t = graph.local(id);
+        Mat4 local = trsMatrix(t.position, t.rotation, t.scale);
+        uint32_t p = graph.parent(id);
+        worlds[id] = p == SceneGraph::noParent ? local : Mat4::multiply(worlds[p], local, bestSimdLevel());
+    }
+}
+
+}
+
+int benchScenegraph(const BenchArgs& args) {
+    size_t n = 100000;
+    double percent = 1.0;
+    for (const std::string& a : args) {
+        if (a.rfind("--animated=", 0) == 0)
+            percent = std::atof(a.c_str() + 11);
+        else
+            n = strtoull(a.c_str(), nullptr, 10);
+    }
+    if (n == 0 || !(percent >= 0.0 && percent <= 100.0)) {
+        printf("scenegraph: expected [nodes] [--animated=PERCENT]\n");
+        return 1;
+    }
+
+    SceneGraph graph;
+    for (size_t i = 0; i < n; i++) {
+        NodeTransform t;
+        for (int a = 0; a < 3; a++) {
+            t.position[a] = random01() * 4.0f - 2.0f;
+            t.scale[a] = 0.9f + random01() * 0.2f;
+        }
+        axisAngleQuaternion(random01() - 0.5f, random01() - 0.5f, random01() - 0.5f, random01() * 6.2831853f,
+                            t.rotation);
+        graph.add(i == 0 ? SceneGraph::noParent : (uint32_t)(random01() * i), t);
+    }
+    double start = benchNowMs();
+    SceneGraphStats first = graph.update();
+    double firstMs = benchNowMs() - start;
+
+    size_t animatedCount = (size_t)(n * percent / 100.0);
+    std::vector<uint32_t> animated(animatedCount);
+    std::vector<float> axes(animatedCount * 3);
+    for (size_t k = 0; k < animatedCount; k++) {
+        animated[k] = (uint32_t)(random01() * n);
+        for (int a = 0; a < 3; a++)
+            axes[k * 3 + a] = random01() - 0.5f;
+    }
+
+    const int frames = 100;
+    size_t dirty = 0, recomputed = 0, worstRecomputed = 0;
+    double ms = 0.0, worstMs = 0.0;
+    for (int f = 1; f <= frames; f++) {
+        for (size_t k = 0; k < animatedCount; k++) {
+            NodeTransform t = graph.local(animated[k]);
+            axisAngleQuaternion(axes[k * 3], axes[k * 3 + 1], axes[k * 3 + 2], f * 0.01f, t.rotation);
+            graph.setLocal(animated[k], t);
+        }
+        start = benchNowMs();
+        SceneGraphStats stats = graph.update();
+        double frameMs = benchNowMs() - start;
+        ms += frameMs;
+        worstMs = std::fmax(worstMs, frameMs);
+        dirty += stats.dirty;
+        recomputed += stats.recomputed;
+        worstRecomputed = stats.recomputed > worstRecomputed ? stats.recomputed : worstRecomputed;
+    }
+
+    std::vector<Mat4> worlds(n);
+    double fullMs = benchBestMs(10, [&]() { remakeAll(graph, worlds); });
+    bool same = true;
+    for (uint32_t id = 0; id < n && same; id++)
+        same = memcmp(&worlds[id], &graph.world(id), sizeof(Mat4)) == 0;
+
+    printf("%zu nodes, %zu animated (%.2f%%), %s\n", n, animatedCount, percent, simdLevelName(bestSimdLevel()));
+    printf("  first update (depth-first order + every matrix): %zu matrices, %.3f ms\n", first.recomputed, firstMs);
+    printf("  per frame over %d frames: %.0f nodes changed, %.0f matrices remade (%zu at most, %.2f%% of the nodes), "
+        "%.3f ms (%.3f at most)\n", frames, (double)dirty / frames, (double)recomputed / frames, worstRecomputed,
+        100.0 * recomputed / frames / n, ms / frames, worstMs);
+    printf("  every matrix remade: %zu matrices, %.3f ms, %.1fx the dirty update | same matrices: %s\n", n, fullMs,
+        fullMs / (ms / frames), same ? "yes" : "NO");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#include <cstdio>
+#include "bench.hpp"
+#include "../include/mesh.hpp"
+#include "../include/parallel.hpp"
+
+// Flat normals (one vertex per corner) versus smooth normals with a 60 and a 180 degree crease
+// Smooth runs go over 1, 2, 4 ... threads up to the core count (at least 4, so the split is always
+// exercised) and must give the same mesh every time
+
+static bool sameMesh(const Mesh& a, const Mesh& b) {
+    return a.vertices == b.vertices && a.normals == b.normals && a.uvs == b.uvs && a.indices == b.indices;
+}
+
+int benchSmooth(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("smooth: expected .obj files or grid:N\n");
+        return 1;
+    }
+    unsigned maxThreads = resolveThreadCount(0) > 4 ? resolveThreadCount(0) : 4;
+
+    for (const std::string& arg : args) {
+        Mesh source;
+        if (!benchLoadMesh(arg, source)) {
+            printf("%s: failed to load\n", arg.c_str());
+            return 1;
+        }
+        source.normals.clear();
+        size_t tris = source.indices.size() / 3;
+        int runs = tris > 1000000 ? 1 : 10;
+        printf("%s: %zu triangles, %zu input vertices\n", arg.c_str(), tris, source.vertices.size() / 3);
+        printf("  %-12s %8s %10s %12s %12s %10s\n", "normals", "threads", "ms", "Mtris/s", "vertices", "per tri");
+
+        Mesh flat;
+        double ms = benchBestMs(runs, [&]() {
+            flat = source;
+            generateNormals(flat, 1);
+        });
+        printf("  %-12s %8u %10.2f %12.1f %12zu %10.2f\n", "flat", 1u, ms, tris / (ms * 1000.0),
+            flat.vertices.size() / 3, (flat.vertices.size() / 3) / (double)tris);
+
+        const float creases[] = { 60.0f, 180.0f };
+        for (float crease : creases) {
+            Mesh reference;
+            for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+                Mesh smooth;
+                ms = benchBestMs(runs, [&]() {
+                    smooth = source;
+                    generateSmoothNormals(smooth, crease, threads);
+                });
+                if (threads == 1)
+                    reference = smooth;
+                char name[32];
+                snprintf(name, sizeof(name), "smooth %.0f", crease);
+                printf("  %-12s %8u %10.2f %12.1f %12zu %10.2f%s\n", name, threads, ms, tris / (ms * 1000.0),
+                    smooth.vertices.size() / 3, (smooth.vertices.size() / 3) / (double)tris,
+                    sameMesh(smooth, reference) ? "" : "  MISMATCH");
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <cstdio>
+#include "bench.hpp"
+#include "../include/parsing.hpp"
+#include "../include/parallel.hpp"
+
+// Speedup of the chunked mmap loader against its own serial run (threads = 1)
+// Every thread count must give exactly the serial mesh
+
+int benchThreads(const BenchArgs& args) {
+    if (args.empty()) {
+        printf("threads: expected at least one .obj file\n");
+        return 1;
+    }
+
+    unsigned maxThreads = resolveThreadCount(0);
+    if (maxThreads < 16)
+        maxThreads = 16;
+    int status = 0;
+
+    for (const std::string& path : args) {
+        double mb = benchFileSize(path) / (1024.0 * 1024.0);
+        printf("%s (%.1f MB, %u hardware threads)\n", path.c_str(), mb, resolveThreadCount(0));
+        printf("  %8s %10s %10s %9s\n", "threads", "ms", "MB/s", "speedup");
+
+        ObjOptions opts;
+        opts.verbose = false;
+        opts.threads = 1;
+        Mesh serial;
+        if (!loadOBJ(path, serial, opts)) {
+            printf("%s: failed to load\n", path.c_str());
+            return 1;
+        }
+
+        double serialMs = 0.0;
+        for (unsigned t = 1; t <= maxThreads; t *= 2) {
+            opts.threads = t;
+            Mesh mesh;
+            loadOBJ(path, mesh, opts);
+            if (mesh.vertices != serial.vertices || mesh.normals != serial.normals || mesh.uvs != serial.uvs
+                || mesh.indices != serial.indices) {
+                printf("  %u threads: output differs from the serial loader\n", t);
+                status = 1;
+            }
+            mesh = Mesh();
+
+            double ms = benchBestMs(3, [&]() {
+                Mesh m;
+                loadOBJ(path, m, opts);
+            });
+            if (t == 1)
+                serialMs = ms;
+            printf("  %8u %10.1f %10.1f %8.2fx\n", t, ms, mb / (ms / 1000.0), serialMs / ms);
+        }
+    }
+    return status;
+}
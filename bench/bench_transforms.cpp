@@ -0,0 +1,148 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "bench.hpp"
+#include "../include/transforms.hpp"
+#include "../include/parallel.hpp"
+
+// Model and MVP matrices of N objects per frame, the way renderLoop used to make them (a rotation, a
+// translation and two Mat4::multiply per object) against computeTransforms at every SIMD level, on one
+// thread and on all of them. Objects have a random position, rotation axis and angle, and scale
+// Then viewProj * model alone (computeMvps, for models made elsewhere) against a loop of Mat4 products
+// Checks : every level gives the scalar level's bits, and stays within float rounding of the old way.
+// computeMvps gives computeTransforms' MVPs bit for bit
+
+namespace {
+
+uint64_t randomState = 0x2545F4914F6CDD1Dull;
+
+float random01() {
+    randomState = randomState * 6364136223846793005ull + 1442695040888963407ull;
+    return (float)((randomState >> 40) & 0xffffff) / 16777216.0f;
+}
+
+struct Source {
+    float position[3], axis[3], angle, scale[3];
+};
+
+// Per object, like the render loop did
+void oldTransforms(const std::vector<Source>& objects, const Mat4& viewProj, Mat4* models, Mat4* mvps) {
+    for (size_t i = 0; i < objects.size(); i++) {
+        const Source& o = objects[i];
+        Mat4 scale = Mat4::identity();
+        scale.m[0] = o.scale[0];
+        scale.m[5] = o.scale[1];
+        scale.m[10] = o.scale[2];
+        Mat4 rotation = Mat4::rotateAxis(o.axis[0], o.axis[1], o.axis[2], o.angle);
+        Mat4 translation = Mat4::translate(o.position[0], o.position[1], o.position[2]);
+        models[i] = Mat4::multiply(translation, Mat4::multiply(rotation, scale));
+        mvps[i] = Mat4::multiply(viewProj, models[i]);
+    }
+}
+
+// Largest difference over all elements, relative to the largest element of the matrix
+double largestDifference(const std::vector<Mat4>& a, const std::vector<Mat4>& b) {
+    double worst = 0.0;
+    for (size_t i = 0; i < a.size(); i++) {
+        double largest = 0.0, diff = 0.0;
+        for (int k = 0; k < 16; k++) {
+            largest = std::fmax(largest, std::fabs(b[i].m[k]));
+            diff = std::fmax(diff, std::fabs(a[i].m[k] - b[i].m[k]));
+        }
+        worst = std::fmax(worst, diff / largest);
+    }
+    return worst;
+}
+
+}
+
+int benchTransforms(const BenchArgs& args) {
+    std::vector<size_t> counts;
+    for (const std::string& a : args)
+        counts.push_back(strtoull(a.c_str(), nullptr, 10));
+    if (counts.empty())
+        counts = { 1000, 100000, 1000000 };
+    for (size_t n : counts)
+        if (n == 0) {
+            printf("transforms: expected object counts\n");
+            return 1;
+        }
+
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE, SimdLevel::AVX2 };
+    unsigned threads = resolveThreadCount(0);
+    Mat4 viewProj = Mat4::multiply(Mat4::perspective(3.14159f / 4.0f, 800.0f / 600.0f, 0.1f, 100.0f),
+                                   Mat4::lookAt(6.0f, 3.6f, 6.0f, 0, 0, 0, 0, 1, 0));
+    int status = 0;
+    printf("cpu best %s, %u threads\n", simdLevelName(cpuSimdLevel()), threads);
+    for (size_t n : counts) {
+        std::vector<Source> sources(n);
+        ObjectTransforms transforms;
+        transforms.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            Source& s = sources[i];
+            for (int a = 0; a < 3; a++) {
+                s.position[a] = random01() * 200.0f - 100.0f;
+                s.axis[a] = random01() - 0.5f;
+                s.scale[a] = 0.5f + random01() * 2.0f;
+            }
+            s.angle = random01() * 6.2831853f;
+            float q[4];
+            axisAngleQuaternion(s.axis[0], s.axis[1], s.axis[2], s.angle, q);
+            transforms.set(i, s.position, q, s.scale);
+        }
+
+        // Keeps small counts timed over a few milliseconds
+        int runs = n >= 1000000 ? 5 : n >= 100000 ? 20 : 200;
+        std::vector<Mat4> oldModels(n), oldMvps(n), models(n), mvps(n), refModels, refMvps;
+        double oldMs = benchBestMs(runs, [&]() { oldTransforms(sources, viewProj, oldModels.data(), oldMvps.data()); });
+        printf("%zu objects\n  %-8s %8s %10s %12s %9s %6s %12s\n", n, "level", "threads", "ms", "Mobjects/s",
+            "speedup", "same", "vs old");
+        printf("  %-8s %8u %10.3f %12.2f %8.2fx %6s %12s\n", "old", 1u, oldMs, n / (oldMs * 1000.0), 1.0, "-", "-");
+
+        for (SimdLevel level : levels) {
+            if (clampSimdLevel(level) != level)
+                continue;
+            for (unsigned t = 1; t <= threads; t = t < threads ? threads : t + 1) {
+                double ms = benchBestMs(runs, [&]() {
+                    computeTransforms(transforms, viewProj, models.data(), mvps.data(), t, level);
+                });
+                if (refModels.empty()) {
+                    refModels = models;
+                    refMvps = mvps;
+                }
+                bool same = memcmp(models.data(), refModels.data(), n * sizeof(Mat4)) == 0
+                    && memcmp(mvps.data(), refMvps.data(), n * sizeof(Mat4)) == 0;
+                double difference = std::fmax(largestDifference(models, oldModels), largestDifference(mvps, oldMvps));
+                bool ok = same && difference < 1e-5;
+                if (!ok)
+                    status = 1;
+                printf("  %-8s %8u %10.3f %12.2f %8.2fx %6s %12.1e\n", simdLevelName(level), t, ms,
+                    n / (ms * 1000.0), oldMs / ms, same ? "yes" : "NO", difference);
+            }
+        }
+
+        // MVPs of models that aren't TRS (the scene graph's world matrices), from the models above
+        std::vector<Mat4> mvpOnly(n);
+        double loopMs = benchBestMs(runs, [&]() {
+            for (size_t i = 0; i < n; i++)
+                mvpOnly[i] = viewProj * refModels[i];
+        });
+        printf("  viewProj * model only\n  %-8s %8u %10.3f %12.2f %8.2fx %6s %12s\n", "loop", 1u, loopMs,
+            n / (loopMs * 1000.0), 1.0, "-", "-");
+        for (SimdLevel level : levels) {
+            if (clampSimdLevel(level) != level)
+                continue;
+            double ms = benchBestMs(runs, [&]() {
+                computeMvps(viewProj, refModels.data(), mvpOnly.data(), n, 1, level);
+            });
+            bool same = memcmp(mvpOnly.data(), refMvps.data(), n * sizeof(Mat4)) == 0;
+            if (!same)
+                status = 1;
+            printf("  %-8s %8u %10.3f %12.2f %8.2fx %6s %12s\n", simdLevelName(level), 1u, ms, n / (ms * 1000.0),
+                loopMs / ms, same ? "yes" : "NO", "-");
+        }
+    }
+    return status;
+}
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include "bench.hpp"
+#include "../include/mesh.hpp"
+
+// Post-transform cache reuse before / after optimizeVertexCache, simulated FIFO of 16 (and 32 to see
+// how it holds on a bigger cache than it was tuned for)
+// --shuffle randomizes the triangles inside each submesh first, the order a scanner or a careless
+// exporter gives. Every submesh must keep the same triangles, corners in the same order
+
+namespace {
+
+typedef std::array<uint32_t, 3> Triangle;
+
+// Triangles of every submesh, sorted, to check nothing was lost or turned around
+std::vector<Triangle> sortedTriangles(const Mesh& mesh) {
+    std::vector<Triangle> out(mesh.indices.size() / 3);
+    for (size_t t = 0; t < out.size(); t++)
+        out[t] = { mesh.indices[t * 3], mesh.indices[t * 3 + 1], mesh.indices[t * 3 + 2] };
+    for (const SubMesh& sub : mesh.submeshes)
+        std::sort(out.begin() + sub.firstIndex / 3, out.begin() + (sub.firstIndex + sub.indexCount) / 3);
+    return out;
+}
+
+void shuffleTriangles(Mesh& mesh) {
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (const SubMesh& sub : mesh.submeshes) {
+        uint32_t* first = &mesh.indices[sub.firstIndex];
+        for (size_t t = sub.indexCount / 3; t > 1; t--) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            size_t other = (state >> 33) % t;
+            for (int k = 0; k < 3; k++)
+                std::swap(first[(t - 1) * 3 + k], first[other * 3 + k]);
+        }
+    }
+}
+
+}
+
+int benchVcache(const BenchArgs& args) {
+    bool shuffle = false;
+    std::vector<std::string> files;
+    for (const std::string& a : args) {
+        if (a == "--shuffle")
+            shuffle = true;
+        else
+            files.push_back(a);
+    }
+    if (files.empty()) {
+        printf("vcache: expected at least one .obj file or grid:N [--shuffle]\n");
+        return 1;
+    }
+
+    int status = 0;
+    printf("%-16s %10s %8s %8s %8s %8s %9s %10s %10s %10s %6s\n", "file", "tris", "ACMR in", "ACMR", "ATVR in",
+        "ATVR", "ACMR/32", "tipsify ms", "fetch ms", "Mtris/s", "same");
+    for (const std::string& arg : files) {
+        Mesh mesh;
+        if (!benchLoadMesh(arg, mesh)) {
+            printf("%s: failed to load\n", arg.c_str());
+            return 1;
+        }
+        // Smooth normals share vertices between faces, like buildModelBuffers would leave them
+        if (mesh.normals.empty())
+            generateSmoothNormals(mesh, NormalOptions().creaseAngle);
+        if (shuffle)
+            shuffleTriangles(mesh);
+
+        size_t vertexCount = mesh.vertices.size() / 3;
+        VertexCacheStats before = simulateVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount);
+        std::vector<Triangle> triangles = sortedTriangles(mesh);
+
+        double start = benchNowMs();
+        optimizeVertexCache(mesh);
+        double tipsifyMs = benchNowMs() - start;
+        bool same = sortedTriangles(mesh) == triangles;
+        std::vector<Triangle>().swap(triangles);
+
+        start = benchNowMs();
+        optimizeVertexFetch(mesh);
+        double fetchMs = benchNowMs() - start;
+
+        VertexCacheStats after = simulateVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount);
+        VertexCacheStats after32 = simulateVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount, 32);
+        printf("%-16s %10zu %8.3f %8.3f %8.3f %8.3f %9.3f %10.1f %10.1f %10.1f %6s\n", arg.c_str(),
+            before.triangles, before.acmr(), after.acmr(), before.atvr(), after.atvr(), after32.acmr(),
+            tipsifyMs, fetchMs, before.triangles / ((tipsifyMs + fetchMs) * 1000.0), same ? "yes" : "NO");
+        if (!same)
+            status = 1;
+    }
+    return status;
+}
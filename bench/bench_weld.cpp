@@ -0,0 +1,134 @@
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include "bench.hpp"
+#include "../include/mesh.hpp"
+#include "../include/parallel.hpp"
+
+// Welding a triangle soup back into an indexed mesh
+// Every model is exploded into one vertex per corner (what an STL conversion gives), with a rotated copy
+// and a collapsed triangle added after every 100th triangle. --jitter moves every corner by up to 0.4
+// epsilon on each axis, like a CAD export writing the same point with different rounding
+// Checks : no more vertices than the indexed model had, every added triangle removed and nothing else
+// than that and the defects the model already had
+
+namespace {
+
+uint64_t jitterState = 0x9E3779B97F4A7C15ull;
+
+float jitter(float amount) {
+    jitterState = jitterState * 6364136223846793005ull + 1442695040888963407ull;
+    return ((float)((jitterState >> 40) & 0xffffff) / 16777216.0f * 2.0f - 1.0f) * amount;
+}
+
+// One vertex per corner, defects added in the same submesh as the triangle they copy
+void explode(Mesh& mesh, float move, size_t& added, size_t& collapsed) {
+    Mesh soup;
+    soup.materials.swap(mesh.materials);
+    auto corner = [&](uint32_t v) {
+        for (int a = 0; a < 3; a++)
+            soup.vertices.push_back(mesh.vertices[(size_t)v * 3 + a] + jitter(move));
+        if (!mesh.normals.empty())
+            soup.normals.insert(soup.normals.end(), &mesh.normals[(size_t)v * 3], &mesh.normals[(size_t)v * 3] + 3);
+        if (!mesh.uvs.empty())
+            soup.uvs.insert(soup.uvs.end(), &mesh.uvs[(size_t)v * 2], &mesh.uvs[(size_t)v * 2] + 2);
+        soup.indices.push_back((uint32_t)soup.indices.size());
+    };
+    size_t corners = mesh.indices.size() * 102 / 100 + 6;
+    soup.vertices.reserve(corners * 3);
+    soup.indices.reserve(corners);
+    for (const SubMesh& sub : mesh.submeshes) {
+        SubMesh out = sub;
+        out.firstIndex = (uint32_t)soup.indices.size();
+        for (size_t t = sub.firstIndex / 3; t < (sub.firstIndex + sub.indexCount) / 3; t++) {
+            const uint32_t* c = &mesh.indices[t * 3];
+            for (int k = 0; k < 3; k++)
+                corner(c[k]);
+            if (t % 100 == 0) {
+                corner(c[1]), corner(c[2]), corner(c[0]);
+                corner(c[0]), corner(c[0]), corner(c[1]);
+                added++;
+                collapsed++;
+            }
+        }
+        out.indexCount = (uint32_t)(soup.indices.size() - out.firstIndex);
+        soup.submeshes.push_back(out);
+    }
+    mesh = Mesh();
+    mesh.vertices.swap(soup.vertices);
+    mesh.normals.swap(soup.normals);
+    mesh.uvs.swap(soup.uvs);
+    mesh.indices.swap(soup.indices);
+    mesh.submeshes.swap(soup.submeshes);
+    mesh.materials.swap(soup.materials);
+}
+
+}
+
+int benchWeld(const BenchArgs& args) {
+    float epsilon = defaultWeldEpsilon;
+    bool jittered = false;
+    std::vector<std::string> files;
+    for (const std::string& a : args) {
+        if (a.rfind("--eps=", 0) == 0)
+            epsilon = (float)std::atof(a.c_str() + 6);
+        else if (a == "--jitter")
+            jittered = true;
+        else
+            files.push_back(a);
+    }
+    if (files.empty()) {
+        printf("weld: expected at least one .obj file or grid:N [--eps=E] [--jitter]\n");
+        return 1;
+    }
+
+    unsigned threads = resolveThreadCount(0);
+    int status = 0;
+    printf("%-16s %10s %10s %10s %10s %9s %9s %9s %9s %10s %6s\n", "file", "indexed", "soup", "welded", "tris",
+        "degen", "dupes", "1 thr ms", "all ms", "Mverts/s", "ok");
+    for (const std::string& arg : files) {
+        Mesh mesh;
+        if (!benchLoadMesh(arg, mesh)) {
+            printf("%s: failed to load\n", arg.c_str());
+            return 1;
+        }
+        size_t indexed = mesh.vertices.size() / 3, triangles = mesh.indices.size() / 3;
+        Mesh copy = mesh;
+        WeldStats own = weldVertices(copy, epsilon);
+        copy = Mesh();
+        Bounds box = computeBounds(mesh.vertices.data(), indexed);
+        float diagonal = 0.0f;
+        for (int a = 0; a < 3; a++)
+            diagonal += (box.max[a] - box.min[a]) * (box.max[a] - box.min[a]);
+        float move = jittered ? 0.4f * epsilon * std::sqrt(diagonal) : 0.0f;
+        size_t added = 0, collapsed = 0;
+        explode(mesh, move, added, collapsed);
+        size_t soupVertices = mesh.vertices.size() / 3;
+
+        // The last run is kept, the first one only when there is a single thread count to try
+        double ms[2] = { 0.0, 0.0 };
+        WeldStats stats;
+        unsigned counts[2] = { 1, threads };
+        for (int i = threads > 1 ? 0 : 1; i < 2; i++) {
+            Mesh soup = i == 0 ? mesh : Mesh();
+            if (i == 1)
+                soup = std::move(mesh);
+            double start = benchNowMs();
+            stats = weldVertices(soup, epsilon, counts[i]);
+            ms[i] = benchNowMs() - start;
+        }
+        if (threads == 1)
+            ms[0] = ms[1];
+
+        size_t extra = stats.degenerate + stats.duplicates - collapsed - added;
+        bool ok = stats.verticesOut <= indexed && stats.degenerate >= collapsed && stats.duplicates >= added
+            && stats.trianglesOut + extra == triangles && extra <= own.degenerate + own.duplicates;
+        if (!ok)
+            status = 1;
+        printf("%-16s %10zu %10zu %10zu %10zu %9zu %9zu %9.1f %9.1f %10.1f %6s\n", arg.c_str(), indexed,
+            soupVertices, stats.verticesOut, stats.trianglesOut, stats.degenerate, stats.duplicates, ms[0], ms[1],
+            soupVertices / (ms[1] * 1000.0), ok ? "yes" : "NO");
+    }
+    return status;
+}
@@ -0,0 +1,65 @@
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include "bench.hpp"
+
+// scop_bench : CPU side benchmarks for ft_scop, no window or GL context needed
+// Usage : scop_bench <command> [args...]
+
+struct BenchCommand {
+    const char* name;
+    const char* usage;
+    int (*run)(const BenchArgs& args);
+};
+
+static const BenchCommand commands[] = {
+    { "parse", "model.obj [...]   parse throughput of each OBJ loader", benchParse },
+    { "numbers", "model.obj [...]   number conversion: iostream / sscanf / from_chars / numparse", benchNumbers },
+    { "threads", "model.obj [...]   chunked mmap loader speedup per thread count", benchThreads },
+    { "gen",     "faces out.obj     write a synthetic grid mesh with about that many triangles", benchGen },
+    { "index",   "model.obj [...]   GPU memory as triangle soup versus indexed", benchIndex },
+    { "cache",   "model.obj [...]   cold start versus mapped .scopbin warm start", benchCache },
+    { "faces",   "model.obj [...]   face record parsing, old sscanf code versus readFace", benchFaces },
+    { "presize", "model.obj [...]   mmap loader with and without the counting pre-pass", benchPresize },
+    { "materials", "model.obj [...]   draw calls and texture binds per frame, file order versus sorted", benchMaterials },
+    { "async",   "model.obj [...]   first / last model ready, serial loading versus worker threads", benchAsync },
+    { "normals", "model.obj|grid:N   face normals per SIMD level and thread count", benchNormals },
+    { "smooth",  "model.obj|grid:N   flat versus smooth normals: time per thread count and vertex sharing", benchSmooth },
+    { "bounds",  "[points]          box + bounding sphere of synthetic clouds per SIMD level (100M points by default)", benchBounds },
+    { "pipeline", "model.obj [...]   peak RSS of a cold load to the GPU, copies versus --fused, no cache and cache", benchPipeline },
+    { "formats", "model.obj|grid:N   vertex buffer size and precision of each vertex format", benchFormats },
+    { "vcache",  "model.obj|grid:N [--shuffle]   post-transform cache reuse before / after the reorder", benchVcache },
+    { "lod",     "model.obj|grid:N   level of detail chain: triangles, error, checks and triangles per frame", benchLod },
+    { "meshlets", "model.obj|grid:N   meshlets per model and how many frustum / cone culling skips", benchMeshlets },
+    { "bvh",     "model.obj|grid:N   BVH build time and ray queries per second against testing every triangle", benchBvh },
+    { "weld",    "model.obj|grid:N [--eps=E] [--jitter]   triangle soup welded back: vertices, removed triangles, time", benchWeld },
+    { "mat4",    "[matrices] [points]   Mat4 multiply, transpose, inverses and batch transforms at every SIMD level", benchMat4 },
+    { "transforms", "[objects...]   model and MVP matrices of N objects: per object Mat4 calls against the batched SIMD kernels", benchTransforms },
+    { "chain",   "[objects]   viewProj * translate * rotate per object: time and instructions of multiply and computeTransforms", benchChain },
+    { "scenegraph", "[nodes] [--animated=P]   hierarchy update with dirty flags: matrices remade per frame and time against remaking all", benchScenegraph },
+    { "cull",    "[objects...]   whole object frustum culling: world bounds update and sphere + box test per SIMD level", benchCull },
+};
+
+size_t benchFileSize(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+static void usage(const char* self) {
+    printf("Usage: %s <command> [args...]\n", self);
+    for (const BenchCommand& cmd : commands)
+        printf("  %-9s %s\n", cmd.name, cmd.usage);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (const BenchCommand& cmd : commands) {
+        if (strcmp(cmd.name, argv[1]) == 0)
+            return cmd.run(BenchArgs(argv + 2, argv + argc));
+    }
+    usage(argv[0]);
+    return 1;
+}
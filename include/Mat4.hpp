@@ -1,31 +1,333 @@
 #ifndef MAT4_HPP
 #define MAT4_HPP
 
+#include <cstddef>
+#include "constexpr_math.hpp"
+#include "simd.hpp"
+
+// Basically a matrix is a way to transform a 3D point
+// It's just numbers in an array but positioned in a certain way
+// so our GPU knows what to do with the 3D point (rotate, scale, move...)
+
 // Our 4x4 matrix, in a 16 float array, visual representation would be :
 //
 //  a b c d
 //  e f g h
 //  i j k l
 //  m n o p
-class Mat4 {
+//
+// Aligned on 16 bytes so the SSE versions load and store whole columns (32 would suit AVX2 better,
+// but GCC 12 doesn't always honour it for temporaries, AVX2 uses unaligned loads and stores instead)
+//
+// Everything that makes or combines matrices is constexpr, so fixed ones (the projection) can be made
+// by the compiler : `constexpr Mat4 proj = Mat4::perspective(...)`. Made while the program runs they
+// are what they always were, products and inverses then use the best SIMD level the CPU has
+class alignas(16) Mat4 {
     
     public:
 
     float m[16];
 
-    static Mat4 identity();
-    static Mat4 multiply(const Mat4 &a, const Mat4 &b);
-    static Mat4 perspective(float fov, float aspect, float near, float far);
-    static Mat4 lookAt(float eyeX, float eyeY, float eyeZ,
+    static constexpr Mat4 identity();
+    static constexpr Mat4 multiply(const Mat4 &a, const Mat4 &b);
+    static constexpr Mat4 perspective(float fov, float aspect, float near, float far);
+    static constexpr Mat4 lookAt(float eyeX, float eyeY, float eyeZ,
             float cx, float cy, float cz,
             float upX, float upY, float upZ);
-    static Mat4 rotateX(float angle);
-    static Mat4 rotateY(float angle);
-    static Mat4 rotateZ(float angle);
-    static Mat4 rotateAxis(float x, float y, float z, float angle);
-    static Mat4 translate(float x, float y, float z);
+    static constexpr Mat4 rotateX(float angle);
+    static constexpr Mat4 rotateY(float angle);
+    static constexpr Mat4 rotateZ(float angle);
+    static constexpr Mat4 rotateAxis(float x, float y, float z, float angle);
+    static constexpr Mat4 translate(float x, float y, float z);
+    static constexpr Mat4 transpose(const Mat4 &a);
+    static constexpr Mat4 inverse(const Mat4 &a);
+    static constexpr Mat4 affineInverse(const Mat4 &a);
+
+    // The same at a given SIMD level (never above what the CPU has), runtime only
+    static Mat4 multiply(const Mat4 &a, const Mat4 &b, SimdLevel level);
+    static Mat4 transpose(const Mat4 &a, SimdLevel level);
+    static Mat4 inverse(const Mat4 &a, SimdLevel level);
+    static Mat4 affineInverse(const Mat4 &a, SimdLevel level);
+
+    // count points (x y z, w = 1) or directions (w = 0, translation ignored), 3 floats each
+    // The last row is ignored, so these are for affine matrices (model, view), not a projection
+    // `in` and `out` can be the same array
+    static void transformPoints(const Mat4 &a, const float *in, float *out, size_t count,
+            SimdLevel level = bestSimdLevel());
+    static void transformVectors(const Mat4 &a, const float *in, float *out, size_t count,
+            SimdLevel level = bestSimdLevel());
+
+    // The plain C++ versions : what runs at compile time, and the fallback of the SIMD ones
+    static constexpr Mat4 multiplyScalar(const Mat4 &a, const Mat4 &b);
+    static constexpr Mat4 transposeScalar(const Mat4 &a);
+    static constexpr Mat4 inverseScalar(const Mat4 &a);
+    static constexpr Mat4 affineInverseScalar(const Mat4 &a);
+
+    private:
+
+    static constexpr void cross(const float *a, const float *b, float *out);
 
 };
 
+// Default status of our matrix, like this : 
+//
+// 1 0 0 0
+// 0 1 0 0
+// 0 0 1 0
+// 0 0 0 1
+constexpr Mat4 Mat4::identity() {
+    Mat4 r = {};
+    r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
+    return r;
+}
+
+// Multiply two matrices together. To render any object in 3D we need to apply the transformation
+// Projection * View * Model   (MVP)
+// Each column of the result is the columns of a weighted by one column of b, the SIMD versions (Mat4.cpp)
+// do exactly that four (SSE) or eight (AVX2) floats at a time, in the same order so the result is
+// the same to the bit
+constexpr Mat4 Mat4::multiplyScalar(const Mat4 &a, const Mat4 &b) {
+    Mat4 r = {};
+    for (int col = 0; col < 4; col++)
+        for (int row = 0; row < 4; row++) {
+            r.m[col*4 + row] =
+                a.m[0*4 + row] * b.m[col*4 + 0] +
+                a.m[1*4 + row] * b.m[col*4 + 1] +
+                a.m[2*4 + row] * b.m[col*4 + 2] +
+                a.m[3*4 + row] * b.m[col*4 + 3];
+        }
+    return r;
+}
+
+// Simulate perspective as if we're looking at an object from a camera, taking into account field of view (fov)
+// aspect ratio (aspect), nearest possible object (near) = minimum distance of display, farthest possible object (far) = max distance of display
+constexpr Mat4 Mat4::perspective(float fov, float aspect, float near, float far) {
+    float f = 1.0f / constexprTan(fov / 2.0f);
+    Mat4 r = {};
+    r.m[0]  = f / aspect;
+    r.m[5]  = f;
+    r.m[10] = (far + near) / (near - far);
+    r.m[11] = -1.0f;
+    r.m[14] = (2 * far * near) / (near - far);
+    return r;
+}
+
+
+// Make the camera (eye) look at something (c) according to where up is (up)
+constexpr Mat4 Mat4::lookAt(float eyeX, float eyeY, float eyeZ,
+            float cx, float cy, float cz,
+            float upX, float upY, float upZ)
+{
+
+    // Compute the direction from the camera to the target 
+    // then normalise it so it gives an absolute direction (not based on distance)
+    float fX = cx - eyeX;
+    float fY = cy - eyeY;
+    float fZ = cz - eyeZ;
+    float fLen = constexprSqrt(fX*fX + fY*fY + fZ*fZ);
+    fX /= fLen; fY /= fLen; fZ /= fLen;
+
+    // Normalise up
+    float uLen = constexprSqrt(upX*upX + upY*upY + upZ*upZ);
+    upX /= uLen; upY /= uLen; upZ /= uLen;
+
+    // Compute the s(ide) vector, perpendicular to f(orward) and up
+    float sX = fY*upZ - fZ*upY;
+    float sY = fZ*upX - fX*upZ;
+    float sZ = fX*upY - fY*upX;
+
+    // Re-compute up to make it perpendicular to s(ide) 
+    // If we're looking from an angle, the original up wouldn't necessarily be perpendicular to it 
+    float uX = sY*fZ - sZ*fY;
+    float uY = sZ*fX - sX*fZ;
+    float uZ = sX*fY - sY*fX;
+
+    // Create the new camera matrix with
+    // X axis = side
+    // Y axis = up
+    // Z axis = negative forward 
+    // (negative because we're looking at forward so we're behind it if that makes sense)
+    Mat4 r = identity();
+    r.m[0] = sX; r.m[4] = sY; r.m[8]  = sZ;
+    r.m[1] = uX; r.m[5] = uY; r.m[9]  = uZ;
+    r.m[2] =-fX; r.m[6] =-fY; r.m[10] =-fZ;
+
+    // Then move the entire world in the opposite direction of the camera (instead of moving the camera)
+    // Meaning camera is still at the origin point and everything else translates
+    r.m[12] = -(sX*eyeX + sY*eyeY + sZ*eyeZ);
+    r.m[13] = -(uX*eyeX + uY*eyeY + uZ*eyeZ);
+    r.m[14] =  (fX*eyeX + fY*eyeY + fZ*eyeZ);
+
+    // Return the new view
+    return r;
+}
+
+constexpr Mat4 Mat4::rotateX(float a) {
+    float c = constexprCos(a);
+    float s = constexprSin(a);
+
+    Mat4 r = identity();
+
+    r.m[5]  = c;
+    r.m[6]  = s;
+    r.m[9]  = -s;
+    r.m[10] = c;
+
+    return r;
+}
+
+constexpr Mat4 Mat4::rotateY(float a) {
+    float c = constexprCos(a);
+    float s = constexprSin(a);
+
+    Mat4 r = identity();
+
+    r.m[0]  = c;
+    r.m[2]  = -s;
+    r.m[8]  = s;
+    r.m[10] = c;
+
+    return r;
+}
+
+constexpr Mat4 Mat4::rotateZ(float a) {
+    float c = constexprCos(a);
+    float s = constexprSin(a);
+
+    Mat4 r = identity();
+
+    r.m[0] = c;
+    r.m[1] = s;
+    r.m[4] = -s;
+    r.m[5] = c;
+
+    return r;
+}
+
+constexpr Mat4 Mat4::rotateAxis(float x, float y, float z, float angle) {
+    float len = constexprSqrt(x*x + y*y + z*z);
+    if (len == 0.0f) return identity();
+    x /= len; y /= len; z /= len;
+
+    float c = constexprCos(angle);
+    float s = constexprSin(angle);
+    float ic = 1.0f - c;
+
+    Mat4 r = identity();
+
+    r.m[0] = c + x*x*ic;
+    r.m[4] = x*y*ic - z*s;
+    r.m[8] = x*z*ic + y*s;
+
+    r.m[1] = y*x*ic + z*s;
+    r.m[5] = c + y*y*ic;
+    r.m[9] = y*z*ic - x*s;
+
+    r.m[2] = z*x*ic - y*s;
+    r.m[6] = z*y*ic + x*s;
+    r.m[10] = c + z*z*ic;
+
+    return r;
+}
+
+constexpr Mat4 Mat4::translate(float x, float y, float z) {
+    Mat4 r = identity();
+    r.m[12] = x;
+    r.m[13] = y;
+    r.m[14] = z;
+    return r;
+}
+
+// Undo a matrix : inverse(a) * a = identity, used to turn a point on the screen back into a ray
+// Cofactors divided by the determinant, a matrix that flattens space (determinant 0) gives the identity
+constexpr Mat4 Mat4::inverseScalar(const Mat4 &a) {
+    const float *m = a.m;
+    Mat4 r = {};
+    r.m[0]  =  m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+    r.m[4]  = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+    r.m[8]  =  m[4]*m[9]*m[15]  - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+    r.m[12] = -m[4]*m[9]*m[14]  + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+    r.m[1]  = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+    r.m[5]  =  m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+    r.m[9]  = -m[0]*m[9]*m[15]  + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+    r.m[13] =  m[0]*m[9]*m[14]  - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+    r.m[2]  =  m[1]*m[6]*m[15]  - m[1]*m[7]*m[14]  - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7]  - m[13]*m[3]*m[6];
+    r.m[6]  = -m[0]*m[6]*m[15]  + m[0]*m[7]*m[14]  + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7]  + m[12]*m[3]*m[6];
+    r.m[10] =  m[0]*m[5]*m[15]  - m[0]*m[7]*m[13]  - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7]  - m[12]*m[3]*m[5];
+    r.m[14] = -m[0]*m[5]*m[14]  + m[0]*m[6]*m[13]  + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6]  + m[12]*m[2]*m[5];
+    r.m[3]  = -m[1]*m[6]*m[11]  + m[1]*m[7]*m[10]  + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7]   + m[9]*m[3]*m[6];
+    r.m[7]  =  m[0]*m[6]*m[11]  - m[0]*m[7]*m[10]  - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7]   - m[8]*m[3]*m[6];
+    r.m[11] = -m[0]*m[5]*m[11]  + m[0]*m[7]*m[9]   + m[4]*m[1]*m[11] - m[4]*m[3]*m[9]  - m[8]*m[1]*m[7]   + m[8]*m[3]*m[5];
+    r.m[15] =  m[0]*m[5]*m[10]  - m[0]*m[6]*m[9]   - m[4]*m[1]*m[10] + m[4]*m[2]*m[9]  + m[8]*m[1]*m[6]   - m[8]*m[2]*m[5];
+
+    float det = m[0]*r.m[0] + m[1]*r.m[4] + m[2]*r.m[8] + m[3]*r.m[12];
+    if (det == 0.0f) return identity();
+    for (int i = 0; i < 16; i++)
+        r.m[i] /= det;
+    return r;
+}
+
+// Rows become columns. For a rotation that's also its inverse
+constexpr Mat4 Mat4::transposeScalar(const Mat4 &a) {
+    Mat4 r = {};
+    for (int col = 0; col < 4; col++)
+        for (int row = 0; row < 4; row++)
+            r.m[col*4 + row] = a.m[row*4 + col];
+    return r;
+}
+
+constexpr void Mat4::cross(const float *a, const float *b, float *out) {
+    out[0] = a[1]*b[2] - a[2]*b[1];
+    out[1] = a[2]*b[0] - a[0]*b[2];
+    out[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+// Inverse of a matrix whose last row is 0 0 0 1 (anything built from translate, rotate and scale, even
+// with shear) : the rows of the inverted 3x3 are cross products of its columns over the determinant,
+// then the translation is undone in the new axes. About a third of the work of the general inverse
+constexpr Mat4 Mat4::affineInverseScalar(const Mat4 &a) {
+    const float *c0 = &a.m[0], *c1 = &a.m[4], *c2 = &a.m[8], *t = &a.m[12];
+    float rows[3][3] = {};
+    cross(c1, c2, rows[0]);
+    cross(c2, c0, rows[1]);
+    cross(c0, c1, rows[2]);
+    float det = c0[0]*rows[0][0] + c0[1]*rows[0][1] + c0[2]*rows[0][2];
+    if (det == 0.0f) return identity();
+    float inv = 1.0f / det;
+
+    Mat4 r = Mat4::identity();
+    for (int row = 0; row < 3; row++)
+        for (int col = 0; col < 3; col++)
+            r.m[col*4 + row] = rows[row][col] * inv;
+    for (int row = 0; row < 3; row++)
+        r.m[12 + row] = -(r.m[row]*t[0] + r.m[4 + row]*t[1] + r.m[8 + row]*t[2]);
+    return r;
+}
+
+// Products and inverses : the plain versions at compile time, SIMD ones at runtime
+constexpr Mat4 Mat4::multiply(const Mat4 &a, const Mat4 &b) {
+    if (__builtin_is_constant_evaluated()) return multiplyScalar(a, b);
+    return multiply(a, b, bestSimdLevel());
+}
+
+constexpr Mat4 Mat4::transpose(const Mat4 &a) {
+    if (__builtin_is_constant_evaluated()) return transposeScalar(a);
+    return transpose(a, bestSimdLevel());
+}
+
+constexpr Mat4 Mat4::inverse(const Mat4 &a) {
+    if (__builtin_is_constant_evaluated()) return inverseScalar(a);
+    return inverse(a, bestSimdLevel());
+}
+
+constexpr Mat4 Mat4::affineInverse(const Mat4 &a) {
+    if (__builtin_is_constant_evaluated()) return affineInverseScalar(a);
+    return affineInverse(a, bestSimdLevel());
+}
+
+constexpr Mat4 operator*(const Mat4 &a, const Mat4 &b) {
+    return Mat4::multiply(a, b);
+}
+
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,137 @@
+// async_loader.hpp
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "mesh_cache.hpp"
+#include "material.hpp"
+
+// Background model loading
+// Worker threads take the models one by one and do the whole CPU side (cache lookup or parse,
+// normals, interleaving, materials, texture images), finished models wait in a queue until the GL thread picks
+// them up with poll(). Nothing in here touches GL, uploading is the caller's business
+
+// A model ready to be uploaded, `view` points into `cache` (warm start, or a fused cold start that
+// just wrote it) or `built` (cold start)
+struct LoadedModel {
+    size_t                slot = 0;       // position of the model on the command line
+    std::string           path;
+    bool                  ok   = false;
+    bool                  warm = false;
+    bool                  mapped = false; // `view` is the one of `cache`
+    double                ms   = 0.0;     // time spent on the worker
+    MeshCache             cache;
+    ModelBuffers          built;
+    std::vector<Material> materials;
+    std::map<std::string, DecodedImage> images;   // every diffuseMap of `materials`, the GL thread only uploads
+
+    const MeshView& view() const { return mapped ? cache.view : built.view; }
+};
+
+// Load one model on the calling thread, what a worker does for each job
+// A fused build is interleaved once : here into the cache, then mapped back, or without a cache by the
+// MappedWriter, straight into the GL buffers. A warm start is used as usual
+// A cache written with other normals or in another vertex format counts as a cold start
+std::unique_ptr<LoadedModel> loadModel(size_t slot, const std::string& path, const ObjOptions& objOptions,
+                                       const BuildOptions& buildOptions, const MeshCacheOptions& cacheOptions);
+
+class AsyncModelLoader {
+public:
+    AsyncModelLoader() {}
+    ~AsyncModelLoader();
+
+    AsyncModelLoader(const AsyncModelLoader&) = delete;
+    AsyncModelLoader& operator=(const AsyncModelLoader&) = delete;
+
+    // workers = 0 means one per core, never more than there are models
+    // The thread counts of objOptions / buildOptions are split between the workers
+    void start(const std::vector<std::string>& paths, const ObjOptions& objOptions,
+               const BuildOptions& buildOptions, const MeshCacheOptions& cacheOptions, unsigned workers = 0);
+
+    // Take a finished model if there is one, never blocks
+    bool poll(std::unique_ptr<LoadedModel>& out);
+
+    // Block until the next finished model, false once every model was handed out
+    bool wait(std::unique_ptr<LoadedModel>& out);
+
+    // Every model was handed out by poll() / wait()
+    bool done() const { return handedOut == paths.size(); }
+
+private:
+    void worker();
+
+    std::vector<std::string> paths;
+    ObjOptions               objOptions;
+    BuildOptions             buildOptions;
+    MeshCacheOptions         cacheOptions;
+    std::vector<std::thread> threads;
+    std::atomic<size_t>      nextJob{0};
+    size_t                   handedOut = 0;
+
+    std::mutex                               queueLock;
+    std::condition_variable                  ready;
+    std::deque<std::unique_ptr<LoadedModel>> finished;
+};
+
+// Fills the buffers the GL thread mapped for a model, on a thread of its own : a fused view is
+// interleaved straight into them (see FusedMesh), any other one copied. The GL thread only maps them
+// before and unmaps them after, nothing in here touches GL
+class MappedWriter {
+public:
+    MappedWriter() {}
+    ~MappedWriter() { wait(); }
+
+    MappedWriter(const MappedWriter&) = delete;
+    MappedWriter& operator=(const MappedWriter&) = delete;
+
+    // One model at a time, `view` and both ranges must stay valid until finished() says so
+    void start(const MeshView& view, void* vertices, void* indices);
+
+    // The write that was started is over, never blocks
+    bool finished();
+
+    // Block until the write is over (before the GL context goes away with the mapping)
+    void wait();
+
+private:
+    std::thread       thread;
+    std::atomic<bool> done{false};
+};
+
+// Picking structures, made once the models are on screen so they never hold up a load
+// One thread takes the models in the order they were added and builds each one's BVH (buildViewBvh)
+// from its view, the model's CPU side is released as soon as that is done. Nothing in here touches GL
+class BvhBuilder {
+public:
+    explicit BvhBuilder(unsigned threads = 0) : threads(threads) {}
+    ~BvhBuilder();
+
+    BvhBuilder(const BvhBuilder&) = delete;
+    BvhBuilder& operator=(const BvhBuilder&) = delete;
+
+    // `object` is the caller's number for the model, handed back with its BVH
+    void add(size_t object, std::unique_ptr<LoadedModel> model);
+
+    // Take a finished BVH if there is one, never blocks
+    bool poll(size_t& object, Bvh& out);
+
+private:
+    struct Job {
+        size_t                       object;
+        std::unique_ptr<LoadedModel> model;
+    };
+
+    void worker();
+
+    unsigned                threads;
+    std::thread             thread;
+    bool                    stopping = false;
+    std::mutex              queueLock;
+    std::condition_variable wake;
+    std::deque<Job>         jobs;
+    std::deque<std::pair<size_t, Bvh>> finished;
+};
@@ -0,0 +1,31 @@
+// bounds.hpp
+#pragma once
+#include <cstddef>
+#include "simd.hpp"
+
+// Bounding volumes of a point cloud, nothing in here needs a GL context
+
+// Box and sphere around the same points, kept together so culling can test the cheap sphere
+// first and the box only when it's not conclusive
+// An empty cloud (or one made only of NaN) has min > max and a negative radius
+struct Bounds {
+    float min[3]   = { 0.0f, 0.0f, 0.0f };
+    float max[3]   = { 0.0f, 0.0f, 0.0f };
+    float center[3] = { 0.0f, 0.0f, 0.0f };   // of the sphere, not always the middle of the box
+    float radius   = -1.0f;
+
+    bool empty() const { return radius < 0.0f; }
+};
+
+// Box and a tight sphere around `count` points (x y z floats)
+// The sphere starts on the farthest apart pair of extreme points along the axes and diagonals (EPOS-14),
+// then grows Ritter style towards the farthest point left outside, its final radius is the distance to the farthest point so nothing ever
+// falls out. Each step is one SIMD pass split over `threads`, and the result is the same for every
+// thread count and SIMD level. Any finite coordinate works (the math is scaled by a power of two so
+// nothing overflows), NaN coordinates are ignored, an infinite one or a cloud wider than the float
+// range gives an infinite radius
+Bounds computeBounds(const float* positions, size_t count, unsigned threads = 0,
+                     SimdLevel level = cpuSimdLevel());
+
+// The same volumes once every point went through p -> (p - center) * scale
+Bounds transformBounds(const Bounds& b, const float center[3], float scale);
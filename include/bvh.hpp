@@ -0,0 +1,62 @@
+// bvh.hpp
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bounding volume hierarchy over the triangles of a model, for ray queries (mouse picking)
+// Built top-down with the surface area heuristic on binned centroids, then kept as one flat array of
+// 32 byte nodes in depth-first order : a node's first child is right after it, so going down the
+// near side mostly reads memory that was just fetched. Nothing in here needs a GL context
+
+struct BvhNode {
+    float    min[3];
+    uint32_t first;     // leaf : first triangle slot, inner node : index of the second child
+    float    max[3];
+    uint32_t count;     // leaf : triangles in it, 0 for an inner node (first child = this node + 1)
+};
+
+// Triangles are stored in leaf order with their own copy of the corners, the model's index buffer may
+// be 16 bits or not in memory at all (FusedMesh). Positions are in the same space as the model's view
+struct BvhView {
+    const BvhNode*  nodes         = nullptr;
+    size_t          nodeCount     = 0;
+    const uint32_t* corners       = nullptr;   // 3 vertex numbers per triangle slot
+    const uint32_t* triangles     = nullptr;   // triangle number in the model's index buffer, per slot
+    size_t          triangleCount = 0;
+    const float*    positions     = nullptr;   // 3 floats per vertex
+    size_t          vertexCount   = 0;
+};
+
+struct Bvh {
+    std::vector<BvhNode>  nodes;
+    std::vector<uint32_t> corners;
+    std::vector<uint32_t> triangles;
+    std::vector<float>    positions;
+
+    BvhView view() const;
+};
+
+// Leaves hold at most this many triangles, fewer whenever splitting is cheaper for a ray
+const unsigned maxBvhLeafTriangles = 8;
+
+// `positions` is moved into the result. Subtrees below the top few splits are built on `threads` threads,
+// the node layout doesn't depend on how many
+void buildBvh(std::vector<float> &positions, const uint32_t *indices, size_t triangleCount, Bvh &out,
+              unsigned threads = 0);
+
+struct RayHit {
+    float    t        = 0.0f;   // origin + t * direction
+    uint32_t triangle = 0;      // in the model's index buffer
+    float    u = 0.0f, v = 0.0f;    // barycentrics of the second and third corner
+};
+
+// Closest triangle along the ray with t in [0, maxT], both sides count (the renderer doesn't cull
+// back faces). `direction` needn't be normalized, t is in units of it. nodesVisited, when given, gets
+// the number of nodes the query looked at
+bool intersectBvh(const BvhView &bvh, const float origin[3], const float direction[3], float maxT,
+                  RayHit &hit, size_t *nodesVisited = nullptr);
+
+// The same query without the hierarchy, every triangle tested : what the BVH is checked against
+bool intersectTriangles(const BvhView &bvh, const float origin[3], const float direction[3], float maxT,
+                        RayHit &hit);
@@ -0,0 +1,50 @@
+// constexpr_math.hpp
+#pragma once
+#include <cmath>
+
+// sin, cos, tan and sqrt that also work in constant expressions (none of <cmath> does before C++26)
+// At compile time they run series in double, within an ulp of the float result; while the program
+// runs they are the <cmath> functions, so nothing made at runtime changes
+
+constexpr double constexprPi = 3.14159265358979323846;
+
+// Taylor series after folding x into [-pi, pi], the last term is below 1e-11
+constexpr double seriesSin(double x) {
+    double turns = x / (2.0 * constexprPi);
+    long long k = (long long)(turns + (turns >= 0.0 ? 0.5 : -0.5));
+    x -= (double)k * 2.0 * constexprPi;
+    double term = x, sum = x;
+    for (int n = 1; n < 12; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+// Newton's method until it stops moving
+constexpr double newtonSqrt(double x) {
+    if (!(x > 0.0))
+        return x == 0.0 ? 0.0 : NAN;
+    double guess = x > 1.0 ? x : 1.0, previous = 0.0;
+    for (int i = 0; i < 1100 && guess != previous; i++) {
+        previous = guess;
+        guess = 0.5 * (guess + x / guess);
+    }
+    return guess;
+}
+
+constexpr float constexprSin(float x) {
+    return __builtin_is_constant_evaluated() ? (float)seriesSin(x) : std::sin(x);
+}
+
+constexpr float constexprCos(float x) {
+    return __builtin_is_constant_evaluated() ? (float)seriesSin(x + constexprPi / 2.0) : std::cos(x);
+}
+
+constexpr float constexprTan(float x) {
+    return __builtin_is_constant_evaluated() ? (float)(seriesSin(x) / seriesSin(x + constexprPi / 2.0)) : std::tan(x);
+}
+
+constexpr float constexprSqrt(float x) {
+    return __builtin_is_constant_evaluated() ? (float)newtonSqrt(x) : std::sqrt(x);
+}
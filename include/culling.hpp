@@ -0,0 +1,83 @@
+// culling.hpp
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bounds.hpp"
+#include "parsing.hpp"
+#include "simd.hpp"
+
+// What the renderer can skip before asking the GPU to draw it, nothing in here needs a GL context
+
+// Inside of the 6 planes of a clip volume : a x + b y + c z + d >= 0, (a, b, c) of length 1
+struct Frustum {
+    float planes[6][4];
+};
+
+// Planes of what `m` (column major, like Mat4) maps into the clip volume, in the space m takes its
+// input from : give it an mvp and the planes are in model space (Gribb & Hartmann)
+Frustum frustumFromMatrix(const float m[16]);
+
+// false when the sphere is entirely outside one of the planes (it may still be outside when true)
+bool sphereInFrustum(const Frustum &frustum, const float center[3], float radius);
+
+// Bounds of whole objects in world space, one array per component (x of every object, then y ...) so
+// cullObjects tests 4 or 8 objects per register
+struct ObjectBounds {
+    std::vector<float> center[3];
+    std::vector<float> radius;
+    std::vector<float> min[3], max[3];
+
+    size_t size() const { return radius.size(); }
+    void resize(size_t count);
+    // `b` (model space) through `model` (column major, rotation, scale and translation only) : the sphere
+    // grows with the largest scale, the box is the one around the turned box. Empty bounds are never culled
+    void set(size_t i, const Bounds &b, const float model[16]);
+};
+
+struct ObjectCullStats {
+    size_t tested = 0;
+    size_t culled = 0;
+};
+
+// visible[i] = 0 when object i is entirely outside one of the planes, by its sphere or by its box (the
+// box test takes the corner furthest along the plane's normal), 1 otherwise. Every level gives the same
+// answers
+void cullObjects(const Frustum &frustum, const ObjectBounds &bounds, uint8_t *visible, ObjectCullStats &stats,
+                 SimdLevel level = cpuSimdLevel());
+
+// true when every triangle of a meshlet faces away from `eye` : its normals are all within the cone
+// (axis, acos(coneCos)) and the sphere is entirely on their back side
+bool coneBackFacing(const float center[3], float radius, const float axis[3], float coneCos, const float eye[3]);
+
+struct MeshletCullStats {
+    size_t meshlets       = 0;  // tested
+    size_t frustumCulled  = 0;
+    size_t backFaceCulled = 0;
+    size_t triangles      = 0;  // in the tested meshlets
+    size_t drawn          = 0;  // triangles left to draw
+};
+
+// Where the copies of a model are drawn : p -> (p + offset) * scale, one copy per offset, every offset
+// inside [offsetMin, offsetMax]. A single copy has offsetMin == offsetMax
+struct MeshletCopies {
+    float offsetMin[3] = { 0.0f, 0.0f, 0.0f };
+    float offsetMax[3] = { 0.0f, 0.0f, 0.0f };
+    float scale = 1.0f;
+
+    bool single() const;
+};
+
+// The copies of the vertex shader's instanced grid (ft_scop --instances=N) : columns x columns of them,
+// 3 units apart on x and z, shrunk by `columns`
+MeshletCopies gridCopies(int columns);
+
+// The meshlets of one draw range that may be visible in at least one copy, as (first index, index count)
+// runs : neighbours that both pass are merged into one run
+// The meshlet's sphere is tested at every place the copies put it, so every copy can be drawn from the
+// same runs in one instanced draw. `frustum` and `eye` are in the space the copies are in. Cone culling
+// is only right on a watertight mesh (see isWatertight), `backFaces` = false skips it, and it is only
+// done for a single copy (each copy of a grid sees the meshlet from its own side)
+void cullMeshlets(const Meshlet *meshlets, size_t count, const Frustum &frustum, const float eye[3],
+                  bool backFaces, const MeshletCopies &copies,
+                  std::vector<uint32_t> &firsts, std::vector<uint32_t> &counts, MeshletCullStats &stats);
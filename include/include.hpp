@@ -2,8 +2,16 @@
 # define INCLUDE_HPP
 
 #include "parsing.hpp"
+#include "mesh.hpp"
+#include "mesh_cache.hpp"
+#include "material.hpp"
+#include "async_loader.hpp"
+#include "culling.hpp"
+#include "transforms.hpp"
+#include "scene_graph.hpp"
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <cmath>
 #include <string>
@@ -11,6 +19,8 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <map>
+#include <algorithm>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -19,25 +29,101 @@
 
 struct SceneObject {
     GLuint vao;
-    size_t vertexCount;
+    size_t indexCount;
+    GLenum indexType;   // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    size_t indexSize;   // bytes per index, to turn a first index into a buffer offset
+    std::vector<SubMesh> submeshes;
+    std::vector<MeshLod> lods;          // errors in model space, like `bounds`
+    std::vector<SubMesh> lodSubmeshes;  // submeshes.size() per level
+    std::vector<Meshlet> meshlets;      // model space
+    std::vector<uint32_t> meshletRanges; // see Mesh::meshletRanges, empty = nothing to cull with
+    bool                 watertight;    // back facing meshlets can be skipped
+    Bvh                  bvh;           // model space, for picking, empty until BvhBuilder is done with it
+    std::vector<Material> materials;    // one per SubMesh::materialId
+    Bounds bounds;                      // model space, before the object's own rotation and offset
+    VertexLayout       layout;
+    VertexQuantization quant;           // set as uniforms whenever the object is drawn
+    size_t             vertexBytes;
     float  offsetX;
 };
 
-void generateNormals(Mesh &mesh);
-void computeCenterScale(const Mesh &mesh, float &cx, float &cy, float &cz, float &scale);
-std::vector<float> interleaveMesh(const Mesh &mesh, float cx, float cy, float cz, float scale);
+// Every image is decoded and uploaded once, however many parts and models use it
+struct TextureCache {
+    std::map<std::string, GLuint> textures;    // 0 = could not be loaded, not retried
 
-GLuint createProgram(const char *vs, const char *fs);
+    // With `decoded` (done on a loader worker) only the upload happens here, otherwise the file is
+    // decoded on the spot
+    GLuint get(const std::string &path, const DecodedImage *decoded = nullptr);
+};
+
+// Everything the render loop draws, it grows while models finish loading
+struct Scene {
+    std::vector<SceneObject> objects;
+    std::vector<DrawItem>    draws;      // in submission order
+};
+
+// A model whose buffers exist on the GPU but are only partly filled
+struct PendingUpload {
+    std::unique_ptr<LoadedModel> model;
+    GLuint vao = 0, vbo = 0, ebo = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    size_t vertexBytes = 0, indexBytes = 0, uploaded = 0;
+    bool   mapped = false;      // both buffers are mapped, the MappedWriter is filling them
+};
+
+// GL side of background loading : takes the models an AsyncModelLoader finished and uploads them
+// at most `uploadBudget` bytes per frame (or all at once through `writer`), a model joins the scene
+// once all of its data is on the GPU
+struct SceneStreamer {
+    AsyncModelLoader *loader = nullptr;
+    TextureCache     *textures = nullptr;
+    BvhBuilder       *bvhs = nullptr;    // picking structures once the models are in, null = no picking
+    MappedWriter     *writer = nullptr;  // fills whole mapped buffers off the GL thread, null = in pieces
+    GLuint program = 0;
+    GLuint defaultTexture = 0;
+    size_t uploadBudget = 0;     // bytes per frame, 0 = no limit
+    bool   blocking = false;     // wait for the workers instead of polling them
+    bool   sortDraws = true;
+    int    slotCount = 1;
+    float  spacing = 4.0f;
+    double startMs = 0.0;        // launch time, the reported times are counted from it
+
+    PendingUpload         current;
+    std::vector<DrawItem> fileOrder;   // draws as the models arrived, to compare with the sorted ones
+    size_t frames = 0, uploadFrames = 0, added = 0, failed = 0;
+    bool   reported = false;
+
+    // Call once per frame before drawing, true once every model is in the scene
+    bool update(Scene &scene);
+    // Call after each swap, reports the time to first frame
+    void frameDone();
+};
+
+GLuint createProgram(const char *vs, const char *gs, const char *fs);
 GLuint loadTexture(const char* path);
+GLuint uploadTexture(const DecodedImage &image);
 GLFWwindow* initWindow(int width, int height, const char* title);
-void setupMeshBuffers(const std::vector<float> &interleaved, GLuint &vao, GLuint &vbo);
-void renderLoop(GLFWwindow* win, const std::vector<SceneObject> &objects, GLuint program, GLuint texID,
+void setupMeshBuffers(const MeshView &mesh, GLuint &vao, GLuint &vbo, GLuint &ebo, GLenum &indexType,
+                      bool withData = true);
+// How the render loop draws
+struct RenderOptions {
+    int   instances  = 0;       // > 0 : every part drawn that many times in a grid, and frame times printed
+    bool  lod        = true;    // pick a level of detail per object, or always draw the full mesh
+    float lodPixels  = 1.0f;    // how far (in pixels) a level may move the surface on screen
+    bool  cull       = true;    // skip objects and meshlets off screen, meshlets facing away (see cullObjects, cullMeshlets)
+    float eye[3]     = { 0.0f, 0.0f, 0.0f };    // camera position, in world space
+};
+
+double nowMs();
+void renderLoop(GLFWwindow* win, Scene &scene, SceneStreamer &streamer,
                 GLint mvpLoc, GLint modelLoc, GLint useTexLoc, GLint texLoc,
-                Mat4 vp);
+                Mat4 vp, const RenderOptions &options = RenderOptions());
 
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 
 extern const char* vertexShaderSrc;
+extern const char* geometryShaderSrc;
 extern const char* fragmentShaderSrc;
 
 
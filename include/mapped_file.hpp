@@ -0,0 +1,19 @@
+// mapped_file.hpp
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file mapped in memory (mmap)
+// The bytes stay in the kernel page cache, nothing is copied into our own buffers
+struct MappedFile {
+    const char* data = nullptr;
+    size_t      size = 0;
+
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+};
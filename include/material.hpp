@@ -0,0 +1,57 @@
+// material.hpp
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// .mtl material libraries and the order parts are drawn in, nothing in here needs a GL context
+
+// What we use of a newmtl block : the diffuse color (Kd) and the diffuse texture (map_Kd)
+struct Material {
+    std::string name;
+    float       diffuse[3] = { 1.0f, 1.0f, 1.0f };  // white = the texture is not tinted
+    std::string diffuseMap;                         // path of the image, empty = none
+};
+
+// An image decoded to RGB, bottom row first the way glTexImage2D takes it
+struct DecodedImage {
+    int width  = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;   // empty = could not be decoded
+};
+
+// Decode a texture image, safe on any thread (the loader's workers do it, the GL thread only uploads)
+bool decodeImage(const std::string& path, DecodedImage& out);
+
+// Read every newmtl block of an .mtl file, texture paths are made relative to the working directory
+bool loadMTL(const std::string& path, std::vector<Material>& out);
+
+// One Material per usemtl name of a model, in the same order (see Mesh::materials)
+// The libraries are looked up next to the .obj, names that no library defines get the default Material
+std::vector<Material> resolveMaterials(const std::string& objPath, const std::vector<std::string>& mtllibs,
+                                       const std::vector<std::string>& names);
+
+// One glDrawElements : a part of an object with the state it needs
+struct DrawItem {
+    uint32_t program;
+    uint32_t texture;       // 0 = no texture
+    uint32_t object;        // index in the scene, selects the VAO and the matrices
+    uint32_t submesh;       // part of the object, picks its range in a level of detail
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float    diffuse[3];
+    bool     hasMap;        // texture comes from map_Kd and uses the mesh uvs
+};
+
+// State changes a frame costs when the items are submitted in that order
+struct DrawStats {
+    size_t draws         = 0;
+    size_t programBinds  = 0;
+    size_t textureBinds  = 0;
+    size_t objectChanges = 0;   // VAO bind + matrix upload
+};
+
+// Sort by (program, texture, object) so each program and texture is bound as few times as possible
+// The sort is stable, parts sharing all three keep their file order
+void sortDrawItems(std::vector<DrawItem>& items);
+DrawStats countDrawState(const std::vector<DrawItem>& items);
@@ -0,0 +1,11 @@
+// memstats.hpp
+#pragma once
+#include <cstddef>
+
+// Resident memory of the process, read from /proc/self/status (Linux only, 0 elsewhere)
+
+size_t currentRssKB();
+size_t peakRssKB();
+
+// Start measuring a new peak from the current RSS (writes to /proc/self/clear_refs)
+void resetPeakRss();
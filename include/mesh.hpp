@@ -0,0 +1,209 @@
+// mesh.hpp
+#pragma once
+#include "parsing.hpp"
+#include "simd.hpp"
+#include "bounds.hpp"
+#include "vertex_format.hpp"
+#include "bvh.hpp"
+
+// CPU side processing of a loaded Mesh, nothing in here needs a GL context
+
+// What weldVertices did
+struct WeldStats {
+    size_t verticesIn   = 0, verticesOut  = 0;
+    size_t trianglesIn  = 0, trianglesOut = 0;
+    size_t degenerate   = 0;    // a corner repeated once welded, or no area at all
+    size_t duplicates   = 0;    // the same corners as an earlier triangle of the submesh (same winding)
+};
+
+// Vertices less than `epsilon` apart on every axis (a fraction of the model's box diagonal, 0 = only
+// identical positions) and with the same normal and uv become one, through a parallel spatial hash
+// Then the triangles left with no area and the repeated ones are removed, submeshes keep their order
+// and empty ones go. For soups : STL conversions, CAD exports, files with one vt or vn per corner
+// Run it first, before anything that keeps indices on the side (levels of detail, meshlets)
+WeldStats weldVertices(Mesh &mesh, float epsilon, unsigned threads = 0);
+
+// What --weld alone asks for : float noise of a soup export, far below anything a model means to keep apart
+const float defaultWeldEpsilon = 1e-6f;
+
+// Flat normals : every corner gets the normal of its triangle (vertices are split per corner)
+void generateNormals(Mesh &mesh, unsigned threads = 0);
+
+// Smooth normals : angle-weighted average of the faces around each position, an edge between two
+// faces bending more than `creaseAngle` degrees stays sharp. Vertices are only split at creases,
+// so smooth surfaces keep sharing their vertices between triangles
+void generateSmoothNormals(Mesh &mesh, float creaseAngle, unsigned threads = 0);
+
+// How normals are made for a file that has none
+struct NormalOptions {
+    bool     smooth      = true;
+    float    creaseAngle = 60.0f;    // degrees, 180 = everything smooth
+    unsigned threads     = 0;
+
+    // Crease angle the result looks like, flat normals are the same as a 0 degree crease
+    float crease() const { return smooth ? creaseAngle : 0.0f; }
+};
+
+// Unit normal of every triangle, 3 floats each in `out`, degenerate triangles get their zero cross product
+// Every SIMD level gives bit-identical results as long as the build doesn't enable FMA contraction
+// (-march=native / -mfma), in that case the scalar tail may differ by about 1e-7
+void computeFaceNormals(const float* positions, const uint32_t* indices, size_t triangleCount, float* out,
+                        unsigned threads = 0, SimdLevel level = cpuSimdLevel());
+
+// What a FIFO post-transform cache of `cacheSize` vertices does with an index buffer
+// ACMR = vertices transformed per triangle (3 = no reuse at all, about 0.5 is the best a large
+// regular mesh can get), ATVR = vertices transformed per vertex used (1 = each one exactly once)
+struct VertexCacheStats {
+    size_t triangles   = 0;
+    size_t vertices    = 0;     // distinct vertices referenced
+    size_t transformed = 0;     // cache misses
+
+    double acmr() const { return triangles ? (double)transformed / triangles : 0.0; }
+    double atvr() const { return vertices ? (double)transformed / vertices : 0.0; }
+};
+
+VertexCacheStats simulateVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+                                     unsigned cacheSize = 16);
+
+// Triangle order for the post-transform cache, Tipsify (Sander, Nehab & Barczak 2007) : linear in the
+// number of triangles whatever the cache size. Triangles only move inside their submesh so every draw
+// range stays valid, and keep their corners in order (same winding). Submeshes are spread over `threads`
+void optimizeVertexCache(Mesh &mesh, unsigned cacheSize = 16, unsigned threads = 0);
+
+// Vertices renumbered in the order the triangles first use them, so the vertex fetch walks the buffer
+// forward instead of jumping around. Vertices no triangle uses end up last
+void optimizeVertexFetch(Mesh &mesh, unsigned threads = 0);
+
+// Level of detail chain : one level per ratio (triangles kept, as a fraction of the full mesh, decreasing),
+// each one simplified from the previous with quadric error edge collapses. Vertices on open borders,
+// on uv / normal seams (a position shared by several vertices) and between submeshes never move, so
+// outlines and seams keep their shape. Levels only add indices (Mesh::lods), on the mesh's own vertices
+// Models under about a thousand triangles get none, and the chain stops once a level can't get
+// noticeably smaller than the one before
+void buildLods(Mesh &mesh, const std::vector<float> &ratios, unsigned threads = 0);
+
+// Coarsest level whose error stays under `pixelError` pixels on screen, for a model with a bounding
+// sphere of `radius` that covers `projectedRadius` pixels. 0 = the full mesh, l = lods[l - 1]
+size_t selectLod(const MeshLod *lods, size_t lodCount, float radius, float projectedRadius, float pixelError);
+
+// Vertex number of the first vertex with the same position (bit for bit) as each vertex
+// Several vertices at one position are a seam : the uv or the normal changes there
+std::vector<uint32_t> weldPositions(const Mesh &mesh);
+
+// Closed and consistently wound : once seams are welded every edge has exactly two triangles, going
+// through it in opposite directions. Only then can a triangle facing away from the camera never be seen
+bool isWatertight(const Mesh &mesh);
+
+// Meshlets : every draw range (submeshes, then the levels of detail) cut in runs of at most
+// maxMeshletVertices distinct vertices and maxMeshletTriangles triangles, with a bounding sphere and a
+// normal cone each, so the renderer can skip whole runs that are off screen or facing away
+// Triangles are taken in index order (after optimizeVertexCache they come in compact fans), the index
+// buffer itself doesn't change
+const unsigned maxMeshletVertices  = 64;
+const unsigned maxMeshletTriangles = 124;
+void buildMeshlets(Mesh &mesh, unsigned threads = 0);
+
+// Center on the bounding sphere and scale so it gets a radius of 1.5 : the model fits the window
+// whichever way it turns
+void fitBounds(const Bounds &bounds, float center[3], float &scale);
+
+// Every vertex of the mesh one after the other, in the encoder's layout
+std::vector<uint8_t> interleaveMesh(const Mesh &mesh, const VertexEncoder &encoder);
+
+// Size of one index once uploaded : 16 bits as long as every vertex number fits
+size_t indexSize(size_t vertexCount);
+
+// Fused pipeline : the Mesh is kept as loaded and the GPU layout is produced a range at a time,
+// straight into wherever it goes (mapped GL buffers, the cache file), so the interleaved vertices
+// never exist as a whole on the CPU side
+// Flat normals are made while writing : one vertex per triangle corner, positions read through the
+// indices and the face normal computed on the spot, the unwelded copy of the mesh is never built
+struct FusedMesh {
+    Mesh          mesh;              // normals already there (file / smooth), or none with `flat`
+    bool          flat    = false;
+    VertexEncoder encoder;           // center, scale and layout of the view
+    unsigned      threads = 0;
+
+    // Vertices [first, first + count) of the model, encoder.layout.stride bytes each
+    void writeVertices(size_t first, size_t count, void *dst) const;
+    // Indices [first, first + count) at `size` bytes each
+    void writeIndices(size_t first, size_t count, size_t size, void *dst) const;
+};
+
+// A model ready for the GPU : interleaved vertices (see `layout`) and indices already at their
+// final width, plus where it was centered and how much it was scaled
+// It only points to memory owned by a ModelBuffers (fresh load) or a MeshCache (mapped .scopbin)
+// A fused model has no vertices / indices in memory, `fused` makes them on demand (see copyViewVertices)
+// Submesh boxes and `bounds` are in the same centered and scaled space as the vertices
+struct MeshView {
+    const void*    vertices     = nullptr;
+    size_t         vertexCount  = 0;
+    const void*    indices      = nullptr;
+    const FusedMesh* fused      = nullptr;
+    size_t         indexCount   = 0;
+    size_t         indexSize    = sizeof(uint32_t);
+    const SubMesh* submeshes    = nullptr;
+    size_t         submeshCount = 0;
+    std::vector<std::string> materials;
+    std::vector<std::string> mtllibs;
+    float          center[3]    = { 0.0f, 0.0f, 0.0f };
+    float          scale        = 1.0f;
+    Bounds         bounds;                  // of the whole model, for culling
+    float          normalCrease = -1.0f;    // NormalOptions::crease() of generated normals, -1 = from the file
+    VertexLayout       layout;
+    VertexQuantization quant;               // uniforms of the vertex shader for a quantized layout
+    bool           cacheOrdered = false;    // went through optimizeVertexCache (or had nothing to gain from it)
+    const MeshLod* lods         = nullptr;  // errors in the centered and scaled space
+    size_t         lodCount     = 0;
+    const SubMesh* lodSubmeshes = nullptr;  // submeshCount per level
+    std::vector<float> lodRatios;           // BuildOptions::lodRatios they were made for
+    const Meshlet* meshlets     = nullptr;  // in the centered and scaled space
+    size_t         meshletCount = 0;
+    const uint32_t* meshletRanges = nullptr; // see Mesh::meshletRanges
+    size_t         meshletRangeCount = 0;
+    bool           watertight   = false;
+    float          weldEpsilon  = -1.0f;    // BuildOptions::weldEpsilon it was made with
+};
+
+// Read vertices / indices of any view, copied from memory or written by its FusedMesh
+void copyViewVertices(const MeshView &view, size_t first, size_t count, void *dst);
+void copyViewIndices(const MeshView &view, size_t first, size_t count, void *dst);
+
+// Everything buildModelBuffers can be asked for
+struct BuildOptions {
+    NormalOptions normals;
+    VertexFormat  format      = VertexFormat::Float;
+    bool          vertexCache = true;     // triangle and vertex order for the GPU caches (see optimizeVertexCache)
+    bool          fused       = false;    // see FusedMesh
+    float         weldEpsilon = -1.0f;    // see weldVertices, < 0 = keep the vertices as loaded (the default)
+    std::vector<float> lodRatios = { 0.5f, 0.25f, 0.125f, 0.0625f };   // see buildLods, empty = none
+};
+
+// A .scopbin remembers at most this many ratios
+const size_t maxLodLevels = 8;
+
+// "0.5,0.25,0.1" or "none", up to maxLodLevels ratios in ]0, 1[, each smaller than the one before
+bool parseLodRatios(const std::string& text, std::vector<float>& out);
+
+struct ModelBuffers {
+    std::vector<uint8_t> vertexData;
+    std::vector<uint8_t> indexData;
+    std::vector<SubMesh> submeshes;
+    std::vector<MeshLod> lods;
+    std::vector<SubMesh> lodSubmeshes;
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> meshletRanges;
+    FusedMesh            fused;
+    MeshView             view;
+};
+
+// The whole CPU side of a model : welding, normals if missing, levels of detail, cache friendly order, meshlets,
+// center / scale, interleave in the vertex format, pack indices
+// The mesh is consumed, its arrays are released as soon as they are not needed anymore
+// With `fused` the last two steps are left to whoever writes the view out (see FusedMesh)
+void buildModelBuffers(Mesh &mesh, ModelBuffers &out, const BuildOptions &options = BuildOptions());
+
+// BVH of the full detail triangles of a view, for ray queries, in its centered and scaled space
+// Positions are read back from the vertices as the vertex shader sees them (quantized ones included),
+// so it can be made from any view long after the load, a warm one or a fused one too
+void buildViewBvh(const MeshView &view, Bvh &out, unsigned threads = 0);
@@ -0,0 +1,36 @@
+// mesh_cache.hpp
+#pragma once
+#include <string>
+#include "mesh.hpp"
+#include "mapped_file.hpp"
+
+// Binary cache of a fully processed model (.scopbin)
+// It stores the MeshView of a model (interleaved vertices in their VertexFormat, packed indices,
+// center and scale)
+// so the next launch maps the file and uploads it as is, without parsing anything
+//
+// A cache file is valid for a source .obj with the same size and mtime, or failing that
+// the same content hash (a copied or touched file doesn't need a rebuild)
+// Normals generated for a file without any are only reused with the same NormalOptions,
+// and the vertices only with the same VertexFormat. A cache written without the vertex cache
+// optimization is rebuilt once it is asked for, and so is one with levels of detail for other ratios
+// or welded with another epsilon
+
+struct MeshCacheOptions {
+    bool        enabled = true;
+    std::string dir;            // empty = next to the model
+};
+
+// Where the cache of objPath lives : model.obj.scopbin, or <dir>/model.obj-<hash of the full path>.scopbin
+std::string meshCachePath(const std::string& objPath, const MeshCacheOptions& opts);
+
+// A mapped .scopbin, `view` points inside the mapping and stays valid while this object lives
+struct MeshCache {
+    MappedFile file;
+    MeshView   view;
+
+    bool open(const std::string& cachePath, const std::string& objPath,
+              const BuildOptions& options = BuildOptions());
+};
+
+bool writeMeshCache(const std::string& cachePath, const std::string& objPath, const MeshView& view);
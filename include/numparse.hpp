@@ -0,0 +1,126 @@
+// numparse.hpp
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+
+// Locale-free number parsing for the OBJ loader
+// Everything works on a [p, end) range so the input doesn't need to be null terminated
+// Each function returns the position right after the number, or nullptr if there is no number at p
+
+// Integer like "42" or "-7", fails on overflow
+inline const char* parseInt(const char* p, const char* end, int& out) {
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+
+    const char* digits = p;
+    int64_t value = 0;
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        value = value * 10 + (*p - '0');
+        if (value > 2147483648LL)
+            return nullptr;
+        p++;
+    }
+    if (p == digits || (!neg && value > 2147483647LL))
+        return nullptr;
+
+    out = neg ? (int)-value : (int)value;
+    return p;
+}
+
+// Decimal float like "-0.125", "3", "1.5e-3"
+// Most OBJ values have a few significant digits and a small exponent, those are computed exactly
+// with one float or double operation (both operands are exact powers of ten / integers, so the
+// single rounding is the correct one). Anything longer, or any case where the double result would
+// be rounded twice on its way to float, goes through std::from_chars
+inline const char* parseFloat(const char* p, const char* end, float& out) {
+    static const float  pow10f[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+    static const double pow10d[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    const char* start = p;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+
+    // Mantissa digits, the decimal point only moves the exponent
+    // Leading zeros are counted too, it keeps the digit loop tight and only
+    // sends the rare "0.000000000000000001234" style values to the slow path
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    const char* digits = p;
+
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        mantissa = mantissa * 10 + (unsigned)(*p - '0');
+        p++;
+    }
+    int digitCount = (int)(p - digits);
+    if (p < end && *p == '.') {
+        p++;
+        const char* frac = p;
+        while (p < end && (unsigned)(*p - '0') < 10) {
+            mantissa = mantissa * 10 + (unsigned)(*p - '0');
+            p++;
+        }
+        exponent = -(int)(p - frac);
+        digitCount += (int)(p - frac);
+    }
+    if (digitCount == 0)
+        return nullptr;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool eneg = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            eneg = (*e == '-');
+            e++;
+        }
+        if (e < end && (unsigned)(*e - '0') < 10) {
+            int ev = 0;
+            while (e < end && (unsigned)(*e - '0') < 10) {
+                if (ev < 10000)
+                    ev = ev * 10 + (*e - '0');
+                e++;
+            }
+            exponent += eneg ? -ev : ev;
+            p = e;
+        }
+    }
+
+    // More than 19 digits may have overflowed the mantissa, the fast paths would not be exact anymore
+    if (digitCount <= 19) {
+        if (mantissa == 0) {
+            out = neg ? -0.0f : 0.0f;
+            return p;
+        }
+        // Float fast path : mantissa and power of ten are both exact floats
+        if (mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10) {
+            float v = (float)mantissa;
+            v = (exponent < 0) ? v / pow10f[-exponent] : v * pow10f[exponent];
+            out = neg ? -v : v;
+            return p;
+        }
+        // Double fast path, then make sure the float rounding is not a tie on the double
+        if (mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+            double d = (double)mantissa;
+            d = (exponent < 0) ? d / pow10d[-exponent] : d * pow10d[exponent];
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof(bits));
+            if ((bits & ((1ull << 29) - 1)) != (1ull << 28)) {
+                out = neg ? -(float)d : (float)d;
+                return p;
+            }
+        }
+    }
+
+    // Slow but always correct
+    if (*start == '+')
+        start++;
+    std::from_chars_result r = std::from_chars(start, end, out);
+    return (r.ec == std::errc()) ? r.ptr : nullptr;
+}
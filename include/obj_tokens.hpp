@@ -0,0 +1,124 @@
+// obj_tokens.hpp
+#pragma once
+#include <cstring>
+#include <string>
+#include <vector>
+#include "numparse.hpp"
+
+// Pointer based tokens of the mmap OBJ parser
+// Every function works on a [p, end) range of the mapped file and moves p past what it read
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && isBlank(*p))
+        p++;
+    return p;
+}
+
+// Start of the next line (or end of the file)
+inline const char* nextLine(const char* p, const char* end) {
+    const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+    return nl ? nl + 1 : end;
+}
+
+// Compare the keyword at the start of a line, it has to be followed by a blank
+inline bool isKeyword(const char* p, const char* end, const char* kw, size_t len) {
+    return (size_t)(end - p) > len && memcmp(p, kw, len) == 0 && isBlank(p[len]);
+}
+
+// Rest of the line without its surrounding blanks (names can contain spaces)
+inline std::string readName(const char* p, const char* end) {
+    p = skipBlanks(p, end);
+    while (end > p && (isBlank(end[-1]) || end[-1] == '\n'))
+        end--;
+    return std::string(p, end);
+}
+
+// Read one float, on failure the value is 0 like operator>> does
+inline float readFloat(const char*& p, const char* end) {
+    p = skipBlanks(p, end);
+    float value = 0.0f;
+    const char* next = parseFloat(p, end, value);
+    if (!next)
+        return 0.0f;
+    p = next;
+    return value;
+}
+
+inline bool readInt(const char*& p, const char* end, int& out) {
+    const char* next = parseInt(p, end, out);
+    if (!next)
+        return false;
+    p = next;
+    return true;
+}
+
+// One face corner "v", "v/vt", "v//vn" or "v/vt/vn" with raw OBJ indices
+// OBJ never uses 0 as an index, so 0 means missing. Negative indices are relative (-1 = last one)
+// Returns false when there is no corner left on the line
+inline bool readCorner(const char*& p, const char* end, int& vi, int& ti, int& ni) {
+    vi = ti = ni = 0;
+    p = skipBlanks(p, end);
+    if (p >= end || *p == '\n' || !readInt(p, end, vi))
+        return false;
+
+    if (p < end && *p == '/') {
+        p++;
+        if (p < end && *p != '/')
+            readInt(p, end, ti);
+        if (p < end && *p == '/') {
+            p++;
+            readInt(p, end, ni);
+        }
+    }
+
+    // Skip whatever is left of a malformed corner
+    while (p < end && !isBlank(*p) && *p != '\n')
+        p++;
+    return true;
+}
+
+// Raw corners of one face line
+// The first 16 corners live inside the object, bigger polygons spill to a vector
+// that keeps its capacity, so once warmed up no face line allocates anything
+struct FaceCorners {
+    static const size_t inlineCapacity = 16;
+
+    int              inlineData[inlineCapacity * 3];
+    std::vector<int> spill;
+    size_t           count = 0;
+
+    void clear() {
+        count = 0;
+        spill.clear();
+    }
+
+    void push(int vi, int ti, int ni) {
+        int* dst;
+        if (count < inlineCapacity)
+            dst = inlineData + count * 3;
+        else {
+            if (count == inlineCapacity)
+                spill.assign(inlineData, inlineData + inlineCapacity * 3);
+            spill.resize((count + 1) * 3);
+            dst = spill.data() + count * 3;
+        }
+        dst[0] = vi; dst[1] = ti; dst[2] = ni;
+        count++;
+    }
+
+    const int* data() const {
+        return count <= inlineCapacity ? inlineData : spill.data();
+    }
+};
+
+// Read every corner of a face line
+inline void readFace(const char* p, const char* end, FaceCorners& face) {
+    face.clear();
+    int vi, ti, ni;
+    while (readCorner(p, end, vi, ti, ni))
+        face.push(vi, ti, ni);
+}
@@ -0,0 +1,55 @@
+// parallel.hpp
+#pragma once
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Tiny fork/join helpers for the CPU side of loading
+// Threads are created for each call, so only use them on work that takes well over a millisecond
+
+// 0 means "as many as the machine has"
+inline unsigned resolveThreadCount(unsigned requested) {
+    if (requested != 0)
+        return requested;
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw ? hw : 1;
+}
+
+// Call fn(task) once for every task in [0, count), spread over up to `threads` threads
+// Task t always runs on worker t % threads, so the split is deterministic
+template <typename F>
+void parallelFor(size_t count, unsigned threads, F fn) {
+    if (threads > count)
+        threads = (unsigned)count;
+    if (threads <= 1) {
+        for (size_t t = 0; t < count; t++)
+            fn(t);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned w = 1; w < threads; w++) {
+        workers.emplace_back([&fn, count, threads, w]() {
+            for (size_t t = w; t < count; t += threads)
+                fn(t);
+        });
+    }
+    // The calling thread is worker 0
+    for (size_t t = 0; t < count; t += threads)
+        fn(t);
+    for (std::thread& th : workers)
+        th.join();
+}
+
+// Split [0, n) in `threads` contiguous ranges and call fn(begin, end, rangeIndex) on each
+template <typename F>
+void parallelRanges(size_t n, unsigned threads, F fn) {
+    if (threads == 0)
+        threads = 1;
+    if (threads > n)
+        threads = n ? (unsigned)n : 1;
+    parallelFor(threads, threads, [&](size_t r) {
+        fn(n * r / threads, n * (r + 1) / threads, r);
+    });
+}
@@ -1,13 +1,113 @@
 // parsing.hpp
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <string>
 
+// Part of a mesh between two o / g / usemtl records, drawn with one call
+// It is a range of the shared index buffer, with the bounding box of the vertices it uses
+struct SubMesh {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t  materialId;                // into Mesh::materials, -1 = no usemtl
+    float    min[3];
+    float    max[3];
+};
+
+// A coarser version of the whole mesh (see buildLods), drawn instead of it once its error is too small to see
+struct MeshLod {
+    float    ratio;                     // triangles asked for, as a fraction of the full mesh
+    float    error;                     // how far the surface may have moved, in the units of the vertices
+    uint32_t triangleCount;
+};
+
+// A small run of triangles of one draw range (see buildMeshlets), culled as a whole on the CPU
+struct Meshlet {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float    center[3];                 // bounding sphere of its vertices
+    float    radius;
+    float    coneAxis[3];               // average facing of its triangles
+    float    coneCos;                   // cos of the widest angle between the axis and one of them, <= 0 = never back facing
+};
+
+// Indexed mesh : every unique (v, vt, vn) combination of the file is stored once,
+// triangles refer to them through `indices`
 struct Mesh {
-    std::vector<float> vertices;
-    std::vector<float> colors;
-    std::vector<float> normals;
-    std::vector<float> uvs;
+    std::vector<float>       vertices;  // x y z per vertex
+    std::vector<float>       normals;   // nx ny nz per vertex, empty when the file has none
+    std::vector<float>       uvs;       // u v per vertex, empty when the file has none
+    std::vector<uint32_t>    indices;   // 3 per triangle
+    std::vector<SubMesh>     submeshes; // always at least one when there are triangles
+    std::vector<std::string> materials; // usemtl names, in order of first use
+    std::vector<std::string> mtllibs;   // mtllib file names, relative to the .obj
+    std::vector<MeshLod>     lods;      // finest first, their triangles follow the full mesh in `indices`
+    std::vector<SubMesh>     lodSubmeshes; // submeshes.size() per level, level after level
+    std::vector<Meshlet>     meshlets;  // every submesh then every lodSubmesh, cut in runs, in index order
+    std::vector<uint32_t>    meshletRanges; // first meshlet of each of those ranges, plus the total at the end
+    bool                     watertight = false; // see isWatertight, set by buildMeshlets
+};
+
+// An o / g / usemtl record, `corner` is the number of triangle corners read before it
+struct ObjGroupEvent {
+    enum Kind { Object, Group, Material };
+
+    size_t      corner;
+    Kind        kind;
+    std::string name;
+};
+
+// Raw records of an .obj file, before face corners are turned into unique vertices
+struct ObjData {
+    std::vector<float>         positions;
+    std::vector<float>         uvs;
+    std::vector<float>         normals;
+    std::vector<int>           corners;  // (v, vt, vn) per triangle corner, 0-based, -1 when missing
+    std::vector<ObjGroupEvent> groups;
+    std::vector<std::string>   mtllibs;
 };
- 
-bool loadOBJ(const std::string& path, Mesh& outMesh);
+
+// Corner of a relative index that reaches before the first record (-999 with 3 vertices read)
+// Not the same as missing : buildIndexedMesh rejects the face
+const int badRelativeIndex = INT32_MIN;
+
+// Which parser reads the .obj file
+// Stream = the original getline + stringstream path, kept so we can compare against it
+// Mapped = the file is mmapped and walked with a pointer, no allocation per line
+enum class ObjLoader {
+    Stream,
+    Mapped
+};
+
+struct ObjOptions {
+    ObjLoader loader  = ObjLoader::Mapped;
+    unsigned  threads = 0;       // 0 = one per core, 1 = serial (the stream loader is always serial)
+    bool      presize = true;    // mmap loader : count records first so every buffer is allocated once
+    bool      verbose = true;    // print vertex count, parse throughput and memory use
+};
+
+// What a load cost in memory
+// Reallocations are counted on the growing buffers of the mmap loader and the indexing step
+struct ObjLoadStats {
+    size_t reallocations = 0;
+    size_t peakRssKB     = 0;    // peak resident memory during loadOBJ
+    size_t startRssKB    = 0;    // resident memory when loadOBJ started
+};
+
+bool loadOBJ(const std::string& path, Mesh& outMesh, const ObjOptions& opts = ObjOptions(),
+             ObjLoadStats* stats = nullptr);
+bool loadOBJStream(const std::string& path, ObjData& out);
+bool loadOBJMapped(const std::string& path, ObjData& out, const ObjOptions& opts = ObjOptions(),
+                   ObjLoadStats* stats = nullptr);
+bool buildIndexedMesh(ObjData& data, Mesh& outMesh, unsigned threads = 0, ObjLoadStats* stats = nullptr);
+
+// push_back that counts how many times the vector had to grow
+template <typename T>
+inline void countedPush(std::vector<T>& v, const T& value, size_t& reallocations) {
+    if (v.size() == v.capacity())
+        reallocations++;
+    v.push_back(value);
+}
+
+const char* objLoaderName(ObjLoader loader);
+bool parseObjLoader(const std::string& name, ObjLoader& out);
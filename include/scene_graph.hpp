@@ -0,0 +1,59 @@
+// scene_graph.hpp
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Mat4.hpp"
+#include "simd.hpp"
+
+// Hierarchy of transforms : every node has a translation, rotation (unit quaternion) and scale relative
+// to its parent, and a world matrix = parent's world * translate * rotate * scale
+// Nodes live in one flat array in depth-first order, parents before their children, so a subtree is one
+// run of the array and a world matrix is always made after its parent's. Changing a node only marks it,
+// update() then remakes the runs under the marked nodes and leaves everything else alone
+
+struct NodeTransform {
+    float position[3] = { 0.0f, 0.0f, 0.0f };
+    float rotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };   // x y z w
+    float scale[3]    = { 1.0f, 1.0f, 1.0f };
+};
+
+struct SceneGraphStats {
+    size_t dirty      = 0;   // nodes changed since the last update
+    size_t recomputed = 0;   // world matrices made again : the changed nodes and everything under them
+};
+
+class SceneGraph {
+public:
+    static constexpr uint32_t noParent = 0xffffffffu;
+
+    // Ids are handed out in order and never change, `parent` must already be in the graph
+    // Adding a node reorders the array on the next update, which then remakes every matrix
+    uint32_t add(uint32_t parent, const NodeTransform &local);
+
+    size_t size() const { return locals.size(); }
+    uint32_t parent(uint32_t node) const;
+    const NodeTransform &local(uint32_t node) const { return locals[slotOf[node]]; }
+    void setLocal(uint32_t node, const NodeTransform &local);
+
+    // World matrices as of the last update
+    const Mat4 &world(uint32_t node) const { return worlds[slotOf[node]]; }
+
+    SceneGraphStats update(SimdLevel level = bestSimdLevel());
+
+private:
+    void reorder();
+    void remake(size_t begin, size_t end, SimdLevel level);
+
+    // By slot, the place in the depth-first array
+    std::vector<NodeTransform> locals;
+    std::vector<Mat4>          worlds;
+    std::vector<uint32_t>      parentSlots;
+    std::vector<uint32_t>      subtreeEnds;   // one past the last slot of the node's subtree
+    std::vector<uint32_t>      ids;
+    std::vector<char>          marked;
+
+    std::vector<uint32_t> slotOf;   // by id
+    std::vector<uint32_t> dirty;    // slots changed since the last update
+    bool                  reordered = true;
+};
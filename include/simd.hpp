@@ -0,0 +1,52 @@
+// simd.hpp
+#pragma once
+
+// Which vector instructions the CPU running us has
+// Kernels are compiled for every level with target attributes (no -mavx2 on the whole build)
+// and pick one at runtime, so the same binary runs everywhere
+
+#if defined(__x86_64__) || defined(__i386__)
+# define SCOP_X86 1
+# include <immintrin.h>
+# define SCOP_TARGET_SSE  __attribute__((target("sse4.1")))
+# define SCOP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+# define SCOP_X86 0
+#endif
+
+enum class SimdLevel {
+    Scalar,
+    SSE,    // SSE4.1, 4 floats
+    AVX2    // 8 floats
+};
+
+// Best level this CPU supports
+inline SimdLevel cpuSimdLevel() {
+#if SCOP_X86
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return SimdLevel::SSE;
+#endif
+    return SimdLevel::Scalar;
+}
+
+// cpuSimdLevel() asked once, for calls too small to pay for the CPU check every time (Mat4)
+inline SimdLevel bestSimdLevel() {
+    static const SimdLevel best = cpuSimdLevel();
+    return best;
+}
+
+// Never go above what the CPU has, asking for AVX2 on an SSE machine gives SSE
+inline SimdLevel clampSimdLevel(SimdLevel wanted) {
+    SimdLevel best = bestSimdLevel();
+    return (int)wanted < (int)best ? wanted : best;
+}
+
+inline const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::SSE:  return "sse4.1";
+        default:              return "scalar";
+    }
+}
@@ -0,0 +1,40 @@
+// transforms.hpp
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "Mat4.hpp"
+#include "simd.hpp"
+
+// Model and model-view-projection matrices of many objects at once
+// Translation, rotation and scale are kept one array per component (x of every object, then y ...),
+// so the kernels load 4 or 8 objects into a register and build their matrices side by side.
+// The matrices come out one after the other in plain Mat4 arrays, ready for a single upload
+
+struct ObjectTransforms {
+    std::vector<float> position[3];    // translation x y z
+    std::vector<float> rotation[4];    // unit quaternion x y z w
+    std::vector<float> scale[3];
+
+    size_t size() const { return position[0].size(); }
+    // New objects sit at the origin, unrotated, at scale 1
+    void resize(size_t count);
+    void set(size_t i, const float position[3], const float rotation[4], const float scale[3]);
+};
+
+// Quaternion of a turn of `angle` radians around (x, y, z), which needn't be normalized
+void axisAngleQuaternion(float x, float y, float z, float angle, float out[4]);
+
+// translate * rotate * scale of one object, the same bits as its model matrix from computeTransforms
+Mat4 trsMatrix(const float position[3], const float rotation[4], const float scale[3]);
+
+// models[i] = translate * rotate * scale and mvps[i] = viewProj * models[i] for every object
+// `models` may be null when only the MVPs are needed. Every level gives the same bits, threads are only
+// used for tens of thousands of objects
+void computeTransforms(const ObjectTransforms &objects, const Mat4 &viewProj, Mat4 *models, Mat4 *mvps,
+                       unsigned threads = 0, SimdLevel level = cpuSimdLevel());
+
+// mvps[i] = viewProj * models[i] for matrices that aren't kept as TRS (a scene graph's world matrices)
+// The models' last row must be 0 0 0 1, it is skipped like in computeTransforms, which gives the same
+// bits for the same model
+void computeMvps(const Mat4 &viewProj, const Mat4 *models, Mat4 *mvps, size_t count, unsigned threads = 0,
+                 SimdLevel level = cpuSimdLevel());
@@ -0,0 +1,70 @@
+// vertex_format.hpp
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "bounds.hpp"
+
+// How the vertices of a model are laid out in its VBO, nothing in here needs a GL context
+//
+//   Float  : 3 floats position, 3 floats normal, 2 floats uv                        24 / 32 bytes
+//   Packed : 4 x unorm16 position, GL_INT_2_10_10_10_REV normal, 2 x unorm16 uv      12 / 16 bytes
+//   Octa   : 4 x unorm16 position, 2 x snorm16 octahedral normal, 2 x unorm16 uv     12 / 16 bytes
+//
+// The second size is with uvs, they are only stored when the file has `vt` : the default texture is
+// mapped triplanar from the position and the normal, it never reads them
+// The 4th position component is padding, attributes stay 4 byte aligned
+// Packed normals are expanded by the vertex fetch, octahedral ones are decoded in the vertex shader
+// but keep 16 bits per component instead of 10
+enum class VertexFormat {
+    Float,
+    Packed,
+    Octa
+};
+
+// Where each attribute sits in a vertex, in bytes
+struct VertexLayout {
+    VertexFormat format       = VertexFormat::Float;
+    bool         hasUvs       = true;
+    size_t       stride       = 32;
+    size_t       normalOffset = 12;
+    size_t       uvOffset     = 24;     // meaningless without uvs
+};
+
+VertexLayout vertexLayout(VertexFormat format, bool hasUvs);
+
+// What the vertex shader needs to map quantized values back : position = positionMin + q * positionExtent
+// with q in [0, 1], uvs the same way with their own box. A Float layout keeps the identity
+struct VertexQuantization {
+    float positionMin[3]    = { 0.0f, 0.0f, 0.0f };
+    float positionExtent[3] = { 1.0f, 1.0f, 1.0f };
+    float uvMin[2]          = { 0.0f, 0.0f };
+    float uvExtent[2]       = { 1.0f, 1.0f };
+};
+
+// Boxes of the positions (`bounds`, already centered and scaled) and of the `uvCount` uvs
+VertexQuantization fitQuantization(VertexFormat format, const Bounds& bounds, const float* uvs, size_t uvCount);
+
+// Writes one vertex at a time in a layout, from the position as loaded (it is centered and scaled
+// here), the normal and the uv (ignored without uvs)
+struct VertexEncoder {
+    VertexLayout       layout;
+    VertexQuantization quant;
+    float              center[3] = { 0.0f, 0.0f, 0.0f };
+    float              scale     = 1.0f;
+    float              positionInv[3] = { 1.0f, 1.0f, 1.0f };
+    float              uvInv[2]       = { 1.0f, 1.0f };
+
+    VertexEncoder() {}
+    VertexEncoder(const VertexLayout& layout, const VertexQuantization& quant, const float center[3], float scale);
+
+    void write(const float* position, const float* normal, const float* uv, unsigned char* dst) const;
+};
+
+// What the vertex shader gets back from an encoded vertex, the position in the centered and scaled space
+// The renderer only decodes on the CPU to build picking structures (see buildViewBvh)
+void decodeVertex(const VertexLayout& layout, const VertexQuantization& quant, const unsigned char* src,
+                  float position[3], float normal[3], float uv[2]);
+
+const char* vertexFormatName(VertexFormat format);
+bool parseVertexFormat(const std::string& name, VertexFormat& out);
@@ -1,172 +1,305 @@
-#include <cmath>
 #include "../include/Mat4.hpp"
 
-// Basically a matrix is a way to transform a 3D point
-// It's just numbers in an array but positioned in a certain way
-// so our GPU knows what to do with the 3D point (rotate, scale, move...)
-
-// Default status of our matrix, like this : 
-//
-// 1 0 0 0
-// 0 1 0 0
-// 0 0 1 0
-// 0 0 0 1
-Mat4 Mat4::identity() {
-    Mat4 r = {};
-    r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
-    return r;
+// The SIMD versions of the Mat4 products, transposes, inverses and transforms, and what picks one
+// The plain versions, which are also what runs at compile time, are in Mat4.hpp
+
+// out = a * (x, y, z, w), w being 1 for points and 0 for directions
+static void transformScalar(const Mat4 &a, const float *in, float *out, size_t count, bool points) {
+    const float *m = a.m;
+    for (size_t i = 0; i < count; i++) {
+        float x = in[i*3], y = in[i*3 + 1], z = in[i*3 + 2];
+        for (int row = 0; row < 3; row++) {
+            float v = m[row]*x + m[4 + row]*y + m[8 + row]*z;
+            out[i*3 + row] = points ? v + m[12 + row] : v;
+        }
+    }
 }
 
-// Multiply two matrices together. To render any object in 3D we need to apply the transformation
-// Projection * View * Model   (MVP)
-Mat4 Mat4::multiply(const Mat4 &a, const Mat4 &b) {
+#if SCOP_X86
+
+// A column of a times one element of b, for every column of b : 4 shuffles, 4 multiplies, 3 adds
+SCOP_TARGET_SSE static Mat4 multiplySse(const Mat4 &a, const Mat4 &b) {
+    __m128 a0 = _mm_load_ps(&a.m[0]), a1 = _mm_load_ps(&a.m[4]);
+    __m128 a2 = _mm_load_ps(&a.m[8]), a3 = _mm_load_ps(&a.m[12]);
     Mat4 r;
-    for (int col = 0; col < 4; col++)
-        for (int row = 0; row < 4; row++) {
-            r.m[col*4 + row] =
-                a.m[0*4 + row] * b.m[col*4 + 0] +
-                a.m[1*4 + row] * b.m[col*4 + 1] +
-                a.m[2*4 + row] * b.m[col*4 + 2] +
-                a.m[3*4 + row] * b.m[col*4 + 3];
-        }
+    for (int col = 0; col < 4; col++) {
+        __m128 bc = _mm_load_ps(&b.m[col*4]);
+        __m128 v = _mm_mul_ps(a0, _mm_shuffle_ps(bc, bc, 0x00));
+        v = _mm_add_ps(v, _mm_mul_ps(a1, _mm_shuffle_ps(bc, bc, 0x55)));
+        v = _mm_add_ps(v, _mm_mul_ps(a2, _mm_shuffle_ps(bc, bc, 0xAA)));
+        v = _mm_add_ps(v, _mm_mul_ps(a3, _mm_shuffle_ps(bc, bc, 0xFF)));
+        _mm_store_ps(&r.m[col*4], v);
+    }
     return r;
 }
 
-// Simulate perspective as if we're looking at an object from a camera, taking into account field of view (fov)
-// aspect ratio (aspect), nearest possible object (near) = minimum distance of display, farthest possible object (far) = max distance of display
-Mat4 Mat4::perspective(float fov, float aspect, float near, float far) {
-    float f = 1.0f / tanf(fov / 2.0f);
-    Mat4 r = {};
-    r.m[0]  = f / aspect;
-    r.m[5]  = f;
-    r.m[10] = (far + near) / (near - far);
-    r.m[11] = -1.0f;
-    r.m[14] = (2 * far * near) / (near - far);
+// Same with two columns of the result per register : a's columns are repeated in both halves and
+// each half of b takes its own broadcast (the shuffle stays inside a half)
+SCOP_TARGET_AVX2 static Mat4 multiplyAvx2(const Mat4 &a, const Mat4 &b) {
+    __m256 a0 = _mm256_broadcast_ps((const __m128 *)&a.m[0]);
+    __m256 a1 = _mm256_broadcast_ps((const __m128 *)&a.m[4]);
+    __m256 a2 = _mm256_broadcast_ps((const __m128 *)&a.m[8]);
+    __m256 a3 = _mm256_broadcast_ps((const __m128 *)&a.m[12]);
+    Mat4 r;
+    for (int col = 0; col < 4; col += 2) {
+        __m256 bc = _mm256_loadu_ps(&b.m[col*4]);
+        __m256 v = _mm256_mul_ps(a0, _mm256_permute_ps(bc, 0x00));
+        v = _mm256_add_ps(v, _mm256_mul_ps(a1, _mm256_permute_ps(bc, 0x55)));
+        v = _mm256_add_ps(v, _mm256_mul_ps(a2, _mm256_permute_ps(bc, 0xAA)));
+        v = _mm256_add_ps(v, _mm256_mul_ps(a3, _mm256_permute_ps(bc, 0xFF)));
+        _mm256_storeu_ps(&r.m[col*4], v);
+    }
     return r;
 }
 
-
-// Make the camera (eye) look at something (c) according to where up is (up)
-Mat4 Mat4::lookAt(float eyeX, float eyeY, float eyeZ,
-            float cx, float cy, float cz,
-            float upX, float upY, float upZ)
-{
-
-    // Compute the direction from the camera to the target 
-    // then normalise it so it gives an absolute direction (not based on distance)
-    float fX = cx - eyeX;
-    float fY = cy - eyeY;
-    float fZ = cz - eyeZ;
-    float fLen = sqrtf(fX*fX + fY*fY + fZ*fZ);
-    fX /= fLen; fY /= fLen; fZ /= fLen;
-
-    // Normalise up
-    float uLen = sqrtf(upX*upX + upY*upY + upZ*upZ);
-    upX /= uLen; upY /= uLen; upZ /= uLen;
-
-    // Compute the s(ide) vector, perpendicular to f(orward) and up
-    float sX = fY*upZ - fZ*upY;
-    float sY = fZ*upX - fX*upZ;
-    float sZ = fX*upY - fY*upX;
-
-    // Re-compute up to make it perpendicular to s(ide) 
-    // If we're looking from an angle, the original up wouldn't necessarily be perpendicular to it 
-    float uX = sY*fZ - sZ*fY;
-    float uY = sZ*fX - sX*fZ;
-    float uZ = sX*fY - sY*fX;
-
-    // Create the new camera matrix with
-    // X axis = side
-    // Y axis = up
-    // Z axis = negative forward 
-    // (negative because we're looking at forward so we're behind it if that makes sense)
-    Mat4 r = identity();
-    r.m[0] = sX; r.m[4] = sY; r.m[8]  = sZ;
-    r.m[1] = uX; r.m[5] = uY; r.m[9]  = uZ;
-    r.m[2] =-fX; r.m[6] =-fY; r.m[10] =-fZ;
-
-    // Then move the entire world in the opposite direction of the camera (instead of moving the camera)
-    // Meaning camera is still at the origin point and everything else translates
-    r.m[12] = -(sX*eyeX + sY*eyeY + sZ*eyeZ);
-    r.m[13] = -(uX*eyeX + uY*eyeY + uZ*eyeZ);
-    r.m[14] =  (fX*eyeX + fY*eyeY + fZ*eyeZ);
-
-    // Return the new view
+SCOP_TARGET_SSE static Mat4 transposeSse(const Mat4 &a) {
+    __m128 c0 = _mm_load_ps(&a.m[0]), c1 = _mm_load_ps(&a.m[4]);
+    __m128 c2 = _mm_load_ps(&a.m[8]), c3 = _mm_load_ps(&a.m[12]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    Mat4 r;
+    _mm_store_ps(&r.m[0], c0);
+    _mm_store_ps(&r.m[4], c1);
+    _mm_store_ps(&r.m[8], c2);
+    _mm_store_ps(&r.m[12], c3);
     return r;
 }
 
-Mat4 Mat4::rotateX(float a) {
-    float c = cosf(a);
-    float s = sinf(a);
+// 2x2 blocks packed in one register, x y z w = top left, top right, bottom left, bottom right
+// (how they come out of the column major matrix read as rows, which inverts just the same :
+// inverse(transpose(m)) = transpose(inverse(m)))
+SCOP_TARGET_SSE static inline __m128 mat2Mul(__m128 a, __m128 b) {
+    return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
 
-    Mat4 r = identity();
+// adjugate(a) * b
+SCOP_TARGET_SSE static inline __m128 mat2AdjMul(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+}
 
-    r.m[5]  = c;
-    r.m[6]  = s;
-    r.m[9]  = -s;
-    r.m[10] = c;
+// a * adjugate(b)
+SCOP_TARGET_SSE static inline __m128 mat2MulAdj(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
 
+// Block inverse : the 4x4 as four 2x2 blocks A B / C D, every block of the inverse is a few 2x2
+// products of them and the determinant comes out of the same products. No cofactor is computed twice,
+// which is where the scalar version spends most of its 200 or so operations
+SCOP_TARGET_SSE static Mat4 inverseSse(const Mat4 &a) {
+    __m128 r0 = _mm_load_ps(&a.m[0]), r1 = _mm_load_ps(&a.m[4]);
+    __m128 r2 = _mm_load_ps(&a.m[8]), r3 = _mm_load_ps(&a.m[12]);
+    __m128 A = _mm_movelh_ps(r0, r1), B = _mm_movehl_ps(r1, r0);
+    __m128 C = _mm_movelh_ps(r2, r3), D = _mm_movehl_ps(r3, r2);
+
+    // Determinants of A B C D
+    __m128 detSub = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+    __m128 detA = _mm_shuffle_ps(detSub, detSub, 0x00), detB = _mm_shuffle_ps(detSub, detSub, 0x55);
+    __m128 detC = _mm_shuffle_ps(detSub, detSub, 0xAA), detD = _mm_shuffle_ps(detSub, detSub, 0xFF);
+
+    // Adjugates of the blocks of the inverse, X Y / Z W, before the division by the determinant
+    __m128 DC = mat2AdjMul(D, C), AB = mat2AdjMul(A, B);
+    __m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), mat2Mul(B, DC));
+    __m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), mat2Mul(C, AB));
+    __m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), mat2MulAdj(D, AB));
+    __m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), mat2MulAdj(A, DC));
+
+    // |M| = |A||D| + |B||C| - trace(AB * DC)
+    __m128 tr = _mm_mul_ps(AB, _mm_shuffle_ps(DC, DC, _MM_SHUFFLE(3, 1, 2, 0)));
+    tr = _mm_hadd_ps(tr, tr);
+    tr = _mm_hadd_ps(tr, tr);
+    __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+    if (_mm_cvtss_f32(det) == 0.0f) return Mat4::identity();
+
+    // Signs of the adjugate, then its shuffle and the store in one go
+    __m128 rdet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+    X = _mm_mul_ps(X, rdet);
+    Y = _mm_mul_ps(Y, rdet);
+    Z = _mm_mul_ps(Z, rdet);
+    W = _mm_mul_ps(W, rdet);
+    Mat4 r;
+    _mm_store_ps(&r.m[0], _mm_shuffle_ps(X, Y, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_store_ps(&r.m[4], _mm_shuffle_ps(X, Y, _MM_SHUFFLE(0, 2, 0, 2)));
+    _mm_store_ps(&r.m[8], _mm_shuffle_ps(Z, W, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_store_ps(&r.m[12], _mm_shuffle_ps(Z, W, _MM_SHUFFLE(0, 2, 0, 2)));
     return r;
 }
 
-Mat4 Mat4::rotateY(float a) {
-    float c = cosf(a);
-    float s = sinf(a);
-
-    Mat4 r = identity();
-
-    r.m[0]  = c;
-    r.m[2]  = -s;
-    r.m[8]  = s;
-    r.m[10] = c;
+SCOP_TARGET_SSE static inline __m128 crossSse(__m128 a, __m128 b) {
+    __m128 yzxA = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), zxyA = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+    __m128 yzxB = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1)), zxyB = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+    return _mm_sub_ps(_mm_mul_ps(yzxA, zxyB), _mm_mul_ps(zxyA, yzxB));
+}
 
+// Same steps as affineInverseScalar, the last row of a is not read
+SCOP_TARGET_SSE static Mat4 affineInverseSse(const Mat4 &a) {
+    const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    __m128 c0 = _mm_and_ps(_mm_load_ps(&a.m[0]), xyz), c1 = _mm_and_ps(_mm_load_ps(&a.m[4]), xyz);
+    __m128 c2 = _mm_and_ps(_mm_load_ps(&a.m[8]), xyz), t = _mm_load_ps(&a.m[12]);
+    __m128 r0 = crossSse(c1, c2), r1 = crossSse(c2, c0), r2 = crossSse(c0, c1);
+    __m128 det = _mm_dp_ps(c0, r0, 0x7F);
+    if (_mm_cvtss_f32(det) == 0.0f) return Mat4::identity();
+    __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    r0 = _mm_mul_ps(r0, inv);
+    r1 = _mm_mul_ps(r1, inv);
+    r2 = _mm_mul_ps(r2, inv);
+    __m128 r3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    __m128 moved = _mm_mul_ps(r0, _mm_shuffle_ps(t, t, 0x00));
+    moved = _mm_add_ps(moved, _mm_mul_ps(r1, _mm_shuffle_ps(t, t, 0x55)));
+    moved = _mm_add_ps(moved, _mm_mul_ps(r2, _mm_shuffle_ps(t, t, 0xAA)));
+    Mat4 r;
+    _mm_store_ps(&r.m[0], r0);
+    _mm_store_ps(&r.m[4], r1);
+    _mm_store_ps(&r.m[8], r2);
+    _mm_store_ps(&r.m[12], _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), moved));
     return r;
 }
 
-Mat4 Mat4::rotateZ(float a) {
-    float c = cosf(a);
-    float s = sinf(a);
+// Batch transforms work on 4 (SSE) or 8 (AVX2) points at once : the x y z x y z ... run is split into
+// one register of x, one of y, one of z with 5 shuffles, transformed with broadcast matrix elements,
+// and interleaved back with 6. Each 128 bit half of an AVX2 register does the SSE shuffles on its own
+// 4 points. Results are the same to the bit as transformScalar
+SCOP_TARGET_SSE static void transformSse(const Mat4 &a, const float *in, float *out, size_t count, bool points) {
+    const float *m = a.m;
+    __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2  = _mm_set1_ps(m[2]);
+    __m128 m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]), m6  = _mm_set1_ps(m[6]);
+    __m128 m8 = _mm_set1_ps(m[8]), m9 = _mm_set1_ps(m[9]), m10 = _mm_set1_ps(m[10]);
+    __m128 m12 = _mm_set1_ps(m[12]), m13 = _mm_set1_ps(m[13]), m14 = _mm_set1_ps(m[14]);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 v0 = _mm_loadu_ps(in + i*3), v1 = _mm_loadu_ps(in + i*3 + 4), v2 = _mm_loadu_ps(in + i*3 + 8);
+        __m128 xy = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 1, 3, 2));
+        __m128 yz = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 0, 2, 1));
+        __m128 x = _mm_shuffle_ps(v0, xy, _MM_SHUFFLE(2, 0, 3, 0));
+        __m128 y = _mm_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+        __m128 z = _mm_shuffle_ps(yz, v2, _MM_SHUFFLE(3, 0, 3, 1));
+
+        __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m4, y)), _mm_mul_ps(m8, z));
+        __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m1, x), _mm_mul_ps(m5, y)), _mm_mul_ps(m9, z));
+        __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m2, x), _mm_mul_ps(m6, y)), _mm_mul_ps(m10, z));
+        if (points) {
+            rx = _mm_add_ps(rx, m12);
+            ry = _mm_add_ps(ry, m13);
+            rz = _mm_add_ps(rz, m14);
+        }
 
-    Mat4 r = identity();
+        __m128 rxy = _mm_shuffle_ps(rx, ry, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 ryz = _mm_shuffle_ps(ry, rz, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 rzx = _mm_shuffle_ps(rz, rx, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_ps(out + i*3, _mm_shuffle_ps(rxy, rzx, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(out + i*3 + 4, _mm_shuffle_ps(ryz, rxy, _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm_storeu_ps(out + i*3 + 8, _mm_shuffle_ps(rzx, ryz, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    transformScalar(a, in + i*3, out + i*3, count - i, points);
+}
 
-    r.m[0] = c;
-    r.m[1] = s;
-    r.m[4] = -s;
-    r.m[5] = c;
+SCOP_TARGET_AVX2 static inline __m256 loadHalves(const float *low, const float *high) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(low)), _mm_loadu_ps(high), 1);
+}
 
-    return r;
+SCOP_TARGET_AVX2 static inline void storeHalves(float *low, float *high, __m256 v) {
+    _mm_storeu_ps(low, _mm256_castps256_ps128(v));
+    _mm_storeu_ps(high, _mm256_extractf128_ps(v, 1));
 }
 
-Mat4 Mat4::rotateAxis(float x, float y, float z, float angle) {
-    float len = sqrtf(x*x + y*y + z*z);
-    if (len == 0.0f) return identity();
-    x /= len; y /= len; z /= len;
+SCOP_TARGET_AVX2 static void transformAvx2(const Mat4 &a, const float *in, float *out, size_t count, bool points) {
+    const float *m = a.m;
+    __m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]), m2  = _mm256_set1_ps(m[2]);
+    __m256 m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]), m6  = _mm256_set1_ps(m[6]);
+    __m256 m8 = _mm256_set1_ps(m[8]), m9 = _mm256_set1_ps(m[9]), m10 = _mm256_set1_ps(m[10]);
+    __m256 m12 = _mm256_set1_ps(m[12]), m13 = _mm256_set1_ps(m[13]), m14 = _mm256_set1_ps(m[14]);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const float *p = in + i*3;
+        __m256 v0 = loadHalves(p, p + 12), v1 = loadHalves(p + 4, p + 16), v2 = loadHalves(p + 8, p + 20);
+        __m256 xy = _mm256_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 1, 3, 2));
+        __m256 yz = _mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 0, 2, 1));
+        __m256 x = _mm256_shuffle_ps(v0, xy, _MM_SHUFFLE(2, 0, 3, 0));
+        __m256 y = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+        __m256 z = _mm256_shuffle_ps(yz, v2, _MM_SHUFFLE(3, 0, 3, 1));
+
+        __m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, x), _mm256_mul_ps(m4, y)), _mm256_mul_ps(m8, z));
+        __m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m1, x), _mm256_mul_ps(m5, y)), _mm256_mul_ps(m9, z));
+        __m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m2, x), _mm256_mul_ps(m6, y)), _mm256_mul_ps(m10, z));
+        if (points) {
+            rx = _mm256_add_ps(rx, m12);
+            ry = _mm256_add_ps(ry, m13);
+            rz = _mm256_add_ps(rz, m14);
+        }
+
+        __m256 rxy = _mm256_shuffle_ps(rx, ry, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 ryz = _mm256_shuffle_ps(ry, rz, _MM_SHUFFLE(3, 1, 3, 1));
+        __m256 rzx = _mm256_shuffle_ps(rz, rx, _MM_SHUFFLE(3, 1, 2, 0));
+        float *o = out + i*3;
+        storeHalves(o, o + 12, _mm256_shuffle_ps(rxy, rzx, _MM_SHUFFLE(2, 0, 2, 0)));
+        storeHalves(o + 4, o + 16, _mm256_shuffle_ps(ryz, rxy, _MM_SHUFFLE(3, 1, 2, 0)));
+        storeHalves(o + 8, o + 20, _mm256_shuffle_ps(rzx, ryz, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    transformSse(a, in + i*3, out + i*3, count - i, points);
+}
 
-    float c = cosf(angle);
-    float s = sinf(angle);
-    float ic = 1.0f - c;
+#endif
+
+// Which version runs : the one asked for, never above what the CPU has. Transpose and the inverses
+// are 4 wide work, AVX2 gets the SSE versions for them
+Mat4 Mat4::multiply(const Mat4 &a, const Mat4 &b, SimdLevel level) {
+#if SCOP_X86
+    level = clampSimdLevel(level);
+    if (level == SimdLevel::AVX2) return multiplyAvx2(a, b);
+    if (level == SimdLevel::SSE) return multiplySse(a, b);
+#else
+    (void)level;
+#endif
+    return multiplyScalar(a, b);
+}
 
-    Mat4 r = identity();
+Mat4 Mat4::transpose(const Mat4 &a, SimdLevel level) {
+#if SCOP_X86
+    if (clampSimdLevel(level) != SimdLevel::Scalar) return transposeSse(a);
+#else
+    (void)level;
+#endif
+    return transposeScalar(a);
+}
 
-    r.m[0] = c + x*x*ic;
-    r.m[4] = x*y*ic - z*s;
-    r.m[8] = x*z*ic + y*s;
+Mat4 Mat4::inverse(const Mat4 &a, SimdLevel level) {
+#if SCOP_X86
+    if (clampSimdLevel(level) != SimdLevel::Scalar) return inverseSse(a);
+#else
+    (void)level;
+#endif
+    return inverseScalar(a);
+}
 
-    r.m[1] = y*x*ic + z*s;
-    r.m[5] = c + y*y*ic;
-    r.m[9] = y*z*ic - x*s;
+Mat4 Mat4::affineInverse(const Mat4 &a, SimdLevel level) {
+#if SCOP_X86
+    if (clampSimdLevel(level) != SimdLevel::Scalar) return affineInverseSse(a);
+#else
+    (void)level;
+#endif
+    return affineInverseScalar(a);
+}
 
-    r.m[2] = z*x*ic - y*s;
-    r.m[6] = z*y*ic + x*s;
-    r.m[10] = c + z*z*ic;
+static void transform(const Mat4 &a, const float *in, float *out, size_t count, bool points, SimdLevel level) {
+#if SCOP_X86
+    level = clampSimdLevel(level);
+    if (level == SimdLevel::AVX2) return transformAvx2(a, in, out, count, points);
+    if (level == SimdLevel::SSE) return transformSse(a, in, out, count, points);
+#else
+    (void)level;
+#endif
+    transformScalar(a, in, out, count, points);
+}
 
-    return r;
+void Mat4::transformPoints(const Mat4 &a, const float *in, float *out, size_t count, SimdLevel level) {
+    transform(a, in, out, count, true, level);
 }
 
-Mat4 Mat4::translate(float x, float y, float z) {
-    Mat4 r = identity();
-    r.m[12] = x;
-    r.m[13] = y;
-    r.m[14] = z;
-    return r;
+void Mat4::transformVectors(const Mat4 &a, const float *in, float *out, size_t count, SimdLevel level) {
+    transform(a, in, out, count, false, level);
 }
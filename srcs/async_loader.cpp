@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cstdio>
+#include <chrono>
+#include "../include/async_loader.hpp"
+#include "../include/parallel.hpp"
+
+std::unique_ptr<LoadedModel> loadModel(size_t slot, const std::string& path, const ObjOptions& objOptions,
+                                       const BuildOptions& buildOptions, const MeshCacheOptions& cacheOptions) {
+    std::unique_ptr<LoadedModel> model(new LoadedModel());
+    model->slot = slot;
+    model->path = path;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Warm start : a valid .scopbin is mapped without touching the .obj
+    // Cold start : parse, process, then write the cache for next time
+    std::string cachePath = meshCachePath(path, cacheOptions);
+    model->warm = cacheOptions.enabled && model->cache.open(cachePath, path, buildOptions);
+    model->mapped = model->warm;
+    if (!model->warm) {
+        Mesh mesh;
+        if (!loadOBJ(path, mesh, objOptions))
+            return model;
+        if (objOptions.verbose)
+            printf("Loaded OBJ: %s (%zu vertices)\n", path.c_str(), mesh.vertices.size() / 3);
+
+        // Normals, center / scale, interleaving (see mesh_loader)
+        buildModelBuffers(mesh, model->built, buildOptions);
+
+        bool written = cacheOptions.enabled && writeMeshCache(cachePath, path, model->built.view);
+        if (cacheOptions.enabled && !written)
+            printf("Warning: could not write mesh cache %s\n", cachePath.c_str());
+
+        // A fused view was just interleaved into the cache, its mapping is already what the GPU wants
+        // Without a cache the Mesh stays, a MappedWriter interleaves it straight into the GL buffers
+        if (model->built.view.fused && written && model->cache.open(cachePath, path, buildOptions)) {
+            model->mapped = true;
+            model->built.fused = FusedMesh();
+            model->built.view.fused = nullptr;
+        }
+    }
+
+    const MeshView& view = model->view();
+    model->materials = resolveMaterials(path, view.mtllibs, view.materials);
+    for (const Material& material : model->materials)
+        if (!material.diffuseMap.empty() && !model->images.count(material.diffuseMap))
+            decodeImage(material.diffuseMap, model->images[material.diffuseMap]);
+    model->ok = true;
+    model->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return model;
+}
+
+AsyncModelLoader::~AsyncModelLoader() {
+    // Let the workers finish their current model, they don't take new ones
+    nextJob = paths.size();
+    for (std::thread& t : threads)
+        t.join();
+}
+
+void AsyncModelLoader::start(const std::vector<std::string>& modelPaths, const ObjOptions& objOpts,
+                             const BuildOptions& buildOpts, const MeshCacheOptions& cacheOpts, unsigned workers) {
+    paths         = modelPaths;
+    objOptions    = objOpts;
+    buildOptions  = buildOpts;
+    cacheOptions = cacheOpts;
+
+    workers = resolveThreadCount(workers);
+    if (workers > paths.size())
+        workers = (unsigned)paths.size();
+    // The workers share the cores : each model's own parallel steps get its part of them
+    if (workers > 1) {
+        objOptions.threads = std::max(1u, resolveThreadCount(objOpts.threads) / workers);
+        buildOptions.normals.threads = std::max(1u, resolveThreadCount(buildOpts.normals.threads) / workers);
+    }
+    for (unsigned w = 0; w < workers; w++)
+        threads.emplace_back(&AsyncModelLoader::worker, this);
+}
+
+void AsyncModelLoader::worker() {
+    for (;;) {
+        size_t job = nextJob++;
+        if (job >= paths.size())
+            return;
+
+        std::unique_ptr<LoadedModel> model = loadModel(job, paths[job], objOptions, buildOptions, cacheOptions);
+        std::lock_guard<std::mutex> lock(queueLock);
+        finished.push_back(std::move(model));
+        ready.notify_one();
+    }
+}
+
+bool AsyncModelLoader::poll(std::unique_ptr<LoadedModel>& out) {
+    std::lock_guard<std::mutex> lock(queueLock);
+    if (finished.empty())
+        return false;
+    out = std::move(finished.front());
+    finished.pop_front();
+    handedOut++;
+    return true;
+}
+
+bool AsyncModelLoader::wait(std::unique_ptr<LoadedModel>& out) {
+    std::unique_lock<std::mutex> lock(queueLock);
+    if (handedOut == paths.size())
+        return false;
+    ready.wait(lock, [this]() { return !finished.empty(); });
+    out = std::move(finished.front());
+    finished.pop_front();
+    handedOut++;
+    return true;
+}
+
+void MappedWriter::start(const MeshView& view, void* vertices, void* indices) {
+    wait();
+    done = false;
+    thread = std::thread([this, &view, vertices, indices]() {
+        auto start = std::chrono::steady_clock::now();
+        copyViewVertices(view, 0, view.vertexCount, vertices);
+        copyViewIndices(view, 0, view.indexCount, indices);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("[FUSED] %.1f MB %s into the mapped buffers in %.1f ms\n",
+            (view.vertexCount * view.layout.stride + view.indexCount * view.indexSize) / (1024.0 * 1024.0),
+            view.fused ? "interleaved" : "copied", ms);
+        done = true;
+    });
+}
+
+bool MappedWriter::finished() {
+    if (!thread.joinable() || !done)
+        return false;
+    thread.join();
+    return true;
+}
+
+void MappedWriter::wait() {
+    if (thread.joinable())
+        thread.join();
+}
+
+BvhBuilder::~BvhBuilder() {
+    // The BVH being built is finished, the ones waiting are not started
+    {
+        std::lock_guard<std::mutex> lock(queueLock);
+        stopping = true;
+        jobs.clear();
+    }
+    wake.notify_one();
+    if (thread.joinable())
+        thread.join();
+}
+
+void BvhBuilder::add(size_t object, std::unique_ptr<LoadedModel> model) {
+    {
+        std::lock_guard<std::mutex> lock(queueLock);
+        jobs.push_back(Job{ object, std::move(model) });
+    }
+    if (!thread.joinable())
+        thread = std::thread(&BvhBuilder::worker, this);
+    wake.notify_one();
+}
+
+void BvhBuilder::worker() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(queueLock);
+            wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        Bvh bvh;
+        buildViewBvh(job.model->view(), bvh, threads);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("[BVH] %s: %zu nodes over %zu triangles in %.1f ms, in the background\n", job.model->path.c_str(),
+            bvh.nodes.size(), bvh.triangles.size(), ms);
+        job.model.reset();
+
+        std::lock_guard<std::mutex> lock(queueLock);
+        finished.emplace_back(job.object, std::move(bvh));
+    }
+}
+
+bool BvhBuilder::poll(size_t& object, Bvh& out) {
+    std::lock_guard<std::mutex> lock(queueLock);
+    if (finished.empty())
+        return false;
+    object = finished.front().first;
+    out = std::move(finished.front().second);
+    finished.pop_front();
+    return true;
+}
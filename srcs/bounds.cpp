@@ -0,0 +1,487 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "../include/bounds.hpp"
+#include "../include/parallel.hpp"
+
+// Box and bounding sphere of a point cloud
+// Every pass over the points is a reduction : each thread reduces its own range with SIMD lanes,
+// then the ranges are merged in order. Two kinds of pass :
+//   extremes  min / max along the 3 axes and the 4 diagonals, and the first point that has each
+//   farthest  largest squared distance to a center and the first point that has it
+// The scalar, SSE and AVX2 kernels do the same float operations in the same order, so they agree
+// bit for bit and pick the same points
+
+namespace {
+
+// Below this many points threads cost more than they bring
+const size_t minPointsPerThread = 256 * 1024;
+
+// Ritter steps before giving up on growing and taking the farthest distance as it is
+// Real models need 1 or 2, the limit only matters for adversarial clouds
+const int maxGrowSteps = 8;
+
+// A sphere that misses the farthest point by less than this is not worth another pass, its radius
+// becomes that distance instead (at most 0.1% bigger than what growing would give)
+const double closeEnough = 1.001;
+
+// EPOS-14 : x, y, z, then the 4 cube diagonals. The first 3 are the box
+const int directionCount = 7;
+
+struct Extremes {
+    float  min[directionCount];
+    float  max[directionCount];
+    size_t minIndex[directionCount];
+    size_t maxIndex[directionCount];
+
+    Extremes() {
+        for (int d = 0; d < directionCount; d++) {
+            min[d] = INFINITY;
+            max[d] = -INFINITY;
+            minIndex[d] = maxIndex[d] = 0;
+        }
+    }
+};
+
+struct Farthest {
+    float  d2    = -1.0f;   // -1 = no point yet (empty range or only NaN)
+    size_t index = 0;
+};
+
+// Position of a point along every direction. The diagonals are taken on the point / 4 (exact)
+// so adding 3 coordinates can't overflow
+inline void project(const float* v, float* out) {
+    float qx = v[0] * 0.25f, qy = v[1] * 0.25f, qz = v[2] * 0.25f;
+    out[0] = v[0];
+    out[1] = v[1];
+    out[2] = v[2];
+    out[3] = qx + qy + qz;
+    out[4] = qx + qy - qz;
+    out[5] = qx - qy + qz;
+    out[6] = qx - qy - qz;
+}
+
+// Comparisons are written so NaN never wins : `v < min` is false for a NaN v
+void extremesScalar(const float* pos, size_t begin, size_t end, Extremes& e) {
+    for (size_t i = begin; i < end; i++) {
+        float p[directionCount];
+        project(pos + i * 3, p);
+        for (int d = 0; d < directionCount; d++) {
+            if (p[d] < e.min[d]) { e.min[d] = p[d]; e.minIndex[d] = i; }
+            if (p[d] > e.max[d]) { e.max[d] = p[d]; e.maxIndex[d] = i; }
+        }
+    }
+}
+
+// Squared distance from the point scaled by s to c, the vector kernels compute exactly this
+inline float distance2(const float* v, float s, const float* c) {
+    float dx = v[0] * s - c[0];
+    float dy = v[1] * s - c[1];
+    float dz = v[2] * s - c[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+void farthestScalar(const float* pos, size_t begin, size_t end, float s, const float* c, Farthest& best) {
+    for (size_t i = begin; i < end; i++) {
+        float d2 = distance2(pos + i * 3, s, c);
+        if (d2 > best.d2) {
+            best.d2    = d2;
+            best.index = i;
+        }
+    }
+}
+
+#if SCOP_X86
+
+// The vector kernels work on blocks of 4 (or 8) points, each lane remembers its best value and
+// the block it came from. The winner is the best lane, the earliest block on ties, then the first
+// point of that block with that exact value : the same point the scalar loop keeps
+
+// First point of the block whose projection on direction d is v
+size_t firstWith(const float* pos, size_t first, int width, int d, float v) {
+    for (size_t i = first; i < first + width; i++) {
+        float p[directionCount];
+        project(pos + i * 3, p);
+        if (p[d] == v)
+            return i;
+    }
+    return first;
+}
+
+// lo / hi hold `width` lanes per direction, one direction after the other
+void mergeExtremesLanes(const float* pos, size_t begin, int width, const float* lo, const float* hi,
+                        const uint32_t* loBlock, const uint32_t* hiBlock, Extremes& e) {
+    for (int d = 0; d < directionCount; d++) {
+        int base = d * width, l = base, h = base;
+        for (int j = base + 1; j < base + width; j++) {
+            if (lo[j] < lo[l] || (lo[j] == lo[l] && loBlock[j] < loBlock[l])) l = j;
+            if (hi[j] > hi[h] || (hi[j] == hi[h] && hiBlock[j] < hiBlock[h])) h = j;
+        }
+        if (lo[l] < e.min[d]) {
+            e.min[d]      = lo[l];
+            e.minIndex[d] = firstWith(pos, begin + (size_t)loBlock[l] * width, width, d, lo[l]);
+        }
+        if (hi[h] > e.max[d]) {
+            e.max[d]      = hi[h];
+            e.maxIndex[d] = firstWith(pos, begin + (size_t)hiBlock[h] * width, width, d, hi[h]);
+        }
+    }
+}
+
+void mergeFarthestLanes(const float* pos, size_t begin, int width, const float* d2, const uint32_t* block,
+                        float s, const float* c, Farthest& best) {
+    int lane = -1;
+    for (int j = 0; j < width; j++) {
+        if (d2[j] < 0.0f)
+            continue;
+        if (lane < 0 || d2[j] > d2[lane] || (d2[j] == d2[lane] && block[j] < block[lane]))
+            lane = j;
+    }
+    if (lane < 0 || !(d2[lane] > best.d2))
+        return;
+    size_t first = begin + (size_t)block[lane] * width;
+    for (size_t i = first; i < first + width; i++) {
+        if (distance2(pos + i * 3, s, c) == d2[lane]) {
+            best.d2    = d2[lane];
+            best.index = i;
+            return;
+        }
+    }
+}
+
+// 4 points (12 floats) as x / y / z vectors, lane j holds point 0 3 2 1 of the group
+SCOP_TARGET_SSE inline void loadPoints4(const float* v, __m128& x, __m128& y, __m128& z) {
+    __m128 a = _mm_loadu_ps(v);         // x0 y0 z0 x1
+    __m128 b = _mm_loadu_ps(v + 4);     // y1 z1 x2 y2
+    __m128 c = _mm_loadu_ps(v + 8);     // z2 x3 y3 z3
+    x = _mm_blend_ps(_mm_blend_ps(a, b, 0x4), c, 0x2);     // x0 x3 x2 x1
+    y = _mm_blend_ps(_mm_blend_ps(a, b, 0x9), c, 0x4);     // y1 y0 y3 y2
+    z = _mm_blend_ps(_mm_blend_ps(a, b, 0x2), c, 0x9);     // z2 z1 z0 z3
+    y = _mm_shuffle_ps(y, y, _MM_SHUFFLE(0, 3, 2, 1));     // y0 y3 y2 y1
+    z = _mm_shuffle_ps(z, z, _MM_SHUFFLE(1, 0, 3, 2));     // z0 z3 z2 z1
+}
+
+// Block numbers are 32 bits per lane, a range can hold up to 16G points
+SCOP_TARGET_SSE void extremesSse(const float* pos, size_t begin, size_t end, Extremes& e) {
+    size_t blocks = (end - begin) / 4;
+    if (blocks) {
+        __m128  lo[directionCount], hi[directionCount];
+        __m128i loBlock[directionCount], hiBlock[directionCount];
+        for (int d = 0; d < directionCount; d++) {
+            lo[d] = _mm_set1_ps(INFINITY);
+            hi[d] = _mm_set1_ps(-INFINITY);
+            loBlock[d] = hiBlock[d] = _mm_setzero_si128();
+        }
+        const __m128  quarter = _mm_set1_ps(0.25f);
+        const __m128i one     = _mm_set1_epi32(1);
+        __m128i block = _mm_setzero_si128();
+
+        for (size_t b = 0; b < blocks; b++) {
+            __m128 p[directionCount];
+            loadPoints4(pos + (begin + b * 4) * 3, p[0], p[1], p[2]);
+            __m128 qx = _mm_mul_ps(p[0], quarter), qy = _mm_mul_ps(p[1], quarter), qz = _mm_mul_ps(p[2], quarter);
+            __m128 sum = _mm_add_ps(qx, qy), diff = _mm_sub_ps(qx, qy);
+            p[3] = _mm_add_ps(sum, qz);
+            p[4] = _mm_sub_ps(sum, qz);
+            p[5] = _mm_add_ps(diff, qz);
+            p[6] = _mm_sub_ps(diff, qz);
+            for (int d = 0; d < directionCount; d++) {
+                __m128 less = _mm_cmplt_ps(p[d], lo[d]);
+                __m128 more = _mm_cmpgt_ps(p[d], hi[d]);
+                lo[d]      = _mm_blendv_ps(lo[d], p[d], less);
+                hi[d]      = _mm_blendv_ps(hi[d], p[d], more);
+                loBlock[d] = _mm_blendv_epi8(loBlock[d], block, _mm_castps_si128(less));
+                hiBlock[d] = _mm_blendv_epi8(hiBlock[d], block, _mm_castps_si128(more));
+            }
+            block = _mm_add_epi32(block, one);
+        }
+        alignas(16) float    l[directionCount * 4], h[directionCount * 4];
+        alignas(16) uint32_t lb[directionCount * 4], hb[directionCount * 4];
+        for (int d = 0; d < directionCount; d++) {
+            _mm_store_ps(l + d * 4, lo[d]);
+            _mm_store_ps(h + d * 4, hi[d]);
+            _mm_store_si128(reinterpret_cast<__m128i*>(lb + d * 4), loBlock[d]);
+            _mm_store_si128(reinterpret_cast<__m128i*>(hb + d * 4), hiBlock[d]);
+        }
+        mergeExtremesLanes(pos, begin, 4, l, h, lb, hb, e);
+    }
+    extremesScalar(pos, begin + blocks * 4, end, e);
+}
+
+SCOP_TARGET_SSE void farthestSse(const float* pos, size_t begin, size_t end, float s, const float* c,
+                                 Farthest& best) {
+    size_t blocks = (end - begin) / 4;
+    if (blocks) {
+        const __m128 vs = _mm_set1_ps(s);
+        const __m128 cx = _mm_set1_ps(c[0]), cy = _mm_set1_ps(c[1]), cz = _mm_set1_ps(c[2]);
+        __m128  bestD2    = _mm_set1_ps(-1.0f);
+        __m128i bestBlock = _mm_setzero_si128();
+        __m128i block     = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi32(1);
+
+        for (size_t b = 0; b < blocks; b++) {
+            __m128 x, y, z;
+            loadPoints4(pos + (begin + b * 4) * 3, x, y, z);
+            __m128 dx = _mm_sub_ps(_mm_mul_ps(x, vs), cx);
+            __m128 dy = _mm_sub_ps(_mm_mul_ps(y, vs), cy);
+            __m128 dz = _mm_sub_ps(_mm_mul_ps(z, vs), cz);
+            __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            __m128 better = _mm_cmpgt_ps(d2, bestD2);
+            bestD2    = _mm_blendv_ps(bestD2, d2, better);
+            bestBlock = _mm_blendv_epi8(bestBlock, block, _mm_castps_si128(better));
+            block     = _mm_add_epi32(block, one);
+        }
+        alignas(16) float    d2[4];
+        alignas(16) uint32_t blk[4];
+        _mm_store_ps(d2, bestD2);
+        _mm_store_si128(reinterpret_cast<__m128i*>(blk), bestBlock);
+        mergeFarthestLanes(pos, begin, 4, d2, blk, s, c, best);
+    }
+    farthestScalar(pos, begin + blocks * 4, end, s, c, best);
+}
+
+// 8 points (24 floats) as x / y / z vectors, lane j holds point 0 3 6 1 4 7 2 5 of the group
+// The blends put every coordinate in a lane of its own, y and z are then rotated onto x's order
+SCOP_TARGET_AVX2 inline void loadPoints8(const float* v, __m256& x, __m256& y, __m256& z) {
+    __m256 a = _mm256_loadu_ps(v);
+    __m256 b = _mm256_loadu_ps(v + 8);
+    __m256 c = _mm256_loadu_ps(v + 16);
+    x = _mm256_blend_ps(_mm256_blend_ps(a, b, 0x92), c, 0x24);   // x0 x3 x6 x1 x4 x7 x2 x5
+    y = _mm256_blend_ps(_mm256_blend_ps(a, b, 0x24), c, 0x49);   // y5 y0 y3 y6 y1 y4 y7 y2
+    z = _mm256_blend_ps(_mm256_blend_ps(a, b, 0x49), c, 0x92);   // z2 z5 z0 z3 z6 z1 z4 z7
+    y = _mm256_permutevar8x32_ps(y, _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0));
+    z = _mm256_permutevar8x32_ps(z, _mm256_setr_epi32(2, 3, 4, 5, 6, 7, 0, 1));
+}
+
+SCOP_TARGET_AVX2 void extremesAvx2(const float* pos, size_t begin, size_t end, Extremes& e) {
+    size_t blocks = (end - begin) / 8;
+    if (blocks) {
+        __m256  lo[directionCount], hi[directionCount];
+        __m256i loBlock[directionCount], hiBlock[directionCount];
+        for (int d = 0; d < directionCount; d++) {
+            lo[d] = _mm256_set1_ps(INFINITY);
+            hi[d] = _mm256_set1_ps(-INFINITY);
+            loBlock[d] = hiBlock[d] = _mm256_setzero_si256();
+        }
+        const __m256  quarter = _mm256_set1_ps(0.25f);
+        const __m256i one     = _mm256_set1_epi32(1);
+        __m256i block = _mm256_setzero_si256();
+
+        for (size_t b = 0; b < blocks; b++) {
+            __m256 p[directionCount];
+            loadPoints8(pos + (begin + b * 8) * 3, p[0], p[1], p[2]);
+            __m256 qx = _mm256_mul_ps(p[0], quarter), qy = _mm256_mul_ps(p[1], quarter), qz = _mm256_mul_ps(p[2], quarter);
+            __m256 sum = _mm256_add_ps(qx, qy), diff = _mm256_sub_ps(qx, qy);
+            p[3] = _mm256_add_ps(sum, qz);
+            p[4] = _mm256_sub_ps(sum, qz);
+            p[5] = _mm256_add_ps(diff, qz);
+            p[6] = _mm256_sub_ps(diff, qz);
+            for (int d = 0; d < directionCount; d++) {
+                __m256 less = _mm256_cmp_ps(p[d], lo[d], _CMP_LT_OQ);
+                __m256 more = _mm256_cmp_ps(p[d], hi[d], _CMP_GT_OQ);
+                lo[d]      = _mm256_blendv_ps(lo[d], p[d], less);
+                hi[d]      = _mm256_blendv_ps(hi[d], p[d], more);
+                loBlock[d] = _mm256_blendv_epi8(loBlock[d], block, _mm256_castps_si256(less));
+                hiBlock[d] = _mm256_blendv_epi8(hiBlock[d], block, _mm256_castps_si256(more));
+            }
+            block = _mm256_add_epi32(block, one);
+        }
+        alignas(32) float    l[directionCount * 8], h[directionCount * 8];
+        alignas(32) uint32_t lb[directionCount * 8], hb[directionCount * 8];
+        for (int d = 0; d < directionCount; d++) {
+            _mm256_store_ps(l + d * 8, lo[d]);
+            _mm256_store_ps(h + d * 8, hi[d]);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lb + d * 8), loBlock[d]);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(hb + d * 8), hiBlock[d]);
+        }
+        mergeExtremesLanes(pos, begin, 8, l, h, lb, hb, e);
+    }
+    extremesScalar(pos, begin + blocks * 8, end, e);
+}
+
+SCOP_TARGET_AVX2 void farthestAvx2(const float* pos, size_t begin, size_t end, float s, const float* c,
+                                   Farthest& best) {
+    size_t blocks = (end - begin) / 8;
+    if (blocks) {
+        const __m256 vs = _mm256_set1_ps(s);
+        const __m256 cx = _mm256_set1_ps(c[0]), cy = _mm256_set1_ps(c[1]), cz = _mm256_set1_ps(c[2]);
+        __m256  bestD2    = _mm256_set1_ps(-1.0f);
+        __m256i bestBlock = _mm256_setzero_si256();
+        __m256i block     = _mm256_setzero_si256();
+        const __m256i one = _mm256_set1_epi32(1);
+
+        for (size_t b = 0; b < blocks; b++) {
+            __m256 x, y, z;
+            loadPoints8(pos + (begin + b * 8) * 3, x, y, z);
+            __m256 dx = _mm256_sub_ps(_mm256_mul_ps(x, vs), cx);
+            __m256 dy = _mm256_sub_ps(_mm256_mul_ps(y, vs), cy);
+            __m256 dz = _mm256_sub_ps(_mm256_mul_ps(z, vs), cz);
+            __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                      _mm256_mul_ps(dz, dz));
+            __m256 better = _mm256_cmp_ps(d2, bestD2, _CMP_GT_OQ);
+            bestD2    = _mm256_blendv_ps(bestD2, d2, better);
+            bestBlock = _mm256_blendv_epi8(bestBlock, block, _mm256_castps_si256(better));
+            block     = _mm256_add_epi32(block, one);
+        }
+        alignas(32) float    d2[8];
+        alignas(32) uint32_t blk[8];
+        _mm256_store_ps(d2, bestD2);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(blk), bestBlock);
+        mergeFarthestLanes(pos, begin, 8, d2, blk, s, c, best);
+    }
+    farthestScalar(pos, begin + blocks * 8, end, s, c, best);
+}
+
+#endif
+
+}
+
+Bounds computeBounds(const float* positions, size_t count, unsigned threads, SimdLevel level) {
+    typedef void (*ExtremesKernel)(const float*, size_t, size_t, Extremes&);
+    typedef void (*FarthestKernel)(const float*, size_t, size_t, float, const float*, Farthest&);
+    ExtremesKernel extremesKernel = extremesScalar;
+    FarthestKernel farthestKernel = farthestScalar;
+#if SCOP_X86
+    level = clampSimdLevel(level);
+    if (level == SimdLevel::AVX2) {
+        extremesKernel = extremesAvx2;
+        farthestKernel = farthestAvx2;
+    }
+    else if (level == SimdLevel::SSE) {
+        extremesKernel = extremesSse;
+        farthestKernel = farthestSse;
+    }
+#else
+    (void)level;
+#endif
+
+    threads = resolveThreadCount(threads);
+    size_t maxThreads = count / minPointsPerThread;
+    if (threads > maxThreads)
+        threads = maxThreads ? (unsigned)maxThreads : 1;
+
+    // Box, no sentinel values : an empty box is +inf / -inf and any float point fits in it
+    std::vector<Extremes> partial(threads);
+    parallelRanges(count, threads, [&](size_t begin, size_t end, size_t r) {
+        extremesKernel(positions, begin, end, partial[r]);
+    });
+    Extremes box;
+    for (const Extremes& e : partial) {
+        for (int d = 0; d < directionCount; d++) {
+            if (e.min[d] < box.min[d]) { box.min[d] = e.min[d]; box.minIndex[d] = e.minIndex[d]; }
+            if (e.max[d] > box.max[d]) { box.max[d] = e.max[d]; box.maxIndex[d] = e.maxIndex[d]; }
+        }
+    }
+
+    Bounds out;
+    for (int a = 0; a < 3; a++)
+        if (!(box.min[a] <= box.max[a]))
+            return out;
+    double halfExtent = 0.0;
+    for (int a = 0; a < 3; a++) {
+        out.min[a] = box.min[a];
+        out.max[a] = box.max[a];
+        // Halves first, (min + max) overflows for boxes near the float range
+        out.center[a] = box.min[a] * 0.5f + box.max[a] * 0.5f;
+        halfExtent = std::fmax(halfExtent, ((double)box.max[a] - box.min[a]) * 0.5);
+    }
+    if (!std::isfinite(halfExtent)) {
+        for (int a = 0; a < 3; a++)
+            if (!std::isfinite(out.center[a]))
+                out.center[a] = 0.0f;
+        out.radius = INFINITY;
+        return out;
+    }
+
+    // The sphere is computed on the points scaled by a power of two, which brings the box to about
+    // [-1, 1] around its center without rounding anything : squared distances can't overflow
+    // for huge clouds (coordinates past 1e19 already do) nor underflow for tiny ones
+    int exponent = 0;
+    if (halfExtent > 0.0)
+        std::frexp(halfExtent, &exponent);
+    if (exponent < -126)
+        exponent = -126;
+    const float  s       = std::ldexp(1.0f, -exponent);
+    const double unscale = std::ldexp(1.0, exponent);
+
+    std::vector<Farthest> far(threads);
+    auto farthest = [&](const float* c) {
+        parallelRanges(count, threads, [&](size_t begin, size_t end, size_t r) {
+            far[r] = Farthest();
+            farthestKernel(positions, begin, end, s, c, far[r]);
+        });
+        // Strictly greater : on ties the earlier range, so the earlier point, wins
+        Farthest best;
+        for (const Farthest& f : far)
+            if (f.d2 > best.d2)
+                best = f;
+        return best;
+    };
+    auto scaled = [&](size_t i, float* q) {
+        for (int a = 0; a < 3; a++)
+            q[a] = positions[i * 3 + a] * s;
+    };
+
+    // Starting sphere : of the 7 pairs of extreme points, the one farthest apart on the sphere's
+    // surface. The first pass found them already, so this costs nothing
+    float c[3], p[3], q[3];
+    double radius = -1.0;
+    for (int d = 0; d < directionCount; d++) {
+        float lo[3], hi[3];
+        scaled(box.minIndex[d], lo);
+        scaled(box.maxIndex[d], hi);
+        double d2 = 0.0;
+        for (int a = 0; a < 3; a++)
+            d2 += ((double)hi[a] - lo[a]) * ((double)hi[a] - lo[a]);
+        if (d2 > radius) {
+            radius = d2;
+            memcpy(p, lo, sizeof(p));
+            memcpy(q, hi, sizeof(q));
+        }
+    }
+    double center[3];
+    for (int a = 0; a < 3; a++) {
+        center[a] = ((double)p[a] + q[a]) * 0.5;
+        c[a]      = (float)center[a];
+    }
+    radius = std::sqrt(radius) * 0.5;
+
+    // Ritter : while a point is outside, move the sphere towards it just enough to touch it with the
+    // far side still where it was. Then the radius is the distance to the farthest point, measured
+    // from the float center we return, so every point is inside whatever rounding happened before
+    for (int step = 0;; step++) {
+        Farthest outside = farthest(c);
+        double distance = std::sqrt((double)outside.d2);
+        if (distance <= radius * closeEnough || step == maxGrowSteps) {
+            radius = distance;
+            break;
+        }
+        scaled(outside.index, p);
+        double move = (distance - radius) * 0.5 / distance;
+        for (int a = 0; a < 3; a++) {
+            center[a] = c[a] + (p[a] - (double)c[a]) * move;
+            c[a]      = (float)center[a];
+        }
+        radius = (radius + distance) * 0.5;
+    }
+
+    for (int a = 0; a < 3; a++)
+        out.center[a] = (float)(c[a] * unscale);
+    // A few float roundings separate our distances from the ones a caller computes, pad for them
+    out.radius = (float)(radius * unscale * (1.0 + 1e-6));
+    return out;
+}
+
+Bounds transformBounds(const Bounds& b, const float center[3], float scale) {
+    Bounds out = b;
+    if (b.empty())
+        return out;
+    for (int a = 0; a < 3; a++) {
+        out.min[a]    = (b.min[a] - center[a]) * scale;
+        out.max[a]    = (b.max[a] - center[a]) * scale;
+        out.center[a] = (b.center[a] - center[a]) * scale;
+    }
+    out.radius = b.radius * scale;
+    return out;
+}
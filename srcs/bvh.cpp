@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <thread>
+#include "../include/bvh.hpp"
+#include "../include/parallel.hpp"
+
+namespace {
+
+const unsigned binCount = 16;
+// A node visit against a triangle test, what a split has to save to be worth it
+const float traversalCost = 1.0f;
+// Past this depth splits are made at the median, so even a pathological input stays shallow enough
+// for the query stack
+const unsigned medianDepth = 48;
+const unsigned stackSize   = 128;
+// Below this many triangles a subtree isn't worth a thread of its own
+const size_t spawnTriangles = 65536;
+
+// Plain compares, std::fmin has to care about NaNs and ends up several times slower here
+inline float minf(float a, float b) { return a < b ? a : b; }
+inline float maxf(float a, float b) { return a > b ? a : b; }
+
+struct Box {
+    float min[3] = { INFINITY, INFINITY, INFINITY };
+    float max[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+    void grow(const float* lo, const float* hi) {
+        for (int a = 0; a < 3; a++) {
+            min[a] = minf(min[a], lo[a]);
+            max[a] = maxf(max[a], hi[a]);
+        }
+    }
+    // Half the surface area, only ever compared
+    float area() const {
+        float d[3] = { max[0] - min[0], max[1] - min[1], max[2] - min[2] };
+        if (!(d[0] >= 0.0f))
+            return 0.0f;
+        return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+    }
+};
+
+struct Bin {
+    Box    box;
+    size_t count = 0;
+};
+
+// boxes = min[3], max[3] of every triangle, slots = triangle numbers, reordered into leaf order
+struct Builder {
+    const float* boxes;
+    uint32_t*    slots;
+    unsigned     spawnDepth;
+
+    float centroid(uint32_t t, int a) const { return (boxes[t * 6 + a] + boxes[t * 6 + 3 + a]) * 0.5f; }
+    void  build(std::vector<BvhNode>& nodes, size_t begin, size_t end, unsigned depth) const;
+    size_t split(const Box& box, const Box& centroids, size_t begin, size_t end, unsigned depth) const;
+};
+
+// Where [begin, end) gets cut, end = make a leaf
+size_t Builder::split(const Box& box, const Box& centroids, size_t begin, size_t end, unsigned depth) const {
+    size_t count = end - begin;
+    int axis = 0;
+    for (int a = 1; a < 3; a++) {
+        if (centroids.max[a] - centroids.min[a] > centroids.max[axis] - centroids.min[axis])
+            axis = a;
+    }
+    // Every centroid at the same place : no plane separates them, halves just keep leaves small
+    if (!(centroids.max[axis] > centroids.min[axis]))
+        return count <= maxBvhLeafTriangles ? end : begin + count / 2;
+    if (depth >= medianDepth) {
+        size_t mid = begin + count / 2;
+        std::nth_element(slots + begin, slots + mid, slots + end, [&](uint32_t a, uint32_t b) {
+            return centroid(a, axis) < centroid(b, axis);
+        });
+        return mid;
+    }
+
+    float bestCost = INFINITY;
+    int bestAxis = -1;
+    unsigned bestBin = 0;
+    for (int a = 0; a < 3; a++) {
+        float lo = centroids.min[a], extent = centroids.max[a] - lo;
+        if (!(extent > 0.0f))
+            continue;
+        float toBin = binCount / extent;
+        Bin bins[binCount];
+        for (size_t i = begin; i < end; i++) {
+            uint32_t t = slots[i];
+            unsigned b = std::min(binCount - 1, (unsigned)((centroid(t, a) - lo) * toBin));
+            bins[b].count++;
+            bins[b].box.grow(&boxes[t * 6], &boxes[t * 6 + 3]);
+        }
+        // Cost of cutting after bin b : left side swept forward, right side backward
+        float rightArea[binCount];
+        size_t rightCount[binCount];
+        Box right;
+        size_t n = 0;
+        for (unsigned b = binCount - 1; b > 0; b--) {
+            right.grow(bins[b].box.min, bins[b].box.max);
+            n += bins[b].count;
+            rightArea[b] = right.area();
+            rightCount[b] = n;
+        }
+        Box left;
+        n = 0;
+        for (unsigned b = 0; b + 1 < binCount; b++) {
+            left.grow(bins[b].box.min, bins[b].box.max);
+            n += bins[b].count;
+            if (n == 0 || rightCount[b + 1] == 0)
+                continue;
+            float cost = left.area() * n + rightArea[b + 1] * rightCount[b + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = a;
+                bestBin = b;
+            }
+        }
+    }
+
+    float area = box.area();
+    float splitCost = area > 0.0f ? traversalCost + bestCost / area : traversalCost + count;
+    if (bestAxis < 0 || (splitCost >= (float)count && count <= maxBvhLeafTriangles))
+        return bestAxis < 0 && count > maxBvhLeafTriangles ? begin + count / 2 : end;
+
+    float lo = centroids.min[bestAxis], toBin = binCount / (centroids.max[bestAxis] - lo);
+    uint32_t* mid = std::partition(slots + begin, slots + end, [&](uint32_t t) {
+        return std::min(binCount - 1, (unsigned)((centroid(t, bestAxis) - lo) * toBin)) <= bestBin;
+    });
+    return (size_t)(mid - slots);
+}
+
+// Appends the subtree of [begin, end) to `nodes`, its root first
+void Builder::build(std::vector<BvhNode>& nodes, size_t begin, size_t end, unsigned depth) const {
+    size_t index = nodes.size();
+    nodes.push_back(BvhNode());
+
+    Box box, centroids;
+    for (size_t i = begin; i < end; i++) {
+        uint32_t t = slots[i];
+        box.grow(&boxes[t * 6], &boxes[t * 6 + 3]);
+        float c[3] = { centroid(t, 0), centroid(t, 1), centroid(t, 2) };
+        centroids.grow(c, c);
+    }
+    for (int a = 0; a < 3; a++) {
+        nodes[index].min[a] = box.min[a];
+        nodes[index].max[a] = box.max[a];
+    }
+
+    size_t mid = end - begin > 1 ? split(box, centroids, begin, end, depth) : end;
+    if (mid == end || mid == begin) {
+        nodes[index].first = (uint32_t)begin;
+        nodes[index].count = (uint32_t)(end - begin);
+        return;
+    }
+
+    // The second half on a thread of its own, built in a separate array and moved in after the first
+    if (depth < spawnDepth && end - mid >= spawnTriangles) {
+        std::vector<BvhNode> right;
+        std::thread worker([&]() { build(right, mid, end, depth + 1); });
+        build(nodes, begin, mid, depth + 1);
+        worker.join();
+        uint32_t base = (uint32_t)nodes.size();
+        nodes[index].first = base;
+        for (BvhNode& node : right) {
+            if (node.count == 0)
+                node.first += base;
+            nodes.push_back(node);
+        }
+        return;
+    }
+    build(nodes, begin, mid, depth + 1);
+    nodes[index].first = (uint32_t)nodes.size();
+    build(nodes, mid, end, depth + 1);
+}
+
+// Möller & Trumbore, either side
+inline bool intersectTriangle(const float* p0, const float* p1, const float* p2, const float* o, const float* d,
+                              float maxT, float& t, float& u, float& v) {
+    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    float p[3]  = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+    float det   = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (det == 0.0f)
+        return false;
+    float inv = 1.0f / det;
+    float s[3] = { o[0] - p0[0], o[1] - p0[1], o[2] - p0[2] };
+    u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+    v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+    return t >= 0.0f && t <= maxT;
+}
+
+bool testSlot(const BvhView& bvh, size_t slot, const float* o, const float* d, RayHit& hit) {
+    const uint32_t* c = &bvh.corners[slot * 3];
+    float t, u, v;
+    if (!intersectTriangle(&bvh.positions[(size_t)c[0] * 3], &bvh.positions[(size_t)c[1] * 3],
+                           &bvh.positions[(size_t)c[2] * 3], o, d, hit.t, t, u, v))
+        return false;
+    hit.t = t;
+    hit.u = u;
+    hit.v = v;
+    hit.triangle = bvh.triangles[slot];
+    return true;
+}
+
+// Distance to the node's box along the ray, INFINITY when missed or further than maxT
+inline float slabs(const BvhNode& node, const float* o, const float* inv, float maxT) {
+    float tmin = 0.0f, tmax = maxT;
+    for (int a = 0; a < 3; a++) {
+        float t0 = (node.min[a] - o[a]) * inv[a], t1 = (node.max[a] - o[a]) * inv[a];
+        tmin = maxf(tmin, minf(t0, t1));
+        tmax = minf(tmax, maxf(t0, t1));
+    }
+    return tmin <= tmax ? tmin : INFINITY;
+}
+
+}
+
+BvhView Bvh::view() const {
+    BvhView v;
+    v.nodes         = nodes.data();
+    v.nodeCount     = nodes.size();
+    v.corners       = corners.data();
+    v.triangles     = triangles.data();
+    v.triangleCount = triangles.size();
+    v.positions     = positions.data();
+    v.vertexCount   = positions.size() / 3;
+    return v;
+}
+
+void buildBvh(std::vector<float> &positions, const uint32_t *indices, size_t triangleCount, Bvh &out,
+              unsigned threads) {
+    out = Bvh();
+    out.positions.swap(positions);
+    if (triangleCount == 0)
+        return;
+    threads = resolveThreadCount(threads);
+
+    // Box of every triangle, the split only ever looks at those
+    std::vector<float> boxes(triangleCount * 6);
+    const float* p = out.positions.data();
+    parallelRanges(triangleCount, threads, [&](size_t begin, size_t end, size_t) {
+        for (size_t t = begin; t < end; t++) {
+            Box box;
+            for (int k = 0; k < 3; k++) {
+                const float* v = &p[(size_t)indices[t * 3 + k] * 3];
+                box.grow(v, v);
+            }
+            std::copy(box.min, box.min + 3, &boxes[t * 6]);
+            std::copy(box.max, box.max + 3, &boxes[t * 6 + 3]);
+        }
+    });
+
+    out.triangles.resize(triangleCount);
+    std::iota(out.triangles.begin(), out.triangles.end(), 0u);
+    // Each level of splits doubles the threads at work
+    unsigned spawnDepth = 0;
+    while ((1u << spawnDepth) < threads)
+        spawnDepth++;
+    Builder builder = { boxes.data(), out.triangles.data(), spawnDepth };
+    out.nodes.reserve(triangleCount / 2 + 1);
+    builder.build(out.nodes, 0, triangleCount, 0);
+    out.nodes.shrink_to_fit();
+
+    out.corners.resize(triangleCount * 3);
+    parallelRanges(triangleCount, threads, [&](size_t begin, size_t end, size_t) {
+        for (size_t s = begin; s < end; s++)
+            std::copy(&indices[(size_t)out.triangles[s] * 3], &indices[(size_t)out.triangles[s] * 3] + 3,
+                      &out.corners[s * 3]);
+    });
+}
+
+bool intersectBvh(const BvhView &bvh, const float origin[3], const float direction[3], float maxT,
+                  RayHit &hit, size_t *nodesVisited) {
+    size_t visited = 0;
+    bool found = false;
+    hit.t = maxT;
+    if (bvh.nodeCount) {
+        // An axis the ray doesn't move along gets a huge inverse instead of inf, 0 * inf would be a NaN
+        float inv[3];
+        for (int a = 0; a < 3; a++)
+            inv[a] = 1.0f / (direction[a] != 0.0f ? direction[a] : 1e-30f);
+
+        uint32_t stack[stackSize];
+        unsigned top = 0;
+        uint32_t node = 0;
+        if (slabs(bvh.nodes[0], origin, inv, maxT) == INFINITY)
+            top = 0, node = (uint32_t)-1;
+        while (node != (uint32_t)-1) {
+            const BvhNode& n = bvh.nodes[node];
+            visited++;
+            if (n.count) {
+                for (uint32_t s = n.first; s < n.first + n.count; s++)
+                    found |= testSlot(bvh, s, origin, direction, hit);
+                node = (uint32_t)-1;
+            }
+            else {
+                // Nearer child first, the other one waits on the stack with its distance checked again later
+                uint32_t a = node + 1, b = n.first;
+                float ta = slabs(bvh.nodes[a], origin, inv, hit.t), tb = slabs(bvh.nodes[b], origin, inv, hit.t);
+                if (tb < ta) {
+                    std::swap(a, b);
+                    std::swap(ta, tb);
+                }
+                if (ta == INFINITY)
+                    node = (uint32_t)-1;
+                else {
+                    node = a;
+                    if (tb != INFINITY)
+                        stack[top++] = b;
+                }
+            }
+            // Boxes popped again may have become further than the closest hit so far
+            while (node == (uint32_t)-1 && top > 0) {
+                uint32_t next = stack[--top];
+                if (slabs(bvh.nodes[next], origin, inv, hit.t) != INFINITY)
+                    node = next;
+            }
+        }
+    }
+    if (nodesVisited)
+        *nodesVisited = visited;
+    return found;
+}
+
+bool intersectTriangles(const BvhView &bvh, const float origin[3], const float direction[3], float maxT,
+                        RayHit &hit) {
+    bool found = false;
+    hit.t = maxT;
+    for (size_t s = 0; s < bvh.triangleCount; s++)
+        found |= testSlot(bvh, s, origin, direction, hit);
+    return found;
+}
@@ -0,0 +1,256 @@
+#include <cmath>
+#include "../include/culling.hpp"
+
+Frustum frustumFromMatrix(const float m[16]) {
+    // Rows of m, m[col * 4 + row] : left / right = w +- x, bottom / top = w +- y, near / far = w +- z
+    Frustum f;
+    for (int p = 0; p < 6; p++) {
+        int row = p / 2;
+        float sign = (p % 2) ? -1.0f : 1.0f;
+        for (int c = 0; c < 4; c++)
+            f.planes[p][c] = m[c * 4 + 3] + sign * m[c * 4 + row];
+        float len = std::sqrt(f.planes[p][0] * f.planes[p][0] + f.planes[p][1] * f.planes[p][1]
+                              + f.planes[p][2] * f.planes[p][2]);
+        if (len > 0.0f) {
+            for (int c = 0; c < 4; c++)
+                f.planes[p][c] /= len;
+        }
+    }
+    return f;
+}
+
+bool sphereInFrustum(const Frustum &frustum, const float center[3], float radius) {
+    for (int p = 0; p < 6; p++) {
+        const float* pl = frustum.planes[p];
+        if (pl[0] * center[0] + pl[1] * center[1] + pl[2] * center[2] + pl[3] < -radius)
+            return false;
+    }
+    return true;
+}
+
+// With d = center - eye and t the angle between d and the axis, the normal of the cone closest to
+// facing the eye makes an angle t + a with d (a = the cone's half angle). Every point p of the sphere
+// is hidden when dot(n, p - eye) > 0 for all those normals, the worst case being
+// |d| cos(t + a) - radius > 0, and |d| cos(t + a) = dot(d, axis) cos a - |d x axis| sin a
+bool coneBackFacing(const float center[3], float radius, const float axis[3], float coneCos, const float eye[3]) {
+    if (!(coneCos > 0.0f))
+        return false;
+    float d[3] = { center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+    float along = d[0] * axis[0] + d[1] * axis[1] + d[2] * axis[2];
+    if (along <= radius)
+        return false;
+    float across2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] - along * along;
+    float coneSin = std::sqrt(std::fmax(0.0f, 1.0f - coneCos * coneCos));
+    return along * coneCos - std::sqrt(std::fmax(0.0f, across2)) * coneSin > radius;
+}
+
+bool MeshletCopies::single() const {
+    return offsetMin[0] == offsetMax[0] && offsetMin[1] == offsetMax[1] && offsetMin[2] == offsetMax[2];
+}
+
+MeshletCopies gridCopies(int columns) {
+    MeshletCopies copies;
+    if (columns <= 1)
+        return copies;
+    float half = (columns - 1) * 0.5f * 3.0f;
+    copies.offsetMin[0] = copies.offsetMin[2] = -half;
+    copies.offsetMax[0] = copies.offsetMax[2] = half;
+    copies.scale = 1.0f / columns;
+    return copies;
+}
+
+// The copies put the center anywhere in a box : the sphere is out of a plane when it is out at the
+// corner of that box furthest along the plane's normal
+void cullMeshlets(const Meshlet *meshlets, size_t count, const Frustum &frustum, const float eye[3],
+                  bool backFaces, const MeshletCopies &copies,
+                  std::vector<uint32_t> &firsts, std::vector<uint32_t> &counts, MeshletCullStats &stats) {
+    backFaces = backFaces && copies.single();
+    for (size_t i = 0; i < count; i++) {
+        const Meshlet& m = meshlets[i];
+        float lo[3], hi[3];
+        for (int a = 0; a < 3; a++) {
+            lo[a] = (m.center[a] + copies.offsetMin[a]) * copies.scale;
+            hi[a] = (m.center[a] + copies.offsetMax[a]) * copies.scale;
+        }
+        float radius = m.radius * copies.scale;
+        stats.meshlets++;
+        stats.triangles += m.indexCount / 3;
+
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++) {
+            const float* pl = frustum.planes[p];
+            float d = pl[3];
+            for (int a = 0; a < 3; a++)
+                d += pl[a] * (pl[a] >= 0.0f ? hi[a] : lo[a]);
+            outside = d < -radius;
+        }
+        if (outside) {
+            stats.frustumCulled++;
+            continue;
+        }
+        if (backFaces && coneBackFacing(lo, radius, m.coneAxis, m.coneCos, eye)) {
+            stats.backFaceCulled++;
+            continue;
+        }
+        stats.drawn += m.indexCount / 3;
+        // Right after the run before it in the index buffer : same draw
+        if (!firsts.empty() && firsts.back() + counts.back() == m.firstIndex)
+            counts.back() += m.indexCount;
+        else {
+            firsts.push_back(m.firstIndex);
+            counts.push_back(m.indexCount);
+        }
+    }
+}
+
+void ObjectBounds::resize(size_t count) {
+    for (int a = 0; a < 3; a++) {
+        center[a].resize(count);
+        min[a].resize(count);
+        max[a].resize(count);
+    }
+    radius.resize(count);
+}
+
+// Box of the turned box (Arvo) : each output axis takes, column by column, the smaller and the larger of
+// the model's element times the input min and max
+void ObjectBounds::set(size_t i, const Bounds &b, const float model[16]) {
+    if (b.empty()) {
+        for (int a = 0; a < 3; a++) {
+            center[a][i] = 0.0f;
+            min[a][i] = -INFINITY;
+            max[a][i] = INFINITY;
+        }
+        radius[i] = INFINITY;
+        return;
+    }
+    float scale = 0.0f;
+    for (int c = 0; c < 3; c++) {
+        float length2 = model[c * 4] * model[c * 4] + model[c * 4 + 1] * model[c * 4 + 1]
+            + model[c * 4 + 2] * model[c * 4 + 2];
+        scale = length2 > scale ? length2 : scale;
+    }
+    radius[i] = b.radius * std::sqrt(scale);
+    for (int a = 0; a < 3; a++) {
+        float c = model[12 + a], lo = model[12 + a], hi = model[12 + a];
+        for (int k = 0; k < 3; k++) {
+            float e = model[k * 4 + a], toMin = e * b.min[k], toMax = e * b.max[k];
+            c += e * b.center[k];
+            lo += toMin < toMax ? toMin : toMax;
+            hi += toMin < toMax ? toMax : toMin;
+        }
+        center[a][i] = c;
+        min[a][i] = lo;
+        max[a][i] = hi;
+    }
+}
+
+// The kernels do the same operations in the same order (no FMA), the vector ones on 4 or 8 objects : a
+// plane goes in registers once, and its sign picks the min or the max of the box on each axis for the
+// whole register. Only the scalar one stops at the first plane an object is out of : a register of
+// them rarely gets all out at the same plane, and the branch then costs more than the planes it skips
+namespace {
+
+void cullObjectsScalar(const Frustum &f, const ObjectBounds &b, uint8_t *visible, size_t begin, size_t end,
+                       size_t &culled) {
+    for (size_t i = begin; i < end; i++) {
+        bool out = false;
+        for (int p = 0; p < 6; p++) {
+            const float *pl = f.planes[p];
+            float d = pl[0] * b.center[0][i] + pl[1] * b.center[1][i] + pl[2] * b.center[2][i] + pl[3];
+            float px = pl[0] >= 0.0f ? b.max[0][i] : b.min[0][i];
+            float py = pl[1] >= 0.0f ? b.max[1][i] : b.min[1][i];
+            float pz = pl[2] >= 0.0f ? b.max[2][i] : b.min[2][i];
+            float e = pl[0] * px + pl[1] * py + pl[2] * pz + pl[3];
+            out = out || d < -b.radius[i] || e < 0.0f;
+            if (out)
+                break;
+        }
+        visible[i] = !out;
+        culled += out;
+    }
+}
+
+#if SCOP_X86
+
+SCOP_TARGET_SSE void cullObjectsSse(const Frustum &f, const ObjectBounds &b, uint8_t *visible, size_t begin,
+                                    size_t end, size_t &culled) {
+    const __m128 zero = _mm_setzero_ps();
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 c[3] = { _mm_loadu_ps(&b.center[0][i]), _mm_loadu_ps(&b.center[1][i]), _mm_loadu_ps(&b.center[2][i]) };
+        __m128 lo[3] = { _mm_loadu_ps(&b.min[0][i]), _mm_loadu_ps(&b.min[1][i]), _mm_loadu_ps(&b.min[2][i]) };
+        __m128 hi[3] = { _mm_loadu_ps(&b.max[0][i]), _mm_loadu_ps(&b.max[1][i]), _mm_loadu_ps(&b.max[2][i]) };
+        __m128 minusRadius = _mm_sub_ps(zero, _mm_loadu_ps(&b.radius[i]));
+        __m128 out = zero;
+        for (int p = 0; p < 6; p++) {
+            const float *pl = f.planes[p];
+            __m128 n[3] = { _mm_set1_ps(pl[0]), _mm_set1_ps(pl[1]), _mm_set1_ps(pl[2]) }, w = _mm_set1_ps(pl[3]);
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], c[0]), _mm_mul_ps(n[1], c[1])),
+                                             _mm_mul_ps(n[2], c[2])), w);
+            __m128 e = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], pl[0] >= 0.0f ? hi[0] : lo[0]),
+                                                        _mm_mul_ps(n[1], pl[1] >= 0.0f ? hi[1] : lo[1])),
+                                             _mm_mul_ps(n[2], pl[2] >= 0.0f ? hi[2] : lo[2])), w);
+            out = _mm_or_ps(out, _mm_or_ps(_mm_cmplt_ps(d, minusRadius), _mm_cmplt_ps(e, zero)));
+        }
+        int mask = _mm_movemask_ps(out);
+        for (int k = 0; k < 4; k++)
+            visible[i + k] = !((mask >> k) & 1);
+        culled += __builtin_popcount(mask);
+    }
+    cullObjectsScalar(f, b, visible, i, end, culled);
+}
+
+SCOP_TARGET_AVX2 void cullObjectsAvx2(const Frustum &f, const ObjectBounds &b, uint8_t *visible, size_t begin,
+                                      size_t end, size_t &culled) {
+    const __m256 zero = _mm256_setzero_ps();
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 c[3] = { _mm256_loadu_ps(&b.center[0][i]), _mm256_loadu_ps(&b.center[1][i]),
+                        _mm256_loadu_ps(&b.center[2][i]) };
+        __m256 lo[3] = { _mm256_loadu_ps(&b.min[0][i]), _mm256_loadu_ps(&b.min[1][i]), _mm256_loadu_ps(&b.min[2][i]) };
+        __m256 hi[3] = { _mm256_loadu_ps(&b.max[0][i]), _mm256_loadu_ps(&b.max[1][i]), _mm256_loadu_ps(&b.max[2][i]) };
+        __m256 minusRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(&b.radius[i]));
+        __m256 out = zero;
+        for (int p = 0; p < 6; p++) {
+            const float *pl = f.planes[p];
+            __m256 n[3] = { _mm256_set1_ps(pl[0]), _mm256_set1_ps(pl[1]), _mm256_set1_ps(pl[2]) };
+            __m256 w = _mm256_set1_ps(pl[3]);
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(n[0], c[0]), _mm256_mul_ps(n[1], c[1])),
+                                                   _mm256_mul_ps(n[2], c[2])), w);
+            __m256 e = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(n[0], pl[0] >= 0.0f ? hi[0] : lo[0]),
+                                                                 _mm256_mul_ps(n[1], pl[1] >= 0.0f ? hi[1] : lo[1])),
+                                                   _mm256_mul_ps(n[2], pl[2] >= 0.0f ? hi[2] : lo[2])), w);
+            out = _mm256_or_ps(out, _mm256_or_ps(_mm256_cmp_ps(d, minusRadius, _CMP_LT_OQ),
+                                                 _mm256_cmp_ps(e, zero, _CMP_LT_OQ)));
+        }
+        int mask = _mm256_movemask_ps(out);
+        for (int k = 0; k < 8; k++)
+            visible[i + k] = !((mask >> k) & 1);
+        culled += __builtin_popcount(mask);
+    }
+    cullObjectsSse(f, b, visible, i, end, culled);
+}
+
+#endif
+
+}
+
+void cullObjects(const Frustum &frustum, const ObjectBounds &bounds, uint8_t *visible, ObjectCullStats &stats,
+                 SimdLevel level) {
+    typedef void (*Kernel)(const Frustum&, const ObjectBounds&, uint8_t*, size_t, size_t, size_t&);
+    Kernel kernel = cullObjectsScalar;
+#if SCOP_X86
+    level = clampSimdLevel(level);
+    if (level == SimdLevel::AVX2)
+        kernel = cullObjectsAvx2;
+    else if (level == SimdLevel::SSE)
+        kernel = cullObjectsSse;
+#else
+    (void)level;
+#endif
+    size_t culled = 0;
+    kernel(frustum, bounds, visible, 0, bounds.size(), culled);
+    stats.tested += bounds.size();
+    stats.culled += culled;
+}
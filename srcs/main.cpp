@@ -1,15 +1,153 @@
 #include "../include/include.hpp"
+#include <cerrno>
+#include <climits>
 
 bool useTexture = false;    // false = one color per face (default), true = texture
 GLuint texID = 0;           // texture ID
 
+static void printUsage(const char *self){
+    printf("Usage: %s [--loader=stream|mmap] [--threads=N] [--cache-dir=DIR | --no-cache] [--no-presize] [--flat | --crease=DEG] [--no-sort] [--no-vcache] [--sync | --upload-mb=N] [--fused] [--vertex-format=float|packed|octa] [--weld | --weld=EPS | --no-weld] [--instances=N] [--lod=R1,R2,...|none] [--no-lod] [--lod-pixels=PX] [--no-cull] [--no-bvh] model.obj [model2.obj ...]\n", self);
+}
+
+// A whole number >= `min` and nothing after it, "--threads=abc" or "--threads=-2" are mistakes
+static bool parseCount(const char *text, long min, int &out){
+    char *end;
+    errno = 0;
+    long value = std::strtol(text, &end, 10);
+    if(end == text || *end != '\0' || errno == ERANGE || value < min || value > INT_MAX)
+        return false;
+    out = (int)value;
+    return true;
+}
+
+// A finite number in [min, max] and nothing after it, "--weld=abc" is a mistake, not 0
+static bool parseAmount(const char *text, float min, float max, float &out){
+    char *end;
+    errno = 0;
+    float value = std::strtof(text, &end);
+    if(end == text || *end != '\0' || errno == ERANGE || !(value >= min && value <= max))
+        return false;
+    out = value;
+    return true;
+}
+
 int main(int argc, char** argv) {
-    if(argc < 2){
-        printf("Usage: %s model.obj [model2.obj ...]\n", argv[0]);
+    double startMs = nowMs();
+    ObjOptions objOptions;
+    BuildOptions buildOptions;
+    MeshCacheOptions cacheOptions;
+    std::vector<std::string> objPaths;
+    bool sortDraws = true;
+    bool syncLoad = false;
+    RenderOptions renderOptions;
+    size_t uploadMB = 16;
+    bool picking = true;
+
+    // Anything starting with "--" is an option, everything else is a model to load
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if(arg.rfind("--loader=", 0) == 0){
+            if(!parseObjLoader(arg.substr(9), objOptions.loader)){
+                printf("Unknown loader: %s (expected stream or mmap)\n", arg.c_str() + 9);
+                return -1;
+            }
+        }
+        else if(arg.rfind("--threads=", 0) == 0){
+            int threads;
+            if(!parseCount(arg.c_str() + 10, 0, threads)){
+                printf("Bad thread count: %s (expected 0 for every core, or a positive number)\n", arg.c_str() + 10);
+                printUsage(argv[0]);
+                return -1;
+            }
+            objOptions.threads = buildOptions.normals.threads = (unsigned)threads;
+        }
+        else if(arg.rfind("--cache-dir=", 0) == 0)
+            cacheOptions.dir = arg.substr(12);
+        else if(arg == "--no-cache")
+            cacheOptions.enabled = false;
+        else if(arg == "--no-presize")
+            objOptions.presize = false;
+        else if(arg == "--flat")
+            buildOptions.normals.smooth = false;
+        else if(arg.rfind("--crease=", 0) == 0){
+            if(!parseAmount(arg.c_str() + 9, 0.0f, 180.0f, buildOptions.normals.creaseAngle)){
+                printf("Bad crease angle: %s (expected degrees between 0 and 180)\n", arg.c_str() + 9);
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if(arg == "--no-sort")
+            sortDraws = false;
+        else if(arg == "--sync")
+            syncLoad = true;
+        else if(arg == "--no-vcache")
+            buildOptions.vertexCache = false;
+        else if(arg == "--fused")
+            buildOptions.fused = true;
+        else if(arg.rfind("--vertex-format=", 0) == 0){
+            if(!parseVertexFormat(arg.substr(16), buildOptions.format)){
+                printf("Unknown vertex format: %s (expected float, packed or octa)\n", arg.c_str() + 16);
+                return -1;
+            }
+        }
+        else if(arg.rfind("--instances=", 0) == 0){
+            if(!parseCount(arg.c_str() + 12, 0, renderOptions.instances)){
+                printf("Bad instance count: %s\n", arg.c_str() + 12);
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if(arg.rfind("--lod=", 0) == 0){
+            if(!parseLodRatios(arg.substr(6), buildOptions.lodRatios)){
+                printf("Bad level of detail ratios: %s (expected up to %zu decreasing fractions like 0.5,0.25 or none)\n",
+                    arg.c_str() + 6, maxLodLevels);
+                return -1;
+            }
+        }
+        else if(arg.rfind("--weld=", 0) == 0){
+            if(!parseAmount(arg.c_str() + 7, 0.0f, 1.0f, buildOptions.weldEpsilon)){
+                printf("Bad weld epsilon: %s (expected a fraction of the model's size, 0 for exact duplicates)\n",
+                    arg.c_str() + 7);
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if(arg == "--weld")
+            buildOptions.weldEpsilon = defaultWeldEpsilon;
+        else if(arg == "--no-weld")
+            buildOptions.weldEpsilon = -1.0f;
+        else if(arg == "--no-lod")
+            renderOptions.lod = false;
+        else if(arg == "--no-cull")
+            renderOptions.cull = false;
+        else if(arg == "--no-bvh")
+            picking = false;
+        else if(arg.rfind("--lod-pixels=", 0) == 0){
+            if(!parseAmount(arg.c_str() + 13, 0.0f, 1e6f, renderOptions.lodPixels)){
+                printf("Bad level of detail error: %s (expected pixels, 0 for full detail only)\n", arg.c_str() + 13);
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if(arg.rfind("--upload-mb=", 0) == 0){
+            int mb;
+            if(!parseCount(arg.c_str() + 12, 0, mb)){
+                printf("Bad upload budget: %s (expected megabytes per frame, 0 for no limit)\n", arg.c_str() + 12);
+                printUsage(argv[0]);
+                return -1;
+            }
+            uploadMB = (size_t)mb;
+        }
+        else
+            objPaths.push_back(arg);
+    }
+
+    if(objPaths.empty()){
+        printUsage(argv[0]);
         return -1;
     }
 
-    int objCount = argc - 1;
+    int objCount = objPaths.size();
     if(objCount > 5){
         printf("Warning: max 5 objects supported, ignoring the rest\n");
         objCount = 5;
@@ -18,49 +156,8 @@ int main(int argc, char** argv) {
     GLFWwindow* win = initWindow(800, 600, "ft_scop-iaschnei");
     if(!win) return -1;
 
-    std::vector<SceneObject> objects;
-    float spacing = 4.0f;
-
-    for(int i = 0; i < objCount; i++){
-        std::string objPath = argv[i + 1];
-
-        Mesh mesh;
-        if(!loadOBJ(objPath, mesh)){
-            printf("Failed to load OBJ: %s\n", objPath.c_str());
-            return -1;
-        }
-        printf("Loaded OBJ: %s (%zu vertices)\n", objPath.c_str(), mesh.vertices.size()/3);
-
-        if(mesh.normals.empty()){
-            printf("No normals found, generating normals for: %s\n", objPath.c_str());
-            generateNormals(mesh);
-        }
-
-        // Calculate the scale of the object so it fits in our window
-        float cx, cy, cz, scale;
-        computeCenterScale(mesh, cx, cy, cz, scale);
-
-        // Store all data for each vertex in succession in memory
-        std::vector<float> interleaved = interleaveMesh(mesh, cx, cy, cz, scale);
-
-        // Setup VAO and VBO for this object
-        // VAO = Tells the GPU how to read data in VBO (what data is where)
-        // VBO = Data stored in the GPU memory for all our meshes
-        GLuint vao, vbo;
-        setupMeshBuffers(interleaved, vao, vbo);
-
-        // Make sure there is enough distance between objects
-        float offsetX = i * spacing - (objCount - 1) * spacing / 2.0f;
-
-        SceneObject obj;
-        obj.vao         = vao;
-        obj.vertexCount = mesh.vertices.size() / 3;
-        obj.offsetX     = offsetX;
-        objects.push_back(obj);
-    }
-
     // Load our shaders and combine them in a program that OpenGL can use
-    GLuint program = createProgram(vertexShaderSrc, fragmentShaderSrc);
+    GLuint program = createProgram(vertexShaderSrc, geometryShaderSrc, fragmentShaderSrc);
     glUseProgram(program);
 
     // Make the texture repeat itself like tiles
@@ -74,19 +171,59 @@ int main(int argc, char** argv) {
     GLint useTexLoc = glGetUniformLocation(program, "useTexture");
     GLint texLoc   = glGetUniformLocation(program, "tex");
 
-    // Load our texture
-    texID = loadTexture("ressources/texture.png");
+    // Load our textures, the default one is used by every part without a map_Kd
+    TextureCache textures;
+    texID = textures.get("ressources/texture.png");
 
-    // Setup matrices (more details in Mat4 file)
+    // Setup matrices (more details in Mat4 file), the projection never changes so the compiler makes it
     // Push camera back further so all objects fit in view
-    Mat4 proj = Mat4::perspective(3.14159f/4.0f, 800.0f/600.0f, 0.1f, 100.0f);
+    constexpr Mat4 proj = Mat4::perspective(3.14159f/4.0f, 800.0f/600.0f, 0.1f, 100.0f);
     float camDist = 4.0f + objCount * 2.0f;
     Mat4 view = Mat4::lookAt(camDist, camDist*0.6f, camDist, 0,0,0, 0,1,0);
     Mat4 vp = Mat4::multiply(proj, view);
+    renderOptions.eye[0] = camDist;
+    renderOptions.eye[1] = camDist*0.6f;
+    renderOptions.eye[2] = camDist;
+
+    // Models are parsed and processed on worker threads (see async_loader)
+    // and uploaded a few MB per frame while the render loop is already running
+    // With --fused the interleaved vertices are written once : into the .scopbin that is then uploaded,
+    // or without a cache straight into the mapped GL buffers, by a MappedWriter
+    AsyncModelLoader loader;
+    loader.start(std::vector<std::string>(objPaths.begin(), objPaths.begin() + objCount),
+                 objOptions, buildOptions, cacheOptions);
+
+    // Click to pick needs a BVH per model, built in the background once the model is on screen
+    BvhBuilder bvhs(buildOptions.normals.threads);
+    MappedWriter writer;
+
+    Scene scene;
+    SceneStreamer streamer;
+    streamer.loader         = &loader;
+    streamer.textures       = &textures;
+    streamer.bvhs           = picking ? &bvhs : nullptr;
+    streamer.writer         = buildOptions.fused ? &writer : nullptr;
+    streamer.program        = program;
+    streamer.defaultTexture = texID;
+    streamer.uploadBudget   = syncLoad ? 0 : uploadMB * 1024 * 1024;
+    streamer.blocking       = syncLoad;
+    streamer.sortDraws      = sortDraws;
+    streamer.slotCount      = objCount;
+    streamer.startMs        = startMs;
+
+    // Old behaviour : everything is on the GPU before the first frame
+    if(syncLoad)
+        while(!streamer.update(scene)) {}
+
+    // Measuring frame times : don't let vsync round them up
+    if(renderOptions.instances > 0)
+        glfwSwapInterval(0);
 
     // Start render loop
-    renderLoop(win, objects, program, texID, mvpLoc, modelLoc, useTexLoc, texLoc, vp);
+    renderLoop(win, scene, streamer, mvpLoc, modelLoc, useTexLoc, texLoc, vp, renderOptions);
 
+    // A model still being written into its mapping goes away with the context
+    writer.wait();
     glDeleteProgram(program);
     glfwTerminate();
     return 0;
@@ -0,0 +1,51 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include "../include/mapped_file.hpp"
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+// Map the whole file read-only, an empty file is valid and gives size 0
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    size = (size_t)st.st_size;
+    if (size == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file, we don't need the fd anymore
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+        size = 0;
+        return false;
+    }
+
+    // We read the file front to back once, let the kernel read ahead aggressively
+    madvise(ptr, size, MADV_SEQUENTIAL);
+    data = static_cast<const char*>(ptr);
+    return true;
+}
+
+void MappedFile::close() {
+    if (data)
+        munmap(const_cast<char*>(data), size);
+    data = nullptr;
+    size = 0;
+}
@@ -0,0 +1,126 @@
+#include <cstdio>
+#include <algorithm>
+#include "../include/material.hpp"
+#include "../include/obj_tokens.hpp"
+#include "../include/mapped_file.hpp"
+#define STB_IMAGE_IMPLEMENTATION
+#include "../include/stb_image.h"
+
+namespace {
+
+// "models/girl.obj" -> "models/", "girl.obj" -> ""
+std::string directoryOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return (slash == std::string::npos) ? std::string() : path.substr(0, slash + 1);
+}
+
+// Image name of a map_Kd line
+// Options like "-s 1 1 1" or "-clamp on" come first, when there are some the image is the last word,
+// otherwise it is the whole rest of the line (exporters happily write names with spaces)
+std::string readMapName(const char* p, const char* end) {
+    std::string name = readName(p, end);
+    if (!name.empty() && name[0] == '-') {
+        size_t blank = name.find_last_of(" \t");
+        name = (blank == std::string::npos) ? std::string() : name.substr(blank + 1);
+    }
+    // Files written on Windows use backslashes
+    std::replace(name.begin(), name.end(), '\\', '/');
+    return name;
+}
+
+}
+
+bool loadMTL(const std::string& path, std::vector<Material>& out) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    std::string dir = directoryOf(path);
+    const char* p   = file.data;
+    const char* end = file.data + file.size;
+
+    while (p < end) {
+        const char* line = skipBlanks(p, end);
+        const char* eol  = nextLine(line, end);
+        p = eol;
+
+        // newmtl = every following line belongs to this material
+        if (isKeyword(line, eol, "newmtl", 6)) {
+            out.push_back(Material());
+            out.back().name = readName(line + 6, eol);
+        }
+        else if (out.empty())
+            continue;
+        // Kd = diffuse color
+        else if (isKeyword(line, eol, "Kd", 2)) {
+            const char* q = line + 2;
+            for (int i = 0; i < 3; i++)
+                out.back().diffuse[i] = readFloat(q, eol);
+        }
+        // map_Kd = diffuse texture, relative to the .mtl file
+        else if (isKeyword(line, eol, "map_Kd", 6)) {
+            std::string name = readMapName(line + 6, eol);
+            if (!name.empty())
+                out.back().diffuseMap = (name[0] == '/') ? name : dir + name;
+        }
+    }
+    return true;
+}
+
+std::vector<Material> resolveMaterials(const std::string& objPath, const std::vector<std::string>& mtllibs,
+                                       const std::vector<std::string>& names) {
+    std::vector<Material> library;
+    std::string dir = directoryOf(objPath);
+    for (const std::string& lib : mtllibs) {
+        if (!loadMTL(dir + lib, library))
+            printf("[MTL] Cannot open material library %s%s, using default materials\n", dir.c_str(), lib.c_str());
+    }
+
+    // Later definitions win, like they would when reading the libraries in order
+    std::vector<Material> out(names.size());
+    for (size_t i = 0; i < names.size(); i++) {
+        out[i].name = names[i];
+        for (const Material& m : library)
+            if (m.name == names[i])
+                out[i] = m;
+    }
+    return out;
+}
+
+void sortDrawItems(std::vector<DrawItem>& items) {
+    std::stable_sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) {
+        if (a.program != b.program) return a.program < b.program;
+        if (a.texture != b.texture) return a.texture < b.texture;
+        return a.object < b.object;
+    });
+}
+
+DrawStats countDrawState(const std::vector<DrawItem>& items) {
+    // Same rules as the render loop : a texture stays bound until another one replaces it
+    DrawStats stats;
+    uint32_t texture = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        const DrawItem& item = items[i];
+        stats.draws++;
+        stats.programBinds  += i == 0 || items[i - 1].program != item.program;
+        stats.objectChanges += i == 0 || items[i - 1].object != item.object;
+        if (item.texture != 0 && item.texture != texture) {
+            stats.textureBinds++;
+            texture = item.texture;
+        }
+    }
+    return stats;
+}
+
+bool decodeImage(const std::string& path, DecodedImage& out) {
+    out = DecodedImage();
+    // The flip flag of this thread only, several workers decode at once
+    stbi_set_flip_vertically_on_load_thread(1);
+    int channels;
+    unsigned char* data = stbi_load(path.c_str(), &out.width, &out.height, &channels, 3);
+    if (!data)
+        return false;
+    out.pixels.assign(data, data + (size_t)out.width * out.height * 3);
+    stbi_image_free(data);
+    return true;
+}
@@ -0,0 +1,37 @@
+#include <cstdio>
+#include <cstring>
+#include "../include/memstats.hpp"
+
+static size_t readStatusKB(const char* key) {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f)
+        return 0;
+
+    char line[256];
+    size_t len = strlen(key);
+    size_t value = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, key, len) == 0) {
+            sscanf(line + len, "%zu", &value);
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+size_t currentRssKB() {
+    return readStatusKB("VmRSS:");
+}
+
+size_t peakRssKB() {
+    return readStatusKB("VmHWM:");
+}
+
+void resetPeakRss() {
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (!f)
+        return;
+    fputs("5", f);
+    fclose(f);
+}
@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include "../include/mesh_cache.hpp"
+
+// Layout of a .scopbin file :
+//   header
+//   vertices  (vertexCount * stride bytes, see VertexLayout), starts at vertexOffset
+//   indices   (indexCount * indexSize bytes), starts at indexOffset
+//   submeshes (submeshCount SubMesh records), starts at submeshOffset
+//   lods      (lodCount MeshLod records, then lodCount * submeshCount SubMesh records), starts at lodOffset
+//   meshlets  (meshletCount Meshlet records, then meshletRangeCount uint32), starts at meshletOffset
+//   materials (materialCount names, each a uint32 length + the bytes), starts at materialOffset
+//   mtllibs   (mtllibCount names, same encoding), right after the materials
+// Every offset is 16 byte aligned. The numbers are stored in the machine's own byte order,
+// a cache is not meant to be shared between machines
+
+namespace {
+
+const char     cacheMagic[8] = { 'S', 'C', 'O', 'P', 'B', 'I', 'N', '\0' };
+const uint32_t cacheVersion  = 14;
+
+struct CacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t indexSize;
+    uint64_t sourceSize;
+    int64_t  sourceMtimeNs;
+    uint64_t sourceHash;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t submeshCount;
+    uint64_t submeshOffset;
+    uint64_t materialCount;
+    uint64_t materialOffset;
+    uint64_t mtllibCount;
+    float    center[3];
+    float    scale;
+    float    normalCrease;
+    float    boundsMin[3];
+    float    boundsMax[3];
+    float    sphere[4];         // center + radius
+    uint32_t vertexFormat;      // VertexFormat
+    uint32_t hasUvs;
+    float    positionMin[3];    // VertexQuantization
+    float    positionExtent[3];
+    float    uvMin[2];
+    float    uvExtent[2];
+    uint32_t cacheOrdered;      // MeshView::cacheOrdered
+    uint64_t lodCount;
+    uint64_t lodOffset;
+    uint32_t lodRatioCount;     // MeshView::lodRatios
+    float    lodRatios[maxLodLevels];
+    uint64_t meshletCount;
+    uint64_t meshletRangeCount;
+    uint64_t meshletOffset;
+    uint32_t watertight;
+    float    weldEpsilon;       // MeshView::weldEpsilon
+};
+
+// Levels made for other ratios are rebuilt
+bool sameLodRatios(const CacheHeader& h, const std::vector<float>& ratios) {
+    if (h.lodRatioCount != ratios.size() || ratios.size() > maxLodLevels)
+        return false;
+    for (size_t i = 0; i < ratios.size(); i++) {
+        if (h.lodRatios[i] != ratios[i])
+            return false;
+    }
+    return true;
+}
+
+struct SourceInfo {
+    uint64_t size;
+    int64_t  mtimeNs;
+};
+
+bool statSource(const std::string& path, SourceInfo& out) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+    out.size    = (uint64_t)st.st_size;
+    out.mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+// FNV-1a over 8 byte words, enough to notice a changed model, not meant to be cryptographic
+uint64_t hashFile(const std::string& path, bool& ok) {
+    MappedFile file;
+    ok = file.open(path);
+    uint64_t h = 0xcbf29ce484222325ull;
+    if (!ok)
+        return h;
+
+    size_t words = file.size / 8;
+    for (size_t i = 0; i < words; i++) {
+        uint64_t w;
+        memcpy(&w, file.data + i * 8, 8);
+        h = (h ^ w) * 0x100000001b3ull;
+    }
+    for (size_t i = words * 8; i < file.size; i++)
+        h = (h ^ (unsigned char)file.data[i]) * 0x100000001b3ull;
+    return h ^ file.size;
+}
+
+size_t alignUp(size_t v) {
+    return (v + 15) & ~(size_t)15;
+}
+
+// A fused view has no vertices / indices in memory, they are written through a small buffer
+const size_t writeChunk = 64 * 1024;
+
+bool writeVertices(FILE* f, const MeshView& view) {
+    size_t stride = view.layout.stride;
+    if (view.vertices)
+        return fwrite(view.vertices, stride, view.vertexCount, f) == view.vertexCount;
+    std::vector<unsigned char> chunk(writeChunk * stride);
+    for (size_t first = 0; first < view.vertexCount; first += writeChunk) {
+        size_t n = std::min(writeChunk, view.vertexCount - first);
+        copyViewVertices(view, first, n, chunk.data());
+        if (fwrite(chunk.data(), stride, n, f) != n)
+            return false;
+    }
+    return true;
+}
+
+bool writeIndices(FILE* f, const MeshView& view) {
+    if (view.indices)
+        return fwrite(view.indices, view.indexSize, view.indexCount, f) == view.indexCount;
+    std::vector<uint32_t> chunk(writeChunk);
+    for (size_t first = 0; first < view.indexCount; first += writeChunk) {
+        size_t n = std::min(writeChunk, view.indexCount - first);
+        copyViewIndices(view, first, n, chunk.data());
+        if (fwrite(chunk.data(), view.indexSize, n, f) != n)
+            return false;
+    }
+    return true;
+}
+
+// Write zeros up to `offset`
+bool padTo(FILE* f, uint64_t offset) {
+    static const char zeros[16] = {};
+    long at = ftell(f);
+    return at >= 0 && (uint64_t)at <= offset
+        && fwrite(zeros, 1, offset - at, f) == offset - at;
+}
+
+}
+
+std::string meshCachePath(const std::string& objPath, const MeshCacheOptions& opts) {
+    if (opts.dir.empty())
+        return objPath + ".scopbin";
+    // Two models with the same name in different directories must not share a cache file : the name
+    // carries a hash of the full path, resolved so that every way of writing it gives the same file
+    char *resolved = realpath(objPath.c_str(), nullptr);
+    std::string full = resolved ? resolved : objPath;
+    free(resolved);
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : full)
+        h = (h ^ c) * 0x100000001b3ull;
+    char tag[20];
+    snprintf(tag, sizeof(tag), "-%016llx", (unsigned long long)h);
+    size_t slash = objPath.find_last_of('/');
+    std::string name = (slash == std::string::npos) ? objPath : objPath.substr(slash + 1);
+    return opts.dir + "/" + name + tag + ".scopbin";
+}
+
+bool MeshCache::open(const std::string& cachePath, const std::string& objPath, const BuildOptions& options) {
+    SourceInfo src;
+    if (!statSource(objPath, src) || !file.open(cachePath))
+        return false;
+
+    if (file.size < sizeof(CacheHeader)) {
+        file.close();
+        return false;
+    }
+    CacheHeader h;
+    memcpy(&h, file.data, sizeof(h));
+    VertexLayout layout = vertexLayout(options.format, h.hasUvs != 0);
+
+    bool valid = memcmp(h.magic, cacheMagic, sizeof(cacheMagic)) == 0
+        && h.version == cacheVersion
+        && (h.indexSize == 2 || h.indexSize == 4)
+        // Made for another vertex format : rebuilt, not converted
+        && h.vertexFormat == (uint32_t)options.format && h.hasUvs <= 1
+        // Written with --no-vcache : reordered now that it is asked for
+        && (h.cacheOrdered || !options.vertexCache)
+        && sameLodRatios(h, options.lodRatios) && h.lodCount <= h.lodRatioCount
+        // Welded another way (or not at all) : the vertices and triangles differ
+        && h.weldEpsilon == options.weldEpsilon
+        && h.sourceSize == src.size
+        && h.vertexCount < file.size && h.indexCount < file.size && h.submeshCount < file.size
+        && h.vertexOffset + h.vertexCount * layout.stride <= file.size
+        && h.indexOffset + h.indexCount * h.indexSize <= file.size
+        && h.submeshOffset + h.submeshCount * sizeof(SubMesh) <= file.size
+        && h.lodOffset + h.lodCount * (sizeof(MeshLod) + h.submeshCount * sizeof(SubMesh)) <= file.size
+        && h.meshletCount < file.size
+        && (h.meshletRangeCount == 0 || h.meshletRangeCount == h.submeshCount * (h.lodCount + 1) + 1)
+        && h.meshletOffset + h.meshletCount * sizeof(Meshlet) + h.meshletRangeCount * sizeof(uint32_t) <= file.size
+        && h.materialCount < file.size && h.mtllibCount < file.size
+        && h.materialOffset <= file.size
+        // Generated normals must have been made the way we would make them now
+        && (h.normalCrease < 0.0f || h.normalCrease == options.normals.crease());
+
+    // Same size but another mtime : only the content can tell
+    if (valid && h.sourceMtimeNs != src.mtimeNs) {
+        bool ok;
+        valid = hashFile(objPath, ok) == h.sourceHash && ok;
+    }
+
+    // Material and library names are the only variable sized part
+    std::vector<std::string> names;
+    size_t at = h.materialOffset;
+    for (uint64_t m = 0; valid && m < h.materialCount + h.mtllibCount; m++) {
+        uint32_t len;
+        valid = at + sizeof(len) <= file.size;
+        if (valid) {
+            memcpy(&len, file.data + at, sizeof(len));
+            at += sizeof(len);
+            valid = at + len <= file.size;
+        }
+        if (valid) {
+            names.push_back(std::string(file.data + at, len));
+            at += len;
+        }
+    }
+    if (!valid) {
+        file.close();
+        return false;
+    }
+
+    view.vertices    = file.data + h.vertexOffset;
+    view.vertexCount = h.vertexCount;
+    view.indices     = file.data + h.indexOffset;
+    view.indexCount  = h.indexCount;
+    view.indexSize   = h.indexSize;
+    view.submeshes    = reinterpret_cast<const SubMesh*>(file.data + h.submeshOffset);
+    view.submeshCount = h.submeshCount;
+    view.lods         = reinterpret_cast<const MeshLod*>(file.data + h.lodOffset);
+    view.lodCount     = h.lodCount;
+    view.lodSubmeshes = reinterpret_cast<const SubMesh*>(file.data + h.lodOffset + h.lodCount * sizeof(MeshLod));
+    view.lodRatios    = options.lodRatios;
+    view.meshlets          = reinterpret_cast<const Meshlet*>(file.data + h.meshletOffset);
+    view.meshletCount      = h.meshletCount;
+    view.meshletRanges     = reinterpret_cast<const uint32_t*>(file.data + h.meshletOffset + h.meshletCount * sizeof(Meshlet));
+    view.meshletRangeCount = h.meshletRangeCount;
+    view.watertight        = h.watertight != 0;
+    view.weldEpsilon       = h.weldEpsilon;
+    view.materials.assign(names.begin(), names.begin() + h.materialCount);
+    view.mtllibs.assign(names.begin() + h.materialCount, names.end());
+    memcpy(view.center, h.center, sizeof(view.center));
+    view.scale       = h.scale;
+    view.normalCrease = h.normalCrease;
+    memcpy(view.bounds.min, h.boundsMin, sizeof(h.boundsMin));
+    memcpy(view.bounds.max, h.boundsMax, sizeof(h.boundsMax));
+    memcpy(view.bounds.center, h.sphere, sizeof(view.bounds.center));
+    view.bounds.radius = h.sphere[3];
+    view.layout      = layout;
+    view.cacheOrdered = h.cacheOrdered != 0;
+    memcpy(view.quant.positionMin, h.positionMin, sizeof(h.positionMin));
+    memcpy(view.quant.positionExtent, h.positionExtent, sizeof(h.positionExtent));
+    memcpy(view.quant.uvMin, h.uvMin, sizeof(h.uvMin));
+    memcpy(view.quant.uvExtent, h.uvExtent, sizeof(h.uvExtent));
+    return true;
+}
+
+// Written to a temporary file first then renamed, so a crash never leaves half a cache behind
+bool writeMeshCache(const std::string& cachePath, const std::string& objPath, const MeshView& view) {
+    SourceInfo src;
+    bool hashed;
+    if (!statSource(objPath, src))
+        return false;
+
+    CacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, cacheMagic, sizeof(cacheMagic));
+    h.version       = cacheVersion;
+    h.indexSize     = (uint32_t)view.indexSize;
+    h.sourceSize    = src.size;
+    h.sourceMtimeNs = src.mtimeNs;
+    h.sourceHash    = hashFile(objPath, hashed);
+    h.vertexCount   = view.vertexCount;
+    h.indexCount    = view.indexCount;
+    h.vertexOffset  = alignUp(sizeof(CacheHeader));
+    h.indexOffset   = alignUp(h.vertexOffset + view.vertexCount * view.layout.stride);
+    h.submeshCount  = view.submeshCount;
+    h.submeshOffset = alignUp(h.indexOffset + view.indexCount * view.indexSize);
+    h.lodCount      = view.lodCount;
+    h.lodOffset     = alignUp(h.submeshOffset + view.submeshCount * sizeof(SubMesh));
+    h.lodRatioCount = (uint32_t)view.lodRatios.size();
+    for (size_t i = 0; i < view.lodRatios.size() && i < maxLodLevels; i++)
+        h.lodRatios[i] = view.lodRatios[i];
+    h.meshletCount  = view.meshletCount;
+    h.meshletRangeCount = view.meshletRangeCount;
+    h.meshletOffset = alignUp(h.lodOffset + view.lodCount * (sizeof(MeshLod) + view.submeshCount * sizeof(SubMesh)));
+    h.watertight    = view.watertight;
+    h.weldEpsilon   = view.weldEpsilon;
+    h.materialCount = view.materials.size();
+    h.materialOffset = alignUp(h.meshletOffset + view.meshletCount * sizeof(Meshlet)
+                               + view.meshletRangeCount * sizeof(uint32_t));
+    h.mtllibCount   = view.mtllibs.size();
+    memcpy(h.center, view.center, sizeof(h.center));
+    h.scale         = view.scale;
+    h.normalCrease  = view.normalCrease;
+    memcpy(h.boundsMin, view.bounds.min, sizeof(h.boundsMin));
+    memcpy(h.boundsMax, view.bounds.max, sizeof(h.boundsMax));
+    memcpy(h.sphere, view.bounds.center, sizeof(view.bounds.center));
+    h.sphere[3]     = view.bounds.radius;
+    h.vertexFormat  = (uint32_t)view.layout.format;
+    h.hasUvs        = view.layout.hasUvs;
+    h.cacheOrdered  = view.cacheOrdered;
+    memcpy(h.positionMin, view.quant.positionMin, sizeof(h.positionMin));
+    memcpy(h.positionExtent, view.quant.positionExtent, sizeof(h.positionExtent));
+    memcpy(h.uvMin, view.quant.uvMin, sizeof(h.uvMin));
+    memcpy(h.uvExtent, view.quant.uvExtent, sizeof(h.uvExtent));
+    if (!hashed)
+        return false;
+
+    std::string tmpPath = cachePath + ".tmp";
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (!f)
+        return false;
+
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && padTo(f, h.vertexOffset)
+        && writeVertices(f, view)
+        && padTo(f, h.indexOffset)
+        && writeIndices(f, view)
+        && padTo(f, h.submeshOffset)
+        && fwrite(view.submeshes, sizeof(SubMesh), view.submeshCount, f) == view.submeshCount
+        && padTo(f, h.lodOffset)
+        && fwrite(view.lods, sizeof(MeshLod), view.lodCount, f) == view.lodCount
+        && fwrite(view.lodSubmeshes, sizeof(SubMesh), view.lodCount * view.submeshCount, f)
+            == view.lodCount * view.submeshCount
+        && padTo(f, h.meshletOffset)
+        && fwrite(view.meshlets, sizeof(Meshlet), view.meshletCount, f) == view.meshletCount
+        && fwrite(view.meshletRanges, sizeof(uint32_t), view.meshletRangeCount, f) == view.meshletRangeCount
+        && padTo(f, h.materialOffset);
+    std::vector<std::string> names(view.materials);
+    names.insert(names.end(), view.mtllibs.begin(), view.mtllibs.end());
+    for (const std::string& name : names) {
+        uint32_t len = (uint32_t)name.size();
+        ok = ok && fwrite(&len, sizeof(len), 1, f) == 1 && fwrite(name.data(), 1, len, f) == len;
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
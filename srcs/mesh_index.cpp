@@ -0,0 +1,227 @@
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include "../include/parsing.hpp"
+#include "../include/parallel.hpp"
+
+// Turn the face corners of an .obj into an indexed mesh
+// A corner is a (v, vt, vn) triplet, all the corners using the same triplet become one vertex
+// Vertices are numbered in order of first use, so the result only depends on the file
+
+namespace {
+
+const uint32_t emptySlot = 0xFFFFFFFFu;
+
+inline uint64_t hashCorner(const int* c) {
+    uint64_t h = (uint64_t)(uint32_t)c[0] * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t)(uint32_t)c[1] * 0xC2B2AE3D27D4EB4Full + (h >> 31);
+    h ^= (uint64_t)(uint32_t)c[2] * 0x165667B19E3779F9ull + (h >> 27);
+    return h ^ (h >> 33);
+}
+
+// Open addressing table from a corner triplet to its vertex number
+// The triplets themselves live in `keys` (3 ints per vertex), the table only stores vertex numbers
+struct CornerTable {
+    std::vector<uint32_t> slots;
+    std::vector<int>      keys;
+    size_t                mask = 0;
+    size_t                reallocations = 0;
+
+    explicit CornerTable(size_t expected) {
+        size_t cap = 16;
+        while (cap < expected * 2)
+            cap <<= 1;
+        slots.assign(cap, emptySlot);
+        mask = cap - 1;
+        keys.reserve(expected * 3);
+    }
+
+    uint32_t insert(const int* c) {
+        size_t i = hashCorner(c) & mask;
+        while (slots[i] != emptySlot) {
+            const int* k = &keys[(size_t)slots[i] * 3];
+            if (k[0] == c[0] && k[1] == c[1] && k[2] == c[2])
+                return slots[i];
+            i = (i + 1) & mask;
+        }
+
+        uint32_t id = (uint32_t)(keys.size() / 3);
+        slots[i] = id;
+        if (keys.size() + 3 > keys.capacity())
+            reallocations++;
+        keys.insert(keys.end(), c, c + 3);
+        // Keep the load under 1/2 so probes stay short
+        if (keys.size() / 3 * 2 > slots.size())
+            grow();
+        return id;
+    }
+
+    void grow() {
+        reallocations++;
+        slots.assign(slots.size() * 2, emptySlot);
+        mask = slots.size() - 1;
+        for (size_t id = 0; id < keys.size() / 3; id++) {
+            size_t i = hashCorner(&keys[id * 3]) & mask;
+            while (slots[i] != emptySlot)
+                i = (i + 1) & mask;
+            slots[i] = (uint32_t)id;
+        }
+    }
+};
+
+// Replay the o / g / usemtl records : every stretch of triangles between two of them
+// becomes a SubMesh with the material that was active (empty stretches are dropped)
+void buildSubMeshes(const std::vector<ObjGroupEvent>& events, Mesh& mesh, unsigned threads) {
+    size_t cornerCount = mesh.indices.size();
+    int material = -1;
+    size_t start = 0;
+
+    mesh.submeshes.clear();
+    mesh.materials.clear();
+    for (size_t e = 0; e <= events.size(); e++) {
+        size_t end = (e < events.size()) ? events[e].corner : cornerCount;
+        if (end > start) {
+            SubMesh sub;
+            sub.firstIndex = (uint32_t)start;
+            sub.indexCount = (uint32_t)(end - start);
+            sub.materialId = material;
+            mesh.submeshes.push_back(sub);
+            start = end;
+        }
+        if (e == events.size() || events[e].kind != ObjGroupEvent::Material)
+            continue;
+
+        // Materials are numbered in order of first use
+        material = -1;
+        for (size_t m = 0; m < mesh.materials.size() && material < 0; m++)
+            if (mesh.materials[m] == events[e].name)
+                material = (int)m;
+        if (material < 0) {
+            material = (int)mesh.materials.size();
+            mesh.materials.push_back(events[e].name);
+        }
+    }
+
+    // Local bounding box of every part
+    parallelFor(mesh.submeshes.size(), threads, [&](size_t i) {
+        SubMesh& sub = mesh.submeshes[i];
+        for (int a = 0; a < 3; a++) {
+            sub.min[a] =  std::numeric_limits<float>::max();
+            sub.max[a] = -std::numeric_limits<float>::max();
+        }
+        for (uint32_t k = sub.firstIndex; k < sub.firstIndex + sub.indexCount; k++) {
+            const float* v = &mesh.vertices[(size_t)mesh.indices[k] * 3];
+            for (int a = 0; a < 3; a++) {
+                if (v[a] < sub.min[a]) sub.min[a] = v[a];
+                if (v[a] > sub.max[a]) sub.max[a] = v[a];
+            }
+        }
+    });
+}
+
+}
+
+bool buildIndexedMesh(ObjData& data, Mesh& outMesh, unsigned threads, ObjLoadStats* stats) {
+    threads = resolveThreadCount(threads);
+
+    const size_t posCount    = data.positions.size() / 3;
+    const size_t uvCount     = data.uvs.size() / 2;
+    const size_t normalCount = data.normals.size() / 3;
+    const size_t cornerCount = data.corners.size() / 3;
+    int* corners = data.corners.data();
+
+    // 1. Check every corner : a missing position is an error, a missing uv or normal is just dropped
+    //    A relative index reaching before the first v / vt / vn is an error for all three
+    //    The mesh only keeps normals if every corner has one, uvs if at least one corner has one
+    std::vector<int>  badIndex(threads, 0);
+    std::vector<char> bad(threads, 0), allNormals(threads, 1), anyUv(threads, 0);
+    parallelRanges(cornerCount, threads, [&](size_t begin, size_t end, size_t r) {
+        for (size_t i = begin; i < end; i++) {
+            int* c = corners + i * 3;
+            if ((c[0] < 0 || (size_t)c[0] >= posCount) && !bad[r]) {
+                bad[r] = 1;
+                badIndex[r] = c[0] == badRelativeIndex ? c[0] : c[0] + 1;
+            }
+            if ((c[1] == badRelativeIndex || c[2] == badRelativeIndex) && !bad[r]) {
+                bad[r] = 1;
+                badIndex[r] = badRelativeIndex;
+            }
+            if (c[1] >= 0 && (size_t)c[1] >= uvCount)     c[1] = -1;
+            if (c[2] >= 0 && (size_t)c[2] >= normalCount) c[2] = -1;
+            if (c[1] >= 0) anyUv[r] = 1;
+            if (c[2] < 0)  allNormals[r] = 0;
+        }
+    });
+
+    bool hasUvs = false, hasNormals = cornerCount > 0;
+    for (unsigned r = 0; r < threads; r++) {
+        if (bad[r] && badIndex[r] == badRelativeIndex) {
+            fprintf(stderr, "[OBJ] Face uses vertex data through a relative index before the first record\n");
+            return false;
+        }
+        if (bad[r]) {
+            fprintf(stderr, "[OBJ] Face uses vertex %d but the file only has %zu\n", badIndex[r], posCount);
+            return false;
+        }
+        hasUvs     = hasUvs || anyUv[r];
+        hasNormals = hasNormals && allNormals[r];
+    }
+
+    // Attributes we drop must not split vertices either
+    if (!hasNormals) {
+        parallelRanges(cornerCount, threads, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++)
+                corners[i * 3 + 2] = -1;
+        });
+    }
+
+    // 2. Give every distinct triplet a vertex number, in order of first use
+    outMesh.indices.resize(cornerCount);
+    std::vector<int> keys;
+
+    if (!hasUvs && !hasNormals) {
+        // Positions only : the position index is the key, no hashing needed
+        std::vector<uint32_t> remap(posCount, emptySlot);
+        keys.reserve(posCount * 3);
+        for (size_t i = 0; i < cornerCount; i++) {
+            uint32_t& id = remap[corners[i * 3]];
+            if (id == emptySlot) {
+                id = (uint32_t)(keys.size() / 3);
+                keys.insert(keys.end(), corners + i * 3, corners + i * 3 + 3);
+            }
+            outMesh.indices[i] = id;
+        }
+    }
+    else {
+        CornerTable table(posCount);
+        for (size_t i = 0; i < cornerCount; i++)
+            outMesh.indices[i] = table.insert(corners + i * 3);
+        keys.swap(table.keys);
+        if (stats)
+            stats->reallocations += table.reallocations;
+    }
+    std::vector<int>().swap(data.corners);
+
+    // 3. Fetch the attributes of every unique vertex
+    const size_t vertexCount = keys.size() / 3;
+    outMesh.vertices.resize(vertexCount * 3);
+    outMesh.normals.resize(hasNormals ? vertexCount * 3 : 0);
+    outMesh.uvs.resize(hasUvs ? vertexCount * 2 : 0);
+
+    parallelRanges(vertexCount, threads, [&](size_t begin, size_t end, size_t) {
+        for (size_t v = begin; v < end; v++) {
+            const int* k = &keys[v * 3];
+            memcpy(&outMesh.vertices[v * 3], &data.positions[(size_t)k[0] * 3], 3 * sizeof(float));
+            if (hasNormals)
+                memcpy(&outMesh.normals[v * 3], &data.normals[(size_t)k[2] * 3], 3 * sizeof(float));
+            if (hasUvs) {
+                outMesh.uvs[v * 2 + 0] = k[1] >= 0 ? data.uvs[(size_t)k[1] * 2 + 0] : 0.0f;
+                outMesh.uvs[v * 2 + 1] = k[1] >= 0 ? data.uvs[(size_t)k[1] * 2 + 1] : 0.0f;
+            }
+        }
+    });
+
+    buildSubMeshes(data.groups, outMesh, threads);
+    outMesh.mtllibs.swap(data.mtllibs);
+    return true;
+}
@@ -1,85 +1,357 @@
-#include "../include/include.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "../include/mesh.hpp"
+#include "../include/parallel.hpp"
+
+// Flat shading needs its own normal on every corner, so the vertices shared
+// by several triangles are split back into one vertex per corner
+static void unweldMesh(Mesh &mesh) {
+    size_t cornerCount = mesh.indices.size();
+    bool hasUvs = !mesh.uvs.empty();
+    std::vector<float> vertices(cornerCount * 3);
+    std::vector<float> uvs(hasUvs ? cornerCount * 2 : 0);
+
+    for(size_t i = 0; i < cornerCount; i++){
+        uint32_t v = mesh.indices[i];
+        vertices[i*3+0] = mesh.vertices[v*3+0];
+        vertices[i*3+1] = mesh.vertices[v*3+1];
+        vertices[i*3+2] = mesh.vertices[v*3+2];
+        if(hasUvs){
+            uvs[i*2+0] = mesh.uvs[v*2+0];
+            uvs[i*2+1] = mesh.uvs[v*2+1];
+        }
+        mesh.indices[i] = (uint32_t)i;
+    }
+
+    mesh.vertices.swap(vertices);
+    mesh.uvs.swap(uvs);
+}
 
 // Generate normals (a normal ~= the direction each triangle is facing perpendicularly)
-void generateNormals(Mesh &mesh) {
-    size_t vertexCount = mesh.vertices.size() / 3;
-    mesh.normals.resize(mesh.vertices.size(), 0.0f);
+// Face normals are computed on the indexed mesh (see normals.cpp), then copied to the 3 corners
+void generateNormals(Mesh &mesh, unsigned threads) {
+    size_t triangleCount = mesh.indices.size() / 3;
+    std::vector<float> faceNormals(triangleCount * 3);
+    computeFaceNormals(mesh.vertices.data(), mesh.indices.data(), triangleCount, faceNormals.data(), threads);
 
-    for(size_t i=0; i < vertexCount; i += 3) {
-        float* v0 = &mesh.vertices[i*3 + 0];
-        float* v1 = &mesh.vertices[(i+1)*3 + 0];
-        float* v2 = &mesh.vertices[(i+2)*3 + 0];
+    unweldMesh(mesh);
+    mesh.normals.resize(mesh.vertices.size());
+    parallelRanges(triangleCount, resolveThreadCount(threads), [&](size_t begin, size_t end, size_t) {
+        for(size_t i = begin; i < end; i++)
+            for(int j = 0; j < 3; j++)
+                memcpy(&mesh.normals[(i*3 + j)*3], &faceNormals[i*3], 3*sizeof(float));
+    });
+}
 
-        float edge1[3] = { v1[0]-v0[0], v1[1]-v0[1], v1[2]-v0[2] };
-        float edge2[3] = { v2[0]-v0[0], v2[1]-v0[1], v2[2]-v0[2] };
+void fitBounds(const Bounds &bounds, float center[3], float &scale) {
+    scale = 1.0f;
+    for(int a = 0; a < 3; a++)
+        center[a] = bounds.empty() ? 0.0f : bounds.center[a];
+    if(!bounds.empty() && bounds.radius > 0.0f && std::isfinite(bounds.radius))
+        scale = 1.5f / bounds.radius;
+}
 
-        float nx = edge1[1]*edge2[2] - edge1[2]*edge2[1];
-        float ny = edge1[2]*edge2[0] - edge1[0]*edge2[2];
-        float nz = edge1[0]*edge2[1] - edge1[1]*edge2[0];
+// Below this many vertices one thread writes them faster than several
+static const size_t minVerticesPerThread = 64 * 1024;
 
-        float length = std::sqrt(nx*nx + ny*ny + nz*nz);
-        if(length != 0.0f) { nx/=length; ny/=length; nz/=length; }
+static unsigned writeThreads(size_t count, unsigned threads) {
+    size_t maxThreads = count / minVerticesPerThread;
+    threads = resolveThreadCount(threads);
+    if(threads > maxThreads)
+        threads = maxThreads ? (unsigned)maxThreads : 1;
+    return threads;
+}
+
+// Vertices [first, first + count) of an indexed mesh in the GPU layout
+static void interleaveRange(const Mesh &mesh, const VertexEncoder &encoder, size_t first, size_t count,
+                            unsigned char *dst) {
+    bool hasUvs = !mesh.uvs.empty();
+    for(size_t i = 0; i < count; i++){
+        size_t v = first + i;
+        // Without uvs in the file the default texture is mapped in the fragment shader instead
+        encoder.write(&mesh.vertices[v*3], &mesh.normals[v*3], hasUvs ? &mesh.uvs[v*2] : nullptr,
+                      dst + i*encoder.layout.stride);
+    }
+}
 
-        for(int j=0;j<3;j++){
-            mesh.normals[(i+j)*3 + 0] = nx;
-            mesh.normals[(i+j)*3 + 1] = ny;
-            mesh.normals[(i+j)*3 + 2] = nz;
+// Same for the corners [first, first + count) of the triangles, each one gets the normal of its face
+// The normals are computed a block of triangles at a time into a small buffer on the stack
+static void interleaveCorners(const Mesh &mesh, const VertexEncoder &encoder, size_t first, size_t count,
+                              unsigned char *dst) {
+    const size_t blockTriangles = 256;
+    float faceNormals[blockTriangles * 3];
+    bool hasUvs = !mesh.uvs.empty();
+
+    size_t corner = first, end = first + count;
+    while(corner < end){
+        size_t firstTriangle = corner / 3;
+        size_t triangles = (end - firstTriangle*3 + 2) / 3;
+        if(triangles > blockTriangles)
+            triangles = blockTriangles;
+        computeFaceNormals(mesh.vertices.data(), &mesh.indices[firstTriangle*3], triangles, faceNormals, 1);
+
+        size_t blockEnd = std::min(end, (firstTriangle + triangles) * 3);
+        for(; corner < blockEnd; corner++){
+            size_t v = mesh.indices[corner];
+            encoder.write(&mesh.vertices[v*3], &faceNormals[(corner/3 - firstTriangle)*3],
+                          hasUvs ? &mesh.uvs[v*2] : nullptr, dst + (corner - first)*encoder.layout.stride);
         }
     }
 }
 
-// Find the largest and smallest point of our Mesh so we can scale it down or up to fit in our window
-void computeCenterScale(const Mesh &mesh, float &cx, float &cy, float &cz, float &scale) {
-    float minX=1e9,minY=1e9,minZ=1e9;
-    float maxX=-1e9,maxY=-1e9,maxZ=-1e9;
+// Store every relevant data for each vertex in memory in the right order
+// With the Float layout that is 8 float values : three position (x, y, z), three normals (nx, ny, nz)
+// and u + v (used to apply textures, only when the file has some)
+std::vector<uint8_t> interleaveMesh(const Mesh &mesh, const VertexEncoder &encoder) {
+    size_t vertexCount = mesh.vertices.size()/3;
+    std::vector<uint8_t> interleaved(vertexCount*encoder.layout.stride);
+    interleaveRange(mesh, encoder, 0, vertexCount, interleaved.data());
+    return interleaved;
+}
 
-    for(size_t i=0;i<mesh.vertices.size();i+=3){
-        float x=mesh.vertices[i], y=mesh.vertices[i+1], z=mesh.vertices[i+2];
-        if(x<minX) minX=x; 
-        if(x>maxX) maxX=x;
-        if(y<minY) minY=y; 
-        if(y>maxY) maxY=y;
-        if(z<minZ) minZ=z; 
-        if(z>maxZ) maxZ=z;
+void FusedMesh::writeVertices(size_t first, size_t count, void *dst) const {
+    unsigned char *out = static_cast<unsigned char*>(dst);
+    size_t stride = encoder.layout.stride;
+    parallelRanges(count, writeThreads(count, threads), [&](size_t begin, size_t end, size_t) {
+        if(flat)
+            interleaveCorners(mesh, encoder, first + begin, end - begin, out + begin*stride);
+        else
+            interleaveRange(mesh, encoder, first + begin, end - begin, out + begin*stride);
+    });
+}
+
+void FusedMesh::writeIndices(size_t first, size_t count, size_t size, void *dst) const {
+    // Flat : corner i is vertex i
+    if(size == sizeof(uint16_t)){
+        uint16_t *out = static_cast<uint16_t*>(dst);
+        for(size_t i = 0; i < count; i++)
+            out[i] = (uint16_t)(flat ? first + i : mesh.indices[first + i]);
+    }
+    else if(flat){
+        uint32_t *out = static_cast<uint32_t*>(dst);
+        for(size_t i = 0; i < count; i++)
+            out[i] = (uint32_t)(first + i);
     }
+    else
+        memcpy(dst, &mesh.indices[first], count * sizeof(uint32_t));
+}
 
-    cx = (minX+maxX)*0.5f;
-    cy = (minY+maxY)*0.5f;
-    cz = (minZ+maxZ)*0.5f;
+void copyViewVertices(const MeshView &view, size_t first, size_t count, void *dst) {
+    size_t stride = view.layout.stride;
+    if(view.vertices)
+        memcpy(dst, (const char*)view.vertices + first*stride, count*stride);
+    else
+        view.fused->writeVertices(first, count, dst);
+}
+
+void copyViewIndices(const MeshView &view, size_t first, size_t count, void *dst) {
+    if(view.indices)
+        memcpy(dst, (const char*)view.indices + first * view.indexSize, count * view.indexSize);
+    else
+        view.fused->writeIndices(first, count, view.indexSize, dst);
+}
 
-    float dx = maxX-minX;
-    float dy = maxY-minY;
-    float dz = maxZ-minZ;
-    float radius = std::sqrt(dx*dx + dy*dy + dz*dz)*0.5f;
+void buildViewBvh(const MeshView &view, Bvh &out, unsigned threads){
+    if(!view.indexCount || !view.submeshCount)
+        return;
+    // Levels of detail come after the full detail triangles in the index buffer
+    const SubMesh &last = view.submeshes[view.submeshCount - 1];
+    size_t triangleCount = (last.firstIndex + last.indexCount) / 3;
 
-    float desiredRadius = 1.5f;
-    scale = desiredRadius / radius;
+    // A piece of the vertices at a time, so the encoded copy never exists whole
+    const size_t piece = 4096;
+    std::vector<float> positions(view.vertexCount * 3);
+    std::vector<unsigned char> encoded(piece * view.layout.stride);
+    for(size_t first = 0; first < view.vertexCount; first += piece){
+        size_t count = std::min(piece, view.vertexCount - first);
+        copyViewVertices(view, first, count, encoded.data());
+        for(size_t v = 0; v < count; v++){
+            float normal[3], uv[2];
+            decodeVertex(view.layout, view.quant, &encoded[v * view.layout.stride], &positions[(first + v) * 3],
+                         normal, uv);
+        }
+    }
+    std::vector<uint32_t> indices(triangleCount * 3);
+    if(view.indexSize == sizeof(uint32_t))
+        copyViewIndices(view, 0, indices.size(), indices.data());
+    else{
+        std::vector<uint16_t> narrow(indices.size());
+        copyViewIndices(view, 0, narrow.size(), narrow.data());
+        std::copy(narrow.begin(), narrow.end(), indices.begin());
+    }
+    buildBvh(positions, indices.data(), triangleCount, out, threads);
 }
 
-// Store every relevant data for each vertex in memory in the right order
-// In our case we have 8 size_t value to store : three position (x, y, z), three normals (nx, ny, nz) and u + v (used to apply textures)
-std::vector<float> interleaveMesh(const Mesh &mesh, float cx, float cy, float cz, float scale) {
-    size_t vertexCount = mesh.vertices.size()/3;
-    std::vector<float> interleaved;
-    interleaved.reserve(vertexCount*8); // 3 pos + 3 normal + 2 UV
+size_t indexSize(size_t vertexCount) {
+    return vertexCount <= 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
 
-    for(size_t i=0;i<vertexCount;i++){
-        float x = (mesh.vertices[i*3+0]-cx)*scale;
-        float y = (mesh.vertices[i*3+1]-cy)*scale;
-        float z = (mesh.vertices[i*3+2]-cz)*scale;
+void buildModelBuffers(Mesh &mesh, ModelBuffers &out, const BuildOptions &options) {
+    const NormalOptions &normals = options.normals;
+    bool fused = options.fused;
+    MeshView &view = out.view;
+    bool flatLater = false, perCorner = false;
 
-        float nx = mesh.normals[i*3+0];
-        float ny = mesh.normals[i*3+1];
-        float nz = mesh.normals[i*3+2];
+    // Soups first (--weld) : every later step gains from shared vertices
+    view.weldEpsilon = options.weldEpsilon;
+    if(options.weldEpsilon >= 0.0f && !mesh.indices.empty()){
+        auto start = std::chrono::steady_clock::now();
+        WeldStats weld = weldVertices(mesh, options.weldEpsilon, normals.threads);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("[WELD] %zu -> %zu vertices, %zu degenerate and %zu duplicate triangles removed (%zu left) in %.1f ms\n",
+            weld.verticesIn, weld.verticesOut, weld.degenerate, weld.duplicates, weld.trianglesOut, ms);
+    }
+    bool flat = mesh.normals.empty() && !normals.smooth;
+    if(mesh.normals.empty() && normals.smooth){
+        printf("No normals found, generating smooth normals (crease %.0f degrees)\n", normals.creaseAngle);
+        generateSmoothNormals(mesh, normals.creaseAngle, normals.threads);
+        view.normalCrease = normals.crease();
+    }
 
-        // UVs are computed in the fragment shader
-        float u = 0.0f;
-        float v = 0.0f;
+    // Levels of detail on the welded vertices, flat normals split them per corner afterwards
+    view.lodRatios = options.lodRatios;
+    if(!options.lodRatios.empty() && !mesh.indices.empty()){
+        auto start = std::chrono::steady_clock::now();
+        buildLods(mesh, options.lodRatios, normals.threads);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(!mesh.lods.empty()){
+            printf("[LOD] %zu levels in %.1f ms:", mesh.lods.size(), ms);
+            for(const MeshLod &lod : mesh.lods)
+                printf(" %u", lod.triangleCount);
+            printf(" triangles\n");
+        }
+    }
 
-        interleaved.push_back(x); interleaved.push_back(y); interleaved.push_back(z);
-        interleaved.push_back(nx); interleaved.push_back(ny); interleaved.push_back(nz);
-        interleaved.push_back(u); interleaved.push_back(v);
+    if(flat){
+        if(fused){
+            printf("No normals found, generating normals while uploading\n");
+            flatLater = perCorner = true;
+        }
+        else{
+            printf("No normals found, generating normals\n");
+            generateNormals(mesh, normals.threads);
+            perCorner = true;
+        }
+        view.normalCrease = normals.crease();
     }
 
-    return interleaved;
+    // Triangle and vertex order for the GPU caches, before anything is laid out
+    // Flat normals give every corner its own vertex, there is nothing to reuse then
+    if(options.vertexCache && !perCorner && !mesh.indices.empty()){
+        size_t vertexCount = mesh.vertices.size() / 3;
+        VertexCacheStats before = simulateVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount);
+        auto start = std::chrono::steady_clock::now();
+        optimizeVertexCache(mesh, 16, normals.threads);
+        optimizeVertexFetch(mesh, normals.threads);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        VertexCacheStats after = simulateVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount);
+        printf("[VCACHE] ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (FIFO of 16, %zu triangles reordered in %.1f ms)\n",
+            before.acmr(), after.acmr(), before.atvr(), after.atvr(), before.triangles, ms);
+    }
+    view.cacheOrdered = options.vertexCache || perCorner;
+
+    // Cut every draw range in meshlets for culling, in the final triangle order
+    // Normals made while uploading don't change it, nor where the corners are
+    if(!mesh.indices.empty()){
+        auto start = std::chrono::steady_clock::now();
+        buildMeshlets(mesh, normals.threads);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("[MESHLET] %zu meshlets in %.1f ms, %s\n", mesh.meshlets.size(), ms,
+            mesh.watertight ? "watertight (back facing ones can be culled)" : "open surface (frustum culling only)");
+    }
+
+    // Calculate the scale of the object so it fits in our window
+    Bounds bounds = computeBounds(mesh.vertices.data(), mesh.vertices.size() / 3, normals.threads);
+    fitBounds(bounds, view.center, view.scale);
+    view.bounds = transformBounds(bounds, view.center, view.scale);
+
+
+    // Quantized layouts are relative to the box the vertices end up in
+    view.layout = vertexLayout(options.format, !mesh.uvs.empty());
+    view.quant  = fitQuantization(options.format, view.bounds, mesh.uvs.data(), mesh.uvs.size() / 2);
+    VertexEncoder encoder(view.layout, view.quant, view.center, view.scale);
+
+    if(fused){
+        // Keep the mesh as it is, the uploader asks for the vertices a range at a time
+        FusedMesh &src = out.fused;
+        src.flat    = flatLater;
+        src.encoder = encoder;
+        src.threads = normals.threads;
+        src.mesh.vertices.swap(mesh.vertices);
+        src.mesh.normals.swap(mesh.normals);
+        src.mesh.uvs.swap(mesh.uvs);
+        src.mesh.indices.swap(mesh.indices);
+
+        view.vertexCount = flatLater ? src.mesh.indices.size() : src.mesh.vertices.size() / 3;
+        view.indexCount  = src.mesh.indices.size();
+        view.indexSize   = indexSize(view.vertexCount);
+        view.fused       = &src;
+    }
+    else{
+        // Store all data for each vertex in succession in memory
+        out.vertexData   = interleaveMesh(mesh, encoder);
+        view.vertices    = out.vertexData.data();
+        view.vertexCount = mesh.vertices.size() / 3;
+        mesh.vertices = std::vector<float>();
+        mesh.normals  = std::vector<float>();
+        mesh.uvs      = std::vector<float>();
+
+        // Indices at the width they will have on the GPU
+        view.indexCount = mesh.indices.size();
+        view.indexSize  = indexSize(view.vertexCount);
+        out.indexData.resize(view.indexCount * view.indexSize);
+        if(view.indexSize == sizeof(uint16_t)){
+            uint16_t *dst = reinterpret_cast<uint16_t*>(out.indexData.data());
+            for(size_t i = 0; i < view.indexCount; i++)
+                dst[i] = (uint16_t)mesh.indices[i];
+        }
+        else if(view.indexCount)
+            memcpy(out.indexData.data(), mesh.indices.data(), view.indexCount * sizeof(uint32_t));
+        view.indices = out.indexData.data();
+        mesh.indices = std::vector<uint32_t>();
+    }
+
+    // Submesh boxes follow the vertices into the centered / scaled space
+    out.submeshes.swap(mesh.submeshes);
+    for(SubMesh &sub : out.submeshes){
+        for(int a = 0; a < 3; a++){
+            sub.min[a] = (sub.min[a] - view.center[a]) * view.scale;
+            sub.max[a] = (sub.max[a] - view.center[a]) * view.scale;
+        }
+    }
+    view.submeshes    = out.submeshes.data();
+    view.submeshCount = out.submeshes.size();
+
+    // Errors too, so they compare with the bounding sphere the renderer sees
+    out.lods.swap(mesh.lods);
+    out.lodSubmeshes.swap(mesh.lodSubmeshes);
+    for(MeshLod &lod : out.lods)
+        lod.error *= view.scale;
+    for(SubMesh &sub : out.lodSubmeshes){
+        for(int a = 0; a < 3; a++){
+            sub.min[a] = (sub.min[a] - view.center[a]) * view.scale;
+            sub.max[a] = (sub.max[a] - view.center[a]) * view.scale;
+        }
+    }
+    view.lods         = out.lods.data();
+    view.lodCount     = out.lods.size();
+    view.lodSubmeshes = out.lodSubmeshes.data();
+
+    out.meshlets.swap(mesh.meshlets);
+    out.meshletRanges.swap(mesh.meshletRanges);
+    for(Meshlet &m : out.meshlets){
+        for(int a = 0; a < 3; a++)
+            m.center[a] = (m.center[a] - view.center[a]) * view.scale;
+        m.radius *= view.scale;
+    }
+    view.meshlets          = out.meshlets.data();
+    view.meshletCount      = out.meshlets.size();
+    view.meshletRanges     = out.meshletRanges.data();
+    view.meshletRangeCount = out.meshletRanges.size();
+    view.watertight        = mesh.watertight;
+    view.materials.swap(mesh.materials);
+    view.mtllibs.swap(mesh.mtllibs);
 }
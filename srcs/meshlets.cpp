@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cmath>
+#include "../include/mesh.hpp"
+#include "../include/parallel.hpp"
+
+// Meshlets : the renderer culls them against the frustum and by facing before drawing (see culling.hpp)
+// A run of at most 64 vertices / 124 triangles is small enough that its normals still mostly agree,
+// and big enough that the CPU doesn't spend more time testing them than the GPU would drawing them
+
+namespace {
+
+const uint32_t noVertex = 0xffffffffu;
+
+// Sphere around the box of its corners, cone around the unit normals of its triangles
+void meshletBounds(const Mesh& mesh, Meshlet& m) {
+    const uint32_t* indices = &mesh.indices[m.firstIndex];
+    float min[3] = { INFINITY, INFINITY, INFINITY }, max[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (uint32_t i = 0; i < m.indexCount; i++) {
+        const float* p = &mesh.vertices[(size_t)indices[i] * 3];
+        for (int a = 0; a < 3; a++) {
+            min[a] = std::fmin(min[a], p[a]);
+            max[a] = std::fmax(max[a], p[a]);
+        }
+    }
+    float radius2 = 0.0f;
+    for (int a = 0; a < 3; a++)
+        m.center[a] = (min[a] + max[a]) * 0.5f;
+    for (uint32_t i = 0; i < m.indexCount; i++) {
+        const float* p = &mesh.vertices[(size_t)indices[i] * 3];
+        float dx = p[0] - m.center[0], dy = p[1] - m.center[1], dz = p[2] - m.center[2];
+        radius2 = std::fmax(radius2, dx * dx + dy * dy + dz * dz);
+    }
+    m.radius = std::sqrt(radius2);
+
+    // Degenerate triangles face nowhere, they don't widen the cone
+    float normals[maxMeshletTriangles * 3];
+    size_t normalCount = 0;
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t t = 0; t < m.indexCount / 3; t++) {
+        const float* p0 = &mesh.vertices[(size_t)indices[t * 3] * 3];
+        const float* p1 = &mesh.vertices[(size_t)indices[t * 3 + 1] * 3];
+        const float* p2 = &mesh.vertices[(size_t)indices[t * 3 + 2] * 3];
+        float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (!(len > 0.0f) || !std::isfinite(len))
+            continue;
+        for (int a = 0; a < 3; a++) {
+            normals[normalCount * 3 + a] = n[a] / len;
+            axis[a] += n[a] / len;
+        }
+        normalCount++;
+    }
+    float len = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    m.coneAxis[0] = m.coneAxis[1] = 0.0f;
+    m.coneAxis[2] = 1.0f;
+    m.coneCos = -1.0f;
+    if (!(len > 1e-6f))
+        return;
+    for (int a = 0; a < 3; a++)
+        m.coneAxis[a] = axis[a] / len;
+    m.coneCos = 1.0f;
+    for (size_t t = 0; t < normalCount; t++) {
+        const float* n = &normals[t * 3];
+        m.coneCos = std::fmin(m.coneCos, n[0] * m.coneAxis[0] + n[1] * m.coneAxis[1] + n[2] * m.coneAxis[2]);
+    }
+}
+
+}
+
+bool isWatertight(const Mesh &mesh) {
+    std::vector<uint32_t> position = weldPositions(mesh);
+    std::vector<uint64_t> edges;
+    for (const SubMesh& sub : mesh.submeshes) {
+        for (uint32_t i = sub.firstIndex; i + 2 < sub.firstIndex + sub.indexCount; i += 3) {
+            uint32_t c[3] = { position[mesh.indices[i]], position[mesh.indices[i + 1]], position[mesh.indices[i + 2]] };
+            // Collapsed onto an edge or a point, it covers nothing either way
+            if (c[0] == c[1] || c[1] == c[2] || c[0] == c[2])
+                continue;
+            for (int k = 0; k < 3; k++)
+                edges.push_back((uint64_t)c[k] << 32 | c[(k + 1) % 3]);
+        }
+    }
+    if (edges.empty())
+        return false;
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size(); i++) {
+        uint64_t twin = edges[i] << 32 | edges[i] >> 32;
+        if ((i + 1 < edges.size() && edges[i + 1] == edges[i])
+            || !std::binary_search(edges.begin(), edges.end(), twin))
+            return false;
+    }
+    return true;
+}
+
+void buildMeshlets(Mesh &mesh, unsigned threads) {
+    size_t vertexCount = mesh.vertices.size() / 3;
+    mesh.meshlets.clear();
+    mesh.meshletRanges.clear();
+
+    // seen[v] = the meshlet being filled when v is already in it, meshlets are numbered as they are made
+    std::vector<uint32_t> seen(vertexCount, noVertex);
+    size_t rangeCount = mesh.submeshes.size() + mesh.lodSubmeshes.size();
+    for (size_t r = 0; r < rangeCount; r++) {
+        const SubMesh& sub = r < mesh.submeshes.size() ? mesh.submeshes[r]
+                                                       : mesh.lodSubmeshes[r - mesh.submeshes.size()];
+        mesh.meshletRanges.push_back((uint32_t)mesh.meshlets.size());
+
+        Meshlet current = Meshlet();
+        current.firstIndex = sub.firstIndex;
+        unsigned vertices = 0;
+        for (uint32_t i = sub.firstIndex; i + 2 < sub.firstIndex + sub.indexCount; i += 3) {
+            uint32_t id = (uint32_t)mesh.meshlets.size();
+            unsigned added = 0;
+            for (int k = 0; k < 3; k++)
+                added += seen[mesh.indices[i + k]] != id;
+            if (current.indexCount && (vertices + added > maxMeshletVertices
+                                       || current.indexCount / 3 >= maxMeshletTriangles)) {
+                mesh.meshlets.push_back(current);
+                current = Meshlet();
+                current.firstIndex = i;
+                vertices = 0;
+                id++;
+                added = 3;
+            }
+            for (int k = 0; k < 3; k++)
+                seen[mesh.indices[i + k]] = id;
+            vertices += added;
+            current.indexCount += 3;
+        }
+        if (current.indexCount)
+            mesh.meshlets.push_back(current);
+    }
+    mesh.meshletRanges.push_back((uint32_t)mesh.meshlets.size());
+
+    parallelRanges(mesh.meshlets.size(), resolveThreadCount(threads), [&](size_t begin, size_t end, size_t) {
+        for (size_t m = begin; m < end; m++)
+            meshletBounds(mesh, mesh.meshlets[m]);
+    });
+    mesh.watertight = isWatertight(mesh);
+}
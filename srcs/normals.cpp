@@ -0,0 +1,545 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "../include/mesh.hpp"
+#include "../include/parallel.hpp"
+
+// Face normal kernels
+// Triangles go 8 at a time : the corners are gathered from the indexed positions into SoA
+// registers (x0, y0, z0, x1 ... one lane per triangle) so the math runs on full vectors
+// The scalar, SSE and AVX2 versions do the same operations in the same order, with a real
+// sqrt and divide, so their results are bit-identical (no rsqrt approximation, no FMA)
+
+namespace {
+
+// Below this many triangles threads cost more than they bring
+const size_t minTrianglesPerThread = 64 * 1024;
+
+inline void storeBlock(float* out, size_t first, const float* nx, const float* ny, const float* nz) {
+    float* dst = out + first * 3;
+    for (int t = 0; t < 8; t++) {
+        dst[t * 3 + 0] = nx[t];
+        dst[t * 3 + 1] = ny[t];
+        dst[t * 3 + 2] = nz[t];
+    }
+}
+
+// One triangle, also used for the tail of the vector kernels
+inline void faceNormal(const float* pos, const uint32_t* tri, float* out) {
+    const float* v0 = pos + (size_t)tri[0] * 3;
+    const float* v1 = pos + (size_t)tri[1] * 3;
+    const float* v2 = pos + (size_t)tri[2] * 3;
+
+    float edge1[3] = { v1[0]-v0[0], v1[1]-v0[1], v1[2]-v0[2] };
+    float edge2[3] = { v2[0]-v0[0], v2[1]-v0[1], v2[2]-v0[2] };
+
+    float nx = edge1[1]*edge2[2] - edge1[2]*edge2[1];
+    float ny = edge1[2]*edge2[0] - edge1[0]*edge2[2];
+    float nz = edge1[0]*edge2[1] - edge1[1]*edge2[0];
+
+    float length = std::sqrt(nx*nx + ny*ny + nz*nz);
+    if (length != 0.0f) { nx /= length; ny /= length; nz /= length; }
+
+    out[0] = nx;
+    out[1] = ny;
+    out[2] = nz;
+}
+
+void faceNormalsScalar(const float* pos, const uint32_t* idx, size_t begin, size_t end, float* out) {
+    for (size_t t = begin; t < end; t++)
+        faceNormal(pos, idx + t * 3, out + t * 3);
+}
+
+#if SCOP_X86
+
+// x y z 0 of one vertex, without reading past its 3 floats
+SCOP_TARGET_SSE inline __m128 loadVertex(const float* pos, uint32_t i) {
+    const float* v = pos + (size_t)i * 3;
+    __m128 xy = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(v)));
+    return _mm_insert_ps(xy, _mm_load_ss(v + 2), 0x20);
+}
+
+// Corner c of the 4 triangles starting at `first`, transposed to one x / y / z vector each
+// (plain loads and shuffles : AVX2 gather instructions are slower than this on many CPUs)
+SCOP_TARGET_SSE inline void gatherCorner(const float* pos, const uint32_t* idx, size_t first, int c,
+                                         __m128& x, __m128& y, __m128& z) {
+    const uint32_t* tri = idx + first * 3 + c;
+    __m128 a = loadVertex(pos, tri[0]);
+    __m128 b = loadVertex(pos, tri[3]);
+    __m128 d = loadVertex(pos, tri[6]);
+    __m128 e = loadVertex(pos, tri[9]);
+    _MM_TRANSPOSE4_PS(a, b, d, e);
+    x = a;
+    y = b;
+    z = d;
+}
+
+SCOP_TARGET_SSE void faceNormalsSse(const float* pos, const uint32_t* idx, size_t begin, size_t end, float* out) {
+    alignas(16) float nx[8], ny[8], nz[8];
+    const __m128 zero = _mm_setzero_ps();
+
+    size_t t = begin;
+    for (; t + 8 <= end; t += 8) {
+        for (int h = 0; h < 8; h += 4) {
+            __m128 x0, y0, z0, x1, y1, z1, x2, y2, z2;
+            gatherCorner(pos, idx, t + h, 0, x0, y0, z0);
+            gatherCorner(pos, idx, t + h, 1, x1, y1, z1);
+            gatherCorner(pos, idx, t + h, 2, x2, y2, z2);
+
+            __m128 e1x = _mm_sub_ps(x1, x0), e1y = _mm_sub_ps(y1, y0), e1z = _mm_sub_ps(z1, z0);
+            __m128 e2x = _mm_sub_ps(x2, x0), e2y = _mm_sub_ps(y2, y0), e2z = _mm_sub_ps(z2, z0);
+
+            __m128 x = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+            __m128 y = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+            __m128 z = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+            // Degenerate triangles keep their (zero) cross product, like the scalar `if`
+            __m128 keep = _mm_cmpeq_ps(length, zero);
+            _mm_store_ps(nx + h, _mm_blendv_ps(_mm_div_ps(x, length), x, keep));
+            _mm_store_ps(ny + h, _mm_blendv_ps(_mm_div_ps(y, length), y, keep));
+            _mm_store_ps(nz + h, _mm_blendv_ps(_mm_div_ps(z, length), z, keep));
+        }
+        storeBlock(out, t, nx, ny, nz);
+    }
+    faceNormalsScalar(pos, idx, t, end, out);
+}
+
+SCOP_TARGET_AVX2 void faceNormalsAvx2(const float* pos, const uint32_t* idx, size_t begin, size_t end, float* out) {
+    alignas(32) float nx[8], ny[8], nz[8];
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t t = begin;
+    for (; t + 8 <= end; t += 8) {
+        __m256 x[3], y[3], z[3];
+        for (int c = 0; c < 3; c++) {
+            __m128 lx, ly, lz, hx, hy, hz;
+            gatherCorner(pos, idx, t, c, lx, ly, lz);
+            gatherCorner(pos, idx, t + 4, c, hx, hy, hz);
+            x[c] = _mm256_set_m128(hx, lx);
+            y[c] = _mm256_set_m128(hy, ly);
+            z[c] = _mm256_set_m128(hz, lz);
+        }
+        __m256 e1x = _mm256_sub_ps(x[1], x[0]), e1y = _mm256_sub_ps(y[1], y[0]), e1z = _mm256_sub_ps(z[1], z[0]);
+        __m256 e2x = _mm256_sub_ps(x[2], x[0]), e2y = _mm256_sub_ps(y[2], y[0]), e2z = _mm256_sub_ps(z[2], z[0]);
+
+        __m256 cx = _mm256_sub_ps(_mm256_mul_ps(e1y, e2z), _mm256_mul_ps(e1z, e2y));
+        __m256 cy = _mm256_sub_ps(_mm256_mul_ps(e1z, e2x), _mm256_mul_ps(e1x, e2z));
+        __m256 cz = _mm256_sub_ps(_mm256_mul_ps(e1x, e2y), _mm256_mul_ps(e1y, e2x));
+
+        __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)),
+                                                     _mm256_mul_ps(cz, cz)));
+        __m256 keep = _mm256_cmp_ps(length, zero, _CMP_EQ_OQ);
+        _mm256_store_ps(nx, _mm256_blendv_ps(_mm256_div_ps(cx, length), cx, keep));
+        _mm256_store_ps(ny, _mm256_blendv_ps(_mm256_div_ps(cy, length), cy, keep));
+        _mm256_store_ps(nz, _mm256_blendv_ps(_mm256_div_ps(cz, length), cz, keep));
+        storeBlock(out, t, nx, ny, nz);
+    }
+    faceNormalsScalar(pos, idx, t, end, out);
+}
+
+#endif
+
+}
+
+void computeFaceNormals(const float* positions, const uint32_t* indices, size_t triangleCount, float* out,
+                        unsigned threads, SimdLevel level) {
+    typedef void (*Kernel)(const float*, const uint32_t*, size_t, size_t, float*);
+    Kernel kernel = faceNormalsScalar;
+#if SCOP_X86
+    level = clampSimdLevel(level);
+    if (level == SimdLevel::AVX2)
+        kernel = faceNormalsAvx2;
+    else if (level == SimdLevel::SSE)
+        kernel = faceNormalsSse;
+#else
+    (void)level;
+#endif
+
+    threads = resolveThreadCount(threads);
+    size_t maxThreads = triangleCount / minTrianglesPerThread;
+    if (threads > maxThreads)
+        threads = maxThreads ? (unsigned)maxThreads : 1;
+
+    // Ranges start on a multiple of 8 so only the last one has a scalar tail
+    size_t blocks = (triangleCount + 7) / 8;
+    parallelRanges(blocks, threads, [&](size_t begin, size_t end, size_t) {
+        size_t last = end * 8 < triangleCount ? end * 8 : triangleCount;
+        kernel(positions, indices, begin * 8, last, out);
+    });
+}
+
+// Smooth normals
+// Every corner gets the weighted sum of the face normals around its position, skipping the faces
+// that bend more than the crease angle away from its own face. Corners of the same vertex that end
+// up with the same normal share one output vertex, so smooth areas are drawn fully indexed
+//
+// Nothing is accumulated with atomics : corners are bucket-sorted by position (each thread writes
+// to slots reserved for it), then each position is owned by exactly one thread which gathers
+// the faces around it
+
+namespace {
+
+const uint32_t noPosition = 0xFFFFFFFFu;
+
+// Vertices that sit at exactly the same place get the same position number, in order of first use
+// A uv seam splits a vertex in two, the normal must still be smoothed across it
+std::vector<uint32_t> weldPositions(const std::vector<float>& vertices, size_t& positionCount) {
+    size_t vertexCount = vertices.size() / 3;
+    size_t cap = 16;
+    while (cap < vertexCount * 2)
+        cap <<= 1;
+    std::vector<uint32_t> slots(cap, noPosition), ids(vertexCount), firstVertex;
+    firstVertex.reserve(vertexCount);
+
+    for (size_t v = 0; v < vertexCount; v++) {
+        uint32_t bits[3];
+        memcpy(bits, &vertices[v * 3], sizeof(bits));
+        // +0 and -0 are the same place
+        for (int a = 0; a < 3; a++)
+            if (bits[a] == 0x80000000u)
+                bits[a] = 0;
+        uint64_t h = bits[0] * 0x9E3779B97F4A7C15ull;
+        h ^= bits[1] * 0xC2B2AE3D27D4EB4Full + (h >> 31);
+        h ^= bits[2] * 0x165667B19E3779F9ull + (h >> 27);
+        size_t i = (h ^ (h >> 33)) & (cap - 1);
+
+        for (;;) {
+            if (slots[i] == noPosition) {
+                slots[i] = (uint32_t)firstVertex.size();
+                firstVertex.push_back((uint32_t)v);
+                break;
+            }
+            const float* p = &vertices[(size_t)firstVertex[slots[i]] * 3];
+            const float* q = &vertices[v * 3];
+            if (p[0] == q[0] && p[1] == q[1] && p[2] == q[2])
+                break;
+            i = (i + 1) & (cap - 1);
+        }
+        ids[v] = slots[i];
+    }
+    positionCount = firstVertex.size();
+    return ids;
+}
+
+// Corners grouped by position : the corners of position p are list[start[p] .. start[p + 1])
+// Two passes of a bucket sort, both split over threads without sharing any counter
+struct CornerLists {
+    std::vector<uint32_t> start;
+    std::vector<uint32_t> list;
+};
+
+void buildCornerLists(const std::vector<uint32_t>& cornerPos, size_t positionCount, unsigned threads,
+                      CornerLists& out) {
+    size_t cornerCount = cornerPos.size();
+    size_t bucketCount = (size_t)threads * 16;
+    if (bucketCount > positionCount)
+        bucketCount = positionCount ? positionCount : 1;
+    // Position p goes to bucket p * bucketCount / positionCount, buckets are contiguous position ranges
+    auto bucketOf = [&](uint32_t p) { return (size_t)((uint64_t)p * bucketCount / positionCount); };
+
+    // 1. Every thread counts its own range of corners per bucket
+    std::vector<uint32_t> counts((size_t)threads * bucketCount, 0);
+    parallelRanges(cornerCount, threads, [&](size_t begin, size_t end, size_t r) {
+        uint32_t* c = &counts[r * bucketCount];
+        for (size_t i = begin; i < end; i++)
+            c[bucketOf(cornerPos[i])]++;
+    });
+
+    // Slots of bucket b : thread 0's corners, then thread 1's ... so the order stays the file order
+    std::vector<uint32_t> bucketStart(bucketCount + 1, 0);
+    uint32_t total = 0;
+    for (size_t b = 0; b < bucketCount; b++) {
+        bucketStart[b] = total;
+        for (unsigned r = 0; r < threads; r++) {
+            uint32_t n = counts[r * bucketCount + b];
+            counts[r * bucketCount + b] = total;
+            total += n;
+        }
+    }
+    bucketStart[bucketCount] = total;
+
+    std::vector<uint32_t> byBucket(cornerCount);
+    parallelRanges(cornerCount, threads, [&](size_t begin, size_t end, size_t r) {
+        uint32_t* next = &counts[r * bucketCount];
+        for (size_t i = begin; i < end; i++)
+            byBucket[next[bucketOf(cornerPos[i])]++] = (uint32_t)i;
+    });
+
+    // 2. Each bucket is counting-sorted by position on its own
+    out.start.assign(positionCount + 1, 0);
+    out.list.resize(cornerCount);
+    parallelFor(bucketCount, threads, [&](size_t b) {
+        size_t first = (b * positionCount + bucketCount - 1) / bucketCount;
+        size_t last  = ((b + 1) * positionCount + bucketCount - 1) / bucketCount;
+        std::vector<uint32_t> offset(last - first + 1, 0);
+        for (uint32_t k = bucketStart[b]; k < bucketStart[b + 1]; k++)
+            offset[cornerPos[byBucket[k]] - first + 1]++;
+        for (size_t p = 1; p < offset.size(); p++)
+            offset[p] += offset[p - 1];
+        for (size_t p = first; p < last; p++)
+            out.start[p] = bucketStart[b] + offset[p - first];
+        for (uint32_t k = bucketStart[b]; k < bucketStart[b + 1]; k++) {
+            uint32_t c = byBucket[k];
+            out.list[bucketStart[b] + offset[cornerPos[c] - first]++] = c;
+        }
+    });
+    out.start[positionCount] = (uint32_t)cornerCount;
+}
+
+// acos within 7e-5 radians (Abramowitz & Stegun 4.4.45), plenty for a weight and a lot cheaper
+inline float weightAcos(float x) {
+    float a = std::fabs(x);
+    float r = std::sqrt(1.0f - a) * (1.5707288f + a * (-0.2121144f + a * (0.0742610f - a * 0.0187293f)));
+    return x < 0.0f ? 3.14159265f - r : r;
+}
+
+// Angle of the triangle at each of its corners, the weight of its face normal there
+void cornerAngles(const Mesh& mesh, size_t triangleCount, unsigned threads, std::vector<float>& out) {
+    out.resize(triangleCount * 3);
+    parallelRanges(triangleCount, threads, [&](size_t begin, size_t end, size_t) {
+        for (size_t t = begin; t < end; t++) {
+            const float* p[3];
+            for (int c = 0; c < 3; c++)
+                p[c] = &mesh.vertices[(size_t)mesh.indices[t * 3 + c] * 3];
+            for (int c = 0; c < 3; c++) {
+                const float* a = p[c];
+                const float* b = p[(c + 1) % 3];
+                const float* d = p[(c + 2) % 3];
+                float e1[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+                float e2[3] = { d[0]-a[0], d[1]-a[1], d[2]-a[2] };
+                float l = std::sqrt((e1[0]*e1[0] + e1[1]*e1[1] + e1[2]*e1[2]) * (e2[0]*e2[0] + e2[1]*e2[1] + e2[2]*e2[2]));
+                float cosA = l > 0.0f ? (e1[0]*e2[0] + e1[1]*e2[1] + e1[2]*e2[2]) / l : 1.0f;
+                out[t * 3 + c] = weightAcos(std::fmax(-1.0f, std::fmin(1.0f, cosA)));
+            }
+        }
+    });
+}
+
+}
+
+void generateSmoothNormals(Mesh &mesh, float creaseAngle, unsigned threads) {
+    threads = resolveThreadCount(threads);
+    const size_t cornerCount   = mesh.indices.size();
+    const size_t triangleCount = cornerCount / 3;
+    const float  cosCrease     = std::cos(creaseAngle * 3.14159265f / 180.0f);
+    const bool   hasUvs        = !mesh.uvs.empty();
+    if (cornerCount == 0)
+        return;
+
+    // 1. Face normals, corner weights and the corners around every position
+    std::vector<float> faceNormals(triangleCount * 3), angles;
+    computeFaceNormals(mesh.vertices.data(), mesh.indices.data(), triangleCount, faceNormals.data(), threads);
+    cornerAngles(mesh, triangleCount, threads, angles);
+
+    // Without uvs every vertex already is a distinct position (see buildIndexedMesh)
+    size_t positionCount = mesh.vertices.size() / 3;
+    std::vector<uint32_t> cornerPos;
+    if (hasUvs) {
+        std::vector<uint32_t> vertexPos = weldPositions(mesh.vertices, positionCount);
+        cornerPos.resize(cornerCount);
+        parallelRanges(cornerCount, threads, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++)
+                cornerPos[i] = vertexPos[mesh.indices[i]];
+        });
+    }
+    else
+        cornerPos.assign(mesh.indices.begin(), mesh.indices.end());
+    CornerLists lists;
+    buildCornerLists(cornerPos, positionCount, threads, lists);
+    std::vector<uint32_t>().swap(cornerPos);
+
+    // The faces around one position fall into smooth clusters : two faces sharing an edge through it
+    // join when they are within the crease angle of each other, and a cluster is every face reachable
+    // that way (union-find). Every corner gets the angle-weighted normal of its cluster
+    // Edges are matched by the position at their other end, compared by value since the input may
+    // repeat a position under several vertices. Large fans sort their edges, n log n instead of n * n
+    const uint32_t smallFan = 16;
+    struct Edge {
+        uint64_t hash;       // of the position at the other end
+        uint32_t vertex;     // at the other end
+        uint32_t slot;
+        bool operator<(const Edge& o) const { return hash != o.hash ? hash < o.hash : slot < o.slot; }
+    };
+    struct Fan {
+        std::vector<Edge>     edges;     // two per corner
+        std::vector<uint32_t> root;      // by slot, the cluster once fanClusters is done
+        std::vector<uint32_t> order;
+    };
+    // By value : -0 and 0 are the same place
+    auto samePosition = [&](const Edge& a, const Edge& b) {
+        if (a.vertex == b.vertex)
+            return true;
+        if (a.hash != b.hash)
+            return false;
+        const float* pa = &mesh.vertices[(size_t)a.vertex * 3];
+        const float* pb = &mesh.vertices[(size_t)b.vertex * 3];
+        return pa[0] == pb[0] && pa[1] == pb[1] && pa[2] == pb[2];
+    };
+    auto positionHash = [&](uint32_t v) {
+        const float* pv = &mesh.vertices[(size_t)v * 3];
+        float values[3] = { pv[0] + 0.0f, pv[1] + 0.0f, pv[2] + 0.0f };
+        uint32_t bits[3];
+        memcpy(bits, values, sizeof bits);
+        uint64_t h = 1469598103934665603ull;
+        for (uint32_t b : bits)
+            h = (h ^ b) * 1099511628211ull;
+        return h;
+    };
+    auto findRoot = [](std::vector<uint32_t>& root, uint32_t k) {
+        while (root[k] != k) {
+            root[k] = root[root[k]];
+            k = root[k];
+        }
+        return k;
+    };
+    // fan.root[k] = cluster of the k-th corner of position p, returns the number of corners
+    auto fanClusters = [&](size_t p, Fan& fan) {
+        uint32_t first = lists.start[p], n = lists.start[p + 1] - first;
+        const uint32_t* corners = &lists.list[first];
+        fan.edges.resize((size_t)n * 2);
+        fan.root.resize(n);
+        for (uint32_t k = 0; k < n; k++) {
+            uint32_t c = corners[k], t = c - c % 3;
+            fan.edges[k * 2].vertex     = mesh.indices[t + (c + 1) % 3];
+            fan.edges[k * 2 + 1].vertex = mesh.indices[t + (c + 2) % 3];
+            fan.edges[k * 2].hash       = positionHash(fan.edges[k * 2].vertex);
+            fan.edges[k * 2 + 1].hash   = positionHash(fan.edges[k * 2 + 1].vertex);
+            fan.edges[k * 2].slot = fan.edges[k * 2 + 1].slot = k;
+            fan.root[k] = k;
+        }
+
+        // Degenerate faces have no direction to compare, they join whatever is across their edges
+        // The lowest slot stays the root, whatever order the edges were matched in
+        auto join = [&](uint32_t j, uint32_t k) {
+            const float* a = &faceNormals[(size_t)(corners[j] / 3) * 3];
+            const float* b = &faceNormals[(size_t)(corners[k] / 3) * 3];
+            bool flat = (a[0] == 0.0f && a[1] == 0.0f && a[2] == 0.0f) || (b[0] == 0.0f && b[1] == 0.0f && b[2] == 0.0f);
+            if (!flat && a[0]*b[0] + a[1]*b[1] + a[2]*b[2] < cosCrease)
+                return;
+            j = findRoot(fan.root, j);
+            k = findRoot(fan.root, k);
+            if (j != k)
+                fan.root[std::max(j, k)] = std::min(j, k);
+        };
+        if (n <= smallFan) {
+            // A handful of faces, the usual case : comparing them all beats sorting
+            for (uint32_t k = 1; k < n; k++) {
+                const Edge* ek = &fan.edges[k * 2];
+                for (uint32_t j = 0; j < k; j++) {
+                    const Edge* ej = &fan.edges[j * 2];
+                    if (samePosition(ej[0], ek[0]) || samePosition(ej[0], ek[1])
+                        || samePosition(ej[1], ek[0]) || samePosition(ej[1], ek[1]))
+                        join(j, k);
+                }
+            }
+        }
+        else {
+            // Faces on the same edge end up next to each other
+            std::sort(fan.edges.begin(), fan.edges.end());
+            for (size_t e = 0, run; e < fan.edges.size(); e = run) {
+                for (run = e + 1; run < fan.edges.size() && fan.edges[run].hash == fan.edges[e].hash; run++)
+                    for (size_t o = e; o < run; o++)
+                        if (samePosition(fan.edges[o], fan.edges[run]))
+                            join(fan.edges[o].slot, fan.edges[run].slot);
+            }
+        }
+
+        for (uint32_t k = 0; k < n; k++)
+            fan.root[k] = findRoot(fan.root, k);
+        return n;
+    };
+
+    // 2. Corners of the same input vertex in the same cluster become one output vertex
+    //    Output vertices are numbered per position first (slotGroup, in list order),
+    //    then every position gets its first vertex number from a prefix sum
+    //    slotCluster keeps the clusters (root slots) for step 3
+    std::vector<uint32_t> slotGroup(cornerCount), slotCluster(cornerCount), vertexBase(positionCount + 1, 0);
+    parallelRanges(positionCount, threads, [&](size_t begin, size_t end, size_t) {
+        Fan fan;
+        for (size_t p = begin; p < end; p++) {
+            uint32_t first = lists.start[p], n = fanClusters(p, fan);
+            const uint32_t* corners = &lists.list[first];
+            uint32_t* group = &slotGroup[first];
+            memcpy(&slotCluster[first], fan.root.data(), (size_t)n * sizeof(uint32_t));
+
+            uint32_t groups = 0;
+            if (n <= smallFan) {
+                for (uint32_t k = 0; k < n; k++) {
+                    group[k] = groups;
+                    for (uint32_t j = 0; j < k && group[k] == groups; j++) {
+                        if (mesh.indices[corners[j]] == mesh.indices[corners[k]] && fan.root[j] == fan.root[k])
+                            group[k] = group[j];
+                    }
+                    groups += (group[k] == groups);
+                }
+            }
+            else {
+                // Sorted by (input vertex, cluster, slot) : the first slot of each run leads it
+                fan.order.resize(n);
+                for (uint32_t k = 0; k < n; k++)
+                    fan.order[k] = k;
+                std::sort(fan.order.begin(), fan.order.end(), [&](uint32_t j, uint32_t k) {
+                    uint32_t vj = mesh.indices[corners[j]], vk = mesh.indices[corners[k]];
+                    if (vj != vk)
+                        return vj < vk;
+                    return fan.root[j] != fan.root[k] ? fan.root[j] < fan.root[k] : j < k;
+                });
+                for (uint32_t i = 0; i < n; i++) {
+                    uint32_t k = fan.order[i], j = i > 0 ? fan.order[i - 1] : k;
+                    bool same = i > 0 && mesh.indices[corners[j]] == mesh.indices[corners[k]] && fan.root[j] == fan.root[k];
+                    group[k] = same ? group[j] : k;   // the leader's slot for now
+                }
+                // Numbered in list order, a leader comes before the rest of its run
+                for (uint32_t k = 0; k < n; k++)
+                    group[k] = group[k] == k ? groups++ : group[group[k]];
+            }
+            vertexBase[p + 1] = groups;
+        }
+    });
+    for (size_t p = 0; p < positionCount; p++)
+        vertexBase[p + 1] += vertexBase[p];
+    const size_t vertexCount = vertexBase[positionCount];
+
+    // 3. Every position writes its own vertices and corners, only the first corner of each
+    //    output vertex needs its normal
+    std::vector<float> vertices(vertexCount * 3), normals(vertexCount * 3), uvs(hasUvs ? vertexCount * 2 : 0);
+    std::vector<uint32_t> indices(cornerCount);
+    parallelRanges(positionCount, threads, [&](size_t begin, size_t end, size_t) {
+        std::vector<float> sums;
+        for (size_t p = begin; p < end; p++) {
+            uint32_t first = lists.start[p], n = lists.start[p + 1] - first, written = 0;
+            const uint32_t* cluster = &slotCluster[first];
+            // Angle-weighted sum of each cluster's faces, at the slot of its root
+            sums.assign((size_t)n * 3, 0.0f);
+            for (uint32_t k = 0; k < n; k++) {
+                uint32_t c = lists.list[first + k];
+                const float* f = &faceNormals[(size_t)(c / 3) * 3];
+                for (int i = 0; i < 3; i++)
+                    sums[cluster[k] * 3 + i] += f[i] * angles[c];
+            }
+            for (uint32_t k = 0; k < n; k++) {
+                uint32_t c = lists.list[first + k];
+                uint32_t v = vertexBase[p] + slotGroup[first + k];
+                indices[c] = v;
+                if (slotGroup[first + k] < written)
+                    continue;
+                written++;
+                uint32_t src = mesh.indices[c];
+                memcpy(&vertices[(size_t)v * 3], &mesh.vertices[(size_t)src * 3], 3 * sizeof(float));
+                const float* sum = &sums[cluster[k] * 3];
+                float nx = sum[0], ny = sum[1], nz = sum[2];
+                float length = std::sqrt(nx*nx + ny*ny + nz*nz);
+                if (length != 0.0f) { nx /= length; ny /= length; nz /= length; }
+                normals[(size_t)v * 3] = nx; normals[(size_t)v * 3 + 1] = ny; normals[(size_t)v * 3 + 2] = nz;
+                if (hasUvs)
+                    memcpy(&uvs[(size_t)v * 2], &mesh.uvs[(size_t)src * 2], 2 * sizeof(float));
+            }
+        }
+    });
+
+    mesh.vertices.swap(vertices);
+    mesh.normals.swap(normals);
+    mesh.uvs.swap(uvs);
+    mesh.indices.swap(indices);
+}
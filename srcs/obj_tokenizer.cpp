@@ -0,0 +1,249 @@
+#include <cstdio>
+#include <cstring>
+#include "../include/parsing.hpp"
+#include "../include/obj_tokens.hpp"
+#include "../include/mapped_file.hpp"
+#include "../include/parallel.hpp"
+
+// Zero-copy .obj parser
+// The whole file is mapped in memory and we walk it with a pointer,
+// every token is just a [begin, end) range inside the mapping so nothing is allocated per line
+// and no iostream / locale code is involved (tokens in obj_tokens.hpp, numbers in numparse.hpp)
+
+namespace {
+
+// Everything one thread pulled out of its slice of the file
+// Face corners are 0-based, except relative ones (negative in the file) : they are counted
+// from the start of the slice and listed in `relative`, the merge adds the number of
+// v / vt / vn records of the previous slices to them
+struct ObjChunk {
+    std::vector<float>  pos;
+    std::vector<float>  uvs;
+    std::vector<float>  normals;
+    std::vector<int>    corners;    // (v, vt, vn) for every triangle corner, -1 when missing
+    std::vector<size_t> relative;   // positions in `corners` that still need their slice offset
+    std::vector<ObjGroupEvent> groups;  // `corner` counted from the start of the slice
+    std::vector<std::string>   mtllibs;
+
+    // Filled by the merge : where this chunk's records go in the whole file
+    size_t posBase = 0, uvBase = 0, normalBase = 0, cornerBase = 0;
+    size_t reallocations = 0;
+};
+
+// Pre-pass : count the records of a slice without parsing any number, so its buffers
+// can be allocated once at their final size instead of doubling their way there
+void reserveChunk(const char* p, const char* end, ObjChunk& chunk) {
+    size_t pos = 0, uvs = 0, normals = 0, triangles = 0;
+
+    while (p < end) {
+        const char* line = skipBlanks(p, end);
+        const char* eol  = nextLine(line, end);
+        p = eol;
+
+        if (isKeyword(line, eol, "v", 1))
+            pos++;
+        else if (isKeyword(line, eol, "vt", 2))
+            uvs++;
+        else if (isKeyword(line, eol, "vn", 2))
+            normals++;
+        else if (isKeyword(line, eol, "f", 1)) {
+            // Corners are the blank separated words after "f", a fan gives n - 2 triangles
+            size_t corners = 0;
+            bool inWord = false;
+            for (const char* q = line + 1; q < eol && *q != '\n'; q++) {
+                bool word = !isBlank(*q);
+                corners += (word && !inWord);
+                inWord = word;
+            }
+            if (corners >= 3)
+                triangles += corners - 2;
+        }
+    }
+
+    chunk.pos.reserve(pos * 3);
+    chunk.uvs.reserve(uvs * 2);
+    chunk.normals.reserve(normals * 3);
+    chunk.corners.reserve(triangles * 9);
+}
+
+// Raw OBJ index → 0-based, `count` is how many records of that kind this slice has read so far
+inline void pushIndex(ObjChunk& chunk, int raw, size_t count) {
+    if (raw > 0)
+        countedPush(chunk.corners, raw - 1, chunk.reallocations);
+    else if (raw < 0) {
+        countedPush(chunk.relative, chunk.corners.size(), chunk.reallocations);
+        countedPush(chunk.corners, (int)count + raw, chunk.reallocations);
+    }
+    else
+        countedPush(chunk.corners, -1, chunk.reallocations);
+}
+
+inline void pushCorner(ObjChunk& chunk, const int* c) {
+    pushIndex(chunk, c[0], chunk.pos.size() / 3);
+    pushIndex(chunk, c[1], chunk.uvs.size() / 2);
+    pushIndex(chunk, c[2], chunk.normals.size() / 3);
+}
+
+void tokenizeChunk(const char* p, const char* end, ObjChunk& chunk) {
+    FaceCorners face;
+
+    while (p < end) {
+        const char* line = skipBlanks(p, end);
+        const char* eol  = nextLine(line, end);
+        p = eol;
+
+        // v = position
+        if (isKeyword(line, eol, "v", 1)) {
+            const char* q = line + 1;
+            countedPush(chunk.pos, readFloat(q, eol), chunk.reallocations);
+            countedPush(chunk.pos, readFloat(q, eol), chunk.reallocations);
+            countedPush(chunk.pos, readFloat(q, eol), chunk.reallocations);
+        }
+        // vt = texture coordinate (uv)
+        else if (isKeyword(line, eol, "vt", 2)) {
+            const char* q = line + 2;
+            countedPush(chunk.uvs, readFloat(q, eol), chunk.reallocations);
+            countedPush(chunk.uvs, readFloat(q, eol), chunk.reallocations);
+        }
+        // vn = normals
+        else if (isKeyword(line, eol, "vn", 2)) {
+            const char* q = line + 2;
+            countedPush(chunk.normals, readFloat(q, eol), chunk.reallocations);
+            countedPush(chunk.normals, readFloat(q, eol), chunk.reallocations);
+            countedPush(chunk.normals, readFloat(q, eol), chunk.reallocations);
+        }
+        // o / g / usemtl = a new part of the mesh starts here
+        else if (isKeyword(line, eol, "o", 1) || isKeyword(line, eol, "g", 1) || isKeyword(line, eol, "usemtl", 6)) {
+            ObjGroupEvent event;
+            event.corner = chunk.corners.size() / 3;
+            event.kind   = (line[0] == 'o') ? ObjGroupEvent::Object
+                         : (line[0] == 'g') ? ObjGroupEvent::Group : ObjGroupEvent::Material;
+            event.name   = readName(line + (line[0] == 'u' ? 6 : 1), eol);
+            chunk.groups.push_back(event);
+        }
+        // mtllib = material library the usemtl names come from
+        else if (isKeyword(line, eol, "mtllib", 6)) {
+            std::string name = readName(line + 6, eol);
+            if (!name.empty())
+                chunk.mtllibs.push_back(name);
+        }
+        // f = face, any polygon is cut in a fan of triangles around its first corner
+        else if (isKeyword(line, eol, "f", 1)) {
+            readFace(line + 1, eol, face);
+            if (face.count < 3)
+                continue;
+
+            const int* c = face.data();
+            for (size_t i = 1; i + 1 < face.count; i++) {
+                pushCorner(chunk, c);
+                pushCorner(chunk, c + i * 3);
+                pushCorner(chunk, c + (i + 1) * 3);
+            }
+        }
+    }
+}
+
+// Cut [begin, end) in `count` slices of about the same size, each one ending right after a '\n'
+std::vector<const char*> splitOnLines(const char* begin, const char* end, size_t count) {
+    std::vector<const char*> cuts(1, begin);
+    for (size_t i = 1; i < count; i++) {
+        const char* cut = begin + (end - begin) * i / count;
+        if (cut < cuts.back())
+            cut = cuts.back();
+        cut = nextLine(cut, end);
+        if (cut > cuts.back() && cut < end)
+            cuts.push_back(cut);
+    }
+    cuts.push_back(end);
+    return cuts;
+}
+
+template <typename T>
+void appendAt(std::vector<T>& dst, size_t offset, std::vector<T>& src) {
+    if (!src.empty())
+        memcpy(dst.data() + offset, src.data(), src.size() * sizeof(T));
+    std::vector<T>().swap(src);
+}
+
+}
+
+// Below this a slice is not worth a thread
+static const size_t minChunkBytes = 256 * 1024;
+
+// Read the raw records of an .obj file, same output as loadOBJStream
+// The file is tokenized in slices on several threads, then the slices are merged in file order
+// so the result is exactly the same whatever the thread count
+bool loadOBJMapped(const std::string& path, ObjData& out, const ObjOptions& opts, ObjLoadStats* stats) {
+    MappedFile file;
+    if (!file.open(path)) {
+        fprintf(stderr, "[OBJ] Cannot open file: %s\n", path.c_str());
+        return false;
+    }
+
+    unsigned threads = resolveThreadCount(opts.threads);
+    size_t chunkCount = file.size / minChunkBytes;
+    if (chunkCount > threads) chunkCount = threads;
+    if (chunkCount < 1)       chunkCount = 1;
+
+    std::vector<const char*> cuts = splitOnLines(file.data, file.data + file.size, chunkCount);
+    std::vector<ObjChunk> chunks(cuts.size() - 1);
+
+    // 1. Tokenize every slice on its own
+    parallelFor(chunks.size(), threads, [&](size_t c) {
+        if (opts.presize)
+            reserveChunk(cuts[c], cuts[c + 1], chunks[c]);
+        tokenizeChunk(cuts[c], cuts[c + 1], chunks[c]);
+    });
+
+    // 2. Prefix sums : global offset of each slice's records
+    size_t posTotal = 0, uvTotal = 0, normalTotal = 0, cornerTotal = 0;
+    for (ObjChunk& chunk : chunks) {
+        chunk.posBase    = posTotal;    posTotal    += chunk.pos.size();
+        chunk.uvBase     = uvTotal;     uvTotal     += chunk.uvs.size();
+        chunk.normalBase = normalTotal; normalTotal += chunk.normals.size();
+        chunk.cornerBase = cornerTotal; cornerTotal += chunk.corners.size();
+        if (stats)
+            stats->reallocations += chunk.reallocations;
+    }
+
+    // o / g / usemtl / mtllib records are few, gather them on this thread
+    for (ObjChunk& chunk : chunks) {
+        for (ObjGroupEvent& event : chunk.groups) {
+            event.corner += chunk.cornerBase / 3;
+            out.groups.push_back(std::move(event));
+        }
+        for (std::string& name : chunk.mtllibs)
+            out.mtllibs.push_back(std::move(name));
+    }
+
+    // A single slice already holds everything in order, hand its buffers over instead of copying them
+    if (chunks.size() == 1) {
+        out.positions.swap(chunks[0].pos);
+        out.uvs.swap(chunks[0].uvs);
+        out.normals.swap(chunks[0].normals);
+        out.corners.swap(chunks[0].corners);
+        return true;
+    }
+
+    out.positions.resize(posTotal);
+    out.uvs.resize(uvTotal);
+    out.normals.resize(normalTotal);
+    out.corners.resize(cornerTotal);
+
+    // 3. Gather everything in file order, relative indices get the offset of their slice
+    parallelFor(chunks.size(), threads, [&](size_t c) {
+        ObjChunk& chunk = chunks[c];
+        const int base[3] = { (int)(chunk.posBase / 3), (int)(chunk.uvBase / 2), (int)(chunk.normalBase / 3) };
+        for (size_t i : chunk.relative) {
+            chunk.corners[i] += base[i % 3];
+            if (chunk.corners[i] < 0)
+                chunk.corners[i] = badRelativeIndex;
+        }
+        appendAt(out.positions, chunk.posBase,    chunk.pos);
+        appendAt(out.uvs,       chunk.uvBase,     chunk.uvs);
+        appendAt(out.normals,   chunk.normalBase, chunk.normals);
+        appendAt(out.corners,   chunk.cornerBase, chunk.corners);
+    });
+
+    return true;
+}
@@ -1,17 +1,82 @@
-#include "../include/include.hpp"
+#include <cstdio>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <sys/stat.h>
+#include "../include/parsing.hpp"
+#include "../include/memstats.hpp"
+
+const char* objLoaderName(ObjLoader loader) {
+    return loader == ObjLoader::Stream ? "stream" : "mmap";
+}
+
+bool parseObjLoader(const std::string& name, ObjLoader& out) {
+    if (name == "stream") { out = ObjLoader::Stream; return true; }
+    if (name == "mmap")   { out = ObjLoader::Mapped; return true; }
+    return false;
+}
+
+// 0-based index of a raw OBJ one, `count` records read so far
+static int objIndex(int raw, size_t count) {
+    if (raw > 0)
+        return raw - 1;
+    if (raw < 0)
+        return (int)count + raw >= 0 ? (int)count + raw : badRelativeIndex;
+    return -1;
+}
 
-// Load our mesh from a file path (argv)
+// Load our mesh from a file path (argv) with the selected parser
+// and report how fast the file went through it
+bool loadOBJ(const std::string& path, Mesh& outMesh, const ObjOptions& opts, ObjLoadStats* stats) {
+    ObjLoadStats localStats;
+    if (!stats)
+        stats = &localStats;
+    *stats = ObjLoadStats();
+    resetPeakRss();
+    stats->startRssKB = currentRssKB();
+
+    auto start = std::chrono::steady_clock::now();
+
+    bool ok;
+    {
+        ObjData data;
+        ok = (opts.loader == ObjLoader::Stream)
+            ? loadOBJStream(path, data)
+            : loadOBJMapped(path, data, opts, stats);
+
+        // Both parsers give the same raw records, turning them into an indexed mesh is shared
+        if (ok)
+            ok = buildIndexedMesh(data, outMesh, opts.threads, stats);
+    }
+    stats->peakRssKB = peakRssKB();
+    if (!ok || !opts.verbose)
+        return ok;
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    struct stat st;
+    double mb = (stat(path.c_str(), &st) == 0) ? st.st_size / (1024.0 * 1024.0) : 0.0;
+
+    printf("[OBJ] Loaded %zu vertices, %zu triangles in %.2f ms (%.1f MB/s, %s)\n",
+        outMesh.vertices.size()/3, outMesh.indices.size()/3, ms, ms > 0.0 ? mb / (ms / 1000.0) : 0.0, objLoaderName(opts.loader));
+    printf("[OBJ] Peak RSS +%.1f MB over %.1f MB, %zu buffer reallocations%s\n",
+        (stats->peakRssKB - stats->startRssKB) / 1024.0, stats->startRssKB / 1024.0, stats->reallocations,
+        opts.loader == ObjLoader::Mapped ? (opts.presize ? " (presized)" : "") : " (not counted by the stream loader)");
+    return true;
+}
+
+// Original parser : one getline + stringstream per line
 // Then parse it to get its data
-bool loadOBJ(const std::string& path, Mesh& outMesh) {
+bool loadOBJStream(const std::string& path, ObjData& out) {
     std::ifstream file(path);
     if (!file.is_open()) {
         std::cerr << "[OBJ] Cannot open file: " << path << "\n";
         return false;
     }
 
-    std::vector<float> temp_pos;
-    std::vector<float> temp_uvs;
-    std::vector<float> temp_normals;
+    std::vector<float>& temp_pos     = out.positions;
+    std::vector<float>& temp_uvs     = out.uvs;
+    std::vector<float>& temp_normals = out.normals;
 
     std::string line;
     while (std::getline(file, line)) {
@@ -43,7 +108,25 @@ bool loadOBJ(const std::string& path, Mesh& outMesh) {
             temp_normals.push_back(ny);
             temp_normals.push_back(nz);
         }
-        // f = face (triangle or quad)
+        // o / g / usemtl = a new part of the mesh starts here
+        else if (type == "o" || type == "g" || type == "usemtl") {
+            ObjGroupEvent event;
+            event.corner = out.corners.size() / 3;
+            event.kind   = (type == "o") ? ObjGroupEvent::Object
+                         : (type == "g") ? ObjGroupEvent::Group : ObjGroupEvent::Material;
+            std::getline(ss >> std::ws, event.name);
+            event.name.erase(event.name.find_last_not_of(" \t\r") + 1);
+            out.groups.push_back(event);
+        }
+        // mtllib = material library the usemtl names come from
+        else if (type == "mtllib") {
+            std::string name;
+            std::getline(ss >> std::ws, name);
+            name.erase(name.find_last_not_of(" \t\r") + 1);
+            if (!name.empty())
+                out.mtllibs.push_back(name);
+        }
+        // f = face, any polygon is cut in a fan of triangles around its first corner
         else if (type == "f") {
             
             std::string vStr;
@@ -52,64 +135,40 @@ bool loadOBJ(const std::string& path, Mesh& outMesh) {
             // Collect all vertices of the face
             while (ss >> vStr)
                 face.push_back(vStr);
+            if (face.size() < 3)
+                continue;
 
-            // Convert quad → two triangles
-            int triCount = (face.size() == 4) ? 2 : 1;
-            int indices[6] = {0,1,2, 0,2,3};
-
-            for (int t = 0; t < triCount; t++) {
+            for (size_t t = 1; t + 1 < face.size(); t++) {
+                size_t indices[3] = {0, t, t + 1};
                 for (int i = 0; i < 3; i++) {
 
-                    std::string vert = face[indices[t*3 + i]];
+                    std::string vert = face[indices[i]];
 
-                    int vi = -1, ti = -1, ni = -1;
+                    // OBJ never uses index 0, so 0 = missing
+                    int vi = 0, ti = 0, ni = 0;
 
                     // Try to find v/vt/vn
                     sscanf(vert.c_str(), 
                         "%d/%d/%d", &vi, &ti, &ni);
 
                     // Then only v//vn
-                    if (ti == -1) {
+                    if (ti == 0) {
                         sscanf(vert.c_str(), "%d//%d", &vi, &ni);
                     }
 
                     // And v only
-                    if (vi == -1) {
+                    if (vi == 0) {
                         sscanf(vert.c_str(), "%d", &vi);
                     }
 
-                    // OBJ indices start at 1
-                    vi -= 1;
-                    if (ti > 0) ti -= 1;
-                    if (ni > 0) ni -= 1;
-
-                    // Position
-                    outMesh.vertices.push_back(temp_pos[vi*3 + 0]);
-                    outMesh.vertices.push_back(temp_pos[vi*3 + 1]);
-                    outMesh.vertices.push_back(temp_pos[vi*3 + 2]);
-
-                    // Give it a default color
-                    outMesh.colors.push_back(0.8f);
-                    outMesh.colors.push_back(0.8f);
-                    outMesh.colors.push_back(0.8f);
-
-                    // Normals (if they exist)
-                    if (!temp_normals.empty() && ni >= 0) {
-                        outMesh.normals.push_back(temp_normals[ni*3 + 0]);
-                        outMesh.normals.push_back(temp_normals[ni*3 + 1]);
-                        outMesh.normals.push_back(temp_normals[ni*3 + 2]);
-                    }
-
-                    // UVS (if they exist)
-                    if (!temp_uvs.empty() && ti >= 0) {
-                        outMesh.uvs.push_back(temp_uvs[ti*2 + 0]);
-                        outMesh.uvs.push_back(temp_uvs[ti*2 + 1]);
-                    }
+                    // OBJ indices start at 1, negative ones count back from the last record
+                    out.corners.push_back(objIndex(vi, temp_pos.size() / 3));
+                    out.corners.push_back(objIndex(ti, temp_uvs.size() / 2));
+                    out.corners.push_back(objIndex(ni, temp_normals.size() / 3));
                 }
             }
         }
     }
 
-    std::cout << "[OBJ] Loaded " << outMesh.vertices.size()/3 << " vertices\n";
     return true;
 }
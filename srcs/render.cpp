@@ -1,8 +1,6 @@
 #include "../include/include.hpp"
 
 // Image loading library for the texture
-#define STB_IMAGE_IMPLEMENTATION
-#include "../include/stb_image.h"
 
 extern int useTexture;
 
@@ -14,6 +12,14 @@ struct Transform {
     float z = 0.0f;
 };
 
+// Everything the window callbacks change, the render loop reads it every frame
+struct WindowInput {
+    Transform camOffset;
+    bool   pickRequested = false;   // left click since the last frame
+    bool   spinToggled   = false;   // R since the last frame
+    double pickX = 0.0, pickY = 0.0; // where, in window coordinates
+};
+
 // Listens for any key we press
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     (void) mods;
@@ -23,8 +29,9 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     if(action != GLFW_PRESS && action != GLFW_REPEAT) return;
 
     // Retrieve the object's position so we can modify it
-    Transform* transform = static_cast<Transform*>(glfwGetWindowUserPointer(window));
-    if (!transform) return;
+    WindowInput* input = static_cast<WindowInput*>(glfwGetWindowUserPointer(window));
+    if (!input) return;
+    Transform* transform = &input->camOffset;
 
     float step = 0.1f;
     switch(key){
@@ -36,6 +43,10 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
         case GLFW_KEY_ESCAPE:
             glfwSetWindowShouldClose(window, GLFW_TRUE);
             break;
+        case GLFW_KEY_R:
+            if(action == GLFW_PRESS)
+                input->spinToggled = true;
+            break;
         case GLFW_KEY_LEFT:  transform->x -= step; break;
         case GLFW_KEY_RIGHT: transform->x += step; break;
         case GLFW_KEY_UP:    transform->y += step; break;
@@ -49,32 +60,35 @@ void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
     (void) xoffset;
 
     // Same thing
-    Transform* transform = static_cast<Transform*>(glfwGetWindowUserPointer(window));
-    if (!transform) return;
+    WindowInput* input = static_cast<WindowInput*>(glfwGetWindowUserPointer(window));
+    if (!input) return;
 
     float step = 0.2f;
-    transform->z += (float)yoffset * step;
+    input->camOffset.z += (float)yoffset * step;
+}
+
+// Left click : the render loop looks for what is under the cursor on its next frame
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+    (void) mods;
+
+    if(button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) return;
+    WindowInput* input = static_cast<WindowInput*>(glfwGetWindowUserPointer(window));
+    if (!input) return;
+
+    glfwGetCursorPos(window, &input->pickX, &input->pickY);
+    input->pickRequested = true;
 }
 
 // Load the texture using stb library
-GLuint loadTexture(const char* path){
+GLuint uploadTexture(const DecodedImage &image){
     GLuint tex;
 
     // Generate a texture instance in openGL
     glGenTextures(1, &tex);
     glBindTexture(GL_TEXTURE_2D, tex);
 
-    int width, height, nrChannels;
-
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 3);
-    if(!data){
-        printf("Failed to load texture: %s\n", path);
-        return 0;
-    }
-
     // Upload the image to the GPU
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels.data());
     glGenerateMipmap(GL_TEXTURE_2D);
 
     // Add the settings we want
@@ -82,8 +96,32 @@ GLuint loadTexture(const char* path){
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return tex;
+}
+
+GLuint loadTexture(const char* path){
+    DecodedImage image;
+    if(!decodeImage(path, image)){
+        printf("Failed to load texture: %s\n", path);
+        return 0;
+    }
+    return uploadTexture(image);
+}
 
-    stbi_image_free(data);
+GLuint TextureCache::get(const std::string &path, const DecodedImage *decoded) {
+    std::map<std::string, GLuint>::iterator it = textures.find(path);
+    if(it != textures.end())
+        return it->second;
+    GLuint tex;
+    if(!decoded)
+        tex = loadTexture(path.c_str());
+    else if(decoded->pixels.empty()){
+        printf("Failed to load texture: %s\n", path.c_str());
+        tex = 0;
+    }
+    else
+        tex = uploadTexture(*decoded);
+    textures[path] = tex;
     return tex;
 }
 
@@ -120,74 +158,490 @@ GLFWwindow* initWindow(int width, int height, const char* title) {
     return win;
 }
 
-// Initialise VAO and VBO for OpenGL (see main for details)
-void setupMeshBuffers(const std::vector<float> &interleaved, GLuint &vao, GLuint &vbo) {
+// Initialise VAO, VBO and EBO for OpenGL (see main for details)
+// The data is uploaded as is, it may come straight from a mapped .scopbin file
+// Without data the buffers are only allocated, SceneStreamer fills them a piece at a time
+void setupMeshBuffers(const MeshView &mesh, GLuint &vao, GLuint &vbo, GLuint &ebo, GLenum &indexType,
+                      bool withData) {
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
 
+    const VertexLayout &layout = mesh.layout;
+    GLsizei stride = (GLsizei)layout.stride;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, interleaved.size()*sizeof(float), interleaved.data(), GL_STATIC_DRAW);
-
-    // Position
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)0);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount*layout.stride,
+                 withData ? mesh.vertices : NULL, GL_STATIC_DRAW);
+
+    // Position, quantized ones come in as [0, 1] and the vertex shader puts them back in the model's box
+    if(layout.format == VertexFormat::Float)
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    else
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0);
     glEnableVertexAttribArray(0);
 
-    // Normal
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(3*sizeof(float)));
+    // Normal, the octahedral one is only 2 components decoded in the vertex shader
+    void *normalOffset = (void*)layout.normalOffset;
+    if(layout.format == VertexFormat::Float)
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, normalOffset);
+    else if(layout.format == VertexFormat::Packed)
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, normalOffset);
+    else
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, normalOffset);
     glEnableVertexAttribArray(1);
 
-    // UV
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(6*sizeof(float)));
-    glEnableVertexAttribArray(2);
+    // UV, left disabled without any : the shader reads a constant (0, 0) then
+    if(layout.hasUvs){
+        if(layout.format == VertexFormat::Float)
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)layout.uvOffset);
+        else
+            glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)layout.uvOffset);
+        glEnableVertexAttribArray(2);
+    }
+
+    // Indices, the EBO binding is stored in the VAO
+    glGenBuffers(1, &ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indexCount*mesh.indexSize,
+                 withData ? mesh.indices : NULL, GL_STATIC_DRAW);
+    indexType = (mesh.indexSize == sizeof(uint16_t)) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+// Level of detail of an object drawn with `mvp` on a framebuffer `height` pixels high
+// The bounding sphere covers radius * P11 / w * height / 2 pixels, w = clip w of its center and P11 the
+// length of the mvp's second row (the model and view matrices only rotate and translate)
+// An instanced grid draws the object `columns` times smaller
+static size_t pickLod(const SceneObject &obj, const Mat4 &mvp, int height, int columns, float pixels){
+    if(obj.lods.empty() || obj.bounds.empty())
+        return 0;
+    const float *c = obj.bounds.center;
+    float w = mvp.m[3]*c[0] + mvp.m[7]*c[1] + mvp.m[11]*c[2] + mvp.m[15];
+    float radius = obj.bounds.radius / columns;
+    // Camera inside the sphere (or behind it) : nothing to gain, and w is meaningless
+    if(w <= radius)
+        return 0;
+    float p11 = std::sqrt(mvp.m[1]*mvp.m[1] + mvp.m[5]*mvp.m[5] + mvp.m[9]*mvp.m[9]);
+    float projected = radius * p11 / w * height * 0.5f;
+    // Errors are in model space, the grid shrinks them along with the radius
+    return selectLod(obj.lods.data(), obj.lods.size(), obj.bounds.radius, projected * columns, pixels);
+}
+
+// Model space bounds of every copy of an instanced grid, the vertex shader puts copy c at
+// (p + offset of c) / columns, offsets 3 units apart on x and z
+static Bounds gridBounds(const Bounds &b, int columns){
+    if(b.empty())
+        return b;
+    Bounds grid;
+    float half = (columns - 1) * 0.5f * 3.0f, scale = 1.0f / columns, diagonal = 0.0f;
+    for(int a = 0; a < 3; a++){
+        float spread = a == 1 ? 0.0f : half;
+        grid.min[a] = (b.min[a] - spread) * scale;
+        grid.max[a] = (b.max[a] + spread) * scale;
+        grid.center[a] = (grid.min[a] + grid.max[a]) * 0.5f;
+        diagonal += (grid.max[a] - grid.min[a]) * (grid.max[a] - grid.min[a]);
+    }
+    grid.radius = std::sqrt(diagonal) * 0.5f;
+    return grid;
+}
+
+// Camera position in an object's own space, its model matrix only rotates and translates
+static void eyeInModel(const Mat4 &model, const float eye[3], float out[3]){
+    float d[3] = { eye[0] - model.m[12], eye[1] - model.m[13], eye[2] - model.m[14] };
+    for(int i = 0; i < 3; i++)
+        out[i] = model.m[i*4]*d[0] + model.m[i*4 + 1]*d[1] + model.m[i*4 + 2]*d[2];
+}
+
+// A point of the screen turned back into a ray, through the inverse of the view projection
+// The near plane point is the origin, the far plane one is at t = 1
+static void screenRay(const Mat4 &invVp, float ndcX, float ndcY, float origin[3], float direction[3]){
+    float ends[2][3];
+    for(int e = 0; e < 2; e++){
+        float clip[4] = { ndcX, ndcY, e ? 1.0f : -1.0f, 1.0f };
+        float p[4];
+        for(int r = 0; r < 4; r++)
+            p[r] = invVp.m[r] * clip[0] + invVp.m[4 + r] * clip[1] + invVp.m[8 + r] * clip[2] + invVp.m[12 + r] * clip[3];
+        for(int a = 0; a < 3; a++)
+            ends[e][a] = p[a] / p[3];
+    }
+    for(int a = 0; a < 3; a++){
+        origin[a]    = ends[0][a];
+        direction[a] = ends[1][a] - ends[0][a];
+    }
+}
+
+// Closest object along a world space ray, -1 when there is none. Each object's BVH is in its model space,
+// instanced copies are undone the way the vertex shader places them : p_copy = (p + offset) / columns
+static int pickObject(const std::vector<SceneObject> &objects, const std::vector<Mat4> &models,
+                      const float origin[3], const float direction[3], int instances, int columns, RayHit &best){
+    int picked = -1;
+    best.t = 1.0f;
+    for(size_t i = 0; i < objects.size(); i++){
+        if(objects[i].bvh.nodes.empty())
+            continue;
+        BvhView bvh = objects[i].bvh.view();
+        Mat4 inv = Mat4::affineInverse(models[i]);
+        float o[3], d[3];
+        Mat4::transformPoints(inv, origin, o, 1);
+        Mat4::transformVectors(inv, direction, d, 1);
+        int copies = instances > 0 ? instances : 1;
+        for(int c = 0; c < copies; c++){
+            float co[3] = { o[0], o[1], o[2] }, cd[3] = { d[0], d[1], d[2] };
+            if(columns > 1){
+                float half = (columns - 1) * 0.5f;
+                float offset[3] = { ((float)(c % columns) - half) * 3.0f, 0.0f, ((float)(c / columns) - half) * 3.0f };
+                for(int a = 0; a < 3; a++){
+                    co[a] = co[a] * columns - offset[a];
+                    cd[a] *= columns;
+                }
+            }
+            RayHit hit;
+            if(intersectBvh(bvh, co, cd, best.t, hit)){
+                best = hit;
+                picked = (int)i;
+            }
+        }
+    }
+    return picked;
 }
 
 // The main render loop, runs until the program is closed
-void renderLoop(GLFWwindow* win, const std::vector<SceneObject> &objects, GLuint program, GLuint texID,
+// Models show up while they finish loading (see SceneStreamer)
+// The draws are already in submission order (see sortDrawItems), state is only changed when it differs
+// With `instances` every draw is instanced that many times on a grid (see the vertex shader), and the
+// average frame time is printed once everything is loaded, to compare vertex formats under load
+// Each object is drawn at the coarsest level of detail whose error stays under options.lodPixels
+// With options.cull objects entirely off screen are skipped (see cullObjects), then the meshlets of
+// each part of the others are culled, against every copy of the grid at once, and the runs of
+// meshlets left are drawn with glMultiDrawElements
+void renderLoop(GLFWwindow* win, Scene &scene, SceneStreamer &streamer,
                 GLint mvpLoc, GLint modelLoc, GLint useTexLoc, GLint texLoc,
-                Mat4 vp)
+                Mat4 vp, const RenderOptions &options)
 {
-    (void) program;
-    Transform camOffset;
-    glfwSetWindowUserPointer(win, &camOffset);
+    int instances = options.instances;
+    WindowInput input;
+    const Transform &camOffset = input.camOffset;
+    glfwSetWindowUserPointer(win, &input);
     glfwSetKeyCallback(win, keyCallback);
     glfwSetScrollCallback(win, scrollCallback);
-
-    float angle = 0.0f;
+    glfwSetMouseButtonCallback(win, mouseButtonCallback);
+    int picked = -1;
+
+    SceneGraph sceneGraph;
+    uint32_t sceneRoot = sceneGraph.add(SceneGraph::noParent, NodeTransform());
+    std::vector<uint32_t> objectNodes;     // graph node of each object
+    std::vector<float> spinAngles;         // by object, only moves while it spins
+    std::vector<char> spinning;
+    std::vector<Mat4> models, mvps;
+    std::vector<size_t> levels, lastLevels;
+    std::vector<Frustum> frusta;
+    Frustum viewFrustum = frustumFromMatrix(vp.m);     // world space, the camera never moves
+    ObjectBounds worldBounds;
+    std::vector<uint8_t> objectVisible;
+    std::vector<float> eyes;
+    std::vector<uint32_t> runFirsts, runCounts;
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void*> drawOffsets;
+    DrawStats lastFrame;
+
+    // Defines how fast objects rotate
+    const float spinStep = 0.6f*(3.14159f/180.0f);
+    int instanceColumns = 1;
+    while(instanceColumns * instanceColumns < instances)
+        instanceColumns++;
+    MeshletCopies meshletCopies = gridCopies(instanceColumns);
+    double timedStart = 0.0;
+    size_t timedFrames = 0, frameNumber = 0;
+    // [CULL] totals since the last print
+    ObjectCullStats objectCullTotal;
+    MeshletCullStats cullTotal;
+    size_t trianglesTotal = 0, fullTrianglesTotal = 0;
 
     while(!glfwWindowShouldClose(win)){
+        bool loaded = streamer.update(scene);
+        const std::vector<SceneObject> &objects = scene.objects;
+        const std::vector<DrawItem> &draws = scene.draws;
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Defines how fast objects rotate (shared across all objects)
-        angle += 0.3f*(3.14159f/180.0f);
+        // R stops (or restarts) the spin of the picked object, of every object when none is picked
+        if(input.spinToggled){
+            input.spinToggled = false;
+            if(picked >= 0 && picked < (int)spinning.size()){
+                spinning[picked] = !spinning[picked];
+                printf("[SPIN] object %d %s\n", picked, spinning[picked] ? "spinning" : "stopped");
+            }
+            else{
+                bool any = std::find(spinning.begin(), spinning.end(), 1) != spinning.end();
+                std::fill(spinning.begin(), spinning.end(), any ? 0 : 1);
+                printf("[SPIN] every object %s\n", any ? "stopped" : "spinning");
+            }
+        }
 
-        // Bind texture once, same for all objects
-        glUniform1i(useTexLoc, useTexture ? 1 : 0);
-        if(useTexture && texID != 0){
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, texID);
-            glUniform1i(texLoc, 0);
+        // Each object rotates around its own center, then gets translated to its slot, under a root
+        // node that moves everything by the camera offset. The root only changes on a key press and a
+        // stopped object not at all (see SceneGraph, only the nodes that changed get new matrices)
+        NodeTransform rootLocal = sceneGraph.local(sceneRoot);
+        if(rootLocal.position[0] != camOffset.x || rootLocal.position[1] != camOffset.y
+            || rootLocal.position[2] != camOffset.z){
+            rootLocal.position[0] = camOffset.x;
+            rootLocal.position[1] = camOffset.y;
+            rootLocal.position[2] = camOffset.z;
+            sceneGraph.setLocal(sceneRoot, rootLocal);
+        }
+        for(size_t i = 0; i < objects.size(); i++){
+            if(i == objectNodes.size()){
+                NodeTransform slot;
+                slot.position[0] = objects[i].offsetX;
+                objectNodes.push_back(sceneGraph.add(sceneRoot, slot));
+                spinAngles.push_back(0.0f);
+                spinning.push_back(1);
+            }
+            if(!spinning[i])
+                continue;
+            spinAngles[i] += spinStep;
+            NodeTransform spin = sceneGraph.local(objectNodes[i]);
+            axisAngleQuaternion(0.0f, 1.0f, 0.0f, spinAngles[i], spin.rotation);
+            sceneGraph.setLocal(objectNodes[i], spin);
+        }
+        // viewProj never changes, the MVPs only need redoing when a model matrix did
+        SceneGraphStats graphStats = sceneGraph.update();
+        if(graphStats.recomputed || models.size() != objects.size()){
+            models.resize(objects.size());
+            mvps.resize(objects.size());
+            for(size_t i = 0; i < objects.size(); i++)
+                models[i] = sceneGraph.world(objectNodes[i]);
+            computeMvps(vp, models.data(), mvps.data(), objects.size());
         }
 
-        // Draw each object with its own model matrix
-        for(const SceneObject &obj : objects){
+        // Whole objects off screen are not drawn at all, their meshlets aren't even looked at
+        ObjectCullStats objectCulling;
+        objectVisible.assign(objects.size(), 1);
+        if(options.cull){
+            worldBounds.resize(objects.size());
+            for(size_t i = 0; i < objects.size(); i++)
+                worldBounds.set(i, instanceColumns > 1 ? gridBounds(objects[i].bounds, instanceColumns) : objects[i].bounds,
+                                models[i].m);
+            cullObjects(viewFrustum, worldBounds, objectVisible.data(), objectCulling);
+        }
 
-            // Each object rotates around its own center, then gets translated to its slot
-            Mat4 rotation    = Mat4::rotateY(angle * 2.0f);
-            Mat4 translation = Mat4::translate(obj.offsetX + camOffset.x, camOffset.y, camOffset.z);
-            Mat4 model       = Mat4::multiply(translation, rotation);
-            Mat4 mvp         = Mat4::multiply(vp, model);
+        int width, height;
+        glfwGetFramebufferSize(win, &width, &height);
+        levels.resize(objects.size());
+        frusta.resize(objects.size());
+        eyes.resize(objects.size() * 3);
+        for(size_t i = 0; i < objects.size(); i++){
+            levels[i] = options.lod ? pickLod(objects[i], mvps[i], height, instanceColumns, options.lodPixels) : 0;
+            // Meshlets are tested where they are, in model space
+            frusta[i] = frustumFromMatrix(mvps[i].m);
+            eyeInModel(models[i], options.eye, &eyes[i*3]);
+        }
 
-            // Send matrices to the GPU
-            glUniformMatrix4fv(mvpLoc,  1, GL_FALSE, mvp.m);
-            glUniformMatrix4fv(modelLoc,1, GL_FALSE, model.m);
+        // What the last click landed on, it stays highlighted until the next one
+        if(input.pickRequested){
+            input.pickRequested = false;
+            int windowWidth, windowHeight;
+            glfwGetWindowSize(win, &windowWidth, &windowHeight);
+            float origin[3], direction[3];
+            double start = nowMs();
+            screenRay(Mat4::inverse(vp), (float)(2.0 * input.pickX / windowWidth - 1.0),
+                      (float)(1.0 - 2.0 * input.pickY / windowHeight), origin, direction);
+            RayHit hit;
+            picked = pickObject(objects, models, origin, direction, instances, instanceColumns, hit);
+            double ms = nowMs() - start;
+            if(picked >= 0)
+                printf("[PICK] object %d, triangle %u at %.3f units: %.3f ms\n", picked, hit.triangle,
+                    hit.t * std::sqrt(direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2]), ms);
+            else
+                printf("[PICK] nothing under the cursor: %.3f ms\n", ms);
+            size_t waiting = 0;
+            for(const SceneObject &obj : objects)
+                waiting += obj.bvh.nodes.empty() && obj.indexCount > 0;
+            if(waiting)
+                printf("[PICK] %zu objects can't be picked yet (BVH not built, or --no-bvh)\n", waiting);
+        }
 
-            // Draw this object
-            glBindVertexArray(obj.vao);
-            glDrawArrays(GL_TRIANGLES, 0, obj.vertexCount);
+        // Uniform locations belong to a program, look them up again when it changes
+        GLuint program = 0, texture = 0;
+        uint32_t object = 0xffffffffu;
+        GLint instanceBaseLoc = -1, diffuseLoc = -1, hasMapLoc = -1;
+        GLint positionMinLoc = -1, positionExtentLoc = -1, uvRangeLoc = -1, octNormalsLoc = -1;
+        GLint highlightedLoc = -1;
+        DrawStats frame;
+        MeshletCullStats culling;
+        size_t triangles = 0, fullTriangles = 0;
+
+        for(size_t d = 0; d < draws.size(); d++){
+            const DrawItem &item = draws[d];
+            if(!objectVisible[item.object]){
+                fullTriangles += item.indexCount / 3 * (instances > 0 ? instances : 1);
+                continue;
+            }
+
+            if(d == 0 || item.program != program){
+                program = item.program;
+                glUseProgram(program);
+                glUniform1i(useTexLoc, useTexture ? 1 : 0);
+                glUniform1i(texLoc, 0);
+                instanceBaseLoc  = glGetUniformLocation(program, "instanceBase");
+                diffuseLoc       = glGetUniformLocation(program, "diffuseColor");
+                hasMapLoc        = glGetUniformLocation(program, "hasMap");
+                positionMinLoc    = glGetUniformLocation(program, "positionMin");
+                positionExtentLoc = glGetUniformLocation(program, "positionExtent");
+                uvRangeLoc        = glGetUniformLocation(program, "uvRange");
+                octNormalsLoc     = glGetUniformLocation(program, "octNormals");
+                highlightedLoc    = glGetUniformLocation(program, "highlighted");
+                glUniform1i(glGetUniformLocation(program, "instanceColumns"), instanceColumns);
+                glUniform1i(instanceBaseLoc, 0);
+                frame.programBinds++;
+            }
+            // Face colors don't sample anything, no need to bind textures then
+            if(useTexture && item.texture != 0 && item.texture != texture){
+                texture = item.texture;
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, texture);
+                frame.textureBinds++;
+            }
+            if(d == 0 || item.object != object){
+                object = item.object;
+                glUniformMatrix4fv(mvpLoc,  1, GL_FALSE, mvps[object].m);
+                glUniformMatrix4fv(modelLoc,1, GL_FALSE, models[object].m);
+                // How to read the object's vertices back (the identity for Float)
+                const VertexQuantization &quant = objects[object].quant;
+                const float uvRange[4] = { quant.uvMin[0], quant.uvMin[1], quant.uvExtent[0], quant.uvExtent[1] };
+                glUniform3fv(positionMinLoc, 1, quant.positionMin);
+                glUniform3fv(positionExtentLoc, 1, quant.positionExtent);
+                glUniform4fv(uvRangeLoc, 1, uvRange);
+                glUniform1i(octNormalsLoc, objects[object].layout.format == VertexFormat::Octa ? 1 : 0);
+                glUniform1i(highlightedLoc, (int)object == picked ? 1 : 0);
+                glBindVertexArray(objects[object].vao);
+                frame.objectChanges++;
+            }
+
+            // The same part in the object's level of detail, it may have been simplified away entirely
+            const SceneObject &obj = objects[object];
+            uint32_t first = item.firstIndex, count = item.indexCount;
+            if(levels[object]){
+                const SubMesh &sub = obj.lodSubmeshes[(levels[object] - 1) * obj.submeshes.size() + item.submesh];
+                first = sub.firstIndex;
+                count = sub.indexCount;
+            }
+            size_t copies = instances > 0 ? instances : 1;
+            fullTriangles += item.indexCount / 3 * copies;
+            if(count == 0)
+                continue;
+
+            glUniform3fv(diffuseLoc, 1, item.diffuse);
+            glUniform1i(hasMapLoc, item.hasMap ? 1 : 0);
+            if(!options.cull || obj.meshletRanges.empty()){
+                void *firstIndex = (void*)(first * obj.indexSize);
+                triangles += count / 3 * copies;
+                if(instances > 0)
+                    glDrawElementsInstanced(GL_TRIANGLES, count, obj.indexType, firstIndex, instances);
+                else
+                    glDrawElements(GL_TRIANGLES, count, obj.indexType, firstIndex);
+                frame.draws++;
+                continue;
+            }
+
+            size_t range = levels[object] * obj.submeshes.size() + item.submesh;
+            const Meshlet *meshlets = obj.meshlets.data() + obj.meshletRanges[range];
+            size_t meshletCount = obj.meshletRanges[range + 1] - obj.meshletRanges[range];
+            // One test for every copy of the grid, what passes is drawn for all of them at once
+            size_t drawn = culling.drawn;
+            runFirsts.clear();
+            runCounts.clear();
+            cullMeshlets(meshlets, meshletCount, frusta[object], &eyes[object*3], obj.watertight,
+                         meshletCopies, runFirsts, runCounts, culling);
+            triangles += (culling.drawn - drawn) * copies;
+            if(runFirsts.empty())
+                continue;
+
+            // The runs left go in one multi-draw. GL 3.3 has no instanced multi-draw : a grid takes either
+            // one instanced draw per run or one multi-draw per copy, whichever is fewer calls
+            drawCounts.resize(runFirsts.size());
+            drawOffsets.resize(runFirsts.size());
+            for(size_t r = 0; r < runFirsts.size(); r++){
+                drawCounts[r]  = (GLsizei)runCounts[r];
+                drawOffsets[r] = (const void*)((size_t)runFirsts[r] * obj.indexSize);
+            }
+            if(instances > 0 && runFirsts.size() <= copies){
+                for(size_t r = 0; r < runFirsts.size(); r++)
+                    glDrawElementsInstanced(GL_TRIANGLES, drawCounts[r], obj.indexType, drawOffsets[r], instances);
+                frame.draws += runFirsts.size();
+            }
+            else if(instances > 0){
+                for(size_t c = 0; c < copies; c++){
+                    glUniform1i(instanceBaseLoc, (GLint)c);
+                    glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), obj.indexType, drawOffsets.data(),
+                                        (GLsizei)drawCounts.size());
+                }
+                glUniform1i(instanceBaseLoc, 0);
+                frame.draws += copies;
+            }
+            else{
+                glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), obj.indexType, drawOffsets.data(),
+                                    (GLsizei)drawCounts.size());
+                frame.draws++;
+            }
+        }
+
+        // Only print when it changes (first frame, a model arrived, texture toggled)
+        if(frame.draws != lastFrame.draws || frame.textureBinds != lastFrame.textureBinds){
+            printf("[DRAW] %zu draw calls, %zu texture binds, %zu program binds per frame\n",
+                frame.draws, frame.textureBinds, frame.programBinds);
+            lastFrame = frame;
+        }
+        if(levels != lastLevels){
+            printf("[LOD] levels");
+            for(size_t level : levels)
+                printf(" %zu", level);
+            printf(": %zu triangles per frame, %zu at full detail\n", triangles, fullTriangles);
+            lastLevels = levels;
+        }
+
+        // Culling changes with every turn of the models, an average over 240 frames says more
+        if(options.cull && loaded){
+            objectCullTotal.tested += objectCulling.tested;
+            objectCullTotal.culled += objectCulling.culled;
+            cullTotal.meshlets += culling.meshlets;
+            cullTotal.frustumCulled += culling.frustumCulled;
+            cullTotal.backFaceCulled += culling.backFaceCulled;
+            trianglesTotal += triangles;
+            fullTrianglesTotal += fullTriangles;
+            if(++frameNumber % 240 == 0){
+                double frames = 240.0;
+                printf("[CULL] per frame over %.0f frames: %.1f objects tested, %.1f culled | %.1f meshlets tested, %.1f%% culled (%.1f outside the frustum, %.1f facing away): %.0f of %.0f triangles drawn (%.1f%%)\n",
+                    frames, objectCullTotal.tested / frames, objectCullTotal.culled / frames, cullTotal.meshlets / frames,
+                    cullTotal.meshlets ? 100.0 * (cullTotal.frustumCulled + cullTotal.backFaceCulled) / cullTotal.meshlets : 0.0,
+                    cullTotal.frustumCulled / frames, cullTotal.backFaceCulled / frames, trianglesTotal / frames,
+                    fullTrianglesTotal / frames, fullTrianglesTotal ? 100.0 * trianglesTotal / fullTrianglesTotal : 0.0);
+                objectCullTotal = ObjectCullStats();
+                cullTotal = MeshletCullStats();
+                trianglesTotal = fullTrianglesTotal = 0;
+            }
         }
 
         glfwSwapBuffers(win);
+        streamer.frameDone();
+
+        // Average over 240 frames, the swap blocks once the GPU is a few frames behind so this is its pace
+        if(instances > 0 && loaded){
+            double now = nowMs();
+            if(timedFrames == 0)
+                timedStart = now;
+            else if(timedFrames == 240){
+                size_t vertexBytes = 0;
+                for(const SceneObject &obj : objects)
+                    vertexBytes += obj.vertexBytes;
+                printf("[FRAME] %d instances, %s vertices, %.1f KB of vertex buffers, %zu triangles (lod %s, cull %s): %.3f ms per frame\n",
+                    instances, objects.empty() ? "no" : vertexFormatName(objects[0].layout.format),
+                    vertexBytes / 1024.0, triangles, options.lod ? "on" : "off", options.cull ? "on" : "off",
+                    (now - timedStart) / timedFrames);
+                timedStart = now;
+                timedFrames = 0;
+            }
+            timedFrames++;
+        }
         glfwPollEvents();
     }
-}
\ No newline at end of file
+}
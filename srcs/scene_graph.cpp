@@ -0,0 +1,122 @@
+#include <algorithm>
+#include "../include/scene_graph.hpp"
+#include "../include/transforms.hpp"
+
+// New nodes go at the end of the array until the next update puts them back in depth-first order
+// An update sorts the changed slots : a slot inside the run of one already remade is skipped, its
+// matrix was made again with its ancestor's
+
+uint32_t SceneGraph::add(uint32_t parent, const NodeTransform &local) {
+    uint32_t id = (uint32_t)slotOf.size(), slot = (uint32_t)locals.size();
+    slotOf.push_back(slot);
+    ids.push_back(id);
+    locals.push_back(local);
+    worlds.push_back(Mat4::identity());
+    parentSlots.push_back(parent == noParent ? noParent : slotOf[parent]);
+    subtreeEnds.push_back(slot + 1);
+    marked.push_back(0);
+    reordered = false;
+    return id;
+}
+
+uint32_t SceneGraph::parent(uint32_t node) const {
+    uint32_t p = parentSlots[slotOf[node]];
+    return p == noParent ? noParent : ids[p];
+}
+
+void SceneGraph::setLocal(uint32_t node, const NodeTransform &local) {
+    uint32_t slot = slotOf[node];
+    locals[slot] = local;
+    if (!marked[slot]) {
+        marked[slot] = 1;
+        dirty.push_back(slot);
+    }
+}
+
+// Depth-first from the roots, children in the order they were added. Parents are always added before
+// their children, so every parent slot is lower than its children's
+void SceneGraph::reorder() {
+    size_t n = locals.size();
+    std::vector<uint32_t> childStart(n + 1, 0), children(n);
+    for (size_t s = 0; s < n; s++)
+        if (parentSlots[s] != noParent)
+            childStart[parentSlots[s] + 1]++;
+    for (size_t s = 0; s < n; s++)
+        childStart[s + 1] += childStart[s];
+    std::vector<uint32_t> fill(childStart.begin(), childStart.end() - 1);
+    for (size_t s = 0; s < n; s++)
+        if (parentSlots[s] != noParent)
+            children[fill[parentSlots[s]]++] = (uint32_t)s;
+
+    // order[new slot] = old slot
+    std::vector<uint32_t> order, stack;
+    order.reserve(n);
+    for (size_t root = n; root-- > 0;)
+        if (parentSlots[root] == noParent)
+            stack.push_back((uint32_t)root);
+    while (!stack.empty()) {
+        uint32_t s = stack.back();
+        stack.pop_back();
+        order.push_back(s);
+        for (uint32_t c = childStart[s + 1]; c-- > childStart[s];)
+            stack.push_back(children[c]);
+    }
+
+    std::vector<uint32_t> newSlot(n);
+    for (size_t s = 0; s < n; s++)
+        newSlot[order[s]] = (uint32_t)s;
+    std::vector<NodeTransform> newLocals(n);
+    std::vector<uint32_t> newParents(n), newIds(n);
+    for (size_t s = 0; s < n; s++) {
+        uint32_t old = order[s];
+        newLocals[s] = locals[old];
+        newParents[s] = parentSlots[old] == noParent ? noParent : newSlot[parentSlots[old]];
+        newIds[s] = ids[old];
+        slotOf[ids[old]] = (uint32_t)s;
+    }
+    locals.swap(newLocals);
+    parentSlots.swap(newParents);
+    ids.swap(newIds);
+
+    // A subtree ends where the last one of its children ends, children come after their parent
+    for (size_t s = 0; s < n; s++)
+        subtreeEnds[s] = (uint32_t)s + 1;
+    for (size_t s = n; s-- > 0;)
+        if (parentSlots[s] != noParent)
+            subtreeEnds[parentSlots[s]] = std::max(subtreeEnds[parentSlots[s]], subtreeEnds[s]);
+    reordered = true;
+}
+
+// The parent of `begin` is before the run and up to date, every other parent is in it
+void SceneGraph::remake(size_t begin, size_t end, SimdLevel level) {
+    for (size_t s = begin; s < end; s++) {
+        const NodeTransform &t = locals[s];
+        Mat4 local = trsMatrix(t.position, t.rotation, t.scale);
+        worlds[s] = parentSlots[s] == noParent ? local : Mat4::multiply(worlds[parentSlots[s]], local, level);
+    }
+}
+
+SceneGraphStats SceneGraph::update(SimdLevel level) {
+    SceneGraphStats stats;
+    stats.dirty = dirty.size();
+    if (!reordered) {
+        reorder();
+        remake(0, locals.size(), level);
+        stats.recomputed = locals.size();
+    }
+    else {
+        std::sort(dirty.begin(), dirty.end());
+        size_t covered = 0;
+        for (uint32_t s : dirty) {
+            if (s < covered)
+                continue;
+            remake(s, subtreeEnds[s], level);
+            stats.recomputed += subtreeEnds[s] - s;
+            covered = subtreeEnds[s];
+        }
+    }
+    for (uint32_t s : dirty)
+        marked[s] = 0;
+    dirty.clear();
+    return stats;
+}
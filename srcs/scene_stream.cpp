@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <chrono>
+#include "../include/include.hpp"
+#include "../include/memstats.hpp"
+
+// GL side of background loading (the CPU side is in async_loader)
+// Only one model is uploaded at a time, in pieces, so a big model never stalls a frame
+
+double nowMs() {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+namespace {
+
+// One draw per part, with the program / texture / material it needs
+// The images were decoded on the loader's worker, a texture seen for the first time is only uploaded
+void appendDrawItems(const SceneObject &obj, uint32_t object, GLuint program, TextureCache &textures,
+                     const std::map<std::string, DecodedImage> &images, GLuint defaultTexture,
+                     std::vector<DrawItem> &draws) {
+    for(size_t s = 0; s < obj.submeshes.size(); s++){
+        const SubMesh &sub = obj.submeshes[s];
+        const Material *mat = (sub.materialId >= 0) ? &obj.materials[sub.materialId] : nullptr;
+
+        DrawItem item;
+        item.program    = program;
+        item.object     = object;
+        item.submesh    = (uint32_t)s;
+        item.firstIndex = sub.firstIndex;
+        item.indexCount = sub.indexCount;
+        item.texture    = 0;
+        if(mat && !mat->diffuseMap.empty()){
+            std::map<std::string, DecodedImage>::const_iterator image = images.find(mat->diffuseMap);
+            item.texture = textures.get(mat->diffuseMap, image != images.end() ? &image->second : nullptr);
+        }
+        item.hasMap     = item.texture != 0;
+        if(!item.hasMap)
+            item.texture = defaultTexture;
+        for(int c = 0; c < 3; c++)
+            item.diffuse[c] = mat ? mat->diffuse[c] : 1.0f;
+        draws.push_back(item);
+    }
+}
+
+void copyElements(const MeshView &view, bool vertices, size_t first, size_t count, void *dst) {
+    if(vertices)
+        copyViewVertices(view, first, count, dst);
+    else
+        copyViewIndices(view, first, count, dst);
+}
+
+// Fill up to `budget` bytes of the bound vertex or index buffer from byte `done` on, whole elements only
+// (at least one), returns how many bytes were written
+// Written straight into the mapped range (interleaved there for a fused view) : the buffer is new and
+// not drawn yet so the mapping doesn't need to wait for the GPU
+size_t uploadPiece(GLenum target, const MeshView &view, bool vertices, size_t done, size_t budget) {
+    size_t element = vertices ? view.layout.stride : view.indexSize;
+    size_t size = (vertices ? view.vertexCount : view.indexCount) * element;
+    size_t n = size - done;
+    if(budget && n > budget)
+        n = std::max(budget / element, (size_t)1) * element;
+    if(!n)
+        return 0;
+
+    void *dst = glMapBufferRange(target, done, n,
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    // A driver refusing the mapping still gets the data, the old way (through a copy for a fused view)
+    if(!dst){
+        std::vector<char> piece(n);
+        copyElements(view, vertices, done / element, n / element, piece.data());
+        glBufferSubData(target, done, n, piece.data());
+        return n;
+    }
+    copyElements(view, vertices, done / element, n / element, dst);
+    if(glUnmapBuffer(target) == GL_FALSE)
+        printf("Warning: buffer of a model was lost while mapped, it may show garbage\n");
+    return n;
+}
+
+// Map both buffers of the model whole and let the writer fill them, false if the driver won't map them
+// (the model is then uploaded in pieces)
+bool startMappedWrite(PendingUpload &upload, const MeshView &view, MappedWriter &writer) {
+    if(!upload.vertexBytes || !upload.indexBytes)
+        return false;
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    glBindVertexArray(upload.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, upload.vbo);
+    void *vertices = glMapBufferRange(GL_ARRAY_BUFFER, 0, upload.vertexBytes, access);
+    void *indices  = vertices ? glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, upload.indexBytes, access) : nullptr;
+    if(vertices && !indices)
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindVertexArray(0);
+    if(!indices)
+        return false;
+    writer.start(view, vertices, indices);
+    upload.mapped = true;
+    return true;
+}
+
+// Once the writer is done : the buffers go back to GL, the whole model counts as uploaded
+void finishMappedWrite(PendingUpload &upload) {
+    glBindVertexArray(upload.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, upload.vbo);
+    bool lost = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE;
+    lost = (glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) == GL_FALSE) || lost;
+    glBindVertexArray(0);
+    if(lost)
+        printf("Warning: buffer of a model was lost while mapped, it may show garbage\n");
+    upload.uploaded = upload.vertexBytes + upload.indexBytes;
+    upload.mapped   = false;
+}
+
+}
+
+bool SceneStreamer::update(Scene &scene) {
+    size_t budget = uploadBudget;
+    bool uploaded = false;
+
+    size_t object;
+    Bvh bvh;
+    while(bvhs && bvhs->poll(object, bvh))
+        scene.objects[object].bvh = std::move(bvh);
+
+    while(true){
+        // Start the next model : its buffers are allocated right away and filled in the next steps
+        if(!current.model){
+            std::unique_ptr<LoadedModel> model;
+            bool got = blocking ? loader->wait(model) : loader->poll(model);
+            if(!got)
+                break;
+            if(!model->ok){
+                printf("Failed to load OBJ: %s\n", model->path.c_str());
+                failed++;
+                continue;
+            }
+            const MeshView &view = model->view();
+            setupMeshBuffers(view, current.vao, current.vbo, current.ebo, current.indexType, false);
+            current.vertexBytes = view.vertexCount * view.layout.stride;
+            current.indexBytes  = view.indexCount * view.indexSize;
+            current.uploaded    = 0;
+            current.model.swap(model);
+            if(writer)
+                startMappedWrite(current, current.model->view(), *writer);
+        }
+
+        // Nothing to copy on this thread while the writer fills the mapping, only wait for it
+        const MeshView &view = current.model->view();
+        if(current.mapped){
+            uploaded = true;
+            if(!writer->finished())
+                break;
+            finishMappedWrite(current);
+        }
+
+        // Vertices first then indices, the EBO is bound through the model's own VAO
+        glBindVertexArray(current.vao);
+        while(current.uploaded < current.vertexBytes + current.indexBytes && (!uploadBudget || budget)){
+            size_t n;
+            if(current.uploaded < current.vertexBytes){
+                glBindBuffer(GL_ARRAY_BUFFER, current.vbo);
+                n = uploadPiece(GL_ARRAY_BUFFER, view, true, current.uploaded, budget);
+            }
+            else
+                n = uploadPiece(GL_ELEMENT_ARRAY_BUFFER, view, false, current.uploaded - current.vertexBytes, budget);
+            current.uploaded += n;
+            if(uploadBudget)
+                budget -= std::min(n, budget);
+        }
+        glBindVertexArray(0);
+        uploaded = true;
+        if(current.uploaded < current.vertexBytes + current.indexBytes)
+            break;
+
+        // All on the GPU : the model joins the scene and its CPU copy is released
+        const LoadedModel &model = *current.model;
+        size_t soupBytes = view.indexCount * view.layout.stride;
+        printf("GPU memory for %s: %.1f KB indexed (%zu %s vertices of %zu bytes, %zu-bit indices), %.1f KB as triangle soup\n",
+            model.path.c_str(), (current.vertexBytes + current.indexBytes) / 1024.0, view.vertexCount,
+            vertexFormatName(view.layout.format), view.layout.stride, view.indexSize * 8, soupBytes / 1024.0);
+        printf("%s: %zu parts, %zu materials\n", model.path.c_str(), view.submeshCount, view.materials.size());
+        printf("[CACHE] %s: %s start in %.2f ms\n", model.path.c_str(), model.warm ? "warm" : "cold", model.ms);
+
+        SceneObject obj;
+        obj.vao        = current.vao;
+        obj.indexCount = view.indexCount;
+        obj.indexType  = current.indexType;
+        obj.indexSize  = view.indexSize;
+        obj.submeshes.assign(view.submeshes, view.submeshes + view.submeshCount);
+        obj.lods.assign(view.lods, view.lods + view.lodCount);
+        obj.lodSubmeshes.assign(view.lodSubmeshes, view.lodSubmeshes + view.lodCount * view.submeshCount);
+        obj.meshlets.assign(view.meshlets, view.meshlets + view.meshletCount);
+        obj.meshletRanges.assign(view.meshletRanges, view.meshletRanges + view.meshletRangeCount);
+        obj.watertight = view.watertight;
+        obj.materials  = model.materials;
+        obj.bounds     = view.bounds;
+        obj.layout     = view.layout;
+        obj.quant      = view.quant;
+        obj.vertexBytes = current.vertexBytes;
+        // Make sure there is enough distance between objects
+        obj.offsetX    = model.slot * spacing - (slotCount - 1) * spacing / 2.0f;
+
+        appendDrawItems(obj, (uint32_t)scene.objects.size(), program, *textures, model.images, defaultTexture,
+                        fileOrder);
+        scene.objects.push_back(obj);
+        added++;
+        scene.draws = fileOrder;
+        if(sortDraws)
+            sortDrawItems(scene.draws);
+        // Picking waits for the BVH, the model's CPU side goes with the builder until then
+        if(bvhs)
+            bvhs->add(scene.objects.size() - 1, std::move(current.model));
+        current = PendingUpload();
+    }
+
+    if(uploaded)
+        uploadFrames++;
+
+    bool done = !current.model && loader->done();
+    if(done && !reported){
+        reported = true;
+        printf("[ASYNC] %zu models on the GPU %.2f ms after launch (%zu frames, %zu of them uploading), peak RSS %.1f MB%s\n",
+            scene.objects.size(), nowMs() - startMs, frames, uploadFrames, peakRssKB() / 1024.0,
+            failed ? ", some models failed to load" : "");
+
+        // Group the draws by program and texture so each one is bound once per frame
+        DrawStats unsorted = countDrawState(fileOrder);
+        DrawStats sorted   = countDrawState(scene.draws);
+        printf("[DRAW] %zu draw calls, %zu textures decoded, texture binds per frame: %zu in file order, %zu %s\n",
+            scene.draws.size(), textures->textures.size(), unsorted.textureBinds, sorted.textureBinds,
+            sortDraws ? "sorted" : "(sorting disabled)");
+    }
+    return done;
+}
+
+void SceneStreamer::frameDone() {
+    if(frames++ == 0)
+        printf("[ASYNC] First frame %.2f ms after launch, %zu of %d models in the scene\n", nowMs() - startMs,
+            added, slotCount);
+}
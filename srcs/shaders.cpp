@@ -4,23 +4,91 @@
 const char *vertexShaderSrc = R"(
 #version 330 core
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 normal;
-layout(location = 2) in vec2 texCoord; // = UV
+layout(location = 0) in vec3 position; // quantized formats : [0, 1] inside the model's box
+layout(location = 1) in vec3 normal;   // octahedral format : only xy
+layout(location = 2) in vec2 texCoord; // = UV, (0, 0) when the model has none
 
 uniform mat4 MVP;
 
+// Puts quantized vertices back where they were (see VertexQuantization), the identity for float ones
+uniform vec3 positionMin;
+uniform vec3 positionExtent;
+uniform vec4 uvRange;          // min, extent
+uniform bool octNormals;
+
+// --instances : copies of the model on an instanceColumns x instanceColumns grid, shrunk to fit
+// where the single model was. A multi-draw can't be instanced, it is then repeated per copy with
+// instanceBase telling which one
+uniform int instanceColumns;
+uniform int instanceBase;
+
+out vec3 gNormal;
+out vec3 gWorldPos;
+out vec2 gUv;
+flat out int gVertexId;
+
+// The [-1, 1] square folded back onto the octahedron, then the sphere
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n;
+}
+
+void main()
+{
+    vec3 pos = positionMin + position * positionExtent;
+    gWorldPos = pos;
+    gVertexId = gl_VertexID;
+    if(instanceColumns > 1)
+    {
+        float columns = float(instanceColumns);
+        int instance = instanceBase + gl_InstanceID;
+        vec2 cell = vec2(instance % instanceColumns, instance / instanceColumns) - (columns - 1.0) * 0.5;
+        pos = (pos + vec3(cell.x, 0.0, cell.y) * 3.0) / columns;
+    }
+    gl_Position = MVP * vec4(pos, 1.0);
+    gNormal = normalize(octNormals ? octDecode(normal.xy) : normal);
+    gUv = uvRange.xy + texCoord * uvRange.zw;
+}
+)";
+
+// Passes every triangle through as it is, with a number made from its three vertex ids for the face
+// colors : gl_PrimitiveID restarts at 0 with every run of a multi-draw, the vertex ids don't, so a face
+// keeps its color however culling splits the draws
+const char *geometryShaderSrc = R"(
+#version 330 core
+
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+in vec3 gNormal[];
+in vec3 gWorldPos[];
+in vec2 gUv[];
+flat in int gVertexId[];
+
 out vec3 vNormal;
 out vec3 vWorldPos;
-out vec3 vColor;
+out vec2 vUv;
+flat out uint vFaceKey;
 
 void main()
 {
-    gl_Position = MVP * vec4(position, 1.0);
-    int triIndex = gl_VertexID / 3;
-    vColor = vec3(mod(triIndex*0.37,1.0), mod(triIndex*0.91,1.0), mod(triIndex*0.53,1.0));
-    vNormal = normalize(normal);
-    vWorldPos =  position;
+    uint h = uint(gVertexId[0]) * 73856093u ^ uint(gVertexId[1]) * 19349663u ^ uint(gVertexId[2]) * 83492791u;
+    h = (h ^ (h >> 16)) * 0x7feb352du;
+    h = (h ^ (h >> 15)) * 0x846ca68bu;
+    h = h ^ (h >> 16);
+    for(int i = 0; i < 3; i++)
+    {
+        gl_Position = gl_in[i].gl_Position;
+        vNormal = gNormal[i];
+        vWorldPos = gWorldPos[i];
+        vUv = gUv[i];
+        vFaceKey = h;
+        EmitVertex();
+    }
+    EndPrimitive();
 }
 )";
 
@@ -31,7 +99,8 @@ const char *fragmentShaderSrc = R"(
 // input from the vertex shader
 in vec3 vNormal;
 in vec3 vWorldPos;
-in vec3 vColor;
+in vec2 vUv;
+flat in uint vFaceKey;      // the same for every pixel of a triangle (see the geometry shader)
 
 // Output final color of the pixel
 out vec4 FragColor;
@@ -41,9 +110,18 @@ uniform bool useTexture;
 
 uniform float textureTiling;
 
+// Material of the part being drawn (.mtl Kd / map_Kd), Kd tints every mode
+uniform vec3 diffuseColor;
+uniform bool highlighted;   // the object last clicked on
+uniform bool hasMap;        // tex is the map_Kd image, sample it with the mesh uvs
+
 void main()
 {
-    if(useTexture)
+    if(useTexture && hasMap)
+    {
+        FragColor = texture(tex, vUv) * vec4(diffuseColor, 1.0);
+    }
+    else if(useTexture)
     {
         vec3 weights = pow(abs(vNormal), vec3(8.0));
         weights /= (weights.x + weights.y + weights.z);
@@ -56,13 +134,20 @@ void main()
         vec4 colY = texture(tex, uvY);
         vec4 colZ = texture(tex, uvZ);
 
-        FragColor = colX * weights.x + colY * weights.y + colZ * weights.z;
+        FragColor = (colX * weights.x + colY * weights.y + colZ * weights.z) * vec4(diffuseColor, 1.0);
     }
     else
     {
-        // One color per face
-        FragColor = vec4(vColor, 1.0);
+        // One color per face, vertices are shared between triangles
+        // so it comes from the face key instead of anything interpolated
+        // Tinted by Kd like the textured paths, white (no material) leaves it as is
+        vec3 color = vec3(uvec3(vFaceKey, vFaceKey >> 8, vFaceKey >> 16) & 255u) / 255.0;
+        FragColor = vec4(color * diffuseColor, 1.0);
     }
+
+    // Picked : halfway to yellow, whatever it was drawn with
+    if(highlighted)
+        FragColor.rgb = mix(FragColor.rgb, vec3(1.0, 0.85, 0.1), 0.5);
 }
 
 
@@ -85,13 +170,15 @@ GLuint compileShader(const char *source, GLenum type) {
     return id;
 }
 
-// Combine the vertex shader and the fragment shader together into an OpenGL "program"
-GLuint createProgram(const char *vs, const char *fs) {
+// Combine the vertex shader, the geometry shader and the fragment shader together into an OpenGL "program"
+GLuint createProgram(const char *vs, const char *gs, const char *fs) {
     GLuint v = compileShader(vs, GL_VERTEX_SHADER);
+    GLuint g = compileShader(gs, GL_GEOMETRY_SHADER);
     GLuint f = compileShader(fs, GL_FRAGMENT_SHADER);
 
     GLuint p = glCreateProgram();
     glAttachShader(p, v);
+    glAttachShader(p, g);
     glAttachShader(p, f);
     glLinkProgram(p);
 
@@ -105,6 +192,7 @@ GLuint createProgram(const char *vs, const char *fs) {
     }
 
     glDeleteShader(v);
+    glDeleteShader(g);
     glDeleteShader(f);
     return p;
 }
@@ -0,0 +1,466 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include "../include/mesh.hpp"
+#include "../include/parallel.hpp"
+
+// Level of detail chain : quadric error metric edge collapses (Garland & Heckbert 1997)
+// Every vertex carries the planes of the triangles it started with in a quadric, moving it costs the
+// squared distance to those planes. A collapse always moves a vertex onto one of its neighbors (half
+// edge collapse), so no vertex is ever made and every level indexes the mesh's own vertex array
+
+namespace {
+
+// Below this a model is cheap enough as it is
+const size_t minLodTriangles = 1024;
+// A level that doesn't get at least 10% smaller than the previous one is not worth its indices
+const double minLodShrink = 0.9;
+// A collapse can't turn a triangle more than about 75 degrees, beyond that it starts folding over
+const float minFlipCos = 0.25f;
+
+const uint32_t noVertex = 0xffffffffu;
+
+// Sum over planes of area * (n.p + d)^2, the symmetric 4x4 matrix stored as its upper triangle
+struct Quadric {
+    float a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+    float area;
+};
+
+void addPlane(Quadric& q, const float n[3], float d, float w) {
+    q.a00 += w * n[0] * n[0]; q.a01 += w * n[0] * n[1]; q.a02 += w * n[0] * n[2]; q.a03 += w * n[0] * d;
+    q.a11 += w * n[1] * n[1]; q.a12 += w * n[1] * n[2]; q.a13 += w * n[1] * d;
+    q.a22 += w * n[2] * n[2]; q.a23 += w * n[2] * d;
+    q.a33 += w * d * d;
+    q.area += w;
+}
+
+void addQuadric(Quadric& q, const Quadric& o) {
+    q.a00 += o.a00; q.a01 += o.a01; q.a02 += o.a02; q.a03 += o.a03;
+    q.a11 += o.a11; q.a12 += o.a12; q.a13 += o.a13;
+    q.a22 += o.a22; q.a23 += o.a23;
+    q.a33 += o.a33;
+    q.area += o.area;
+}
+
+float evalQuadric(const Quadric& q, const float p[3]) {
+    float x = p[0], y = p[1], z = p[2];
+    float r = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z + q.a33
+        + 2.0f * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z + q.a03 * x + q.a13 * y + q.a23 * z);
+    return r > 0.0f ? r : 0.0f;
+}
+
+void triangleNormal(const float* a, const float* b, const float* c, float n[3]) {
+    float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Move `from` onto `to`, cost = mean squared distance to the planes of both, in the unit box
+struct Collapse {
+    float    cost;
+    uint32_t from;
+    uint32_t to;
+};
+
+struct Simplifier {
+    size_t                vertexCount = 0;
+    std::vector<float>    pos;            // positions fitted in the unit box, so float quadrics stay precise
+    float                 extent = 1.0f;  // size of that box in model units
+    std::vector<char>     locked;
+    std::vector<Quadric>  quadrics;
+    std::vector<uint32_t> tris;           // triangles of the current level, submesh after submesh
+    std::vector<uint32_t> triSub;         // submesh of each of them
+    std::vector<uint32_t> adjacencyStart; // triangles around each vertex, CSR style
+    std::vector<uint32_t> adjacency;
+    std::vector<uint32_t> mark;
+    std::vector<char>     touched;
+    std::vector<uint32_t> collapseTo;     // best neighbor of each free vertex this pass
+    uint32_t              stamp = 0;
+    float                 maxError = 0.0f; // squared, in the unit box
+    unsigned              threads = 1;
+
+    Simplifier(const Mesh& mesh, unsigned threads);
+
+    // Collapse until `target` triangles are left or nothing can move, false when nothing moved at all
+    bool reduce(size_t target);
+
+private:
+    void weldAttributes(const Mesh& mesh);
+    void lockBorders(const Mesh& mesh);
+    void buildAdjacency();
+    Collapse bestCollapse(uint32_t u) const;
+    bool canCollapse(uint32_t u, uint32_t v);
+    size_t pass(size_t target);
+};
+
+Simplifier::Simplifier(const Mesh& mesh, unsigned t) : threads(t) {
+    vertexCount = mesh.vertices.size() / 3;
+    Bounds bounds = computeBounds(mesh.vertices.data(), vertexCount, threads);
+    float size = 0.0f;
+    for (int a = 0; a < 3; a++)
+        size = std::fmax(size, bounds.max[a] - bounds.min[a]);
+    extent = (size > 0.0f && std::isfinite(size)) ? size : 1.0f;
+    pos.resize(vertexCount * 3);
+    for (size_t v = 0; v < vertexCount; v++)
+        for (int a = 0; a < 3; a++)
+            pos[v * 3 + a] = (mesh.vertices[v * 3 + a] - bounds.min[a]) / extent;
+
+    // Only the triangles of the submeshes, whatever else the index buffer holds
+    for (size_t s = 0; s < mesh.submeshes.size(); s++) {
+        const SubMesh& sub = mesh.submeshes[s];
+        tris.insert(tris.end(), mesh.indices.begin() + sub.firstIndex,
+                    mesh.indices.begin() + sub.firstIndex + sub.indexCount);
+        triSub.insert(triSub.end(), sub.indexCount / 3, (uint32_t)s);
+    }
+    weldAttributes(mesh);
+
+    quadrics.assign(vertexCount, Quadric());
+    for (size_t t = 0; t < tris.size() / 3; t++) {
+        const uint32_t* c = &tris[t * 3];
+        float n[3];
+        triangleNormal(&pos[c[0] * 3], &pos[c[1] * 3], &pos[c[2] * 3], n);
+        float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (!(len > 0.0f))
+            continue;
+        for (int a = 0; a < 3; a++)
+            n[a] /= len;
+        const float* p = &pos[c[0] * 3];
+        float d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+        for (int k = 0; k < 3; k++)
+            addPlane(quadrics[c[k]], n, d, len * 0.5f);
+    }
+
+    lockBorders(mesh);
+    mark.assign(vertexCount, 0);
+    touched.assign(vertexCount, 0);
+    collapseTo.assign(vertexCount, noVertex);
+}
+
+// Vertices equal in everything (position, normal, uv) are one vertex to the simplifier : files often
+// write a normal or uv per corner even where the surface is smooth, and those twins would read as
+// seams. The triangles use the lowest numbered twin, which draws exactly the same
+void Simplifier::weldAttributes(const Mesh& mesh) {
+    const float* v = mesh.vertices.data();
+    const float* n = mesh.normals.size() == vertexCount * 3 ? mesh.normals.data() : nullptr;
+    const float* uv = mesh.uvs.size() == vertexCount * 2 ? mesh.uvs.data() : nullptr;
+    auto compare = [&](uint32_t a, uint32_t b) {
+        int c = memcmp(&v[a * 3], &v[b * 3], 3 * sizeof(float));
+        if (c == 0 && n)
+            c = memcmp(&n[a * 3], &n[b * 3], 3 * sizeof(float));
+        if (c == 0 && uv)
+            c = memcmp(&uv[a * 2], &uv[b * 2], 2 * sizeof(float));
+        return c;
+    };
+    std::vector<uint32_t> order(vertexCount), twin(vertexCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        int c = compare(a, b);
+        return c != 0 ? c < 0 : a < b;
+    });
+    for (size_t i = 0; i < vertexCount; i++)
+        twin[order[i]] = i > 0 && compare(order[i], order[i - 1]) == 0 ? twin[order[i - 1]] : order[i];
+    for (uint32_t& c : tris)
+        c = twin[c];
+}
+
+// Vertices that never move :
+//  - a position still shared by several vertices once twins are welded, a real uv or normal seam
+//    (moving one side would tear it open)
+//  - on an edge with one triangle (open border) or more than two (non-manifold), in position space
+//  - used by more than one submesh, the outline between two materials
+void Simplifier::lockBorders(const Mesh& mesh) {
+    std::vector<uint32_t> position = weldPositions(mesh);
+    std::vector<char> lockedPosition(vertexCount, 0);
+    std::vector<uint32_t> used(vertexCount, noVertex);   // by position, the first vertex seen there
+    for (uint32_t c : tris) {
+        uint32_t& u = used[position[c]];
+        if (u != noVertex && u != c)
+            lockedPosition[position[c]] = 1;
+        u = c;
+    }
+
+    std::vector<uint32_t> submesh(vertexCount, noVertex);
+    std::vector<uint64_t> edges;
+    edges.reserve(tris.size());
+    for (size_t t = 0; t < tris.size() / 3; t++) {
+        for (int k = 0; k < 3; k++) {
+            uint32_t a = position[tris[t * 3 + k]], b = position[tris[t * 3 + (k + 1) % 3]];
+            edges.push_back(a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a);
+            uint32_t& s = submesh[a];
+            if (s != noVertex && s != triSub[t])
+                lockedPosition[a] = 1;
+            s = triSub[t];
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size();) {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i])
+            j++;
+        if (j - i != 2) {
+            lockedPosition[edges[i] >> 32] = 1;
+            lockedPosition[edges[i] & 0xffffffffu] = 1;
+        }
+        i = j;
+    }
+
+    locked.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+        locked[i] = lockedPosition[position[i]];
+}
+
+void Simplifier::buildAdjacency() {
+    adjacencyStart.assign(vertexCount + 1, 0);
+    for (uint32_t c : tris)
+        adjacencyStart[c + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyStart[v + 1] += adjacencyStart[v];
+    adjacency.resize(tris.size());
+    std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (size_t c = 0; c < tris.size(); c++)
+        adjacency[fill[tris[c]]++] = (uint32_t)(c / 3);
+}
+
+// Cheapest neighbor to move u onto
+// A free vertex is inside a closed fan, taking the corner after u in each triangle sees every
+// neighbor once
+Collapse Simplifier::bestCollapse(uint32_t u) const {
+    Collapse best = { INFINITY, u, noVertex };
+    for (uint32_t a = adjacencyStart[u]; a < adjacencyStart[u + 1]; a++) {
+        const uint32_t* c = &tris[adjacency[a] * 3];
+        for (int k = 0; k < 3; k++) {
+            if (c[k] != u)
+                continue;
+            uint32_t v = c[(k + 1) % 3];
+            const float* p = &pos[v * 3];
+            float area = quadrics[u].area + quadrics[v].area;
+            float cost = evalQuadric(quadrics[u], p) + evalQuadric(quadrics[v], p);
+            cost = area > 0.0f ? cost / area : 0.0f;
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.to = v;
+            }
+        }
+    }
+    return best;
+}
+
+bool Simplifier::canCollapse(uint32_t u, uint32_t v) {
+    if (touched[u] || touched[v])
+        return false;
+
+    // Link condition : u and v share exactly the two vertices across their edge, anything else pinches
+    // the surface (a tetrahedron, a fin) into something non-manifold
+    stamp += 2;
+    for (uint32_t a = adjacencyStart[u]; a < adjacencyStart[u + 1]; a++)
+        for (int k = 0; k < 3; k++)
+            mark[tris[adjacency[a] * 3 + k]] = stamp;
+    int common = 0;
+    for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v + 1]; a++) {
+        for (int k = 0; k < 3; k++) {
+            uint32_t w = tris[adjacency[a] * 3 + k];
+            if (w != u && w != v && mark[w] == stamp) {
+                mark[w] = stamp + 1;
+                common++;
+            }
+        }
+    }
+    if (common != 2)
+        return false;
+
+    // No triangle around u may turn over or collapse to a sliver
+    const float* target = &pos[v * 3];
+    for (uint32_t a = adjacencyStart[u]; a < adjacencyStart[u + 1]; a++) {
+        const uint32_t* c = &tris[adjacency[a] * 3];
+        if (c[0] == v || c[1] == v || c[2] == v)
+            continue;
+        const float* p[3];
+        for (int k = 0; k < 3; k++)
+            p[k] = &pos[c[k] * 3];
+        float before[3], after[3];
+        triangleNormal(p[0], p[1], p[2], before);
+        for (int k = 0; k < 3; k++)
+            if (c[k] == u)
+                p[k] = target;
+        triangleNormal(p[0], p[1], p[2], after);
+        float dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+        float lb = before[0] * before[0] + before[1] * before[1] + before[2] * before[2];
+        float la = after[0] * after[0] + after[1] * after[1] + after[2] * after[2];
+        if (!(dot > 0.0f) || dot * dot < minFlipCos * minFlipCos * lb * la)
+            return false;
+    }
+    return true;
+}
+
+// One round : the best collapse of every free vertex, cheapest first, each applied unless a neighbor
+// already moved this round (its costs would be stale). Returns the number of triangles left
+size_t Simplifier::pass(size_t target) {
+    buildAdjacency();
+    size_t triangleCount = tris.size() / 3;
+
+    // Sorted as (cost bits, vertex) : a positive float orders like its bits, and a plain integer
+    // sort is a lot faster than one through a comparator
+    unsigned ranges = resolveThreadCount(threads);
+    std::vector<std::vector<uint64_t>> found(ranges);
+    parallelRanges(vertexCount, ranges, [&](size_t begin, size_t end, size_t r) {
+        for (size_t u = begin; u < end; u++) {
+            if (locked[u] || adjacencyStart[u] == adjacencyStart[u + 1])
+                continue;
+            Collapse c = bestCollapse((uint32_t)u);
+            if (c.to == noVertex)
+                continue;
+            uint32_t bits;
+            memcpy(&bits, &c.cost, sizeof(bits));
+            collapseTo[u] = c.to;
+            found[r].push_back((uint64_t)bits << 32 | u);
+        }
+    });
+    std::vector<uint64_t> collapses;
+    for (std::vector<uint64_t>& f : found)
+        collapses.insert(collapses.end(), f.begin(), f.end());
+    std::sort(collapses.begin(), collapses.end());
+
+    // Every collapse of an interior edge removes the two triangles along it
+    std::vector<uint32_t> remap(vertexCount);
+    std::iota(remap.begin(), remap.end(), 0u);
+    std::fill(touched.begin(), touched.end(), 0);
+    size_t removed = 0;
+    for (uint64_t key : collapses) {
+        if (triangleCount - removed <= target)
+            break;
+        Collapse c;
+        uint32_t bits = (uint32_t)(key >> 32);
+        memcpy(&c.cost, &bits, sizeof(bits));
+        c.from = (uint32_t)key;
+        c.to   = collapseTo[c.from];
+        if (!canCollapse(c.from, c.to))
+            continue;
+        remap[c.from] = c.to;
+        addQuadric(quadrics[c.to], quadrics[c.from]);
+        maxError = std::fmax(maxError, c.cost);
+        for (uint32_t a = adjacencyStart[c.from]; a < adjacencyStart[c.from + 1]; a++)
+            for (int k = 0; k < 3; k++)
+                touched[tris[adjacency[a] * 3 + k]] = 1;
+        removed += 2;
+    }
+    if (!removed)
+        return triangleCount;
+
+    // Apply, the triangles that lost a corner go, the others keep their order (and their submesh)
+    size_t kept = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        uint32_t a = remap[tris[t * 3]], b = remap[tris[t * 3 + 1]], c = remap[tris[t * 3 + 2]];
+        if (a == b || b == c || a == c)
+            continue;
+        tris[kept * 3] = a;
+        tris[kept * 3 + 1] = b;
+        tris[kept * 3 + 2] = c;
+        triSub[kept++] = triSub[t];
+    }
+    tris.resize(kept * 3);
+    triSub.resize(kept);
+    return kept;
+}
+
+bool Simplifier::reduce(size_t target) {
+    size_t start = tris.size() / 3, count = start;
+    while (count > target) {
+        size_t left = pass(target);
+        if (left == count)
+            break;
+        count = left;
+    }
+    return count < start;
+}
+
+}
+
+// Same position = same bits, vertices sorted so twins end up side by side
+std::vector<uint32_t> weldPositions(const Mesh &mesh) {
+    size_t vertexCount = mesh.vertices.size() / 3;
+    std::vector<uint32_t> order(vertexCount), position(vertexCount);
+    std::iota(order.begin(), order.end(), 0u);
+    const float* v = mesh.vertices.data();
+    std::sort(order.begin(), order.end(), [v](uint32_t a, uint32_t b) {
+        int c = memcmp(&v[a * 3], &v[b * 3], 3 * sizeof(float));
+        return c != 0 ? c < 0 : a < b;
+    });
+    for (size_t i = 0; i < vertexCount; i++) {
+        bool twin = i > 0 && memcmp(&v[order[i] * 3], &v[order[i - 1] * 3], 3 * sizeof(float)) == 0;
+        position[order[i]] = twin ? position[order[i - 1]] : order[i];
+    }
+    return position;
+}
+
+void buildLods(Mesh &mesh, const std::vector<float> &ratios, unsigned threads) {
+    mesh.lods.clear();
+    mesh.lodSubmeshes.clear();
+    size_t baseTriangles = 0;
+    for (const SubMesh& sub : mesh.submeshes)
+        baseTriangles += sub.indexCount / 3;
+    if (ratios.empty() || baseTriangles < minLodTriangles)
+        return;
+
+    Simplifier simplifier(mesh, threads);
+    size_t previous = baseTriangles;
+    for (float ratio : ratios) {
+        size_t target = (size_t)(baseTriangles * (double)ratio);
+        if (target >= previous * minLodShrink)
+            continue;
+        simplifier.reduce(target);
+        size_t count = simplifier.tris.size() / 3;
+        if (count > previous * minLodShrink)
+            break;
+
+        // Appended to the index buffer, one range per submesh like the full mesh (possibly empty)
+        MeshLod lod;
+        lod.ratio = ratio;
+        lod.error = std::sqrt(simplifier.maxError) * simplifier.extent;
+        lod.triangleCount = (uint32_t)count;
+        mesh.lods.push_back(lod);
+        size_t t = 0;
+        for (size_t s = 0; s < mesh.submeshes.size(); s++) {
+            SubMesh sub = mesh.submeshes[s];
+            sub.firstIndex = (uint32_t)mesh.indices.size();
+            for (; t < count && simplifier.triSub[t] == s; t++)
+                mesh.indices.insert(mesh.indices.end(), &simplifier.tris[t * 3], &simplifier.tris[t * 3 + 3]);
+            sub.indexCount = (uint32_t)(mesh.indices.size() - sub.firstIndex);
+            mesh.lodSubmeshes.push_back(sub);
+        }
+        previous = count;
+    }
+}
+
+size_t selectLod(const MeshLod *lods, size_t lodCount, float radius, float projectedRadius, float pixelError) {
+    if (!(radius > 0.0f))
+        return 0;
+    float pixelsPerUnit = projectedRadius / radius;
+    size_t level = 0;
+    for (size_t l = 0; l < lodCount && lods[l].error * pixelsPerUnit <= pixelError; l++)
+        level = l + 1;
+    return level;
+}
+
+bool parseLodRatios(const std::string& text, std::vector<float>& out) {
+    std::vector<float> ratios;
+    if (text != "none") {
+        size_t at = 0;
+        while (at <= text.size()) {
+            size_t comma = std::min(text.find(',', at), text.size());
+            std::string item = text.substr(at, comma - at);
+            char* end = nullptr;
+            float r = std::strtof(item.c_str(), &end);
+            if (item.empty() || *end != '\0' || !(r > 0.0f && r < 1.0f)
+                || (!ratios.empty() && r >= ratios.back()) || ratios.size() == maxLodLevels)
+                return false;
+            ratios.push_back(r);
+            at = comma + 1;
+        }
+    }
+    out = ratios;
+    return true;
+}
@@ -0,0 +1,333 @@
+#include <cmath>
+#include "../include/transforms.hpp"
+#include "../include/parallel.hpp"
+
+// Translation, quaternion and scale to matrices
+// The scalar, SSE and AVX2 versions do the same operations in the same order (no FMA), the vector ones
+// on 4 or 8 objects per register : one register per matrix element, turned back into one matrix per
+// object by 4x4 transposes just before the store. The last row of a model matrix is always 0 0 0 1,
+// so the MVP product skips it (a quarter of the multiplies of Mat4::multiply)
+
+namespace {
+
+// Below this many objects threads cost more than they bring
+const size_t minObjectsPerThread = 32 * 1024;
+
+// Columns of rotate * scale
+inline void rotateScale(float x, float y, float z, float w, const float s[3], float m[3][3]) {
+    float x2 = x + x, y2 = y + y, z2 = z + z;
+    float xx = x * x2, yy = y * y2, zz = z * z2;
+    float xy = x * y2, xz = x * z2, yz = y * z2;
+    float wx = w * x2, wy = w * y2, wz = w * z2;
+    m[0][0] = (1.0f - (yy + zz)) * s[0];
+    m[0][1] = (xy + wz) * s[0];
+    m[0][2] = (xz - wy) * s[0];
+    m[1][0] = (xy - wz) * s[1];
+    m[1][1] = (1.0f - (xx + zz)) * s[1];
+    m[1][2] = (yz + wx) * s[1];
+    m[2][0] = (xz + wy) * s[2];
+    m[2][1] = (yz - wx) * s[2];
+    m[2][2] = (1.0f - (xx + yy)) * s[2];
+}
+
+void transformsScalar(const ObjectTransforms &o, const Mat4 &viewProj, Mat4 *models, Mat4 *mvps,
+                      size_t begin, size_t end) {
+    const float *vp = viewProj.m;
+    for (size_t i = begin; i < end; i++) {
+        const float s[3] = { o.scale[0][i], o.scale[1][i], o.scale[2][i] };
+        float t[3] = { o.position[0][i], o.position[1][i], o.position[2][i] };
+        float m[3][3];
+        rotateScale(o.rotation[0][i], o.rotation[1][i], o.rotation[2][i], o.rotation[3][i], s, m);
+        if (models) {
+            float *out = models[i].m;
+            for (int c = 0; c < 3; c++) {
+                out[c * 4] = m[c][0];
+                out[c * 4 + 1] = m[c][1];
+                out[c * 4 + 2] = m[c][2];
+                out[c * 4 + 3] = 0.0f;
+            }
+            out[12] = t[0];
+            out[13] = t[1];
+            out[14] = t[2];
+            out[15] = 1.0f;
+        }
+        float *out = mvps[i].m;
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 3; c++)
+                out[c * 4 + r] = vp[r] * m[c][0] + vp[4 + r] * m[c][1] + vp[8 + r] * m[c][2];
+            out[12 + r] = vp[r] * t[0] + vp[4 + r] * t[1] + vp[8 + r] * t[2] + vp[12 + r];
+        }
+    }
+}
+
+// viewProj * model column by column, the model's w row being 0 0 0 1
+void mvpsScalar(const Mat4 &viewProj, const Mat4 *models, Mat4 *mvps, size_t begin, size_t end) {
+    const float *vp = viewProj.m;
+    for (size_t i = begin; i < end; i++) {
+        const float *m = models[i].m;
+        float *out = mvps[i].m;
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 3; c++)
+                out[c * 4 + r] = vp[r] * m[c * 4] + vp[4 + r] * m[c * 4 + 1] + vp[8 + r] * m[c * 4 + 2];
+            out[12 + r] = vp[r] * m[12] + vp[4 + r] * m[13] + vp[8 + r] * m[14] + vp[12 + r];
+        }
+    }
+}
+
+#if SCOP_X86
+
+// Four registers of one element each (a lane per object) to four columns (one per object)
+SCOP_TARGET_SSE inline void storeColumnsSse(Mat4 *out, int column, __m128 e0, __m128 e1, __m128 e2, __m128 e3) {
+    _MM_TRANSPOSE4_PS(e0, e1, e2, e3);
+    _mm_store_ps(&out[0].m[column * 4], e0);
+    _mm_store_ps(&out[1].m[column * 4], e1);
+    _mm_store_ps(&out[2].m[column * 4], e2);
+    _mm_store_ps(&out[3].m[column * 4], e3);
+}
+
+SCOP_TARGET_SSE void transformsSse(const ObjectTransforms &o, const Mat4 &viewProj, Mat4 *models, Mat4 *mvps,
+                                   size_t begin, size_t end) {
+    const float *vp = viewProj.m;
+    const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(&o.rotation[0][i]), y = _mm_loadu_ps(&o.rotation[1][i]);
+        __m128 z = _mm_loadu_ps(&o.rotation[2][i]), w = _mm_loadu_ps(&o.rotation[3][i]);
+        __m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+        __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+        __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+        __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+        __m128 sx = _mm_loadu_ps(&o.scale[0][i]), sy = _mm_loadu_ps(&o.scale[1][i]), sz = _mm_loadu_ps(&o.scale[2][i]);
+        __m128 t[3] = { _mm_loadu_ps(&o.position[0][i]), _mm_loadu_ps(&o.position[1][i]),
+                        _mm_loadu_ps(&o.position[2][i]) };
+
+        __m128 m[3][3] = {
+            { _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx), _mm_mul_ps(_mm_add_ps(xy, wz), sx),
+              _mm_mul_ps(_mm_sub_ps(xz, wy), sx) },
+            { _mm_mul_ps(_mm_sub_ps(xy, wz), sy), _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+              _mm_mul_ps(_mm_add_ps(yz, wx), sy) },
+            { _mm_mul_ps(_mm_add_ps(xz, wy), sz), _mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+              _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz) },
+        };
+        if (models) {
+            for (int c = 0; c < 3; c++)
+                storeColumnsSse(models + i, c, m[c][0], m[c][1], m[c][2], zero);
+            storeColumnsSse(models + i, 3, t[0], t[1], t[2], one);
+        }
+        for (int c = 0; c < 4; c++) {
+            __m128 e[4];
+            const __m128 *src = c < 3 ? m[c] : t;
+            for (int r = 0; r < 4; r++) {
+                e[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(vp[r]), src[0]),
+                                             _mm_mul_ps(_mm_set1_ps(vp[4 + r]), src[1])),
+                                  _mm_mul_ps(_mm_set1_ps(vp[8 + r]), src[2]));
+                if (c == 3)
+                    e[r] = _mm_add_ps(e[r], _mm_set1_ps(vp[12 + r]));
+            }
+            storeColumnsSse(mvps + i, c, e[0], e[1], e[2], e[3]);
+        }
+    }
+    transformsScalar(o, viewProj, models, mvps, i, end);
+}
+
+// Same on 8 objects : the 4x4 transposes happen inside each 128 bit half, objects 0-3 end up in the
+// low halves and 4-7 in the high ones, and two columns of an object go out in one 32 byte store
+SCOP_TARGET_AVX2 inline void transposeHalves(__m256 &e0, __m256 &e1, __m256 &e2, __m256 &e3) {
+    __m256 t0 = _mm256_unpacklo_ps(e0, e1), t1 = _mm256_unpacklo_ps(e2, e3);
+    __m256 t2 = _mm256_unpackhi_ps(e0, e1), t3 = _mm256_unpackhi_ps(e2, e3);
+    e0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+    e1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+    e2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    e3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+// Columns `column` and `column` + 1 of 8 objects, a[] and b[] being the elements of each
+SCOP_TARGET_AVX2 inline void storeColumnPairAvx2(Mat4 *out, int column, __m256 *a, __m256 *b) {
+    transposeHalves(a[0], a[1], a[2], a[3]);
+    transposeHalves(b[0], b[1], b[2], b[3]);
+    for (int k = 0; k < 4; k++) {
+        _mm256_storeu_ps(&out[k].m[column * 4], _mm256_permute2f128_ps(a[k], b[k], 0x20));
+        _mm256_storeu_ps(&out[k + 4].m[column * 4], _mm256_permute2f128_ps(a[k], b[k], 0x31));
+    }
+}
+
+SCOP_TARGET_AVX2 void transformsAvx2(const ObjectTransforms &o, const Mat4 &viewProj, Mat4 *models, Mat4 *mvps,
+                                     size_t begin, size_t end) {
+    const float *vp = viewProj.m;
+    const __m256 one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps();
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(&o.rotation[0][i]), y = _mm256_loadu_ps(&o.rotation[1][i]);
+        __m256 z = _mm256_loadu_ps(&o.rotation[2][i]), w = _mm256_loadu_ps(&o.rotation[3][i]);
+        __m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+        __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+        __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+        __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+        __m256 sx = _mm256_loadu_ps(&o.scale[0][i]), sy = _mm256_loadu_ps(&o.scale[1][i]);
+        __m256 sz = _mm256_loadu_ps(&o.scale[2][i]);
+        __m256 t[4] = { _mm256_loadu_ps(&o.position[0][i]), _mm256_loadu_ps(&o.position[1][i]),
+                        _mm256_loadu_ps(&o.position[2][i]), one };
+
+        __m256 m[3][4] = {
+            { _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx), _mm256_mul_ps(_mm256_add_ps(xy, wz), sx),
+              _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx), zero },
+            { _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy), _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy),
+              _mm256_mul_ps(_mm256_add_ps(yz, wx), sy), zero },
+            { _mm256_mul_ps(_mm256_add_ps(xz, wy), sz), _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz),
+              _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz), zero },
+        };
+        __m256 e[4][4];
+        for (int c = 0; c < 4; c++) {
+            const __m256 *src = c < 3 ? m[c] : t;
+            for (int r = 0; r < 4; r++) {
+                e[c][r] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(vp[r]), src[0]),
+                                                      _mm256_mul_ps(_mm256_set1_ps(vp[4 + r]), src[1])),
+                                        _mm256_mul_ps(_mm256_set1_ps(vp[8 + r]), src[2]));
+                if (c == 3)
+                    e[c][r] = _mm256_add_ps(e[c][r], _mm256_set1_ps(vp[12 + r]));
+            }
+        }
+        if (models) {
+            storeColumnPairAvx2(models + i, 0, m[0], m[1]);
+            storeColumnPairAvx2(models + i, 2, m[2], t);
+        }
+        storeColumnPairAvx2(mvps + i, 0, e[0], e[1]);
+        storeColumnPairAvx2(mvps + i, 2, e[2], e[3]);
+    }
+    transformsSse(o, viewProj, models, mvps, i, end);
+}
+
+// One object at a time : a column of the model, each of its elements on every lane, times the columns
+// of viewProj
+SCOP_TARGET_SSE void mvpsSse(const Mat4 &viewProj, const Mat4 *models, Mat4 *mvps, size_t begin, size_t end) {
+    const __m128 v0 = _mm_loadu_ps(&viewProj.m[0]), v1 = _mm_loadu_ps(&viewProj.m[4]);
+    const __m128 v2 = _mm_loadu_ps(&viewProj.m[8]), v3 = _mm_loadu_ps(&viewProj.m[12]);
+    for (size_t i = begin; i < end; i++) {
+        for (int c = 0; c < 4; c++) {
+            __m128 m = _mm_loadu_ps(&models[i].m[c * 4]);
+            __m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v0, _mm_shuffle_ps(m, m, 0x00)),
+                                             _mm_mul_ps(v1, _mm_shuffle_ps(m, m, 0x55))),
+                                  _mm_mul_ps(v2, _mm_shuffle_ps(m, m, 0xaa)));
+            if (c == 3)
+                e = _mm_add_ps(e, v3);
+            _mm_storeu_ps(&mvps[i].m[c * 4], e);
+        }
+    }
+}
+
+// Two columns per register, viewProj's columns on both halves
+SCOP_TARGET_AVX2 void mvpsAvx2(const Mat4 &viewProj, const Mat4 *models, Mat4 *mvps, size_t begin, size_t end) {
+    const __m256 v0 = _mm256_broadcast_ps((const __m128 *)&viewProj.m[0]);
+    const __m256 v1 = _mm256_broadcast_ps((const __m128 *)&viewProj.m[4]);
+    const __m256 v2 = _mm256_broadcast_ps((const __m128 *)&viewProj.m[8]);
+    const __m256 v3 = _mm256_broadcast_ps((const __m128 *)&viewProj.m[12]);
+    for (size_t i = begin; i < end; i++) {
+        for (int c = 0; c < 4; c += 2) {
+            __m256 m = _mm256_loadu_ps(&models[i].m[c * 4]);
+            __m256 e = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v0, _mm256_permute_ps(m, 0x00)),
+                                                   _mm256_mul_ps(v1, _mm256_permute_ps(m, 0x55))),
+                                     _mm256_mul_ps(v2, _mm256_permute_ps(m, 0xaa)));
+            // Only the translation column gets viewProj's last one, on the high half
+            if (c == 2)
+                e = _mm256_blend_ps(e, _mm256_add_ps(e, v3), 0xf0);
+            _mm256_storeu_ps(&mvps[i].m[c * 4], e);
+        }
+    }
+}
+
+#endif
+
+}
+
+void ObjectTransforms::resize(size_t count) {
+    for (int a = 0; a < 3; a++) {
+        position[a].resize(count, 0.0f);
+        scale[a].resize(count, 1.0f);
+    }
+    for (int a = 0; a < 4; a++)
+        rotation[a].resize(count, a == 3 ? 1.0f : 0.0f);
+}
+
+void ObjectTransforms::set(size_t i, const float p[3], const float q[4], const float s[3]) {
+    for (int a = 0; a < 3; a++) {
+        position[a][i] = p[a];
+        scale[a][i] = s[a];
+    }
+    for (int a = 0; a < 4; a++)
+        rotation[a][i] = q[a];
+}
+
+void axisAngleQuaternion(float x, float y, float z, float angle, float out[4]) {
+    float len = std::sqrt(x * x + y * y + z * z);
+    float s = len > 0.0f ? std::sin(angle * 0.5f) / len : 0.0f;
+    out[0] = x * s;
+    out[1] = y * s;
+    out[2] = z * s;
+    out[3] = len > 0.0f ? std::cos(angle * 0.5f) : 1.0f;
+}
+
+Mat4 trsMatrix(const float position[3], const float rotation[4], const float scale[3]) {
+    float m[3][3];
+    rotateScale(rotation[0], rotation[1], rotation[2], rotation[3], scale, m);
+    Mat4 r;
+    for (int c = 0; c < 3; c++) {
+        r.m[c * 4] = m[c][0];
+        r.m[c * 4 + 1] = m[c][1];
+        r.m[c * 4 + 2] = m[c][2];
+        r.m[c * 4 + 3] = 0.0f;
+    }
+    r.m[12] = position[0];
+    r.m[13] = position[1];
+    r.m[14] = position[2];
+    r.m[15] = 1.0f;
+    return r;
+}
+
+void computeTransforms(const ObjectTransforms &objects, const Mat4 &viewProj, Mat4 *models, Mat4 *mvps,
+                       unsigned threads, SimdLevel level) {
+    typedef void (*Kernel)(const ObjectTransforms&, const Mat4&, Mat4*, Mat4*, size_t, size_t);
+    Kernel kernel = transformsScalar;
+#if SCOP_X86
+    level = clampSimdLevel(level);
+    if (level == SimdLevel::AVX2)
+        kernel = transformsAvx2;
+    else if (level == SimdLevel::SSE)
+        kernel = transformsSse;
+#else
+    (void)level;
+#endif
+
+    size_t count = objects.size();
+    threads = resolveThreadCount(threads);
+    size_t maxThreads = count / minObjectsPerThread;
+    if (threads > maxThreads)
+        threads = maxThreads ? (unsigned)maxThreads : 1;
+    // Ranges start on a multiple of 8, the vector kernels only fall back to scalar at the very end
+    size_t blocks = (count + 7) / 8;
+    parallelRanges(blocks, threads, [&](size_t begin, size_t end, size_t) {
+        kernel(objects, viewProj, models, mvps, begin * 8, end * 8 < count ? end * 8 : count);
+    });
+}
+
+void computeMvps(const Mat4 &viewProj, const Mat4 *models, Mat4 *mvps, size_t count, unsigned threads,
+                 SimdLevel level) {
+    typedef void (*Kernel)(const Mat4&, const Mat4*, Mat4*, size_t, size_t);
+    Kernel kernel = mvpsScalar;
+#if SCOP_X86
+    level = clampSimdLevel(level);
+    if (level == SimdLevel::AVX2)
+        kernel = mvpsAvx2;
+    else if (level == SimdLevel::SSE)
+        kernel = mvpsSse;
+#else
+    (void)level;
+#endif
+
+    threads = resolveThreadCount(threads);
+    size_t maxThreads = count / minObjectsPerThread;
+    if (threads > maxThreads)
+        threads = maxThreads ? (unsigned)maxThreads : 1;
+    parallelRanges(count, threads, [&](size_t begin, size_t end, size_t) {
+        kernel(viewProj, models, mvps, begin, end);
+    });
+}
@@ -0,0 +1,207 @@
+#include <cstring>
+#include "../include/mesh.hpp"
+#include "../include/parallel.hpp"
+
+// Index and vertex order for the GPU caches
+// The post-transform cache keeps the last few vertex shader outputs, a triangle whose corners are
+// still in there costs less than 3 vertex shader runs. Files list their faces in whatever order the
+// exporter or the scanner produced them, which can be close to no reuse at all
+
+namespace {
+
+const uint32_t noVertex = 0xffffffffu;
+
+// Read together for every corner of every emitted triangle, side by side they cost one cache miss
+struct VertexState {
+    uint32_t live;          // triangles around the vertex not emitted yet
+    uint32_t cacheTime;     // when it last entered the cache
+};
+
+// Everything Tipsify needs for one submesh, kept between submeshes so it is allocated once
+// Vertices are numbered locally (in order of first use) so the per vertex arrays only cover the
+// vertices of the submesh, `local` maps the mesh's vertices to them and is reset after each one
+struct Tipsify {
+    std::vector<uint32_t> local;          // mesh vertex -> local vertex, noVertex when not in the submesh
+    std::vector<uint32_t> used;           // local vertex -> mesh vertex
+    std::vector<uint32_t> corners;        // local vertex of every corner
+    std::vector<uint32_t> adjacencyStart; // triangles around each local vertex, CSR style
+    std::vector<uint32_t> adjacency;
+    std::vector<VertexState> state;
+    std::vector<uint32_t> deadEnd;        // vertices of the emitted triangles, most recent last
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> order;          // emitted triangles
+    std::vector<char>     emitted;
+
+    explicit Tipsify(size_t vertexCount) : local(vertexCount, noVertex) {}
+
+    void run(uint32_t* indices, size_t triangleCount, unsigned cacheSize);
+
+private:
+    uint32_t nextVertex(unsigned cacheSize, uint32_t time, uint32_t& cursor);
+    uint32_t skipDeadEnd(uint32_t& cursor);
+};
+
+// The candidate that will still be in the cache once its remaining triangles are emitted, the oldest
+// one of those (it would leave the cache first), otherwise any vertex with triangles left
+uint32_t Tipsify::nextVertex(unsigned cacheSize, uint32_t time, uint32_t& cursor) {
+    uint32_t best = noVertex;
+    long bestPriority = -1;
+    for (uint32_t v : candidates) {
+        const VertexState& s = state[v];
+        if (!s.live)
+            continue;
+        long priority = 0;
+        if (time - s.cacheTime + 2 * s.live <= cacheSize)
+            priority = time - s.cacheTime;
+        if (priority > bestPriority) {
+            bestPriority = priority;
+            best = v;
+        }
+    }
+    return best != noVertex ? best : skipDeadEnd(cursor);
+}
+
+// Back to the most recent vertex with triangles left, or failing that the next one in input order
+uint32_t Tipsify::skipDeadEnd(uint32_t& cursor) {
+    while (!deadEnd.empty()) {
+        uint32_t v = deadEnd.back();
+        deadEnd.pop_back();
+        if (state[v].live)
+            return v;
+    }
+    for (; cursor < used.size(); cursor++) {
+        if (state[cursor].live)
+            return cursor;
+    }
+    return noVertex;
+}
+
+void Tipsify::run(uint32_t* indices, size_t triangleCount, unsigned cacheSize) {
+    size_t cornerCount = triangleCount * 3;
+    used.clear();
+    corners.resize(cornerCount);
+    for (size_t c = 0; c < cornerCount; c++) {
+        uint32_t& l = local[indices[c]];
+        if (l == noVertex) {
+            l = (uint32_t)used.size();
+            used.push_back(indices[c]);
+        }
+        corners[c] = l;
+    }
+    size_t vertexCount = used.size();
+
+    // Triangles around each vertex
+    state.assign(vertexCount, VertexState{ 0, 0 });
+    for (size_t c = 0; c < cornerCount; c++)
+        state[corners[c]].live++;
+    adjacencyStart.resize(vertexCount + 1);
+    adjacencyStart[0] = 0;
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyStart[v + 1] = adjacencyStart[v] + state[v].live;
+    // Filled in input order, `live` counts back up to the number of triangles
+    adjacency.resize(cornerCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        state[v].live = 0;
+    for (size_t c = 0; c < cornerCount; c++)
+        adjacency[adjacencyStart[corners[c]] + state[corners[c]].live++] = (uint32_t)(c / 3);
+
+    // Fan around a vertex until it has no triangle left, then move on to the best vertex still cached
+    // Time only moves on cache misses, so `time - cacheTime[v]` is how far v is from being evicted
+    emitted.assign(triangleCount, 0);
+    deadEnd.clear();
+    order.clear();
+    uint32_t time = cacheSize + 1, cursor = 0;
+    uint32_t fan = triangleCount ? corners[0] : noVertex;
+    while (fan != noVertex) {
+        candidates.clear();
+        for (uint32_t a = adjacencyStart[fan]; a < adjacencyStart[fan + 1]; a++) {
+            uint32_t t = adjacency[a];
+            if (emitted[t])
+                continue;
+            emitted[t] = 1;
+            order.push_back(t);
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = corners[t * 3 + k];
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                VertexState& s = state[v];
+                s.live--;
+                if (time - s.cacheTime > cacheSize)
+                    s.cacheTime = time++;
+            }
+        }
+        fan = nextVertex(cacheSize, time, cursor);
+    }
+
+    for (size_t i = 0; i < triangleCount; i++)
+        for (int k = 0; k < 3; k++)
+            indices[i * 3 + k] = used[corners[order[i] * 3 + k]];
+    for (uint32_t v : used)
+        local[v] = noVertex;
+}
+
+}
+
+VertexCacheStats simulateVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+                                     unsigned cacheSize) {
+    VertexCacheStats stats;
+    stats.triangles = indexCount / 3;
+
+    // missAt[v] = number of the miss that brought v in (from 1, 0 = never), it is still there as long as
+    // fewer than cacheSize misses happened since
+    std::vector<size_t> missAt(vertexCount, 0);
+    for (size_t i = 0; i < indexCount; i++) {
+        size_t& at = missAt[indices[i]];
+        if (!at)
+            stats.vertices++;
+        if (!at || stats.transformed - at >= cacheSize)
+            at = ++stats.transformed;
+    }
+    return stats;
+}
+
+// Submeshes are independent, each thread takes a run of them (a single big submesh stays on one thread :
+// cutting it in pieces would cost reuse at every cut, and all of it on a shuffled file)
+// Levels of detail are ranges of their own, after the full mesh
+void optimizeVertexCache(Mesh &mesh, unsigned cacheSize, unsigned threads) {
+    size_t vertexCount = mesh.vertices.size() / 3;
+    size_t rangeCount = mesh.submeshes.size() + mesh.lodSubmeshes.size();
+    parallelRanges(rangeCount, resolveThreadCount(threads), [&](size_t begin, size_t end, size_t) {
+        Tipsify tipsify(vertexCount);
+        for (size_t s = begin; s < end; s++) {
+            const SubMesh& sub = s < mesh.submeshes.size() ? mesh.submeshes[s]
+                                                           : mesh.lodSubmeshes[s - mesh.submeshes.size()];
+            tipsify.run(&mesh.indices[sub.firstIndex], sub.indexCount / 3, cacheSize);
+        }
+    });
+}
+
+void optimizeVertexFetch(Mesh &mesh, unsigned threads) {
+    size_t vertexCount = mesh.vertices.size() / 3;
+    std::vector<uint32_t> remap(vertexCount, noVertex);
+    uint32_t next = 0;
+    for (uint32_t& index : mesh.indices) {
+        if (remap[index] == noVertex)
+            remap[index] = next++;
+        index = remap[index];
+    }
+    for (uint32_t& r : remap) {
+        if (r == noVertex)
+            r = next++;
+    }
+
+    // Every attribute array moves the same way
+    auto permute = [&](std::vector<float>& values, size_t n) {
+        if (values.empty())
+            return;
+        std::vector<float> moved(values.size());
+        parallelRanges(vertexCount, resolveThreadCount(threads), [&](size_t begin, size_t end, size_t) {
+            for (size_t v = begin; v < end; v++)
+                memcpy(&moved[(size_t)remap[v] * n], &values[v * n], n * sizeof(float));
+        });
+        values.swap(moved);
+    };
+    permute(mesh.vertices, 3);
+    permute(mesh.normals, 3);
+    permute(mesh.uvs, 2);
+}
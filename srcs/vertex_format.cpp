@@ -0,0 +1,223 @@
+#include <cmath>
+#include <cstring>
+#include "../include/vertex_format.hpp"
+
+namespace {
+
+// [min, min + 1 / inv] to [0, 65535], anything outside (or NaN) is clamped
+uint16_t toUnorm16(float v, float min, float inv) {
+    float t = (v - min) * inv;
+    if (!(t > 0.0f))
+        t = 0.0f;
+    if (t > 1.0f)
+        t = 1.0f;
+    return (uint16_t)(t * 65535.0f + 0.5f);
+}
+
+// [-1, 1] to [-max, max], NaN gives 0
+int toSnorm(float v, int max) {
+    if (!(v > -1.0f))
+        v = (v == v) ? -1.0f : 0.0f;
+    if (v > 1.0f)
+        v = 1.0f;
+    return (int)std::floor(v * max + 0.5f);
+}
+
+float signNotZero(float v) {
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+// The unit sphere projected on an octahedron, whose lower half is folded over the upper one :
+// any direction becomes a point of the [-1, 1] square. A zero normal (degenerate triangle) gives the center
+void octEncode(const float n[3], float out[2]) {
+    float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    out[0] = out[1] = 0.0f;
+    if (!(l1 > 0.0f) || !std::isfinite(l1))
+        return;
+    float x = n[0] / l1, y = n[1] / l1;
+    if (n[2] < 0.0f) {
+        out[0] = (1.0f - std::fabs(y)) * signNotZero(x);
+        out[1] = (1.0f - std::fabs(x)) * signNotZero(y);
+    }
+    else {
+        out[0] = x;
+        out[1] = y;
+    }
+}
+
+// Same as octDecode in the vertex shader
+void octDecode(const float e[2], float n[3]) {
+    n[0] = e[0];
+    n[1] = e[1];
+    n[2] = 1.0f - std::fabs(e[0]) - std::fabs(e[1]);
+    if (n[2] < 0.0f) {
+        n[0] = (1.0f - std::fabs(e[1])) * signNotZero(e[0]);
+        n[1] = (1.0f - std::fabs(e[0])) * signNotZero(e[1]);
+    }
+    float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    for (int a = 0; a < 3; a++)
+        n[a] /= len;
+}
+
+// GL >= 4.2 maps c to max(c / max, -1), which is what we round for
+// A 3.3 context may use (2c + 1) / (2 max + 1) instead, half a step off, normalize() in the shader hides it
+float fromSnorm(int c, int max) {
+    float v = (float)c / max;
+    return v < -1.0f ? -1.0f : v;
+}
+
+// Extent 0 (a flat model, a single uv) or not finite : any scale works as long as it is not a division by 0
+float safeExtent(float extent) {
+    return (extent > 0.0f && std::isfinite(extent)) ? extent : 1.0f;
+}
+
+}
+
+VertexLayout vertexLayout(VertexFormat format, bool hasUvs) {
+    VertexLayout layout;
+    layout.format = format;
+    layout.hasUvs = hasUvs;
+    if (format == VertexFormat::Float) {
+        layout.normalOffset = 3 * sizeof(float);
+        layout.uvOffset     = 6 * sizeof(float);
+    }
+    else {
+        layout.normalOffset = 4 * sizeof(uint16_t);
+        layout.uvOffset     = layout.normalOffset + sizeof(uint32_t);
+    }
+    size_t uvBytes = (format == VertexFormat::Float) ? 2 * sizeof(float) : 2 * sizeof(uint16_t);
+    layout.stride = layout.uvOffset + (hasUvs ? uvBytes : 0);
+    return layout;
+}
+
+VertexQuantization fitQuantization(VertexFormat format, const Bounds& bounds, const float* uvs, size_t uvCount) {
+    VertexQuantization quant;
+    if (format == VertexFormat::Float)
+        return quant;
+
+    if (!bounds.empty()) {
+        for (int a = 0; a < 3; a++) {
+            quant.positionMin[a]    = std::isfinite(bounds.min[a]) ? bounds.min[a] : 0.0f;
+            quant.positionExtent[a] = safeExtent(bounds.max[a] - bounds.min[a]);
+        }
+    }
+
+    float min[2] = { INFINITY, INFINITY }, max[2] = { -INFINITY, -INFINITY };
+    for (size_t i = 0; i < uvCount; i++) {
+        for (int a = 0; a < 2; a++) {
+            float v = uvs[i * 2 + a];
+            if (v < min[a]) min[a] = v;
+            if (v > max[a]) max[a] = v;
+        }
+    }
+    for (int a = 0; a < 2; a++) {
+        if (min[a] <= max[a]) {
+            quant.uvMin[a]    = min[a];
+            quant.uvExtent[a] = safeExtent(max[a] - min[a]);
+        }
+    }
+    return quant;
+}
+
+VertexEncoder::VertexEncoder(const VertexLayout& l, const VertexQuantization& q, const float c[3], float s)
+    : layout(l), quant(q), scale(s) {
+    for (int a = 0; a < 3; a++) {
+        center[a]      = c[a];
+        positionInv[a] = 1.0f / quant.positionExtent[a];
+    }
+    for (int a = 0; a < 2; a++)
+        uvInv[a] = 1.0f / quant.uvExtent[a];
+}
+
+void VertexEncoder::write(const float* position, const float* normal, const float* uv, unsigned char* dst) const {
+    float p[3];
+    for (int a = 0; a < 3; a++)
+        p[a] = (position[a] - center[a]) * scale;
+
+    if (layout.format == VertexFormat::Float) {
+        memcpy(dst, p, sizeof(p));
+        memcpy(dst + layout.normalOffset, normal, 3 * sizeof(float));
+        if (layout.hasUvs)
+            memcpy(dst + layout.uvOffset, uv, 2 * sizeof(float));
+        return;
+    }
+
+    uint16_t q[4];
+    for (int a = 0; a < 3; a++)
+        q[a] = toUnorm16(p[a], quant.positionMin[a], positionInv[a]);
+    q[3] = 0;
+    memcpy(dst, q, sizeof(q));
+
+    if (layout.format == VertexFormat::Packed) {
+        // x in the low 10 bits, then y, z, and 2 bits of w left at 0
+        uint32_t packed = 0;
+        for (int a = 0; a < 3; a++)
+            packed |= ((uint32_t)toSnorm(normal[a], 511) & 0x3ff) << (a * 10);
+        memcpy(dst + layout.normalOffset, &packed, sizeof(packed));
+    }
+    else {
+        float e[2];
+        octEncode(normal, e);
+        int16_t s[2] = { (int16_t)toSnorm(e[0], 32767), (int16_t)toSnorm(e[1], 32767) };
+        memcpy(dst + layout.normalOffset, s, sizeof(s));
+    }
+
+    if (layout.hasUvs) {
+        uint16_t t[2] = { toUnorm16(uv[0], quant.uvMin[0], uvInv[0]), toUnorm16(uv[1], quant.uvMin[1], uvInv[1]) };
+        memcpy(dst + layout.uvOffset, t, sizeof(t));
+    }
+}
+
+void decodeVertex(const VertexLayout& layout, const VertexQuantization& quant, const unsigned char* src,
+                  float position[3], float normal[3], float uv[2]) {
+    uv[0] = uv[1] = 0.0f;
+    if (layout.format == VertexFormat::Float) {
+        memcpy(position, src, 3 * sizeof(float));
+        memcpy(normal, src + layout.normalOffset, 3 * sizeof(float));
+        if (layout.hasUvs)
+            memcpy(uv, src + layout.uvOffset, 2 * sizeof(float));
+        return;
+    }
+
+    uint16_t q[3];
+    memcpy(q, src, sizeof(q));
+    for (int a = 0; a < 3; a++)
+        position[a] = quant.positionMin[a] + q[a] / 65535.0f * quant.positionExtent[a];
+
+    if (layout.format == VertexFormat::Packed) {
+        uint32_t packed;
+        memcpy(&packed, src + layout.normalOffset, sizeof(packed));
+        for (int a = 0; a < 3; a++) {
+            int c = (int)((packed >> (a * 10)) & 0x3ff);
+            normal[a] = fromSnorm(c >= 512 ? c - 1024 : c, 511);
+        }
+    }
+    else {
+        int16_t s[2];
+        memcpy(s, src + layout.normalOffset, sizeof(s));
+        float e[2] = { fromSnorm(s[0], 32767), fromSnorm(s[1], 32767) };
+        octDecode(e, normal);
+    }
+
+    if (layout.hasUvs) {
+        uint16_t t[2];
+        memcpy(t, src + layout.uvOffset, sizeof(t));
+        for (int a = 0; a < 2; a++)
+            uv[a] = quant.uvMin[a] + t[a] / 65535.0f * quant.uvExtent[a];
+    }
+}
+
+const char* vertexFormatName(VertexFormat format) {
+    switch (format) {
+        case VertexFormat::Packed: return "packed";
+        case VertexFormat::Octa:   return "octa";
+        default:                   return "float";
+    }
+}
+
+bool parseVertexFormat(const std::string& name, VertexFormat& out) {
+    if (name == "float")  { out = VertexFormat::Float;  return true; }
+    if (name == "packed") { out = VertexFormat::Packed; return true; }
+    if (name == "octa")   { out = VertexFormat::Octa;   return true; }
+    return false;
+}
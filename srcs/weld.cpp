@@ -0,0 +1,228 @@
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include "../include/mesh.hpp"
+#include "../include/parallel.hpp"
+
+// Welding : vertices closer than epsilon (with the same normal and uv) become one
+// Positions go in cells at least 2 epsilon wide, so a vertex only has to look in the next cell on an axis
+// when it is within epsilon of that side (most of them never do). Cells go in a hash table of chains,
+// filled from every thread at once with a compare and swap on the chain heads : nothing is sorted and
+// nothing is locked
+// Each vertex then joins the lowest numbered vertex it is close to, the result doesn't depend on the
+// order the threads filled the chains in
+
+namespace {
+
+const uint32_t noVertex = 0xffffffffu;
+
+inline uint64_t hashCell(int64_t x, int64_t y, int64_t z) {
+    uint64_t h = (uint64_t)x * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t)y * 0xC2B2AE3D27D4EB4Full + (h >> 31);
+    h ^= (uint64_t)z * 0x165667B19E3779F9ull + (h >> 27);
+    return h ^ (h >> 33);
+}
+
+// Same normal and uv, bit for bit : the weld only removes copies, it never blends attributes
+inline bool sameAttributes(const Mesh& mesh, uint32_t a, uint32_t b) {
+    if (!mesh.normals.empty() && memcmp(&mesh.normals[(size_t)a * 3], &mesh.normals[(size_t)b * 3], 3 * sizeof(float)))
+        return false;
+    return mesh.uvs.empty() || memcmp(&mesh.uvs[(size_t)a * 2], &mesh.uvs[(size_t)b * 2], 2 * sizeof(float)) == 0;
+}
+
+// A triangle whatever corner it starts from, winding kept : the smallest vertex first
+struct TriangleKey {
+    uint32_t v[3];
+
+    explicit TriangleKey(const uint32_t* c) {
+        int first = (c[1] < c[0] && c[1] < c[2]) ? 1 : (c[2] < c[0] && c[2] < c[1]) ? 2 : 0;
+        for (int k = 0; k < 3; k++)
+            v[k] = c[(first + k) % 3];
+    }
+    bool operator==(const TriangleKey& o) const { return v[0] == o.v[0] && v[1] == o.v[1] && v[2] == o.v[2]; }
+    uint64_t hash() const { return hashCell(v[0], v[1], v[2]); }
+};
+
+// Marks the triangles of one submesh to keep : no repeated corner, some area, not already in the submesh
+void filterTriangles(const Mesh& mesh, const SubMesh& sub, std::vector<char>& keep, size_t& degenerate,
+                     size_t& duplicates) {
+    size_t first = sub.firstIndex / 3, count = sub.indexCount / 3;
+    size_t cap = 16;
+    while (cap < count * 2)
+        cap <<= 1;
+    std::vector<uint32_t> slots(cap, noVertex);
+    for (size_t t = first; t < first + count; t++) {
+        const uint32_t* c = &mesh.indices[t * 3];
+        bool flat = c[0] == c[1] || c[1] == c[2] || c[0] == c[2];
+        if (!flat) {
+            const float* p0 = &mesh.vertices[(size_t)c[0] * 3];
+            const float* p1 = &mesh.vertices[(size_t)c[1] * 3];
+            const float* p2 = &mesh.vertices[(size_t)c[2] * 3];
+            float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            flat = e1[1] * e2[2] - e1[2] * e2[1] == 0.0f && e1[2] * e2[0] - e1[0] * e2[2] == 0.0f
+                && e1[0] * e2[1] - e1[1] * e2[0] == 0.0f;
+        }
+        if (flat) {
+            degenerate++;
+            continue;
+        }
+
+        TriangleKey key(c);
+        size_t i = key.hash() & (cap - 1);
+        bool seen = false;
+        while (slots[i] != noVertex && !seen) {
+            seen = TriangleKey(&mesh.indices[(size_t)slots[i] * 3]) == key;
+            i = (i + 1) & (cap - 1);
+        }
+        if (seen) {
+            duplicates++;
+            continue;
+        }
+        slots[i] = (uint32_t)t;
+        keep[t] = 1;
+    }
+}
+
+}
+
+WeldStats weldVertices(Mesh &mesh, float epsilon, unsigned threads) {
+    WeldStats stats;
+    size_t n = mesh.vertices.size() / 3;
+    stats.verticesIn = stats.verticesOut = n;
+    stats.trianglesIn = stats.trianglesOut = mesh.indices.size() / 3;
+    if (n == 0 || mesh.indices.empty())
+        return stats;
+    threads = resolveThreadCount(threads);
+
+    // Cells relative to the corner of the box, epsilon relative to its diagonal
+    Bounds box = computeBounds(mesh.vertices.data(), n, threads);
+    float diagonal = std::sqrt((box.max[0] - box.min[0]) * (box.max[0] - box.min[0])
+                               + (box.max[1] - box.min[1]) * (box.max[1] - box.min[1])
+                               + (box.max[2] - box.min[2]) * (box.max[2] - box.min[2]));
+    float eps = epsilon * diagonal;
+    // About the spacing of the vertices of a surface, so a cell holds a few of them. 0 (or a box of
+    // nothing) : only identical positions, which still land in one cell
+    float cellSize = std::fmax(2.0f * eps, diagonal / std::sqrt((float)n));
+    if (!(cellSize > 0.0f))
+        cellSize = 1.0f;
+    float toCell = 1.0f / cellSize;
+    const float* p = mesh.vertices.data();
+    auto cellOf = [&](uint32_t v, int a) { return (double)(p[(size_t)v * 3 + a] - box.min[a]) * toCell; };
+
+    size_t cap = 16;
+    while (cap < n)
+        cap <<= 1;
+    size_t mask = cap - 1;
+    std::vector<std::atomic<uint32_t>> heads(cap);
+    std::vector<uint32_t> next(n);
+    parallelRanges(cap, threads, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++)
+            heads[i].store(noVertex, std::memory_order_relaxed);
+    });
+    parallelRanges(n, threads, [&](size_t begin, size_t end, size_t) {
+        for (size_t v = begin; v < end; v++) {
+            size_t bucket = hashCell((int64_t)std::floor(cellOf((uint32_t)v, 0)), (int64_t)std::floor(cellOf((uint32_t)v, 1)),
+                                     (int64_t)std::floor(cellOf((uint32_t)v, 2))) & mask;
+            uint32_t head = heads[bucket].load(std::memory_order_relaxed);
+            do
+                next[v] = head;
+            while (!heads[bucket].compare_exchange_weak(head, (uint32_t)v, std::memory_order_release,
+                                                        std::memory_order_relaxed));
+        }
+    });
+
+    // Lowest numbered vertex within epsilon on every axis
+    std::vector<uint32_t> match(n);
+    parallelRanges(n, threads, [&](size_t begin, size_t end, size_t) {
+        for (size_t v = begin; v < end; v++) {
+            int64_t cell[3], side[3];
+            for (int a = 0; a < 3; a++) {
+                double c = cellOf((uint32_t)v, a), f = std::floor(c);
+                cell[a] = (int64_t)f;
+                side[a] = (c - f) * cellSize <= eps ? -1 : (f + 1.0 - c) * cellSize <= eps ? 1 : 0;
+            }
+            uint32_t best = (uint32_t)v;
+            for (int k = 0; k < 8; k++) {
+                if (((k & 1) && !side[0]) || ((k & 2) && !side[1]) || ((k & 4) && !side[2]))
+                    continue;
+                size_t bucket = hashCell(cell[0] + ((k & 1) ? side[0] : 0), cell[1] + ((k & 2) ? side[1] : 0),
+                                         cell[2] + ((k & 4) ? side[2] : 0)) & mask;
+                for (uint32_t u = heads[bucket].load(std::memory_order_acquire); u != noVertex; u = next[u]) {
+                    if (u >= best)
+                        continue;
+                    const float* a = &p[(size_t)u * 3];
+                    const float* b = &p[v * 3];
+                    if (std::fabs(a[0] - b[0]) <= eps && std::fabs(a[1] - b[1]) <= eps && std::fabs(a[2] - b[2]) <= eps
+                        && sameAttributes(mesh, u, (uint32_t)v))
+                        best = u;
+                }
+            }
+            match[v] = best;
+        }
+    });
+    std::vector<std::atomic<uint32_t>>().swap(heads);
+    std::vector<uint32_t>().swap(next);
+
+    // A vertex takes the new number of the one it joins, that one was numbered before it
+    std::vector<uint32_t>& remap = match;
+    uint32_t kept = 0;
+    std::vector<uint32_t> source;
+    source.reserve(n);
+    for (size_t v = 0; v < n; v++) {
+        if (remap[v] == v) {
+            remap[v] = kept++;
+            source.push_back((uint32_t)v);
+        }
+        else
+            remap[v] = remap[remap[v]];
+    }
+    stats.verticesOut = kept;
+
+    auto compact = [&](std::vector<float>& values, size_t width) {
+        if (values.empty() || kept == n)
+            return;
+        std::vector<float> out((size_t)kept * width);
+        parallelRanges(kept, threads, [&](size_t begin, size_t end, size_t) {
+            for (size_t v = begin; v < end; v++)
+                memcpy(&out[v * width], &values[(size_t)source[v] * width], width * sizeof(float));
+        });
+        values.swap(out);
+    };
+    compact(mesh.vertices, 3);
+    compact(mesh.normals, 3);
+    compact(mesh.uvs, 2);
+    parallelRanges(mesh.indices.size(), threads, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++)
+            mesh.indices[i] = remap[mesh.indices[i]];
+    });
+
+    // Triangles that draw nothing or draw the same thing twice go, each submesh on its own
+    std::vector<char> keep(mesh.indices.size() / 3, 0);
+    std::vector<size_t> degenerate(mesh.submeshes.size(), 0), duplicates(mesh.submeshes.size(), 0);
+    parallelFor(mesh.submeshes.size(), threads, [&](size_t s) {
+        filterTriangles(mesh, mesh.submeshes[s], keep, degenerate[s], duplicates[s]);
+    });
+    size_t out = 0;
+    std::vector<SubMesh> submeshes;
+    for (size_t s = 0; s < mesh.submeshes.size(); s++) {
+        SubMesh sub = mesh.submeshes[s];
+        stats.degenerate += degenerate[s];
+        stats.duplicates += duplicates[s];
+        size_t first = out;
+        for (size_t t = sub.firstIndex / 3; t < (sub.firstIndex + sub.indexCount) / 3; t++) {
+            if (!keep[t])
+                continue;
+            memmove(&mesh.indices[out], &mesh.indices[t * 3], 3 * sizeof(uint32_t));
+            out += 3;
+        }
+        sub.firstIndex = (uint32_t)first;
+        sub.indexCount = (uint32_t)(out - first);
+        if (sub.indexCount)
+            submeshes.push_back(sub);
+    }
+    mesh.indices.resize(out);
+    mesh.submeshes.swap(submeshes);
+    stats.trianglesOut = out / 3;
+    return stats;
+}